@@ -26,6 +26,7 @@
 #include "PeriodicLoop.hpp"
 #include "Protocol.hpp"
 #include "SharedRocksDB.hpp"
+#include "SnapshotTransfer.hpp"
 #include "Random.hpp"
 #include "RegistryClient.hpp"
 #include "Time.hpp"
@@ -52,6 +53,7 @@ struct CDCShared {
     std::atomic<double> inFlightTxns;
     std::atomic<double> updateSize;
     ErrorCount shardErrors;
+    SpinCounters receiverSpinCounters;
 
     CDCShared(SharedRocksDB& sharedDb_, CDCDB& db_, LogsDB& logsDB_, std::array<UDPSocketPair, 2>&& socks_) : sharedDb(sharedDb_), db(db_), logsDB(logsDB_), socks(std::move(socks_)), isLeader(false), inFlightTxns(0), updateSize(0) {
         for (CDCMessageKind kind : allCDCMessageKind) {
@@ -276,8 +278,15 @@ public:
         // important to not catch stray requests from previous executions
         _shardRequestIdCounter(RandomGenerator().generate64()),
         _shardTimeout(options.shardTimeout),
-        _receiver({.perSockMaxRecvMsg = MAX_MSG_RECEIVE, .maxMsgSize = MAX_UDP_MTU}),
-        _cdcSender({.maxMsgSize = MAX_UDP_MTU}),
+        _receiver({
+            .perSockMaxRecvMsg = MAX_MSG_RECEIVE,
+            .maxMsgSize = MAX_UDP_MTU,
+            .spin = options.serverOptions.spin,
+            .spinCounters = &shared.receiverSpinCounters,
+            .ioUring = options.serverOptions.ioUring,
+        }),
+        _cdcSender({.maxMsgSize = MAX_UDP_MTU, .ioUring = options.serverOptions.ioUring, .gso = options.serverOptions.gso}),
+        _shardSender({.ioUring = options.serverOptions.ioUring, .gso = options.serverOptions.gso}),
         _logsDB(shared.logsDB)
     {
         expandKey(CDCKey, _expandedCDCKey);
@@ -986,6 +995,28 @@ static void logsDBstatsToMetrics(struct MetricsBuilder& metricsBuilder, const Lo
         metricsBuilder.fieldFloat( "append_window", stats.appendWindow.load(std::memory_order_relaxed));
         metricsBuilder.timestamp(now);
     }
+    {
+        metricsBuilder.measurement("eggsfs_cdc_logsdb");
+        metricsBuilder.tag("replica", replicaId);
+        metricsBuilder.tag("leader", stats.isLeader.load(std::memory_order_relaxed));
+        metricsBuilder.fieldU64( "append_window_limit", stats.appendWindowLimit.load(std::memory_order_relaxed));
+        metricsBuilder.timestamp(now);
+    }
+    {
+        metricsBuilder.measurement("eggsfs_cdc_logsdb");
+        metricsBuilder.tag("replica", replicaId);
+        metricsBuilder.tag("leader", stats.isLeader.load(std::memory_order_relaxed));
+        metricsBuilder.fieldU64( "append_window_full", stats.appendWindowFull.load(std::memory_order_relaxed));
+        metricsBuilder.timestamp(now);
+    }
+    {
+        metricsBuilder.measurement("eggsfs_cdc_logsdb");
+        metricsBuilder.tag("replica", replicaId);
+        metricsBuilder.tag("leader", stats.isLeader.load(std::memory_order_relaxed));
+        metricsBuilder.fieldU64( "commit_latency", stats.commitLatency.load(std::memory_order_relaxed).ns);
+        metricsBuilder.fieldU64( "read_lease_holders", stats.readLeaseHolders.load(std::memory_order_relaxed));
+        metricsBuilder.timestamp(now);
+    }
     {
         metricsBuilder.measurement("eggsfs_cdc_logsdb");
         metricsBuilder.tag("replica", replicaId);
@@ -1135,6 +1166,14 @@ public:
             _metricsBuilder.fieldU64("count", count);
             _metricsBuilder.timestamp(now);
         }
+        {
+            _metricsBuilder.measurement("eggsfs_cdc_spin");
+            _metricsBuilder.tag("replica", _replicaId);
+            _metricsBuilder.tag("what", "receiver");
+            _metricsBuilder.fieldU64("spun", _shared.receiverSpinCounters.spun.load(std::memory_order_relaxed));
+            _metricsBuilder.fieldU64("slept", _shared.receiverSpinCounters.slept.load(std::memory_order_relaxed));
+            _metricsBuilder.timestamp(now);
+        }
         {
             _rocksDBStats.clear();
             _shared.sharedDb.rocksDBMetrics(_rocksDBStats);
@@ -1185,9 +1224,18 @@ void runCDC(CDCOptions& options) {
     LOG_INFO(env, "  registryPort = %s", options.registryClientOptions.port);
     LOG_INFO(env, "  cdcAddrs = %s", options.serverOptions.addrs);
     LOG_INFO(env, "  syslog = %s", (int)options.logOptions.syslog);
+    if (options.serverOptions.gro) {
+        // we receive thousands of packets at once, GRO sized buffers for all of them would be too much
+        LOG_INFO(env, "  ignoring -gro, not supported by the CDC");
+    }
     LOG_INFO(env, "Using LogsDB with options:");
     LOG_INFO(env, "    avoidBeingLeader = '%s'", (int)options.logsDBOptions.avoidBeingLeader);
     LOG_INFO(env, "    noReplication = '%s'", (int)options.logsDBOptions.noReplication);
+    LOG_INFO(env, "    readLeases = '%s'", (int)options.logsDBOptions.readLeases);
+    LOG_INFO(env, "    snapshotPort = %s", options.logsDBOptions.snapshotPort);
+    LOG_INFO(env, "    catchupFrom = '%s:%s'", options.logsDBOptions.catchupFromHost, options.logsDBOptions.catchupFromPort);
+    LOG_INFO(env, "    rocksDBMemoryMiB = %s", options.logsDBOptions.rocksDBMemoryMiB);
+    LOG_INFO(env, "    rocksDBHyperClockCache = %s", (int)options.logsDBOptions.rocksDBHyperClockCache);
 
     LoopThreads threads;
 
@@ -1204,6 +1252,10 @@ void runCDC(CDCOptions& options) {
         threads.emplace_back(LoopThread::Spawn(std::make_unique<Xmon>(logger, xmon, options.xmonOptions)));
     }
 
+    if (!options.logsDBOptions.catchupFromHost.empty() && needsBulkCatchup(env, options.logsDBOptions.dbDir + "/db")) {
+        fetchSnapshot(env, options.logsDBOptions.catchupFromHost, options.logsDBOptions.catchupFromPort, options.logsDBOptions.dbDir + "/db");
+    }
+
     SharedRocksDB sharedDb(logger, xmon, options.logsDBOptions.dbDir + "/db", options.logsDBOptions.dbDir + "/db-statistics.txt");
     sharedDb.registerCFDescriptors(LogsDB::getColumnFamilyDescriptors());
     sharedDb.registerCFDescriptors(CDCDB::getColumnFamilyDescriptors());
@@ -1215,13 +1267,19 @@ void runCDC(CDCOptions& options) {
     // In the shards we set this given that 1000*256 = 256k, doing it here also
     // for symmetry although it's probably not needed.
     dbOptions.max_open_files = 1000;
-    sharedDb.openTransactionDB(dbOptions);
+    sharedDb.openTransactionDB(dbOptions, SharedRocksDBMemoryBudget{
+        .bytes = (size_t)options.logsDBOptions.rocksDBMemoryMiB << 20,
+        .hyperClockCache = options.logsDBOptions.rocksDBHyperClockCache,
+    });
 
     CDCDB db(logger, xmon, sharedDb);
-    LogsDB logsDB(logger, xmon, sharedDb, options.logsDBOptions.replicaId, db.lastAppliedLogEntry(), options.logsDBOptions.noReplication, options.logsDBOptions.avoidBeingLeader);
+    LogsDB logsDB(logger, xmon, sharedDb, options.logsDBOptions.replicaId, db.lastAppliedLogEntry(), options.logsDBOptions.noReplication, options.logsDBOptions.avoidBeingLeader, options.logsDBOptions.readLeases);
     CDCShared shared(
         sharedDb, db, logsDB,
-        std::array<UDPSocketPair, 2>({UDPSocketPair(env, options.serverOptions.addrs), UDPSocketPair(env, options.cdcToShardAddress)})
+        std::array<UDPSocketPair, 2>({
+            UDPSocketPair(env, options.serverOptions.addrs, {.busyPollUs = options.serverOptions.busyPollUs}),
+            UDPSocketPair(env, options.cdcToShardAddress, {.busyPollUs = options.serverOptions.busyPollUs}),
+        })
     );
 
     LOG_INFO(env, "Spawning server threads");
@@ -1229,6 +1287,9 @@ void runCDC(CDCOptions& options) {
     threads.emplace_back(LoopThread::Spawn(std::make_unique<CDCShardUpdater>(logger, xmon, options, shared)));
     threads.emplace_back(LoopThread::Spawn(std::make_unique<CDCServer>(logger, xmon, options, shared)));
     threads.emplace_back(LoopThread::Spawn(std::make_unique<CDCRegisterer>(logger, xmon, options, shared)));
+    if (options.logsDBOptions.snapshotPort != 0) {
+        threads.emplace_back(LoopThread::Spawn(std::make_unique<SnapshotServer>(logger, xmon, sharedDb, options.logsDBOptions.dbDir, options.serverOptions.addrs, options.logsDBOptions.snapshotPort, shared.replicas)));
+    }
     if (!options.metricsOptions.origin.empty()) {
         threads.emplace_back(LoopThread::Spawn(std::make_unique<CDCMetricsInserter>(logger, xmon, options.metricsOptions, shared, options.logsDBOptions.replicaId)));
     }
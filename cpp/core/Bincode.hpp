@@ -5,10 +5,12 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <bit>
 #include <cstdint>
 #include <exception>
 #include <iomanip>
+#include <memory>
 #include <rocksdb/slice.h>
 #include <string>
 #include <type_traits>
@@ -48,6 +50,142 @@ public:
 
 std::ostream& operator<<(std::ostream& out, const BincodeBytesRef& x);
 
+// Bump allocator for the variable-length parts of decoded messages, so that
+// the request path doesn't go through malloc for every name. Memory is only
+// reclaimed wholesale by `reset()`, which must only happen once nothing that
+// was decoded into it is alive anymore. Since decoded requests are handed
+// over to other threads, this is tracked with `BincodeArenaRef`s held by
+// whoever owns the decoded message.
+class BincodeArena {
+public:
+    BincodeArena(size_t capacity): _buf(std::make_unique<char[]>(capacity)), _capacity(capacity), _used(0), _refs(0) {}
+
+    BincodeArena(const BincodeArena&) = delete;
+
+    // Returns nullptr if the arena is full, in which case the caller is
+    // expected to fall back to the heap.
+    char* alloc(size_t sz) {
+        if (unlikely(_capacity - _used < sz)) {
+            return nullptr;
+        }
+        char* p = _buf.get() + _used;
+        _used += sz;
+        return p;
+    }
+
+    size_t used() const {
+        return _used;
+    }
+
+    bool inUse() const {
+        return _refs.load(std::memory_order_acquire) > 0;
+    }
+
+    void reset() {
+        ALWAYS_ASSERT(!inUse());
+        _used = 0;
+    }
+
+private:
+    friend class BincodeArenaRef;
+
+    std::unique_ptr<char[]> _buf;
+    size_t _capacity;
+    size_t _used;
+    std::atomic<uint32_t> _refs;
+};
+
+// Keeps the arena from being reset, can be released from any thread.
+class BincodeArenaRef {
+public:
+    BincodeArenaRef(): _arena(nullptr) {}
+    explicit BincodeArenaRef(BincodeArena* arena): _arena(arena) { _acquire(); }
+    BincodeArenaRef(const BincodeArenaRef& other): _arena(other._arena) { _acquire(); }
+    BincodeArenaRef(BincodeArenaRef&& other): _arena(other._arena) { other._arena = nullptr; }
+
+    BincodeArenaRef& operator=(const BincodeArenaRef& other) {
+        if (this != &other) {
+            _release();
+            _arena = other._arena;
+            _acquire();
+        }
+        return *this;
+    }
+
+    BincodeArenaRef& operator=(BincodeArenaRef&& other) {
+        if (this != &other) {
+            _release();
+            _arena = other._arena;
+            other._arena = nullptr;
+        }
+        return *this;
+    }
+
+    ~BincodeArenaRef() {
+        _release();
+    }
+
+private:
+    BincodeArena* _arena;
+
+    void _acquire() {
+        if (_arena != nullptr) {
+            _arena->_refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void _release() {
+        if (_arena != nullptr) {
+            _arena->_refs.fetch_sub(1, std::memory_order_release);
+            _arena = nullptr;
+        }
+    }
+};
+
+// A set of arenas to reuse, one per receive batch. An arena is handed out
+// again once all the refs to it are gone, we only allocate a new one if the
+// consumers are lagging behind. Past `maxIdle` idle arenas we free them, so
+// that a burst doesn't pin its memory forever.
+class BincodeArenaPool {
+public:
+    BincodeArenaPool(size_t arenaCapacity, size_t maxIdle = 4): _arenaCapacity(arenaCapacity), _maxIdle(maxIdle) {}
+
+    BincodeArena& acquire() {
+        BincodeArena* found = nullptr;
+        size_t idle = 0;
+        for (size_t i = 0; i < _arenas.size();) {
+            if (_arenas[i]->inUse()) {
+                i++;
+            } else if (found == nullptr) {
+                found = _arenas[i].get();
+                i++;
+            } else if (idle < _maxIdle) {
+                idle++;
+                i++;
+            } else {
+                // we're the only ones taking refs, so nobody can be picking it up
+                std::swap(_arenas[i], _arenas.back());
+                _arenas.pop_back();
+            }
+        }
+        if (found == nullptr) {
+            _arenas.emplace_back(std::make_unique<BincodeArena>(_arenaCapacity));
+            return *_arenas.back();
+        }
+        found->reset();
+        return *found;
+    }
+
+    size_t size() const {
+        return _arenas.size();
+    }
+
+private:
+    size_t _arenaCapacity;
+    size_t _maxIdle;
+    std::vector<std::unique_ptr<BincodeArena>> _arenas;
+};
+
 // Owned strings of at most 255 length. We could get away with references
 // to existing strings most of the times, but considering how much allocation
 // happens anyway it's not worth the hassle.
@@ -56,10 +194,13 @@ private:
     // We store the length in the most significant byte of the pointer.
     // If the length is < 8, then the string is in the remaining 7 bytes.
     // Otherwise, the rest of the bytes are to be interpreted as a pointer
-    // to the data.
+    // to the data, with `ARENA_BIT` set if the data lives in a `BincodeArena`
+    // rather than in the heap.
     uintptr_t _data;
     static_assert(sizeof(uintptr_t) == 8);
     static_assert(std::endian::native == std::endian::little);
+    static constexpr uintptr_t ARENA_BIT = 1ull << (64-9);
+    static constexpr uintptr_t POINTER_MASK = ARENA_BIT - 1;
 public:
     static constexpr uint16_t STATIC_SIZE = 1; // length
 
@@ -71,25 +212,31 @@ public:
     BincodeBytes(const char* str): BincodeBytes(str, strlen(str)) {}
 
     void clear() {
-        if (size() >= 8) {
+        if (size() >= 8 && !(_data & ARENA_BIT)) {
             ::free(data());
         }
         _data = 0;
     }
 
-    void copy(const char* data, size_t length) {
+    // If `arena` is provided the data is allocated there, unless it's full.
+    void copy(const char* data, size_t length, BincodeArena* arena = nullptr) {
         clear();
         ALWAYS_ASSERT(length < 256);
         _data = (uintptr_t)length << (64-8);
         if (length < 8) {
             memcpy(&_data, data, length);
+            return;
+        }
+        char* buf = arena == nullptr ? nullptr : arena->alloc(length);
+        if (buf != nullptr) {
+            _data |= ARENA_BIT;
         } else {
-            char* buf = (char*)malloc(length);
+            buf = (char*)malloc(length);
             ALWAYS_ASSERT(buf != nullptr);
-            ALWAYS_ASSERT(((uintptr_t)buf >> (64-8)) == 0);
-            memcpy(buf, data, length);
-            _data |= (uintptr_t)buf;
         }
+        ALWAYS_ASSERT(((uintptr_t)buf & ~POINTER_MASK) == 0);
+        memcpy(buf, data, length);
+        _data |= (uintptr_t)buf;
     }
 
     ~BincodeBytes() {
@@ -104,7 +251,7 @@ public:
         if (size() < 8) {
             return (char*)&_data;
         } else {
-            return (char*)(_data & ~(0xFFull << (64-8)));
+            return (char*)(_data & POINTER_MASK);
         }
     }
 
@@ -126,6 +273,21 @@ public:
         other._data = 0;
     }
 
+    BincodeBytes& operator=(BincodeBytes&& other) {
+        if (this == &other) {
+            return *this;
+        }
+        clear();
+        _data = other._data;
+        other._data = 0;
+        return *this;
+    }
+
+    // Whether the data lives in a `BincodeArena`.
+    bool inArena() const {
+        return _data & ARENA_BIT;
+    }
+
     size_t packedSize() const {
         return 1 + size();
     }
@@ -274,9 +436,11 @@ struct BincodeBuf {
     uint8_t* data;
     uint8_t* cursor;
     uint8_t* end;
+    // If set, unpacked bytes are allocated here rather than in the heap.
+    BincodeArena* arena;
 
     BincodeBuf() = delete;
-    BincodeBuf(char* buf, size_t len): data((uint8_t*)buf), cursor((uint8_t*)buf), end((uint8_t*)buf+len) {}
+    BincodeBuf(char* buf, size_t len): data((uint8_t*)buf), cursor((uint8_t*)buf), end((uint8_t*)buf+len), arena(nullptr) {}
     BincodeBuf(std::string& str): BincodeBuf(str.data(), str.size()) {}
 
     size_t len() const {
@@ -366,7 +530,7 @@ struct BincodeBuf {
         if (unlikely(remaining() < len)) {
             throw BINCODE_EXCEPTION("not enough bytes to unpack bytes (need %s, got %s)", (int)len, remaining());
         }
-        x.copy((char*)cursor, len);
+        x.copy((char*)cursor, len, arena);
         cursor += len;
     }
 
@@ -224,6 +224,20 @@ static inline uint8_t parseReplicaId(CommandLineArgs& args) {
     return replicaId;
 }
 
+// Parsing Helpers
+
+Duration parseDuration(CommandLineArgs& args);
+
+static inline uint32_t parseUint32(CommandLineArgs& args) {
+    size_t processed;
+    auto arg = args.getArg();
+    uint64_t x = std::stoull(arg, &processed);
+    if (processed != arg.size() || x > std::numeric_limits<uint32_t>::max()) {
+        fprintf(stderr, "Invalid argument '%s', expecting an unsigned integer\n", arg.c_str());
+    }
+    return static_cast<uint32_t>(x);
+}
+
 static inline uint8_t parseUint8(CommandLineArgs& args) {
     size_t processed;
     auto arg = args.getArg();
@@ -238,8 +252,18 @@ struct LogsDBOptions {
     std::string dbDir;
     bool avoidBeingLeader = true;
     bool noReplication = false;
+    // Needs to be set on all replicas, see "Read leases" in LogsDB.hpp
+    bool readLeases = false;
+    // See SnapshotTransfer.hpp. 0 doesn't serve snapshots.
+    uint32_t snapshotPort = 0;
+    // Empty doesn't fetch snapshots.
+    std::string catchupFromHost;
+    uint16_t catchupFromPort = 0;
     uint8_t replicaId = 5;
     uint8_t location = 0;
+    // See `SharedRocksDBMemoryBudget`
+    uint32_t rocksDBMemoryMiB = 0;
+    bool rocksDBHyperClockCache = false;
 };
 
 static inline bool parseLogsDBOptions(CommandLineArgs& args, LogsDBOptions& options) {
@@ -262,10 +286,36 @@ static inline bool parseLogsDBOptions(CommandLineArgs& args, LogsDBOptions& opti
         options.noReplication = true;
         return true;
     }
+    if (arg == "-logsdb-read-leases") {
+        args.next();
+        options.readLeases = true;
+        return true;
+    }
+    if (arg == "-logsdb-snapshot-port") {
+        options.snapshotPort = parseUint32(args.next());
+        return true;
+    }
+    if (arg == "-logsdb-catchup-from") {
+        if (!parseRegistryAddress(args.next().peekArg(), options.catchupFromHost, options.catchupFromPort)) {
+            fprintf(stderr, "failed parsing catchup address %s\n", args.peekArg().c_str());
+            args.dieWithUsage();
+        }
+        args.next();
+        return true;
+    }
     if (arg == "-location") {
         options.location = parseUint8(args.next());
         return true;
     }
+    if (arg == "-rocksdb-memory-mb") {
+        options.rocksDBMemoryMiB = parseUint32(args.next());
+        return true;
+    }
+    if (arg == "-rocksdb-hyper-clock-cache") {
+        args.next();
+        options.rocksDBHyperClockCache = true;
+        return true;
+    }
     return false;
 }
 
@@ -278,10 +328,23 @@ static inline void printLogsDBOptionsUsage() {
     fprintf(stderr, " -logsdb-no-replication\n");
     fprintf(stderr, "    	Don't wait for acks from other replicas when becoming leader or replicating.\n");
     fprintf(stderr, "    	Can only be set if -logsdb-leader is also set. Default is false\n");
+    fprintf(stderr, " -logsdb-read-leases\n");
+    fprintf(stderr, "    	Leader grants followers read leases, so that they can serve up to date reads. Writes are only\n");
+    fprintf(stderr, "    	acknowledged once lease holders have them. Must be set on all replicas. Default is false\n");
+    fprintf(stderr, " -logsdb-snapshot-port\n");
+    fprintf(stderr, "    	TCP port to serve database snapshots on, for replicas too far behind to catch up otherwise. Default is 0, not serving\n");
+    fprintf(stderr, " -logsdb-catchup-from host:port\n");
+    fprintf(stderr, "    	If the database is missing or too far behind, replace it on start with a snapshot from the replica\n");
+    fprintf(stderr, "    	serving them at host:port. The previous database is kept next to it\n");
     fprintf(stderr, " -replica\n");
     fprintf(stderr, "    	Which replica are we running as [0-4]\n");
     fprintf(stderr, " -location\n");
     fprintf(stderr, "    	Which location we are running as [0-255]. Default is 0\n");
+    fprintf(stderr, " -rocksdb-memory-mb\n");
+    fprintf(stderr, "    	Size in MiB of the RocksDB block cache shared by all column families, memtables included.\n");
+    fprintf(stderr, "    	Default is 0, which leaves RocksDB to its own devices\n");
+    fprintf(stderr, " -rocksdb-hyper-clock-cache\n");
+    fprintf(stderr, "    	Use HyperClockCache rather than LRUCache for the above. Default is false\n");
 }
 
 static inline bool validateLogsDBOptions(const LogsDBOptions& options) { 
@@ -297,6 +360,14 @@ static inline bool validateLogsDBOptions(const LogsDBOptions& options) {
         fprintf(stderr, "-replica needs to be set\n");
         return false;
     }
+    if (options.snapshotPort > 0xFFFF) {
+        fprintf(stderr, "-logsdb-snapshot-port needs to be a valid port\n");
+        return false;
+    }
+    if (options.rocksDBHyperClockCache && options.rocksDBMemoryMiB == 0) {
+        fprintf(stderr, "-rocksdb-hyper-clock-cache needs -rocksdb-memory-mb\n");
+        return false;
+    }
     return true;
 }
 
@@ -373,6 +444,18 @@ struct ServerOptions {
     // If non-zero, UDP packets will be dropped with this probability. Useful to test
     // resilience of the system.
     double simulateOutgoingPacketDrop = 0.0;
+    // If non-zero, threads waiting on sockets or on internal queues will spin
+    // for this long before blocking. Trades CPU for wakeup latency.
+    Duration spin = 0;
+    // If non-zero, sockets are set up with SO_BUSY_POLL for this many microseconds.
+    uint32_t busyPollUs = 0;
+    // Receive and send UDP packets through io_uring rather than poll/recvmmsg/sendmmsg.
+    bool ioUring = false;
+    // Coalesce consecutive outgoing packets to the same peer with UDP_SEGMENT.
+    bool gso = false;
+    // Let the kernel coalesce incoming packets with UDP_GRO. Needs much bigger
+    // receive buffers, and doesn't work with io_uring.
+    bool gro = false;
 };
 
 static inline bool parseServerOptions(CommandLineArgs& args, ServerOptions& options) {
@@ -393,6 +476,29 @@ static inline bool parseServerOptions(CommandLineArgs& args, ServerOptions& opti
         options.simulateOutgoingPacketDrop = parseProbability(args.next());
         return true;
     }
+    if (arg == "-spin") {
+        options.spin = parseDuration(args.next());
+        return true;
+    }
+    if (arg == "-busy-poll") {
+        options.busyPollUs = parseUint32(args.next());
+        return true;
+    }
+    if (arg == "-io-uring") {
+        options.ioUring = true;
+        args.next();
+        return true;
+    }
+    if (arg == "-gso") {
+        options.gso = true;
+        args.next();
+        return true;
+    }
+    if (arg == "-gro") {
+        options.gro = true;
+        args.next();
+        return true;
+    }
     return false;
 }
 
@@ -402,6 +508,16 @@ static inline void printServerOptionsUsage() {
     fprintf(stderr, "    	Addresses we bind ourselves too and advertise to registry. At least one needs to be provided and at most 2\n");
     fprintf(stderr, " -outgoing-packet-drop [0, 1)\n");
     fprintf(stderr, "    	Drop given ratio of packets after processing them.\n");
+    fprintf(stderr, " -spin duration\n");
+    fprintf(stderr, "    	Spin for this long waiting for packets or queued requests before blocking. Default is 0 (never spin)\n");
+    fprintf(stderr, " -busy-poll microseconds\n");
+    fprintf(stderr, "    	Set SO_BUSY_POLL on our sockets. Default is 0 (disabled)\n");
+    fprintf(stderr, " -io-uring\n");
+    fprintf(stderr, "    	Use io_uring to receive and send UDP packets.\n");
+    fprintf(stderr, " -gso\n");
+    fprintf(stderr, "    	Coalesce consecutive UDP packets to the same peer using UDP_SEGMENT.\n");
+    fprintf(stderr, " -gro\n");
+    fprintf(stderr, "    	Receive coalesced UDP packets using UDP_GRO. Not compatible with -io-uring.\n");
 }
 
 static inline bool validateServerOptions(const ServerOptions& options) { 
@@ -409,19 +525,9 @@ static inline bool validateServerOptions(const ServerOptions& options) {
         fprintf(stderr, "at least one -addr needs to be defined\n");
         return false;
     }
-    return true;
-}
-
-// Parsing Helpers
-
-Duration parseDuration(CommandLineArgs& args);
-
-static inline uint32_t parseUint32(CommandLineArgs& args) {
-    size_t processed;
-    auto arg = args.getArg();
-    uint64_t x = std::stoull(arg, &processed);
-    if (processed != arg.size() || x > std::numeric_limits<uint32_t>::max()) {
-        fprintf(stderr, "Invalid argument '%s', expecting an unsigned integer\n", arg.c_str());
+    if (options.gro && options.ioUring) {
+        fprintf(stderr, "-gro is not supported with -io-uring\n");
+        return false;
     }
-    return static_cast<uint32_t>(x);
+    return true;
 }
@@ -64,6 +64,15 @@ std::vector<rocksdb::ColumnFamilyDescriptor> LogsDB::getColumnFamilyDescriptors(
     };
 }
 
+TernTime LogsDB::lastReleasedTime(SharedRocksDB& sharedDB) {
+    auto cf = sharedDB.getCF(METADATA_CF_NAME);
+    std::string value;
+    if (cf == nullptr || !tryGet(sharedDB.db(), cf, logsDBMetadataKey(LAST_RELEASED_TIME_KEY), value)) {
+        return 0;
+    }
+    return ExternalValue<U64Value>::FromSlice(value)().u64();
+}
+
 void LogsDB::clearAllData(SharedRocksDB &shardDB) {
     shardDB.deleteCF(METADATA_CF_NAME);
     shardDB.deleteCF(DATA_PARTITION_0_NAME);
@@ -86,34 +95,43 @@ struct LogPartition {
     }
 };
 
+// Partitions hold disjoint ranges of log indices: a partition only takes indices
+// below the first one of the partition which came after it. So we can go through
+// them one after the other in index order, rather than merging them.
 class DataPartitions {
 public:
     class Iterator {
         public:
-            Iterator(const DataPartitions& partitions) : _partitions(partitions), _rotationCount(_partitions._rotationCount), _smaller(nullptr) {
+            Iterator(const DataPartitions& partitions) : _partitions(partitions), _rotationCount(_partitions._rotationCount), _current(0), _it(nullptr) {
                 _iterators = _partitions._getPartitionIterators();
             }
 
             void seek(LogIdx idx) {
                 if (unlikely(_rotationCount != _partitions._rotationCount)) {
                     _iterators = _partitions._getPartitionIterators();
+                    _rotationCount = _partitions._rotationCount;
                 }
-                auto key = U64Key::Static(idx.u64);
-                for (auto& it : _iterators) {
-                    it->Seek(key.toSlice());
+                _order = _partitions._partitionsInIndexOrder();
+                // the first partition which can have idx or anything after it
+                for (_current = 0; _current < _order.size() && _partitions._partitions[_order[_current]].maxKey < idx; ++_current) {}
+                if (_current == _order.size()) {
+                    _it = nullptr;
+                    return;
                 }
-                _updateSmaller();
+                _it = _iterators[_order[_current]].get();
+                _it->Seek(U64Key::Static(idx.u64).toSlice());
+                _skipExhaustedPartitions();
             }
 
             bool valid() const {
-                return _smaller != nullptr;
+                return _it != nullptr;
             }
 
             void next() {
-                if (_smaller != nullptr) {
-                    _smaller->Next();
+                if (_it != nullptr) {
+                    _it->Next();
+                    _skipExhaustedPartitions();
                 }
-                _updateSmaller();
             }
             Iterator& operator++() {
                 this->next();
@@ -121,43 +139,38 @@ public:
             }
 
             LogIdx key() const {
-                return LogIdx(ExternalValue<U64Key>::FromSlice(_smaller->key())().u64());
+                return LogIdx(ExternalValue<U64Key>::FromSlice(_it->key())().u64());
             }
 
             LogsDBLogEntry entry() const {
-                auto value = _smaller->value();
+                auto value = _it->value();
                 return LogsDBLogEntry{key(), {(const uint8_t*)value.data(), (const uint8_t*)value.data() + value.size()}};
             }
 
             void dropEntry() {
                 ALWAYS_ASSERT(_rotationCount == _partitions._rotationCount);
-                auto cfIdx = _cfIndexForCurrentIterator();
-                ROCKS_DB_CHECKED(_partitions._sharedDb.db()->Delete({}, _partitions._partitions[cfIdx].cf, _smaller->key()));
+                ROCKS_DB_CHECKED(_partitions._sharedDb.db()->Delete({}, _partitions._partitions[_order[_current]].cf, _it->key()));
             }
 
         private:
-            void _updateSmaller() {
-                _smaller = nullptr;
-                for (auto& it : _iterators) {
-                    if (!it->Valid()) {
-                        continue;
-                    }
-                    if (_smaller == nullptr || (rocksdb::BytewiseComparator()->Compare(it->key(),_smaller->key()) < 0)) {
-                        _smaller = it.get();
+            // moves on to the start of the following partitions while we're at the end of one
+            void _skipExhaustedPartitions() {
+                while (!_it->Valid()) {
+                    ROCKS_DB_CHECKED(_it->status());
+                    if (++_current == _order.size()) {
+                        _it = nullptr;
+                        return;
                     }
+                    _it = _iterators[_order[_current]].get();
+                    _it->SeekToFirst();
                 }
             }
-            size_t _cfIndexForCurrentIterator() const {
-                for (size_t i = 0; i < _iterators.size(); ++i) {
-                    if (_smaller == _iterators[i].get()) {
-                        return i;
-                    }
-                }
-                return -1;
-            }
             const DataPartitions& _partitions;
             size_t _rotationCount;
-            rocksdb::Iterator* _smaller;
+            // the non empty partitions, in index order, and where we are in them
+            std::vector<size_t> _order;
+            size_t _current;
+            rocksdb::Iterator* _it;
             std::vector<std::unique_ptr<rocksdb::Iterator>> _iterators;
     };
 
@@ -311,6 +324,24 @@ public:
         return std::max(_partitions[0].maxKey, _partitions[1].maxKey);
     }
 
+    // Rotation only happens when writing, so when idle we'd keep entries around
+    // forever. Drops the older partition as a whole once everything in it is older
+    // than PARTITION_TIME_SPAN, i.e. the newer one started that long ago, as long as
+    // it has nothing past `safeIdx`.
+    void dropExpiredPartitions(TernTime now, LogIdx safeIdx) {
+        auto order = _partitionsInIndexOrder();
+        if (order.size() < 2) {
+            return;
+        }
+        auto& olderPartition = _partitions[order[0]];
+        auto& newerPartition = _partitions[order[1]];
+        if (likely(newerPartition.firstWriteTime + LogsDB::PARTITION_TIME_SPAN > now || safeIdx < olderPartition.maxKey)) {
+            return;
+        }
+        LOG_INFO(_env, "Partition %s expired, newer partition %s first written at %s", olderPartition.name, newerPartition.name, newerPartition.firstWriteTime);
+        _dropPartition(olderPartition);
+    }
+
 private:
     void _updatePartitionFirstWriteTime(LogPartition& partition, TernTime time) {
         ROCKS_DB_CHECKED(_sharedDb.db()->Put({}, _sharedDb.getCF(METADATA_CF_NAME), logsDBMetadataKey(partition.firstWriteKey), U64Value::Static(time.ns).toSlice()));
@@ -337,14 +368,31 @@ private:
         // we only need to drop older partition and reset it's info.
         // picking partition for writes/reads takes care of rest
         auto& olderPartition = _partitions[0].minKey < _partitions[1].minKey ? _partitions[0] : _partitions[1];
-        LOG_INFO(_env, "Rotating partions. Dropping partition %s, firstWriteTime: %s, minKey: %s, maxKey: %s", olderPartition.name, olderPartition.firstWriteTime, olderPartition.minKey, olderPartition.maxKey);
+        LOG_INFO(_env, "Rotating partions.");
+        _dropPartition(olderPartition);
+    }
 
-        _sharedDb.deleteCF(olderPartition.name);
-        olderPartition.reset(_sharedDb.createCF({olderPartition.name,{}}),0,0);
-        _updatePartitionFirstWriteTime(olderPartition, 0);
+    void _dropPartition(LogPartition& partition) {
+        LOG_INFO(_env, "Dropping partition %s, firstWriteTime: %s, minKey: %s, maxKey: %s", partition.name, partition.firstWriteTime, partition.minKey, partition.maxKey);
+        _sharedDb.deleteCF(partition.name);
+        partition.reset(_sharedDb.createCF({partition.name,{}}),0,0);
+        _updatePartitionFirstWriteTime(partition, 0);
         ++_rotationCount;
     }
 
+    // The indices of the partitions with something in them, by the log indices they hold.
+    std::vector<size_t> _partitionsInIndexOrder() const {
+        std::vector<size_t> order;
+        order.reserve(_partitions.size());
+        for (size_t i = 0; i < _partitions.size(); ++i) {
+            if (_partitions[i].minKey != 0) {
+                order.emplace_back(i);
+            }
+        }
+        std::sort(order.begin(), order.end(), [this](size_t a, size_t b) { return _partitions[a].minKey < _partitions[b].minKey; });
+        return order;
+    }
+
     LogPartition& _getPartitionForIdx(LogIdx key) {
         return const_cast<LogPartition&>(static_cast<const DataPartitions*>(this)->_getPartitionForIdx(key));
     }
@@ -1253,8 +1301,10 @@ public:
         return _lastContinuousIdx;
     }
 
-    void readEntries(std::vector<LogsDBLogEntry>& entries, size_t maxEntries) {
-        if (_lastRead == _lastContinuousIdx) {
+    // Reads up to `readUpTo`, which can't be past the last continuous index
+    void readEntries(std::vector<LogsDBLogEntry>& entries, size_t maxEntries, LogIdx readUpTo) {
+        ALWAYS_ASSERT(readUpTo <= _lastContinuousIdx);
+        if (readUpTo <= _lastRead) {
             update_atomic_stat_ema(_stats.entriesRead, (uint64_t)0);
             return;
         }
@@ -1264,7 +1314,7 @@ public:
 
         auto it = _data.getIterator();
         for (it.seek(startIndex); it.valid(); it.next(), ++startIndex) {
-            if (_lastContinuousIdx < it.key() || entries.size() >= maxEntries) {
+            if (readUpTo < it.key() || entries.size() >= maxEntries) {
                 break;
             }
             ALWAYS_ASSERT(startIndex == it.key());
@@ -1408,15 +1458,28 @@ class Appender {
     static constexpr size_t IN_FLIGHT_MASK = LogsDB::IN_FLIGHT_APPEND_WINDOW - 1;
     static_assert((IN_FLIGHT_MASK & LogsDB::IN_FLIGHT_APPEND_WINDOW) == 0);
 public:
-    Appender(Env& env, LogsDBStats& stats, ReqResp& reqResp, LogMetadata& metadata, LeaderElection& leaderElection, bool noReplication) :
+    Appender(Env& env, LogsDBStats& stats, ReqResp& reqResp, LogMetadata& metadata, LeaderElection& leaderElection, bool noReplication, bool readLeases) :
         _env(env),
+        _stats(stats),
         _reqResp(reqResp),
         _metadata(metadata),
         _leaderElection(leaderElection),
         _noReplication(noReplication),
+        _readLeases(readLeases),
         _currentIsLeader(false),
         _entriesStart(0),
-        _entriesEnd(0) { }
+        _entriesEnd(0),
+        _window(LogsDB::INITIAL_APPEND_WINDOW),
+        _windowFull(false),
+        _releasedSinceAdjust(0),
+        _commitLatencyNs(0),
+        _minCommitLatency(0),
+        _prevMinCommitLatency(0),
+        _entrySize(0),
+        _adjustments(0)
+    {
+        _stats.appendWindowLimit.store(_window, std::memory_order_relaxed);
+    }
 
     void maybeMoveRelease() {
         if (!_currentIsLeader && _leaderElection.isLeader()) {
@@ -1432,6 +1495,7 @@ public:
             return;
         }
 
+        auto now = ternNow();
         auto newRelease = _metadata.getLastReleased();
         std::vector<LogsDBLogEntry> entriesToWrite;
         for (; _entriesStart < _entriesEnd; ++_entriesStart) {
@@ -1439,6 +1503,7 @@ public:
             auto& requestIds = _requestIds[offset];
             if (_noReplication || ReqResp::isQuorum(requestIds)) {
                 ++newRelease;
+                _recordCommit(now - _appendTimes[offset], _entries[offset].value.size());
                 entriesToWrite.emplace_back(std::move(_entries[offset]));
                 ALWAYS_ASSERT(newRelease == entriesToWrite.back().idx);
                 _reqResp.cleanupRequests(requestIds);
@@ -1446,6 +1511,7 @@ public:
             }
             break;
         }
+        _maybeAdjustWindow(now);
         if (entriesToWrite.empty()) {
             return;
         }
@@ -1453,7 +1519,7 @@ public:
         auto err = _leaderElection.writeLogEntries(_metadata.getLeaderToken(), newRelease, entriesToWrite);
         ALWAYS_ASSERT(err == TernError::NO_ERROR);
         for (auto reqId : _releaseRequests) {
-            if (reqId == 0) {
+            if (reqId == 0 || _readLeases) {
                 continue;
             }
             auto request = _reqResp.getRequest(reqId);
@@ -1468,12 +1534,14 @@ public:
         if (!_leaderElection.isLeader()) {
             return TernError::LEADER_PREEMPTED;
         }
-        auto availableSpace = LogsDB::IN_FLIGHT_APPEND_WINDOW - entriesInFlight();
+        auto availableSpace = _window > entriesInFlight() ? _window - entriesInFlight() : 0;
         auto countToAppend = std::min(entries.size(), availableSpace);
+        auto now = ternNow();
         for(size_t i = 0; i < countToAppend; ++i) {
             entries[i].idx = _metadata.assignLogIdx();
             auto offset = (_entriesEnd + i) & IN_FLIGHT_MASK;
             _entries[offset] = entries[i];
+            _appendTimes[offset] = now;
             auto& requestIds = _requestIds[offset];
             for(ReplicaId replicaId = 0; replicaId.u8 < LogsDB::REPLICA_COUNT; ++replicaId.u8) {
                 if (replicaId == _metadata.getReplicaId()) {
@@ -1497,6 +1565,10 @@ public:
             entries[i].idx = 0;
         }
         _entriesEnd += countToAppend;
+        if (!entries.empty() && entriesInFlight() >= _window) {
+            _windowFull = true;
+            _stats.appendWindowFull.fetch_add(1, std::memory_order_relaxed);
+        }
         if (unlikely(_noReplication)) {
             maybeMoveRelease();
         }
@@ -1537,7 +1609,68 @@ public:
         return _entriesEnd - _entriesStart;
     }
 
+    size_t window() const {
+        return _window;
+    }
+
 private:
+    // Every ~10s we start tracking the minimum commit latency from scratch, so that it can follow
+    // replicas moving around. We use the minimum over the current and previous period.
+    static constexpr uint64_t MIN_LATENCY_RESET_ADJUSTMENTS = 100;
+    // Latency below this is never considered inflated, it's mostly down to how often we get to run.
+    static constexpr Duration COMMIT_LATENCY_SLACK = 1_ms;
+
+    void _recordCommit(Duration latency, size_t entrySize) {
+        // EMAs over the last few dozen entries
+        _commitLatencyNs = _commitLatencyNs == 0 ? latency.ns : _commitLatencyNs * 0.95 + latency.ns * 0.05;
+        _entrySize = _entrySize == 0 ? entrySize : _entrySize * 0.95 + entrySize * 0.05;
+        if (_minCommitLatency == 0 || latency < _minCommitLatency) {
+            _minCommitLatency = latency;
+        }
+        ++_releasedSinceAdjust;
+    }
+
+    // The window we need to sustain a release rate is rate * commit latency (the bandwidth-delay
+    // product). If we keep filling the window and the replicas are keeping up (commit latency close to
+    // the minimum we've seen) the window is what's holding us back, so we double it. If commit latency
+    // goes up we're just queueing in front of the replicas, so we halve the window, but not below
+    // twice what we need to keep the current release rate going.
+    void _maybeAdjustWindow(TernTime now) {
+        auto elapsed = now - _lastAdjust;
+        if (elapsed < LogsDB::APPEND_WINDOW_ADJUST_INTERVAL) {
+            return;
+        }
+        Duration minLatency = _minCommitLatency;
+        if (_prevMinCommitLatency != 0 && (minLatency == 0 || _prevMinCommitLatency < minLatency)) {
+            minLatency = _prevMinCommitLatency;
+        }
+        size_t window = _window;
+        if (_releasedSinceAdjust > 0 && minLatency != 0 && _commitLatencyNs > 2.0 * minLatency.ns + COMMIT_LATENCY_SLACK.ns) {
+            double releaseRate = (double)_releasedSinceAdjust / elapsed.ns;
+            size_t needed = 2.0 * releaseRate * _commitLatencyNs;
+            window = std::max(needed, _window / 2);
+        } else if (_windowFull && _releasedSinceAdjust > 0) {
+            window = _window * 2;
+        }
+        // every entry in flight is kept here and in a request for every other replica
+        if (_entrySize > 0) {
+            window = std::min(window, (size_t)(LogsDB::APPEND_WINDOW_MEMORY_BUDGET / (_entrySize * LogsDB::REPLICA_COUNT)));
+        }
+        window = std::clamp(window, LogsDB::MIN_APPEND_WINDOW, LogsDB::IN_FLIGHT_APPEND_WINDOW);
+        if (window != _window) {
+            LOG_DEBUG(_env, "append window %s -> %s, commit latency %s, min %s, released %s", _window, window, Duration(_commitLatencyNs), minLatency, _releasedSinceAdjust);
+            _window = window;
+        }
+        _stats.appendWindowLimit.store(_window, std::memory_order_relaxed);
+        _stats.commitLatency.store(Duration(_commitLatencyNs), std::memory_order_relaxed);
+        if (++_adjustments % MIN_LATENCY_RESET_ADJUSTMENTS == 0) {
+            _prevMinCommitLatency = _minCommitLatency;
+            _minCommitLatency = 0;
+        }
+        _windowFull = false;
+        _releasedSinceAdjust = 0;
+        _lastAdjust = now;
+    }
 
     void _init() {
         for(ReplicaId replicaId = 0; replicaId.u8 < LogsDB::REPLICA_COUNT; ++replicaId.u8) {
@@ -1548,10 +1681,18 @@ private:
             auto& req = _reqResp.newRequest(replicaId);
             auto& releaseReq = req.msg.body.setRelease();
             releaseReq.token = _metadata.getLeaderToken();
-            releaseReq.lastReleased = _metadata.getLastReleased();
+            // With read leases a RELEASE with a release point is a grant, and ReadLeases sends
+            // those. We still need these to keep followers from starting elections while no
+            // grants go out, so they carry no release point.
+            releaseReq.lastReleased = _readLeases ? 0 : _metadata.getLastReleased();
             _releaseRequests[replicaId.u8] = req.msg.id;
         }
         _currentIsLeader = true;
+        _window = LogsDB::INITIAL_APPEND_WINDOW;
+        _stats.appendWindowLimit.store(_window, std::memory_order_relaxed);
+        _windowFull = false;
+        _releasedSinceAdjust = 0;
+        _lastAdjust = ternNow();
     }
 
     void _cleanup() {
@@ -1564,22 +1705,320 @@ private:
         _currentIsLeader = false;
     }
     Env& _env;
+    LogsDBStats& _stats;
     ReqResp& _reqResp;
     LogMetadata& _metadata;
     LeaderElection& _leaderElection;
 
     const bool _noReplication;
+    const bool _readLeases;
     bool _currentIsLeader;
     uint64_t _entriesStart;
     uint64_t _entriesEnd;
 
     std::array<LogsDBLogEntry, LogsDB::IN_FLIGHT_APPEND_WINDOW> _entries;
     std::array<ReqResp::QuorumTrackArray, LogsDB::IN_FLIGHT_APPEND_WINDOW> _requestIds;
+    std::array<TernTime, LogsDB::IN_FLIGHT_APPEND_WINDOW> _appendTimes;
     ReqResp::QuorumTrackArray _releaseRequests;
 
+    // adaptive append window
+    size_t _window;
+    bool _windowFull; // since last adjustment
+    uint64_t _releasedSinceAdjust;
+    double _commitLatencyNs;
+    Duration _minCommitLatency;
+    Duration _prevMinCommitLatency;
+    double _entrySize;
+    uint64_t _adjustments;
+    TernTime _lastAdjust;
+
 
 };
 
+// See "Read leases" in LogsDB.hpp
+class ReadLeases {
+public:
+    ReadLeases(Env& env, LogsDBStats& stats, ReqResp& reqResp, LogMetadata& metadata, LeaderElection& leaderElection, CatchupReader& catchupReader, bool enabled) :
+        _env(env),
+        _stats(stats),
+        _reqResp(reqResp),
+        _metadata(metadata),
+        _leaderElection(leaderElection),
+        _catchupReader(catchupReader),
+        _enabled(enabled),
+        _currentIsLeader(false),
+        _leaseToken(LeaderToken(0,0)),
+        _lastGrantId(0),
+        _lastGrantResult(TernError::NO_ERROR)
+    {}
+
+    bool enabled() const {
+        return _enabled;
+    }
+
+    // follower: grants are answered in `maybeGrantLeases`, once the release point in them has been
+    // written and we've caught up
+    void proccessReleaseRequest(ReplicaId fromReplicaId, uint64_t requestId, const ReleaseReq& request) {
+        // no release point: just a keepalive from the Appender
+        if (!_enabled || unlikely(fromReplicaId != request.token.replica()) || request.lastReleased == 0) {
+            return;
+        }
+        _pendingGrants.emplace_back(PendingGrant{fromReplicaId, requestId, request, ternNow()});
+    }
+
+    // leader
+    void proccessReleaseResponse(ReplicaId fromReplicaId, LogsDBRequest& request, const ReleaseResp& response) {
+        if (!_currentIsLeader) {
+            return;
+        }
+        auto& lease = _leases[fromReplicaId.u8];
+        if (lease.grantId != request.msg.id) {
+            LOG_ERROR(_env, "Unexpected RELEASE response %s from replica %s", response, fromReplicaId);
+            return;
+        }
+        lease.grantId = 0;
+        // `request` goes away with this
+        TernTime sentTime = request.sentTime;
+        LogIdx granted = request.msg.body.getRelease().lastReleased;
+        _reqResp.eraseRequest(request.msg.id);
+        switch ((TernError)response.result) {
+            case TernError::NO_ERROR:
+                lease.expiry = std::max(lease.expiry, sentTime + LogsDB::READ_LEASE_DURATION);
+                lease.confirmed = granted;
+                lease.lastAnsweredSent = sentTime;
+                break;
+            case TernError::LOG_ENTRY_MISSING:
+                // the follower is lagging and has dropped its lease, and ignores anything we've sent it before
+                lease.expiry = 0;
+                lease.lastAnsweredSent = sentTime;
+                break;
+            case TernError::LEADER_PREEMPTED:
+                _leaderElection.resetLeaderElection();
+                break;
+            default:
+                LOG_ERROR(_env, "Unexpected result from RELEASE response %s", response.result);
+                break;
+        }
+    }
+
+    void maybeGrantLeases() {
+        if (!_enabled) {
+            return;
+        }
+        _answerGrants();
+        if (!_currentIsLeader && _leaderElection.isLeader()) {
+            _init();
+        }
+        if (!_leaderElection.isLeader() && _currentIsLeader) {
+            _cleanup();
+            return;
+        }
+        if (!_currentIsLeader) {
+            return;
+        }
+
+        auto now = ternNow();
+        auto lastReleased = _metadata.getLastReleased();
+        // if we can't hear back from a quorum we might have been replaced, so stop extending leases
+        bool canGrant = now < _leaderSince + LogsDB::READ_LEASE_DURATION || _answeringQuorum(now);
+        uint64_t holders = 0;
+        for (ReplicaId replicaId = 0; replicaId.u8 < LogsDB::REPLICA_COUNT; ++replicaId.u8) {
+            if (replicaId == _metadata.getReplicaId()) {
+                continue;
+            }
+            auto& lease = _leases[replicaId.u8];
+            if (lease.grantId != 0) {
+                auto request = _reqResp.getRequest(lease.grantId);
+                ALWAYS_ASSERT(request != nullptr);
+                if (request->sentTime != 0) {
+                    if (lease.firstSent == 0) {
+                        lease.firstSent = request->sentTime;
+                    }
+                    lease.expiry = std::max(lease.expiry, request->sentTime + LogsDB::READ_LEASE_DURATION);
+                }
+                // We give up before ReqResp would resend it, as every resend pushes back when the lease
+                // might run out.
+                if (lease.firstSent != 0 && lease.firstSent + LogsDB::READ_LEASE_RENEW_INTERVAL < now) {
+                    // no answer, stop sending it and don't bother again for a while
+                    LOG_DEBUG(_env, "no answer to read lease grant from replica %s", replicaId);
+                    _reqResp.eraseRequest(lease.grantId);
+                    lease.grantId = 0;
+                    lease.retryAfter = now + LogsDB::READ_LEASE_RETRY_INTERVAL;
+                }
+            } else if (
+                // nothing released means nothing to lease, and a grant needs a release point
+                canGrant && lastReleased != 0 && lease.retryAfter <= now &&
+                (lease.confirmed < lastReleased || lease.lastGranted + LogsDB::READ_LEASE_RENEW_INTERVAL <= now)
+            ) {
+                auto& request = _reqResp.newRequest(replicaId);
+                auto& releaseReq = request.msg.body.setRelease();
+                releaseReq.token = _metadata.getLeaderToken();
+                releaseReq.lastReleased = lastReleased;
+                lease.grantId = request.msg.id;
+                lease.firstSent = 0;
+                lease.lastGranted = now;
+            }
+            holders += now < lease.expiry || lease.grantId != 0;
+        }
+        _stats.readLeaseHolders.store(holders, std::memory_order_relaxed);
+    }
+
+    // leader: what we can make visible without leaving anyone holding a lease behind
+    LogIdx visibleReleased(LogIdx lastReleased) const {
+        if (!_enabled || !_currentIsLeader) {
+            return lastReleased;
+        }
+        auto now = ternNow();
+        if (now < _leaderSince + LogsDB::READ_LEASE_DURATION*2) {
+            return std::min(lastReleased, _releasedWhenElected);
+        }
+        for (ReplicaId replicaId = 0; replicaId.u8 < LogsDB::REPLICA_COUNT; ++replicaId.u8) {
+            if (replicaId == _metadata.getReplicaId()) {
+                continue;
+            }
+            auto& lease = _leases[replicaId.u8];
+            auto expiry = lease.expiry;
+            if (lease.grantId != 0) {
+                // might have been sent since we last looked
+                auto request = _reqResp.getRequest(lease.grantId);
+                if (request->sentTime != 0) {
+                    expiry = std::max(expiry, request->sentTime + LogsDB::READ_LEASE_DURATION);
+                }
+            }
+            if (now < expiry) {
+                lastReleased = std::min(lastReleased, lease.confirmed);
+            }
+        }
+        return lastReleased;
+    }
+
+    // follower
+    LogsDBReadLease readLease() const {
+        if (
+            !_enabled || _currentIsLeader ||
+            _leaseToken != _metadata.getLeaderToken() || _metadata.getNomineeToken() != LeaderToken(0,0)
+        ) {
+            return LogsDBReadLease{0, 0};
+        }
+        return _lease;
+    }
+
+    Duration getNextTimeout() const {
+        if (_currentIsLeader) {
+            return LogsDB::READ_LEASE_RENEW_INTERVAL;
+        }
+        return LogsDB::LEADER_INACTIVE_TIMEOUT;
+    }
+
+private:
+    struct PendingGrant {
+        ReplicaId replicaId;
+        uint64_t requestId;
+        ReleaseReq request;
+        TernTime received;
+    };
+
+    struct Lease {
+        uint64_t grantId; // outstanding grant request
+        TernTime firstSent; // of the outstanding grant
+        TernTime lastGranted;
+        TernTime lastAnsweredSent; // when the last grant which got an answer was sent
+        TernTime expiry; // when the follower's lease runs out at the latest
+        TernTime retryAfter;
+        LogIdx confirmed; // release point the follower has confirmed
+    };
+
+    bool _answeringQuorum(TernTime now) const {
+        size_t answering = 1; // us
+        for (ReplicaId replicaId = 0; replicaId.u8 < LogsDB::REPLICA_COUNT; ++replicaId.u8) {
+            if (replicaId == _metadata.getReplicaId()) {
+                continue;
+            }
+            answering += _leases[replicaId.u8].lastAnsweredSent + LogsDB::READ_LEASE_DURATION > now;
+        }
+        return answering > LogsDB::REPLICA_COUNT / 2;
+    }
+
+    void _answerGrants() {
+        for (const auto& grant : _pendingGrants) {
+            if (grant.request.token == _leaseToken && grant.requestId < _lastGrantId) {
+                // an old grant which got delayed, the leader has moved on
+                continue;
+            }
+            auto& response = _reqResp.newResponse(grant.replicaId, grant.requestId);
+            auto& releaseResp = response.msg.body.setRelease();
+            // any newer token would have been recorded when writing the release point
+            if (grant.request.token != _metadata.getLeaderToken() || _metadata.getNomineeToken() != LeaderToken(0,0)) {
+                releaseResp.result = TernError::LEADER_PREEMPTED;
+                continue;
+            }
+            if (_leaseToken != grant.request.token) {
+                _leaseToken = grant.request.token;
+                _lastGrantId = 0;
+                _lease = LogsDBReadLease{0, 0};
+            }
+            if (grant.requestId == _lastGrantId) {
+                // a resend, we've already answered but the response might have been lost. It
+                // does not extend the lease, as the leader counts from the first send.
+                releaseResp.result = _lastGrantResult;
+                continue;
+            }
+            _lastGrantId = grant.requestId;
+            if (_catchupReader.getLastContinuous() < grant.request.lastReleased) {
+                LOG_DEBUG(_env, "not caught up to %s, dropping read lease", grant.request.lastReleased);
+                _lease = LogsDBReadLease{0, 0};
+                _lastGrantResult = TernError::LOG_ENTRY_MISSING;
+            } else {
+                _lease.idx = grant.request.lastReleased;
+                _lease.expiry = grant.received + (LogsDB::READ_LEASE_DURATION - LogsDB::READ_LEASE_MARGIN);
+                _lastGrantResult = TernError::NO_ERROR;
+            }
+            releaseResp.result = _lastGrantResult;
+        }
+        _pendingGrants.clear();
+    }
+
+    void _init() {
+        _currentIsLeader = true;
+        _leaderSince = ternNow();
+        _releasedWhenElected = _metadata.getLastReleased();
+        _leases.fill(Lease{});
+        _lease = LogsDBReadLease{0, 0};
+    }
+
+    void _cleanup() {
+        for (auto& lease : _leases) {
+            if (lease.grantId != 0) {
+                _reqResp.eraseRequest(lease.grantId);
+            }
+        }
+        _leases.fill(Lease{});
+        _stats.readLeaseHolders.store(0, std::memory_order_relaxed);
+        _currentIsLeader = false;
+    }
+
+    Env& _env;
+    LogsDBStats& _stats;
+    ReqResp& _reqResp;
+    LogMetadata& _metadata;
+    LeaderElection& _leaderElection;
+    CatchupReader& _catchupReader;
+    const bool _enabled;
+
+    // leader
+    bool _currentIsLeader;
+    TernTime _leaderSince;
+    LogIdx _releasedWhenElected;
+    std::array<Lease, LogsDB::REPLICA_COUNT> _leases;
+
+    // follower
+    std::vector<PendingGrant> _pendingGrants;
+    LeaderToken _leaseToken;
+    uint64_t _lastGrantId;
+    TernError _lastGrantResult;
+    LogsDBReadLease _lease;
+};
+
 class LogsDBImpl {
 public:
     LogsDBImpl(
@@ -1589,7 +2028,8 @@ public:
         ReplicaId replicaId,
         LogIdx lastRead,
         bool noReplication,
-        bool avoidBeingLeader)
+        bool avoidBeingLeader,
+        bool readLeases)
     :
         _env(logger, xmon, "LogsDB"),
         _db(sharedDB.db()),
@@ -1601,7 +2041,8 @@ public:
         _leaderElection(_env, _stats, noReplication, avoidBeingLeader, replicaId, _metadata, _partitions, _reqResp),
         _batchWriter(_env,_reqResp, _leaderElection),
         _catchupReader(_stats, _reqResp, _metadata, _partitions, replicaId, lastRead),
-        _appender(_env, _stats, _reqResp, _metadata, _leaderElection, noReplication)
+        _appender(_env, _stats, _reqResp, _metadata, _leaderElection, noReplication, readLeases && !noReplication),
+        _readLeases(_env, _stats, _reqResp, _metadata, _leaderElection, _catchupReader, readLeases && !noReplication)
     {
         LOG_INFO(_env, "Initializing LogsDB");
         auto initialStart = _metadata.isInitialStart() && _partitions.isInitialStart();
@@ -1618,6 +2059,9 @@ public:
         _catchupReader.init();
 
         LOG_INFO(_env,"LogsDB opened, leaderToken(%s), lastReleased(%s), lastRead(%s)",_metadata.getLeaderToken(), _metadata.getLastReleased(), _catchupReader.lastRead());
+        if (!initialStart && !noReplication && _metadata.getLastReleasedTime() + LogsDB::BULK_CATCHUP_AGE < ternNow()) {
+            LOG_ERROR(_env, "last release happened at %s, entries we need might be gone from other replicas. If we can't catch up restart with -logsdb-catchup-from", _metadata.getLastReleasedTime());
+        }
         _infoLoggedTime = ternNow();
         _lastLoopFinished = ternNow();
     }
@@ -1652,6 +2096,7 @@ public:
     void processIncomingMessages(std::vector<LogsDBRequest>& requests, std::vector<LogsDBResponse>& responses) {
         auto processingStarted = ternNow();
         _maybeLogStatus(processingStarted);
+        _partitions.dropExpiredPartitions(processingStarted, std::min(_metadata.getLastReleased(), _catchupReader.lastRead()));
         for(auto& resp : responses) {
             auto request = _reqResp.getRequest(resp.msg.id);
             if (request == nullptr) {
@@ -1673,7 +2118,9 @@ public:
 
             switch(resp.msg.body.kind()) {
             case LogMessageKind::RELEASE:
-                // We don't track release requests. This response is unexpected
+                // Only read lease grants get a response
+                _readLeases.proccessReleaseResponse(request->replicaId, *request, resp.msg.body.getRelease());
+                break;
             case LogMessageKind::ERROR:
                 LOG_ERROR(_env, "Bad response %s", resp);
                 break;
@@ -1711,6 +2158,7 @@ public:
                 break;
             case LogMessageKind::RELEASE:
                 _batchWriter.proccessReleaseRequest(req.replicaId, req.msg.id, req.msg.body.getRelease());
+                _readLeases.proccessReleaseRequest(req.replicaId, req.msg.id, req.msg.body.getRelease());
                 break;
             case LogMessageKind::LOG_READ:
                 _catchupReader.proccessLogReadRequest(req.replicaId, req.msg.id, req.msg.body.getLogRead());
@@ -1736,6 +2184,7 @@ public:
         _batchWriter.writeBatch();
         _appender.maybeMoveRelease();
         _catchupReader.maybeCatchUp();
+        _readLeases.maybeGrantLeases();
         _reqResp.resendTimedOutRequests();
         update_atomic_stat_ema(_stats.requestsReceived, requests.size());
         update_atomic_stat_ema(_stats.responsesReceived, responses.size());
@@ -1761,12 +2210,20 @@ public:
         return _appender.appendEntries(entries);
     }
 
+    size_t appendWindow() const {
+        return _appender.window();
+    }
+
     LogIdx getLastContinuous() const {
-        return _catchupReader.getLastContinuous();
+        return _readLeases.visibleReleased(_catchupReader.getLastContinuous());
+    }
+
+    LogsDBReadLease readLease() const {
+        return _readLeases.readLease();
     }
 
     void readEntries(std::vector<LogsDBLogEntry>& entries, size_t maxEntries) {
-        _catchupReader.readEntries(entries, maxEntries);
+        _catchupReader.readEntries(entries, maxEntries, getLastContinuous());
     }
 
     void readIndexedEntries(const std::vector<LogIdx> &indices, std::vector<LogsDBLogEntry> &entries) const {
@@ -1774,7 +2231,7 @@ public:
     }
 
     Duration getNextTimeout() const {
-        return _reqResp.getNextTimeout();
+        return std::min(_reqResp.getNextTimeout(), _readLeases.getNextTimeout());
     }
 
     LogIdx getLastReleased() const {
@@ -1805,6 +2262,7 @@ private:
     BatchWriter _batchWriter;
     CatchupReader _catchupReader;
     Appender _appender;
+    ReadLeases _readLeases;
     TernTime _infoLoggedTime;
     TernTime _lastLoopFinished;
 };
@@ -1816,9 +2274,10 @@ LogsDB::LogsDB(
         ReplicaId replicaId,
         LogIdx lastRead,
         bool noReplication,
-        bool avoidBeingLeader)
+        bool avoidBeingLeader,
+        bool readLeases)
 {
-    _impl = new LogsDBImpl(logger, xmon, sharedDB, replicaId, lastRead, noReplication, avoidBeingLeader);
+    _impl = new LogsDBImpl(logger, xmon, sharedDB, replicaId, lastRead, noReplication, avoidBeingLeader, readLeases);
 }
 
 LogsDB::~LogsDB() {
@@ -1850,10 +2309,18 @@ TernError LogsDB::appendEntries(std::vector<LogsDBLogEntry>& entries) {
     return _impl->appendEntries(entries);
 }
 
+size_t LogsDB::appendWindow() const {
+    return _impl->appendWindow();
+}
+
 LogIdx LogsDB::getLastContinuous() const {
     return _impl->getLastContinuous();
 }
 
+LogsDBReadLease LogsDB::readLease() const {
+    return _impl->readLease();
+}
+
 void LogsDB::readEntries(std::vector<LogsDBLogEntry>& entries, size_t maxEntries) {
     _impl->readEntries(entries, maxEntries);
 }
@@ -43,6 +43,18 @@
 // Since they were not part of the leader election they know their records after last released point have not been taken into
 // account and could have been overwriten. They at this point drop these records and catch up from lastReleased point.
 
+// ** Read leases **
+// Optionally the leader grants followers time-bounded read leases, so that they can serve reads which observe every write
+// acknowledged before the read arrived. Grants are RELEASE requests, which followers answer once they have every record up
+// to the release point in the request. The usual RELEASE keepalives are still sent, without a release point, so that
+// followers don't start elections while no grants go out. While a follower might be holding a lease the leader doesn't make records past what
+// that follower has confirmed visible to the application (see getLastContinuous), so no write can be acknowledged without
+// lease holders knowing about it. A follower which doesn't answer stops being waited for once its lease runs out.
+// Followers consider leases expired READ_LEASE_MARGIN before the leader does, we assume messages are not delayed more than that.
+// The leader only grants leases while a quorum of replicas answered grants sent in the last READ_LEASE_DURATION, so a
+// deposed leader stops granting at most READ_LEASE_DURATION after the election, and a new leader waits twice that before
+// making anything visible so that leases granted by the previous one have run out.
+
 
 struct LogsDBLogEntry {
     LogIdx idx;
@@ -69,11 +81,20 @@ struct LogsDBResponse {
 
 std::ostream& operator<<(std::ostream& out, const LogsDBResponse& entry);
 
+struct LogsDBReadLease {
+    LogIdx idx; // reads must reflect at least this index
+    TernTime expiry; // and can only be served before this time, 0 if we hold no lease
+};
+
 struct LogsDBStats {
     std::atomic<Duration> idleTime{0};
     std::atomic<Duration> processingTime{0};
     std::atomic<Duration> leaderLastActive{0};
     std::atomic<double> appendWindow{0};
+    std::atomic<uint64_t> appendWindowLimit{0}; // current adaptive append window
+    std::atomic<uint64_t> appendWindowFull{0}; // appends which left the window full
+    std::atomic<Duration> commitLatency{0}; // time from append to quorum
+    std::atomic<uint64_t> readLeaseHolders{0}; // followers we might have granted a read lease to
     std::atomic<double> entriesReleased{0};
     std::atomic<double> followerLag{0};
     std::atomic<double> readerLag{0};
@@ -94,26 +115,50 @@ class LogsDB {
 public:
     static constexpr size_t REPLICA_COUNT = 5;
     static constexpr Duration PARTITION_TIME_SPAN = 12_hours;
+    // Entries older than this might have already been dropped by the other replicas, so a
+    // replica whose last release is older might not be able to catch up by reading entries.
+    // It needs to start from a snapshot of another replica instead, see SnapshotTransfer.hpp.
+    static constexpr Duration BULK_CATCHUP_AGE = PARTITION_TIME_SPAN;
     static constexpr Duration RESPONSE_TIMEOUT = 10_ms;
     static constexpr Duration READ_TIMEOUT = 1_sec;
     static constexpr Duration SEND_RELEASE_INTERVAL = 300_ms;
     static constexpr Duration LEADER_INACTIVE_TIMEOUT = 1_sec;
+    // Hard cap on entries in flight. Leader recovery reads back this many entries past the last
+    // released one, so replicas need to agree on it and it can't be changed in a rolling fashion.
     static constexpr size_t IN_FLIGHT_APPEND_WINDOW = 1 << 8;
+    // The leader adapts the window it actually uses between MIN_APPEND_WINDOW and
+    // IN_FLIGHT_APPEND_WINDOW, starting from INITIAL_APPEND_WINDOW, see `appendWindow()`.
+    static constexpr size_t MIN_APPEND_WINDOW = 1 << 4;
+    static constexpr size_t INITIAL_APPEND_WINDOW = 1 << 6;
+    // Bytes of entries in flight, counting the copy in every replica request. With
+    // DEFAULT_UDP_ENTRY_SIZE entries this allows ~150 in flight, with jumbo entries MIN_APPEND_WINDOW.
+    static constexpr size_t APPEND_WINDOW_MEMORY_BUDGET = 1 << 20;
+    static constexpr Duration APPEND_WINDOW_ADJUST_INTERVAL = 100_ms;
     static constexpr size_t CATCHUP_WINDOW = 1 << 8 ;
+    static constexpr Duration READ_LEASE_DURATION = 500_ms;
+    static constexpr Duration READ_LEASE_MARGIN = 100_ms;
+    // The leader renews leases at least this often, more often if the release point moves.
+    // Grants which don't get an answer within it are given up on.
+    static constexpr Duration READ_LEASE_RENEW_INTERVAL = 100_ms;
+    // After a follower didn't answer a grant we wait this long before granting it another one,
+    // since until its lease expires every grant holds back what the leader can make visible.
+    static constexpr Duration READ_LEASE_RETRY_INTERVAL = 5_sec;
 
     static constexpr size_t MAX_UDP_ENTRY_SIZE = MAX_UDP_MTU - std::max(LogReqMsg::STATIC_SIZE, LogRespMsg::STATIC_SIZE);
     static constexpr size_t DEFAULT_UDP_ENTRY_SIZE = DEFAULT_UDP_MTU - std::max(LogReqMsg::STATIC_SIZE, LogRespMsg::STATIC_SIZE);
 
     LogsDB() = delete;
 
-    // On start we verify last released data is less than 1.5 * PARTITION_TIME_SPAN old to guarantee we can catchup.
+    // Logs an error on start if the last release is older than BULK_CATCHUP_AGE, as we might not
+    // be able to catch up.
     LogsDB(
         Logger& logger, std::shared_ptr<XmonAgent>& xmon,
         SharedRocksDB& sharedDB,
         ReplicaId replicaId,
         LogIdx lastRead,
         bool noReplication,
-        bool avoidBeingLeader);
+        bool avoidBeingLeader,
+        bool readLeases = false);
 
     ~LogsDB();
 
@@ -128,8 +173,20 @@ public:
 
     TernError appendEntries(std::vector<LogsDBLogEntry>& entries);
 
+    // Maximum number of entries in flight, only meaningful on the leader. Entries past it are
+    // rejected by appendEntries. A new leader starts at INITIAL_APPEND_WINDOW. It doubles while the
+    // window is the bottleneck and replicas keep up, shrinks when commit latency inflates, and is
+    // bounded by APPEND_WINDOW_MEMORY_BUDGET.
+    // It only changes in processIncomingMessages.
+    size_t appendWindow() const;
+
     // returns index of last entry available for read
     LogIdx getLastContinuous() const;
+
+    // With read leases, the lease we currently hold as follower. A read is guaranteed to observe every
+    // write acknowledged before it arrived if it's served before `expiry` from state including
+    // everything up to `idx`.
+    LogsDBReadLease readLease() const;
     void readEntries(std::vector<LogsDBLogEntry>& entries, size_t maxEntries = IN_FLIGHT_APPEND_WINDOW);
 
     // Takes a sorted vector of log inxices and returns the corresponding entries
@@ -145,8 +202,11 @@ public:
 
     static std::vector<rocksdb::ColumnFamilyDescriptor> getColumnFamilyDescriptors();
     static void clearAllData(SharedRocksDB& shardDB);
+    // Time of the last release in an opened (possibly read only) database, 0 if there's none.
+    static TernTime lastReleasedTime(SharedRocksDB& sharedDB);
 private:
     friend class LogsDBTools;
+    friend struct LogsDBTestAccess;
     static void _getUnreleasedLogEntries(Env& env, SharedRocksDB& sharedDB, LogIdx& lastReleasedOut, std::vector<LogIdx>& unreleasedLogEntriesOut);
     static void _getLogEntries(Env& env, SharedRocksDB& sharedDB, LogIdx start, size_t count, std::vector<LogsDBLogEntry>& logEntriesOut);
     LogsDBImpl* _impl;
@@ -3,6 +3,7 @@
 // SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
 
 #include <atomic>
+#include <liburing.h>
 #include <pthread.h>
 #include <signal.h>
 #include <sys/epoll.h>
@@ -99,6 +100,15 @@ int Loop::epollWait(int epfd, struct epoll_event* events, int maxevents, Duratio
     return epoll_pwait(epfd, events, maxevents, static_cast<int>(timeout.ns / 1000000), &blockingSigset);
 }
 
+int Loop::uringWait(struct io_uring* ring, Duration timeout) {
+    struct io_uring_cqe* cqe;
+    struct __kernel_timespec spec = {
+        .tv_sec = timeout.ns / 1'000'000'000ll,
+        .tv_nsec = timeout.ns % 1'000'000'000ll,
+    };
+    return io_uring_wait_cqes(ring, &cqe, 1, timeout < 0 ? nullptr : &spec, &blockingSigset);
+}
+
 void Loop::stop() {
     stopLoop.store(true, std::memory_order_release);
 }
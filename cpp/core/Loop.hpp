@@ -9,6 +9,8 @@
 
 #include "Env.hpp"
 
+struct io_uring;
+
 // Each loop runs with SIGINT/SIGTERM blocked. It's expected that any
 // non-time-bounded syscalls which step runs has SIGINT/SIGTERM unmasked
 // (e.g. using ppoll).
@@ -42,6 +44,9 @@ public:
     // If timeout == 0, returns immediately. If timeout > 0, it'll wait.
     static int poll(struct pollfd* fds, nfds_t nfds, Duration timeout);
     static int epollWait(int epfd, struct epoll_event* events, int maxevents, Duration timeout);
+    // Waits for at least one completion on the ring, same conventions as
+    // `poll` for the timeout. Returns 0, -ETIME or -EINTR like `io_uring_wait_cqes`.
+    static int uringWait(struct io_uring* ring, Duration timeout);
 
     // Sleeps with SIGINT/SIGTERM unmasked.
     static int sleep(Duration d);
@@ -0,0 +1,196 @@
+// Copyright 2025 XTX Markets Technologies Limited
+//
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <ctime>
+#include <vector>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <sched.h>
+#include <linux/futex.h>
+
+#include "Common.hpp"
+#include "Exception.hpp"
+#include "Spin.hpp"
+#include "Time.hpp"
+
+// Same interface as `SPSC`, but any number of threads can push and pull
+// concurrently.
+//
+// Every slot carries a sequence number telling whether it is free for the
+// producer (seq == pos) or filled for the consumer (seq == pos+1) at the
+// current lap. Producers claim a contiguous run of free slots with a single
+// CAS on `_head`, fill them, and then add them to `_size`.
+//
+// `_size` counts the published elements no puller has reserved yet.
+// Pullers first reserve what they take from it, and only then claim as
+// many slots from `_tail`. Since producers only add to `_size` after
+// publishing, the claimed slots are all below `_head`, and will be filled
+// soon if they aren't yet. `_size` never goes below zero, which matters
+// since its highest bit is the closed flag.
+//
+// If `spin` is non-zero, `pull` will spin for up to that long waiting for
+// elements before blocking on the futex, like `SPSC`.
+template<typename A>
+struct MPMC {
+private:
+    struct Slot {
+        std::atomic<uint64_t> seq;
+        A el;
+    };
+
+    uint32_t _maxSize;
+    uint32_t _sizeMask;
+    Duration _spin;
+    SpinCounters _spinCounters;
+    // If the highest bit of size is set, then the queue is closed,
+    // and push/pull will always return zero.
+    alignas(64) std::atomic<uint32_t> _size;
+    alignas(64) std::atomic<uint64_t> _head;
+    alignas(64) std::atomic<uint64_t> _tail;
+    std::unique_ptr<Slot[]> _slots;
+
+    void _wakeAll() {
+        long ret = syscall(SYS_futex, &_size, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+        if (unlikely(ret < 0)) {
+            throw SYSCALL_EXCEPTION("futex");
+        }
+    }
+
+public:
+    MPMC(uint32_t maxSize, Duration spin = 0) :
+        _maxSize(maxSize),
+        _sizeMask(maxSize-1),
+        _spin(spin),
+        _size(0),
+        _head(0),
+        _tail(0),
+        _slots(new Slot[maxSize])
+    {
+        ALWAYS_ASSERT(_maxSize > 0);
+        ALWAYS_ASSERT((_maxSize&_sizeMask) == 0);
+        ALWAYS_ASSERT(_maxSize < (1ull<<31));
+        for (uint64_t i = 0; i < _maxSize; i++) {
+            _slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // This will interrupt pullers.
+    void close() {
+        _size.fetch_or(1ull<<31, std::memory_order_relaxed);
+        _wakeAll();
+    }
+
+    bool isClosed() {
+        return _size.load(std::memory_order_relaxed) & (1ull<<31);
+    }
+
+    // Tries to push all the elements. Returns how many were actually
+    // pushed. First element in `els` gets pushed first, and the pushed
+    // elements are contiguous in the queue. Returns 0 if the queue is
+    // closed.
+    uint32_t push(std::vector<A>& els) {
+        if (unlikely(isClosed())) { return 0; }
+        if (unlikely(els.empty())) { return 0; }
+
+        // claim as many contiguous free slots as possible
+        uint64_t head = _head.load(std::memory_order_relaxed);
+        uint32_t toPush;
+        for (;;) {
+            toPush = 0;
+            while (toPush < els.size()) {
+                uint64_t pos = head + toPush;
+                if (_slots[pos&_sizeMask].seq.load(std::memory_order_acquire) != pos) { break; }
+                toPush++;
+            }
+            if (toPush == 0) {
+                uint64_t newHead = _head.load(std::memory_order_relaxed);
+                if (newHead == head) { return 0; } // full
+                head = newHead;
+                continue;
+            }
+            if (_head.compare_exchange_weak(head, head+toPush, std::memory_order_relaxed)) { break; }
+        }
+
+        // fill and publish them
+        for (uint32_t i = 0; i < toPush; i++) {
+            Slot& slot = _slots[(head+i)&_sizeMask];
+            slot.el = std::move(els[i]);
+            slot.seq.store(head+i+1, std::memory_order_release);
+        }
+
+        // make them available to pullers, and wake them up if necessary
+        uint32_t szBefore = _size.fetch_add(toPush, std::memory_order_relaxed);
+        if (unlikely((szBefore & ~(1u<<31)) == 0)) {
+            _wakeAll();
+        }
+
+        return toPush;
+    }
+
+    // Drains at least one element, blocking if there are no elements,
+    // unless the queue is closed or the operation times out, in which case it'll return 0.
+    // Returns how many we've drained.
+    uint32_t pull(std::vector<A>& els, uint32_t max, Duration timeout = -1) {
+        if (_spin > 0 && timeout != 0 && _size.load(std::memory_order_relaxed) == 0) {
+            Duration spin = timeout > 0 ? std::min(timeout, _spin) : _spin;
+            if (spinUntil(spin, [this]() { return _size.load(std::memory_order_relaxed) != 0; })) {
+                _spinCounters.spun.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                _spinCounters.slept.fetch_add(1, std::memory_order_relaxed);
+                if (timeout > 0) { timeout = timeout - spin; }
+            }
+        }
+        for (;;) {
+            uint32_t sz = _size.load(std::memory_order_relaxed);
+
+            if (unlikely(sz == 0)) { // nothing yet, let's wait
+                timespec spec = timeout.timespec();
+                long ret = syscall(SYS_futex, &_size, FUTEX_WAIT_PRIVATE, 0, timeout < 0 ? nullptr : &spec,  nullptr, 0);
+                if (likely(ret == 0 || errno == EAGAIN)) {
+                    continue; // try again
+                }
+                if (likely(errno == ETIMEDOUT)) {
+                    return 0;
+                }
+                throw SYSCALL_EXCEPTION("futex");
+            } else if (unlikely(sz & (1ull<<31))) { // queue is closed
+                return 0;
+            }
+
+            // reserve what we'll drain, then claim as many slots
+            uint32_t toDrain = std::min(sz, max);
+            if (!_size.compare_exchange_weak(sz, sz - toDrain, std::memory_order_relaxed)) {
+                continue;
+            }
+            uint64_t tail = _tail.fetch_add(toDrain, std::memory_order_relaxed);
+
+            for (uint32_t i = 0; i < toDrain; i++) {
+                Slot& slot = _slots[(tail+i)&_sizeMask];
+                // A producer has claimed the slot but might not have
+                // published it yet, it won't take long.
+                while (slot.seq.load(std::memory_order_acquire) != tail+i+1) {
+                    sched_yield();
+                }
+                els.emplace_back(std::move(slot.el));
+                slot.seq.store(tail+i+_maxSize, std::memory_order_release);
+            }
+            return toDrain;
+        }
+    }
+
+    const SpinCounters& spinCounters() const {
+        return _spinCounters;
+    }
+
+    // don't return misleading numbers for a closed queue
+    uint32_t size() const {
+        return _size.load(std::memory_order_relaxed) & ~(1ull<<31);
+    }
+};
@@ -34,6 +34,14 @@ constexpr uint32_t PROXY_SHARD_REQ_PROTOCOL_VERSION = 0x5414853;
 // '6414853'
 constexpr uint32_t PROXY_SHARD_RESP_PROTOCOL_VERSION = 0x6414853;
 
+// >>> format(struct.unpack('<I', b'SHA\7')[0], 'x')
+// '7414853'
+constexpr uint32_t SHARD_LOG_BATCH_PROTOCOL_VERSION = 0x7414853;
+
+// >>> format(struct.unpack('<I', b'SHA\10')[0], 'x')
+// '8414853'
+constexpr uint32_t SHARD_LOG_COMPRESSED_PROTOCOL_VERSION = 0x8414853;
+
 // >>> format(struct.unpack('<I', b'CDC\0')[0], 'x')
 // '434443'
 constexpr uint32_t CDC_REQ_PROTOCOL_VERSION = 0x434443;
@@ -14,6 +14,7 @@
 
 #include "Common.hpp"
 #include "Exception.hpp"
+#include "Spin.hpp"
 #include "Time.hpp"
 
 // This queue is designed for batching shard writes. The intended
@@ -22,11 +23,16 @@
 //
 // Won't work unless it's a single thread pushing serially and a
 // single thread pulling serially.
+//
+// If `spin` is non-zero, `pull` will spin for up to that long waiting for
+// elements before blocking on the futex.
 template<typename A>
 struct SPSC {
 private:
     uint32_t _maxSize;
     uint32_t _sizeMask;
+    Duration _spin;
+    SpinCounters _spinCounters;
     // If the highest bit of size is set, then the queue is closed,
     // and push/pull will always return zero.
     alignas(64) std::atomic<uint32_t> _size;
@@ -35,9 +41,10 @@ private:
     std::vector<A> _elements;
 
 public:
-    SPSC(uint32_t maxSize) :
+    SPSC(uint32_t maxSize, Duration spin = 0) :
         _maxSize(maxSize),
         _sizeMask(maxSize-1),
+        _spin(spin),
         _head(0),
         _tail(0),
         _elements(maxSize)
@@ -91,6 +98,15 @@ public:
     // unless the queue is closed or the operation times out, in which case it'll return 0.
     // Returns how many we've drained.
     uint32_t pull(std::vector<A>& els, uint32_t max, Duration timeout = -1) {
+        if (_spin > 0 && timeout != 0 && _size.load(std::memory_order_acquire) == 0) {
+            Duration spin = timeout > 0 ? std::min(timeout, _spin) : _spin;
+            if (spinUntil(spin, [this]() { return _size.load(std::memory_order_acquire) != 0; })) {
+                _spinCounters.spun.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                _spinCounters.slept.fetch_add(1, std::memory_order_relaxed);
+                if (timeout > 0) { timeout = timeout - spin; }
+            }
+        }
         for (;;) {
             uint32_t sz = _size.load(std::memory_order_acquire);
 
@@ -118,6 +134,10 @@ public:
         }
     }
 
+    const SpinCounters& spinCounters() const {
+        return _spinCounters;
+    }
+
     // don't return misleading numbers for a closed queue
     uint32_t size() const {
         return _size.load(std::memory_order_relaxed) & ~(1ull<<31);
@@ -8,8 +8,10 @@
 #include <filesystem>
 #include <memory>
 #include <mutex>
+#include <rocksdb/cache.h>
 #include <rocksdb/db.h>
 #include <rocksdb/statistics.h>
+#include <rocksdb/table.h>
 #include <rocksdb/utilities/checkpoint.h>
 #include <shared_mutex>
 #include <string>
@@ -37,12 +39,48 @@ SharedRocksDB::~SharedRocksDB() {
     close();
 }
 
-void SharedRocksDB::open(rocksdb::Options options) {
+void SharedRocksDB::_useBlockCache(rocksdb::ColumnFamilyOptions& options) {
+    rocksdb::BlockBasedTableOptions tableOptions;
+    if (options.table_factory) {
+        const auto* existing = options.table_factory->GetOptions<rocksdb::BlockBasedTableOptions>();
+        if (existing == nullptr) { return; } // not block based, nothing to share
+        tableOptions = *existing;
+    }
+    tableOptions.block_cache = _blockCache;
+    // account index and filters in the budget too, but keep the ones for L0
+    // (which every read goes through) in memory
+    tableOptions.cache_index_and_filter_blocks = true;
+    tableOptions.cache_index_and_filter_blocks_with_high_priority = true;
+    tableOptions.pin_l0_filter_and_index_blocks_in_cache = true;
+    options.table_factory.reset(rocksdb::NewBlockBasedTableFactory(tableOptions));
+}
+
+void SharedRocksDB::_applyMemoryBudget(rocksdb::Options& options, const SharedRocksDBMemoryBudget& memoryBudget) {
+    if (memoryBudget.bytes == 0) { return; }
+    ALWAYS_ASSERT(memoryBudget.writeBufferRatio > 0 && memoryBudget.writeBufferRatio < 1);
+    if (memoryBudget.hyperClockCache) {
+        // the estimated charge is roughly a data block
+        rocksdb::HyperClockCacheOptions cacheOptions(memoryBudget.bytes, 8 << 10);
+        _blockCache = cacheOptions.MakeSharedCache();
+    } else {
+        _blockCache = rocksdb::NewLRUCache(memoryBudget.bytes);
+    }
+    _writeBufferManager = std::make_shared<rocksdb::WriteBufferManager>((size_t)(memoryBudget.bytes*memoryBudget.writeBufferRatio), _blockCache);
+    options.write_buffer_manager = _writeBufferManager;
+    _useBlockCache(options);
+    for (auto& cf : _cfDescriptors) {
+        _useBlockCache(cf.options);
+    }
+    LOG_INFO(_env, "using %s bytes %s block cache, %s of which for memtables", memoryBudget.bytes, memoryBudget.hyperClockCache ? "HyperClock" : "LRU", _writeBufferManager->buffer_size());
+}
+
+void SharedRocksDB::open(rocksdb::Options options, const SharedRocksDBMemoryBudget& memoryBudget) {
     std::unique_lock<std::shared_mutex> _(_stateMutex);
     ALWAYS_ASSERT(_db.get() == nullptr);
     ALWAYS_ASSERT(options.statistics.get() == nullptr);
     _dbStatistics = rocksdb::CreateDBStatistics();
     options.statistics = _dbStatistics;
+    _applyMemoryBudget(options, memoryBudget);
 
 
     std::vector<rocksdb::ColumnFamilyHandle*> cfHandles;
@@ -64,12 +102,13 @@ void SharedRocksDB::open(rocksdb::Options options) {
     _cfDescriptors.clear();
 }
 
-void SharedRocksDB::openTransactionDB(rocksdb::Options options) {
+void SharedRocksDB::openTransactionDB(rocksdb::Options options, const SharedRocksDBMemoryBudget& memoryBudget) {
     std::unique_lock<std::shared_mutex> _(_stateMutex);
     ALWAYS_ASSERT(_db.get() == nullptr);
     ALWAYS_ASSERT(options.statistics.get() == nullptr);
     _dbStatistics = rocksdb::CreateDBStatistics();
     options.statistics = _dbStatistics;
+    _applyMemoryBudget(options, memoryBudget);
 
     std::vector<rocksdb::ColumnFamilyHandle*> cfHandles;
     cfHandles.reserve(_cfDescriptors.size());
@@ -165,8 +204,12 @@ rocksdb::ColumnFamilyHandle* SharedRocksDB::createCF(const rocksdb::ColumnFamily
     if (it != _cfs.end()) {
         return it->second;
     }
+    rocksdb::ColumnFamilyOptions options = descriptor.options;
+    if (_blockCache) {
+        _useBlockCache(options);
+    }
     rocksdb::ColumnFamilyHandle* handle;
-    ROCKS_DB_CHECKED(_db->CreateColumnFamily(descriptor.options, descriptor.name, &handle));
+    ROCKS_DB_CHECKED(_db->CreateColumnFamily(options, descriptor.name, &handle));
     _cfs.emplace(descriptor.name, handle);
     return handle;
 }
@@ -188,6 +231,18 @@ void SharedRocksDB::rocksDBMetrics(std::unordered_map<std::string, uint64_t>& st
     std::shared_lock<std::shared_mutex> _(_stateMutex);
     ALWAYS_ASSERT(_db.get() != nullptr);
     ::rocksDBMetrics(_env, _db.get(), *_dbStatistics, stats);
+    if (_blockCache) {
+        // `::rocksDBMetrics` has already filled these in from the default column
+        // family's properties, but the cache all the column families share is
+        // what we care about
+        stats["block_cache_capacity"] = _blockCache->GetCapacity();
+        stats["block_cache_usage"] = _blockCache->GetUsage();
+        stats["block_cache_pinned_usage"] = _blockCache->GetPinnedUsage();
+    }
+    if (_writeBufferManager) {
+        stats.emplace("write_buffer_manager_buffer_size", _writeBufferManager->buffer_size());
+        stats.emplace("write_buffer_manager_memory_usage", _writeBufferManager->memory_usage());
+    }
 }
 
 void SharedRocksDB::dumpRocksDBStatistics() {
@@ -10,20 +10,37 @@
 #include <unordered_map>
 #include <vector>
 
+#include <rocksdb/cache.h>
 #include <rocksdb/db.h>
 #include <rocksdb/options.h>
+#include <rocksdb/write_buffer_manager.h>
 #include <rocksdb/utilities/optimistic_transaction_db.h>
 
 #include "Env.hpp"
 #include "MsgsGen.hpp"
 
+// How much memory RocksDB can use for caching blocks and memtables, across
+// all the column families of a SharedRocksDB.
+struct SharedRocksDBMemoryBudget {
+    // Size of the block cache shared by all the column families, which the
+    // memtables are charged to as well. Index and filter blocks also live
+    // in it (pinned for L0). 0 keeps the RocksDB defaults: a separate 8MiB
+    // block cache per column family, and no cap on memtables.
+    size_t bytes = 0;
+    // How much of the budget memtables can take before we force flushes.
+    double writeBufferRatio = 0.25;
+    // HyperClockCache rather than LRUCache: no lock on lookups, which matters
+    // with many readers.
+    bool hyperClockCache = false;
+};
+
 class SharedRocksDB {
 public:
     SharedRocksDB(Logger& logger, std::shared_ptr<XmonAgent>& xmon, const std::string& path, const std::string& statisticsPath);
     ~SharedRocksDB();
     void open(rocksdb::Options options, const std::string& path);
-    void openTransactionDB(rocksdb::Options options);
-    void open(rocksdb::Options options);
+    void openTransactionDB(rocksdb::Options options, const SharedRocksDBMemoryBudget& memoryBudget = {});
+    void open(rocksdb::Options options, const SharedRocksDBMemoryBudget& memoryBudget = {});
     void openForReadOnly(rocksdb::Options options);
     void close();
 
@@ -42,12 +59,18 @@ public:
     TernError snapshot(const std::string& path);
 
 private:
+    void _applyMemoryBudget(rocksdb::Options& options, const SharedRocksDBMemoryBudget& memoryBudget);
+    void _useBlockCache(rocksdb::ColumnFamilyOptions& options);
+
     Env _env;
     bool _transactionDB;
     const std::string _path;
     const std::string _statisticsFilePath;
     std::unique_ptr<rocksdb::DB, void(*)(rocksdb::DB*)> _db;
     std::shared_ptr<rocksdb::Statistics> _dbStatistics;
+    // both null unless we've been given a memory budget
+    std::shared_ptr<rocksdb::Cache> _blockCache;
+    std::shared_ptr<rocksdb::WriteBufferManager> _writeBufferManager;
     std::vector<rocksdb::ColumnFamilyDescriptor> _cfDescriptors;
     mutable std::shared_mutex _stateMutex;
     std::unordered_map<std::string, rocksdb::ColumnFamilyHandle*> _cfs;
@@ -0,0 +1,363 @@
+// Copyright 2025 XTX Markets Technologies Limited
+//
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "SnapshotTransfer.hpp"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <filesystem>
+#include <memory>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Assert.hpp"
+#include "Exception.hpp"
+#include "LogsDB.hpp"
+#include "RocksDBUtils.hpp"
+#include "crc32c.h"
+
+namespace fs = std::filesystem;
+
+static constexpr size_t TRANSFER_BUF_SIZE = 1 << 20;
+// A receiver which doesn't take anything for this long is considered gone.
+static constexpr Duration SEND_TIMEOUT = 10_sec;
+
+// Returns 0 or the errno.
+static int writeAll(int fd, const void* buf, size_t len) {
+    const char* p = (const char*)buf;
+    while (len > 0) {
+        ssize_t written = write(fd, p, len);
+        if (written < 0) {
+            if (errno == EINTR) { continue; }
+            return errno;
+        }
+        p += written;
+        len -= written;
+    }
+    return 0;
+}
+
+// Returns 0, the errno (EAGAIN if we hit SO_RCVTIMEO), or -1 on EOF.
+static int readAll(int fd, void* buf, size_t len) {
+    char* p = (char*)buf;
+    while (len > 0) {
+        ssize_t r = read(fd, p, len);
+        if (r < 0) {
+            if (errno == EINTR) { continue; }
+            return errno;
+        }
+        if (r == 0) {
+            return -1;
+        }
+        p += r;
+        len -= r;
+    }
+    return 0;
+}
+
+SnapshotServer::SnapshotServer(
+    Logger& logger,
+    std::shared_ptr<XmonAgent>& xmon,
+    SharedRocksDB& sharedDB,
+    const std::string& tmpDir,
+    const AddrsInfo& addrs,
+    uint16_t port,
+    const std::shared_ptr<std::array<AddrsInfo, LogsDB::REPLICA_COUNT>>& replicas
+) :
+    Loop(logger, xmon, "snapshot_server"),
+    _sharedDB(sharedDB),
+    _tmpDir(tmpDir),
+    _replicas(replicas),
+    _port(port)
+{
+    for (int i = 0; i < 2; i++) {
+        bool hasIp = addrs[i].ip != Ip({0,0,0,0});
+        ALWAYS_ASSERT(i > 0 || hasIp, "The first IP address must be specified");
+        if (!hasIp) { continue; }
+        auto sock = Sock::TCPSock();
+        if (sock.error()) {
+            throw EXPLICIT_SYSCALL_EXCEPTION(sock.getErrno(), "socket");
+        }
+        int one = 1;
+        if (setsockopt(sock.get(), SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0) {
+            throw SYSCALL_EXCEPTION("setsockopt");
+        }
+        IpPort addr = addrs[i];
+        addr.port = _port;
+        sockaddr_in saddr{};
+        addr.toSockAddrIn(saddr);
+        if (bind(sock.get(), (sockaddr*)&saddr, sizeof(saddr)) < 0) {
+            throw SYSCALL_EXCEPTION("bind %s", addr);
+        }
+        socklen_t saddrLen = sizeof(saddr);
+        if (getsockname(sock.get(), (sockaddr*)&saddr, &saddrLen) < 0) {
+            throw SYSCALL_EXCEPTION("getsockname");
+        }
+        // if we were given port 0, listen on the same port on both IPs
+        _port = ntohs(saddr.sin_port);
+        if (listen(sock.get(), 1) < 0) {
+            throw SYSCALL_EXCEPTION("listen");
+        }
+        LOG_INFO(_env, "serving snapshots on %s", IpPort::fromSockAddrIn(saddr));
+        _listenSocks.emplace_back(std::move(sock));
+    }
+}
+
+bool SnapshotServer::_isReplica(const Ip& ip) const {
+    auto replicas = std::atomic_load(&_replicas);
+    if (!replicas) { return false; }
+    for (const auto& replica : *replicas) {
+        for (int i = 0; i < 2; i++) {
+            if (replica[i].port != 0 && replica[i].ip == ip) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void SnapshotServer::step() {
+    std::array<struct pollfd, 2> pfds;
+    for (size_t i = 0; i < _listenSocks.size(); i++) {
+        pfds[i] = {.fd = _listenSocks[i].get(), .events = POLLIN, .revents = 0};
+    }
+    if (Loop::poll(pfds.data(), _listenSocks.size(), -1) < 0) {
+        if (errno == EINTR) { return; }
+        throw SYSCALL_EXCEPTION("poll");
+    }
+    for (size_t i = 0; i < _listenSocks.size(); i++) {
+        if (!(pfds[i].revents & POLLIN)) { continue; }
+        sockaddr_in peer{};
+        socklen_t peerLen = sizeof(peer);
+        int fd = accept4(_listenSocks[i].get(), (sockaddr*)&peer, &peerLen, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) { continue; }
+            throw SYSCALL_EXCEPTION("accept4");
+        }
+        auto peerAddr = IpPort::fromSockAddrIn(peer);
+        if (!_isReplica(peerAddr.ip)) {
+            LOG_ERROR(_env, "dropping snapshot request from %s, which is not a known replica", peerAddr);
+        } else {
+            LOG_INFO(_env, "snapshot requested by %s", peerAddr);
+            _serve(fd);
+        }
+        close(fd);
+    }
+}
+
+void SnapshotServer::_serve(int fd) {
+    {
+        struct timeval tv = {.tv_sec = (time_t)(SEND_TIMEOUT.ns / 1'000'000'000ull), .tv_usec = 0};
+        if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0) {
+            LOG_ERROR(_env, "could not set send timeout: %s", errno);
+            return;
+        }
+    }
+    std::string path = _tmpDir + "/catchup-snapshot-" + std::to_string(ternNow().ns);
+    auto err = _sharedDB.snapshot(path);
+    if (err != TernError::NO_ERROR) {
+        LOG_ERROR(_env, "could not create snapshot to send: %s", err);
+        return;
+    }
+    LOG_INFO(_env, "sending snapshot %s", path);
+    auto t0 = ternNow();
+    uint64_t bytes = 0;
+    int ret = writeAll(fd, &SNAPSHOT_TRANSFER_MAGIC, sizeof(SNAPSHOT_TRANSFER_MAGIC));
+    std::vector<char> buf(TRANSFER_BUF_SIZE);
+    std::error_code ec;
+    for (const auto& file : fs::directory_iterator(path, ec)) {
+        if (ret) { break; }
+        std::string name = file.path().filename().generic_string();
+        int fileFd = open(file.path().c_str(), O_RDONLY);
+        if (fileFd < 0) {
+            ret = errno;
+            LOG_ERROR(_env, "could not open %s: %s", file.path().generic_string(), ret);
+            break;
+        }
+        struct stat st;
+        if (fstat(fileFd, &st) < 0) {
+            ret = errno;
+            close(fileFd);
+            break;
+        }
+        uint16_t nameLen = name.size();
+        uint64_t size = st.st_size;
+        if ((ret = writeAll(fd, &nameLen, sizeof(nameLen))) || (ret = writeAll(fd, name.data(), nameLen)) || (ret = writeAll(fd, &size, sizeof(size)))) {
+            close(fileFd);
+            break;
+        }
+        uint32_t crc = 0;
+        for (uint64_t left = size; left > 0;) {
+            size_t toRead = std::min<uint64_t>(left, buf.size());
+            if ((ret = readAll(fileFd, buf.data(), toRead))) { break; }
+            crc = crc32c(crc, buf.data(), toRead);
+            if ((ret = writeAll(fd, buf.data(), toRead))) { break; }
+            left -= toRead;
+        }
+        close(fileFd);
+        if (ret || (ret = writeAll(fd, &crc, sizeof(crc)))) {
+            break;
+        }
+        bytes += size;
+    }
+    if (ec) {
+        LOG_ERROR(_env, "could not list snapshot %s: %s", path, ec.message());
+    } else if (ret == 0) {
+        uint16_t end = 0;
+        ret = writeAll(fd, &end, sizeof(end));
+    }
+    if (ret != 0) {
+        LOG_ERROR(_env, "sending snapshot %s failed: %s", path, ret);
+    } else {
+        LOG_INFO(_env, "sent snapshot %s, %s bytes in %s", path, bytes, ternNow() - t0);
+    }
+    fs::remove_all(path, ec);
+}
+
+bool needsBulkCatchup(Env& env, const std::string& dbPath) {
+    std::error_code ec;
+    if (!fs::exists(fs::path(dbPath) / "CURRENT", ec)) {
+        LOG_INFO(env, "no database in %s", dbPath);
+        return true;
+    }
+    {
+        // opening read only with column families which aren't there fails, and a
+        // database without LogsDB in it is as good as none
+        std::vector<std::string> cfNames;
+        auto status = rocksdb::DB::ListColumnFamilies(rocksdb::DBOptions(), dbPath, &cfNames);
+        ROCKS_DB_CHECKED(status);
+        for (const auto& cf : LogsDB::getColumnFamilyDescriptors()) {
+            if (std::find(cfNames.begin(), cfNames.end(), cf.name) == cfNames.end()) {
+                LOG_INFO(env, "no column family %s in %s", cf.name, dbPath);
+                return true;
+            }
+        }
+    }
+    TernTime lastReleasedTime;
+    {
+        auto xmon = env.xmon();
+        SharedRocksDB sharedDB(env.logger(), xmon, dbPath, "");
+        // read only, we can just open the column families we need
+        sharedDB.registerCFDescriptors({{rocksdb::kDefaultColumnFamilyName, {}}});
+        sharedDB.registerCFDescriptors(LogsDB::getColumnFamilyDescriptors());
+        sharedDB.openForReadOnly({});
+        lastReleasedTime = LogsDB::lastReleasedTime(sharedDB);
+    }
+    LOG_INFO(env, "last release in %s happened at %s", dbPath, lastReleasedTime);
+    return lastReleasedTime + LogsDB::BULK_CATCHUP_AGE < ternNow();
+}
+
+void fetchSnapshot(Env& env, const std::string& host, uint16_t port, const std::string& dbPath, Duration timeout) {
+    auto [sock, connectErr] = connectToHost(host, port);
+    if (sock.error()) {
+        throw TERN_EXCEPTION("could not connect to snapshot server %s:%s: %s", host, port, connectErr);
+    }
+    int fd = sock.get();
+    {
+        struct timeval tv = {
+            .tv_sec = (time_t)(timeout.ns / 1'000'000'000ull),
+            .tv_usec = (suseconds_t)((timeout.ns % 1'000'000'000ull) / 1'000),
+        };
+        if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+            throw SYSCALL_EXCEPTION("setsockopt");
+        }
+    }
+
+    std::string tmpPath = dbPath + ".catchup";
+    fs::remove_all(tmpPath);
+    fs::create_directory(tmpPath);
+
+    LOG_INFO(env, "fetching snapshot from %s:%s into %s", host, port, tmpPath);
+    auto t0 = ternNow();
+    int ret;
+    const auto readOrThrow = [&](void* buf, size_t len) {
+        if ((ret = readAll(fd, buf, len))) {
+            if (ret < 0) {
+                throw TERN_EXCEPTION("snapshot server %s:%s closed connection", host, port);
+            }
+            if (ret == EAGAIN || ret == EWOULDBLOCK) {
+                throw TERN_EXCEPTION("snapshot server %s:%s sent nothing for %s", host, port, timeout);
+            }
+            throw EXPLICIT_SYSCALL_EXCEPTION(ret, "read");
+        }
+    };
+    uint64_t magic;
+    readOrThrow(&magic, sizeof(magic));
+    if (magic != SNAPSHOT_TRANSFER_MAGIC) {
+        throw TERN_EXCEPTION("bad snapshot magic %s from %s:%s", magic, host, port);
+    }
+    uint64_t bytes = 0;
+    std::vector<char> buf(TRANSFER_BUF_SIZE);
+    for (;;) {
+        uint16_t nameLen;
+        readOrThrow(&nameLen, sizeof(nameLen));
+        if (nameLen == 0) { break; }
+        std::string name(nameLen, '\0');
+        readOrThrow(name.data(), nameLen);
+        if (name == "." || name == ".." || name.find('/') != std::string::npos) {
+            throw TERN_EXCEPTION("bad snapshot file name %s", name);
+        }
+        uint64_t size;
+        readOrThrow(&size, sizeof(size));
+        std::string filePath = tmpPath + "/" + name;
+        int fileFd = open(filePath.c_str(), O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC, 0644);
+        if (fileFd < 0) {
+            throw SYSCALL_EXCEPTION("open %s", filePath);
+        }
+        uint32_t crc = 0;
+        for (uint64_t left = size; left > 0;) {
+            size_t toRead = std::min<uint64_t>(left, buf.size());
+            readOrThrow(buf.data(), toRead);
+            crc = crc32c(crc, buf.data(), toRead);
+            if ((ret = writeAll(fileFd, buf.data(), toRead))) {
+                close(fileFd);
+                throw EXPLICIT_SYSCALL_EXCEPTION(ret, "write %s", filePath);
+            }
+            left -= toRead;
+        }
+        if (fsync(fileFd) < 0) {
+            close(fileFd);
+            throw SYSCALL_EXCEPTION("fsync %s", filePath);
+        }
+        close(fileFd);
+        uint32_t expectedCrc;
+        readOrThrow(&expectedCrc, sizeof(expectedCrc));
+        if (crc != expectedCrc) {
+            throw TERN_EXCEPTION("bad crc for snapshot file %s, expected %s, got %s", name, expectedCrc, crc);
+        }
+        bytes += size;
+    }
+    {
+        int dirFd = open(tmpPath.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (dirFd < 0) {
+            throw SYSCALL_EXCEPTION("open %s", tmpPath);
+        }
+        int fsyncRet = fsync(dirFd);
+        close(dirFd);
+        if (fsyncRet < 0) {
+            throw SYSCALL_EXCEPTION("fsync %s", tmpPath);
+        }
+    }
+    LOG_INFO(env, "fetched snapshot, %s bytes in %s", bytes, ternNow() - t0);
+
+    std::string oldPath;
+    if (fs::exists(dbPath)) {
+        oldPath = dbPath + ".before-catchup-" + std::to_string(ternNow().ns);
+        LOG_INFO(env, "moving previous database %s to %s", dbPath, oldPath);
+        fs::rename(dbPath, oldPath);
+    }
+    try {
+        fs::rename(tmpPath, dbPath);
+    } catch (...) {
+        if (!oldPath.empty()) {
+            LOG_ERROR(env, "could not move snapshot into %s, moving previous database back", dbPath);
+            fs::rename(oldPath, dbPath);
+        }
+        throw;
+    }
+}
@@ -0,0 +1,83 @@
+// Copyright 2025 XTX Markets Technologies Limited
+//
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Connect.hpp"
+#include "LogsDB.hpp"
+#include "Loop.hpp"
+#include "Msgs.hpp"
+#include "SharedRocksDB.hpp"
+
+// Bulk catchup for replicas which are too far behind to catch up by reading
+// LogsDB entries (see `LogsDB::BULK_CATCHUP_AGE`), e.g. because they've been
+// down for a day.
+//
+// A healthy replica runs a `SnapshotServer`, which sends a fresh RocksDB
+// checkpoint to whoever connects. The lagging replica fetches one with
+// `fetchSnapshot` before opening its database, and replaces its own with it.
+// LogsDB lives in the same RocksDB as the state machine, so the checkpoint
+// has the log up to the point it was taken, consistent with what was applied,
+// and from there on LogsDB catches up as usual. How long this takes depends on
+// the size of the database, not on how many entries we missed.
+//
+// The stream is a `SNAPSHOT_TRANSFER_MAGIC`, followed by the files of the
+// checkpoint, each as a u16 name length, the name, a u64 size, the contents
+// and their crc32c as a u32, all little endian. A zero name length ends it.
+
+static constexpr uint64_t SNAPSHOT_TRANSFER_MAGIC = 0x0150414e53524554ull; // "TERSNAP", version 1
+
+// Serves one connection at a time: snapshots are big and rarely needed, and we
+// don't want a few lagging replicas to take down the disk of a healthy one.
+//
+// The checkpoint has everything, shard secret included, so we only listen on
+// the IPs in `addrs` (the ones the replica serves requests on), and only talk
+// to peers whose IP is one of `replicas`, as last fetched from the registry.
+// Anybody else is hung up on before we take a checkpoint.
+struct SnapshotServer : Loop {
+    // Checkpoints are created in `tmpDir`, which needs to be on the same
+    // filesystem as the database so that SST files get hard linked. If `port`
+    // is 0, a free one is picked, see `port()`.
+    SnapshotServer(
+        Logger& logger,
+        std::shared_ptr<XmonAgent>& xmon,
+        SharedRocksDB& sharedDB,
+        const std::string& tmpDir,
+        const AddrsInfo& addrs,
+        uint16_t port,
+        const std::shared_ptr<std::array<AddrsInfo, LogsDB::REPLICA_COUNT>>& replicas
+    );
+
+    virtual void step() override;
+
+    uint16_t port() const { return _port; }
+
+private:
+    SharedRocksDB& _sharedDB;
+    const std::string _tmpDir;
+    // Updated with `std::atomic_exchange` by the registerer.
+    const std::shared_ptr<std::array<AddrsInfo, LogsDB::REPLICA_COUNT>>& _replicas;
+    std::vector<Sock> _listenSocks;
+    uint16_t _port;
+
+    bool _isReplica(const Ip& ip) const;
+    void _serve(int fd);
+};
+
+// Whether the database at `dbPath` has a LogsDB too far behind to catch up by
+// reading entries, or no database at all, or one without LogsDB.
+bool needsBulkCatchup(Env& env, const std::string& dbPath);
+
+// Replaces the database at `dbPath` with a checkpoint fetched from the
+// `SnapshotServer` at host:port. The previous database, if any, is moved
+// aside rather than deleted. Throws if anything goes wrong, including the
+// server not sending anything for `timeout`, in which case `dbPath` is left
+// as it was. The server only starts sending once it has taken a checkpoint,
+// and serves one replica at a time, so the default is generous.
+void fetchSnapshot(Env& env, const std::string& host, uint16_t port, const std::string& dbPath, Duration timeout = 2_mins);
@@ -0,0 +1,34 @@
+// Copyright 2025 XTX Markets Technologies Limited
+//
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#include "Time.hpp"
+
+// Some waits (`SPSC::pull`, `UDPReceiver::receiveMessages`) can be configured
+// to spin for a bit before blocking, trading CPU for wakeup latency. These
+// count how often the spinning paid off, so that we can tell whether it's
+// worth it.
+struct SpinCounters {
+    std::atomic<uint64_t> spun;  // we got something while spinning
+    std::atomic<uint64_t> slept; // we gave up spinning and blocked
+
+    SpinCounters() : spun(0), slept(0) {}
+};
+
+// Calls `ready` in a loop until it returns true or `spin` has elapsed.
+// Returns whatever `ready` last returned.
+template<typename F>
+static inline bool spinUntil(Duration spin, F ready) {
+    TernTime deadline = ternNow() + spin;
+    for (uint64_t i = 1;; i++) {
+        if (ready()) { return true; }
+        // don't hammer the clock
+        if ((i & 63) == 0 && ternNow() >= deadline) { return false; }
+        __builtin_ia32_pause();
+    }
+}
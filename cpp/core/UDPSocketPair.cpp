@@ -9,24 +9,30 @@
 #include <arpa/inet.h>
 #include <cstddef>
 
-UDPSocketPair::UDPSocketPair(Env& env, const AddrsInfo& addr_, int32_t sockBufSize) : _addr(addr_) {
+UDPSocketPair::UDPSocketPair(Env& env, const AddrsInfo& addr_, const UDPSocketConfig& config) : _addr(addr_) {
     sockaddr_in saddr;
     for (int i = 0; i < 2; i++) {
         bool hasIp = _addr[i].ip != Ip({0,0,0,0});
         ALWAYS_ASSERT(i > 0 || hasIp, "The first IP address must be specified");
         if (!hasIp) { continue; }
         _addr[i].toSockAddrIn(saddr);
-        _initSock(i, saddr, sockBufSize);
+        _initSock(i, saddr, config);
         _addr[i].port = ntohs(saddr.sin_port);
     }
     LOG_INFO(env, "Bound to addresses %s", _addr);
 }
 
-void UDPSocketPair::_initSock(uint8_t sockIdx, sockaddr_in& addr, int32_t sockBufSize) {
+void UDPSocketPair::_initSock(uint8_t sockIdx, sockaddr_in& addr, const UDPSocketConfig& config) {
     auto sock = Sock::UDPSock();
     if (sock.error()) {
         throw SYSCALL_EXCEPTION("cannot create socket");
     }
+    if (config.reusePort) {
+        int one = 1;
+        if (setsockopt(sock.get(), SOL_SOCKET, SO_REUSEPORT, (void*)&one, sizeof(one)) < 0) {
+            throw SYSCALL_EXCEPTION("setsockopt");
+        }
+    }
 
     if (bind(sock.get(), (sockaddr*)&addr, sizeof(addr)) != 0) {
         char ip[INET_ADDRSTRLEN];
@@ -39,7 +45,18 @@ void UDPSocketPair::_initSock(uint8_t sockIdx, sockaddr_in& addr, int32_t sockBu
         }
     }
     {
-        if (setsockopt(sock.get(), SOL_SOCKET, SO_RCVBUF, (void*)&sockBufSize, sizeof(sockBufSize)) < 0) {
+        if (setsockopt(sock.get(), SOL_SOCKET, SO_RCVBUF, (void*)&config.sockBufSize, sizeof(config.sockBufSize)) < 0) {
+            throw SYSCALL_EXCEPTION("setsockopt");
+        }
+    }
+    if (config.busyPollUs > 0) {
+        if (setsockopt(sock.get(), SOL_SOCKET, SO_BUSY_POLL, (void*)&config.busyPollUs, sizeof(config.busyPollUs)) < 0) {
+            throw SYSCALL_EXCEPTION("setsockopt");
+        }
+    }
+    if (config.gro) {
+        int one = 1;
+        if (setsockopt(sock.get(), SOL_UDP, UDP_GRO, (void*)&one, sizeof(one)) < 0) {
             throw SYSCALL_EXCEPTION("setsockopt");
         }
     }
@@ -48,27 +65,51 @@ void UDPSocketPair::_initSock(uint8_t sockIdx, sockaddr_in& addr, int32_t sockBu
 
 
 void UDPSender::sendMessages(Env& env, const UDPSocketPair& socks) {
+    if (_uring) {
+        // we're done with the previous batch once it's out
+        _uring->reap(env);
+    }
+    // we hand out pointers into this, so it must not be resized while we're preparing
+    _sendCmsgs.reserve(_sendAddrs[0].size() + _sendAddrs[1].size());
     for (size_t i = 0; i < _sendAddrs.size(); ++i) {
         if (_sendAddrs[i].size() == 0) { continue; }
         LOG_TRACE(env, "sending %s messages to socket (%s)[%s]", _sendAddrs[i].size(), socks.addr(), i);
         for (size_t j = 0; j < _sendAddrs[i].size(); ++j) {
             auto& vec = _sendVecs[i][j];
             vec.iov_base = &_sendBuf[(size_t)vec.iov_base];
-            auto& hdr = _sendHdrs[i].emplace_back();
             ALWAYS_ASSERT(_sendAddrs[i][j].sin_port != 0);
-            hdr.msg_hdr = {
-                .msg_name = (sockaddr_in*)&_sendAddrs[i][j],
-                .msg_namelen = sizeof(_sendAddrs[i][j]),
-                .msg_iov = &vec,
-                .msg_iovlen = 1,
-            };
-            hdr.msg_len = vec.iov_len;
+        }
+        if (_gso) {
+            _prepareSegmentedHdrs(i);
+        } else {
+            _prepareHdrs(i, 0);
+        }
+        if (_uring) {
+            _uring->submit(socks.socks()[i].get(), _sendHdrs[i]);
+            continue;
         }
         size_t sentMessages{0};
         int ret{1};
-        while (sentMessages < _sendHdrs[i].size() && ret > 0) {
-            ret = sendmmsg(socks.socks()[i].get(), &_sendHdrs[i][sentMessages], _sendHdrs[i].size() - sentMessages, 0);
-            sentMessages += ret;
+        const auto send = [&]() {
+            while (sentMessages < _sendHdrs[i].size() && ret > 0) {
+                ret = sendmmsg(socks.socks()[i].get(), &_sendHdrs[i][sentMessages], _sendHdrs[i].size() - sentMessages, 0);
+                sentMessages += ret;
+            }
+        };
+        send();
+        if (unlikely(_gso && ret < 0 && errno == EINVAL)) {
+            // The kernel refused a segmented send, most likely because the path MTU is
+            // smaller than we thought. Send what's left one message at a time.
+            size_t firstUnsent = 0;
+            for (size_t j = 0; j < sentMessages; ++j) {
+                firstUnsent += _sendHdrs[i][j].msg_hdr.msg_iovlen;
+            }
+            LOG_INFO(env, "segmented send to socket (%s)[%s] failed with EINVAL, resending %s messages without segmentation", socks.addr(), i, _sendAddrs[i].size() - firstUnsent);
+            _sendHdrs[i].clear();
+            _prepareHdrs(i, firstUnsent);
+            sentMessages = 0;
+            ret = 1;
+            send();
         }
         if (unlikely(ret < 0)) {
             switch (errno) {
@@ -86,7 +127,17 @@ void UDPSender::sendMessages(Env& env, const UDPSocketPair& socks) {
         }
     }
 
+    if (_uring) {
+        // keep what we've just submitted around until it's reaped, and reuse
+        // the buffers of the previous batch, which has been reaped already
+        std::swap(_sendCmsgs, _submittedCmsgs);
+        std::swap(_sendBuf, _submittedBuf);
+        std::swap(_sendAddrs, _submittedAddrs);
+        std::swap(_sendHdrs, _submittedHdrs);
+        std::swap(_sendVecs, _submittedVecs);
+    }
     _sendBuf.clear();
+    _sendCmsgs.clear();
     for(size_t i = 0; i < _sendHdrs.size(); ++i) {
         _sendAddrs[i].clear();
         _sendHdrs[i].clear();
@@ -94,6 +145,58 @@ void UDPSender::sendMessages(Env& env, const UDPSocketPair& socks) {
     }
 }
 
+void UDPSender::_prepareHdrs(size_t sockIdx, size_t from) {
+    for (size_t j = from; j < _sendAddrs[sockIdx].size(); ++j) {
+        auto& hdr = _sendHdrs[sockIdx].emplace_back();
+        hdr.msg_hdr = {
+            .msg_name = (sockaddr_in*)&_sendAddrs[sockIdx][j],
+            .msg_namelen = sizeof(_sendAddrs[sockIdx][j]),
+            .msg_iov = &_sendVecs[sockIdx][j],
+            .msg_iovlen = 1,
+        };
+        hdr.msg_len = _sendVecs[sockIdx][j].iov_len;
+    }
+}
+
+void UDPSender::_prepareSegmentedHdrs(size_t sockIdx) {
+    const auto& addrs = _sendAddrs[sockIdx];
+    auto& vecs = _sendVecs[sockIdx];
+    for (size_t j = 0; j < addrs.size();) {
+        // Coalesce the run of messages to the same peer starting at `j`. The
+        // kernel will cut it up in `segmentSize` datagrams, so all but the
+        // last need to be exactly that big.
+        size_t segmentSize = vecs[j].iov_len;
+        size_t totalSize = segmentSize;
+        size_t k = j+1;
+        for (; segmentSize <= UDP_MAX_GSO_SEGMENT_SIZE && k < addrs.size() && k-j < UDP_MAX_GSO_SEGMENTS; k++) {
+            if (vecs[k-1].iov_len != segmentSize || vecs[k].iov_len > segmentSize) { break; }
+            if (totalSize + vecs[k].iov_len > UDP_MAX_COALESCED_SIZE) { break; }
+            if (addrs[k].sin_addr.s_addr != addrs[j].sin_addr.s_addr || addrs[k].sin_port != addrs[j].sin_port) { break; }
+            totalSize += vecs[k].iov_len;
+        }
+        auto& hdr = _sendHdrs[sockIdx].emplace_back();
+        hdr.msg_hdr = {
+            .msg_name = (sockaddr_in*)&addrs[j],
+            .msg_namelen = sizeof(addrs[j]),
+            .msg_iov = &vecs[j],
+            .msg_iovlen = k-j,
+        };
+        hdr.msg_len = totalSize;
+        if (k-j > 1) {
+            auto& cmsgBuf = _sendCmsgs.emplace_back();
+            hdr.msg_hdr.msg_control = cmsgBuf.buf;
+            hdr.msg_hdr.msg_controllen = sizeof(cmsgBuf.buf);
+            cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr.msg_hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t gsoSize = segmentSize;
+            memcpy(CMSG_DATA(cmsg), &gsoSize, sizeof(gsoSize));
+        }
+        j = k;
+    }
+}
+
 int UDPSocketPair::registerEpoll(int epollFd) {
     for (auto& sock : _socks) {
         if (sock.error()) continue;
@@ -7,7 +7,9 @@
 #include <array>
 #include <cstdint>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <poll.h>
+#include <sys/epoll.h>
 #include <vector>
 
 #include "Bincode.hpp"
@@ -15,9 +17,40 @@
 #include "Env.hpp"
 #include "Msgs.hpp"
 #include "Loop.hpp"
+#include "Spin.hpp"
+#include "UDPUring.hpp"
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+// Largest datagram the kernel will hand us with GRO, or accept from us with GSO.
+constexpr size_t UDP_MAX_COALESCED_SIZE = 65507; // 65535 - IP header - UDP header
+// Most segments the kernel will accept in a single GSO send.
+constexpr size_t UDP_MAX_GSO_SEGMENTS = 64;
+// Biggest segment we coalesce. The kernel refuses GSO sends with segments
+// which don't fit the path MTU, which we assume to be 1500.
+constexpr size_t UDP_MAX_GSO_SEGMENT_SIZE = DEFAULT_UDP_MTU;
+
+struct UDPSocketConfig {
+    int32_t sockBufSize = 1 << 20;
+    // Bind with SO_REUSEPORT, so that several pairs can be bound to the same
+    // addresses and the kernel will spread incoming packets across them.
+    bool reusePort = false;
+    // If non-zero, set SO_BUSY_POLL, so that non-blocking reads busy poll the
+    // device queue for up to that many microseconds.
+    uint32_t busyPollUs = 0;
+    // Set UDP_GRO, so that the kernel may coalesce datagrams from the same
+    // peer. Only use with a `UDPReceiver` configured with `gro`, which will
+    // split them back.
+    bool gro = false;
+};
 
 struct UDPSocketPair {
-    UDPSocketPair(Env& env, const AddrsInfo& addr, int32_t sockBufSize = 1 << 20);
+    UDPSocketPair(Env& env, const AddrsInfo& addr, const UDPSocketConfig& config = UDPSocketConfig());
     UDPSocketPair(const UDPSocketPair&) = delete;
     UDPSocketPair(UDPSocketPair&& s) : _addr(s._addr), _socks(std::move(s._socks)) {}
 
@@ -39,7 +72,7 @@ struct UDPSocketPair {
     }
 
 private:
-    void _initSock(uint8_t sockIdx, sockaddr_in& addr, int32_t sockBufSize);
+    void _initSock(uint8_t sockIdx, sockaddr_in& addr, const UDPSocketConfig& config);
     AddrsInfo _addr;
     std::array<Sock, 2> _socks;
 };
@@ -53,24 +86,45 @@ struct UDPMessage {
 struct UDPReceiverConfig {
     size_t perSockMaxRecvMsg = 127;
     size_t maxMsgSize = DEFAULT_UDP_MTU;
+    // If non-zero, spin polling the sockets for up to this long before
+    // blocking in poll.
+    Duration spin = 0;
+    // Where to record how the spinning went, if anywhere.
+    SpinCounters* spinCounters = nullptr;
+    // Receive through io_uring (see `UringUDPReceiver`) rather than with
+    // poll + recvmmsg.
+    bool ioUring = false;
+    // The sockets have UDP_GRO set (see `UDPSocketConfig`). Every receive
+    // slot will be big enough to hold coalesced datagrams, which are split
+    // back into separate messages.
+    bool gro = false;
 };
 
 // Receives UDP messages from a set of UDP sockets.
 template<size_t N>
 struct UDPReceiver {
-    UDPReceiver(const UDPReceiverConfig& config) : _perSockMaxRecvMsg(config.perSockMaxRecvMsg) {
-        _recvBuf.resize(2*N * config.maxMsgSize * config.perSockMaxRecvMsg);
+    UDPReceiver(const UDPReceiverConfig& config) : _perSockMaxRecvMsg(config.perSockMaxRecvMsg), _maxMsgSize(config.maxMsgSize), _spin(config.spin), _spinCounters(config.spinCounters), _ioUring(config.ioUring), _gro(config.gro) {
+        ALWAYS_ASSERT(!(_ioUring && _gro), "GRO is not supported with io_uring");
+        if (_ioUring) { return; } // the ring owns the buffers
+        size_t slotSize = _gro ? UDP_MAX_COALESCED_SIZE : config.maxMsgSize;
+        _recvBuf.resize(2*N * slotSize * config.perSockMaxRecvMsg);
         _recvHdrs.resize(2*N * config.perSockMaxRecvMsg);
         memset(_recvHdrs.data(), 0, sizeof(_recvHdrs[0]) * 2*N * config.perSockMaxRecvMsg);
         _recvAddrs.resize(2*N * config.perSockMaxRecvMsg);
         _recvVecs.resize(2*N * config.perSockMaxRecvMsg);
+        if (_gro) {
+            _recvCmsgs.resize(2*N * config.perSockMaxRecvMsg);
+        }
         for (int i = 0; i < _recvVecs.size(); ++i) {
-            _recvVecs[i].iov_base = &_recvBuf[i * config.maxMsgSize];
-            _recvVecs[i].iov_len = config.maxMsgSize;
+            _recvVecs[i].iov_base = &_recvBuf[i * slotSize];
+            _recvVecs[i].iov_len = slotSize;
             _recvHdrs[i].msg_hdr.msg_iov = &_recvVecs[i];
             _recvHdrs[i].msg_hdr.msg_iovlen = 1;
             _recvHdrs[i].msg_hdr.msg_namelen = sizeof(_recvAddrs[i]);
             _recvHdrs[i].msg_hdr.msg_name = &_recvAddrs[i];
+            if (_gro) {
+                _recvHdrs[i].msg_hdr.msg_control = _recvCmsgs[i].buf;
+            }
         }
     }
 
@@ -91,6 +145,9 @@ struct UDPReceiver {
         if (maxMsgCount < 0) {
             maxMsgCount = N*2 * _perSockMaxRecvMsg;
         }
+        if (_ioUring) {
+            return _receiveMessagesUring(env, socks, maxMsgCount, noPoll ? 0 : timeout);
+        }
         // fill in FDs
         std::array<pollfd, N*2> fds;
         std::array<std::pair<uint8_t, uint8_t>, N*2> fdToSockIx;
@@ -105,8 +162,22 @@ struct UDPReceiver {
             }
         }
         if (!noPoll) {
+            int err = 0;
+            if (_spin > 0 && timeout != 0) {
+                Duration spin = timeout > 0 ? std::min(timeout, _spin) : _spin;
+                bool spun = spinUntil(spin, [&fds, numFds, &err]() {
+                    err = Loop::poll(fds.data(), numFds, 0);
+                    return err != 0;
+                });
+                if (_spinCounters != nullptr) {
+                    (spun ? _spinCounters->spun : _spinCounters->slept).fetch_add(1, std::memory_order_relaxed);
+                }
+                if (!spun && timeout > 0) { timeout = timeout - spin; }
+            }
             // poll
-            int err = Loop::poll(fds.data(), numFds, timeout);
+            if (err == 0) {
+                err = Loop::poll(fds.data(), numFds, timeout);
+            }
             if (unlikely( err < 0)) {
                 if (errno == EINTR) { return false; }
                 throw SYSCALL_EXCEPTION("poll");
@@ -121,6 +192,12 @@ struct UDPReceiver {
             const auto [sockIx1, sockIx2] = fdToSockIx[i];
             size_t maxMsgs = std::min(maxMsgCount-messagesSoFar, _perSockMaxRecvMsg);
             LOG_TRACE(env, "data on address %s, reading up to %s messages", socks[sockIx1].addr()[sockIx2], maxMsgs);
+            if (_gro) {
+                // the kernel overwrites this with how much it actually used
+                for (size_t j = messagesSoFar; j < messagesSoFar+maxMsgs; j++) {
+                    _recvHdrs[j].msg_hdr.msg_controllen = sizeof(_recvCmsgs[j].buf);
+                }
+            }
             int ret = recvmmsg(pfd.fd, &_recvHdrs[messagesSoFar], maxMsgs, MSG_DONTWAIT, nullptr);
             if (unlikely(ret < 0)) { 
                 if (noPoll) {
@@ -131,11 +208,21 @@ struct UDPReceiver {
             }
             for (int j = 0; j < ret; j++) {
                 const auto& hdr = _recvHdrs[messagesSoFar+j];
-                _recvMsgs[sockIx1].emplace_back(UDPMessage{
-                    .buf = {(char*)hdr.msg_hdr.msg_iov[0].iov_base, hdr.msg_len},
-                    .clientAddr = IpPort::fromSockAddrIn(_recvAddrs[messagesSoFar+j]),
-                    .socketIx = sockIx2,
-                });
+                char* data = (char*)hdr.msg_hdr.msg_iov[0].iov_base;
+                size_t len = hdr.msg_len;
+                size_t segmentSize = _gro ? _groSegmentSize(hdr.msg_hdr) : 0;
+                if (segmentSize == 0) { segmentSize = len; }
+                // a coalesced datagram is a run of segmentSize messages, with
+                // the last one possibly shorter.
+                size_t offset = 0;
+                do {
+                    _recvMsgs[sockIx1].emplace_back(UDPMessage{
+                        .buf = {data + offset, std::min(segmentSize, len - offset)},
+                        .clientAddr = IpPort::fromSockAddrIn(_recvAddrs[messagesSoFar+j]),
+                        .socketIx = sockIx2,
+                    });
+                    offset += segmentSize;
+                } while (offset < len);
             }
             messagesSoFar += ret;
             if (messagesSoFar >= maxMsgCount) {
@@ -148,8 +235,91 @@ struct UDPReceiver {
     std::array<std::vector<UDPMessage>, N>& messages() {
         return _recvMsgs;
     }
+
+    // Registers with epoll whatever will be readable when there are
+    // messages to receive: the sockets themselves, or the io_uring.
+    int registerEpoll(int epollFd, std::array<UDPSocketPair, N>& socks) {
+        if (_ioUring) {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = _uring(socks).fd();
+            return epoll_ctl(epollFd, EPOLL_CTL_ADD, event.data.fd, &event);
+        }
+        for (auto& sock : socks) {
+            int err = sock.registerEpoll(epollFd);
+            if (err) { return err; }
+        }
+        return 0;
+    }
+
+    // Whether an epoll event on `fd` means we have messages to receive.
+    bool isEpollFd(int fd, const std::array<UDPSocketPair, N>& socks) const {
+        if (_ioUring) {
+            return _uringReceiver != nullptr && _uringReceiver->fd() == fd;
+        }
+        for (const auto& sock : socks) {
+            if (sock.containsFd(fd)) { return true; }
+        }
+        return false;
+    }
+
 private:
+    UringUDPReceiver& _uring(const std::array<UDPSocketPair, N>& socks) {
+        if (unlikely(_uringReceiver == nullptr)) {
+            std::vector<UringUDPSocket> uringSocks;
+            for (int sockIx1 = 0; sockIx1 < N; sockIx1++) {
+                for (int sockIx2 = 0; sockIx2 < 2; sockIx2++) {
+                    if (socks[sockIx1].addr()[sockIx2].port == 0) { continue; }
+                    uringSocks.emplace_back(UringUDPSocket{
+                        .fd = socks[sockIx1].socks()[sockIx2].get(),
+                        .sockIx1 = (uint8_t)sockIx1,
+                        .sockIx2 = (uint8_t)sockIx2,
+                    });
+                }
+            }
+            _uringReceiver = std::make_unique<UringUDPReceiver>(uringSocks, _maxMsgSize, N*2 * _perSockMaxRecvMsg, _spin, _spinCounters);
+        }
+        return *_uringReceiver;
+    }
+
+    bool _receiveMessagesUring(Env& env, const std::array<UDPSocketPair, N>& socks, size_t maxMsgCount, Duration timeout) {
+        if (unlikely(!_uring(socks).receive(env, _uringMsgs, maxMsgCount, timeout))) {
+            return false;
+        }
+        for (const auto& msg : _uringMsgs) {
+            _recvMsgs[msg.sockIx1].emplace_back(UDPMessage{
+                .buf = {msg.data, msg.len},
+                .clientAddr = IpPort::fromSockAddrIn(msg.clientAddr),
+                .socketIx = msg.sockIx2,
+            });
+        }
+        return true;
+    }
+
+    static size_t _groSegmentSize(const msghdr& hdr) {
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR((msghdr*)&hdr, cmsg)) {
+            if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                int segmentSize;
+                memcpy(&segmentSize, CMSG_DATA(cmsg), sizeof(segmentSize));
+                return segmentSize;
+            }
+        }
+        return 0;
+    }
+
+    struct GROCmsg {
+        alignas(cmsghdr) char buf[CMSG_SPACE(sizeof(int))];
+    };
+
     size_t _perSockMaxRecvMsg;
+    size_t _maxMsgSize;
+    Duration _spin;
+    SpinCounters* _spinCounters;
+    bool _ioUring;
+    bool _gro;
+    std::vector<GROCmsg> _recvCmsgs;
+    std::unique_ptr<UringUDPReceiver> _uringReceiver;
+    std::vector<UringUDPMessage> _uringMsgs;
     std::vector<char> _recvBuf;
     std::vector<mmsghdr> _recvHdrs;
     std::vector<sockaddr_in> _recvAddrs;
@@ -159,11 +329,20 @@ private:
 
 struct UDPSenderConfig {
     uint16_t maxMsgSize = DEFAULT_UDP_MTU;
+    // Send through io_uring (see `UringUDPSender`) rather than with sendmmsg.
+    bool ioUring = false;
+    // Coalesce consecutive messages to the same peer into a single UDP_SEGMENT
+    // (GSO) send, which the kernel or the NIC will split up again.
+    bool gso = false;
 };
 
 class UDPSender {
 public:
-    UDPSender(const UDPSenderConfig& config) : _maxMsgSize(config.maxMsgSize) {}
+    UDPSender(const UDPSenderConfig& config) : _maxMsgSize(config.maxMsgSize), _gso(config.gso) {
+        if (config.ioUring) {
+            _uring = std::make_unique<UringUDPSender>();
+        }
+    }
     UDPSender() : UDPSender(UDPSenderConfig()) {}
 
     template<typename Fill>
@@ -197,11 +376,32 @@ public:
 
     void sendMessages(Env& env, const UDPSocketPair& socks);
 private:
+    void _prepareSegmentedHdrs(size_t sockIdx);
+    // one header per message, starting from the `from`th
+    void _prepareHdrs(size_t sockIdx, size_t from);
+
+    struct GSOCmsg {
+        alignas(cmsghdr) char buf[CMSG_SPACE(sizeof(uint16_t))];
+    };
+
     uint16_t _maxMsgSize;
+    bool _gso;
+    std::vector<GSOCmsg> _sendCmsgs;
 
     // send buffers
     std::vector<char> _sendBuf;
     std::array<std::vector<sockaddr_in>, 2> _sendAddrs;
     std::array<std::vector<mmsghdr>, 2> _sendHdrs;
     std::array<std::vector<iovec>, 2> _sendVecs;
+
+    // With io_uring the previous batch might still be in flight, its buffers
+    // are swapped in here until the next `sendMessages` reaps it.
+    std::vector<GSOCmsg> _submittedCmsgs;
+    std::vector<char> _submittedBuf;
+    std::array<std::vector<sockaddr_in>, 2> _submittedAddrs;
+    std::array<std::vector<mmsghdr>, 2> _submittedHdrs;
+    std::array<std::vector<iovec>, 2> _submittedVecs;
+
+    // last, so that it waits for sends in flight before the buffers go away
+    std::unique_ptr<UringUDPSender> _uring;
 };
@@ -0,0 +1,297 @@
+// Copyright 2025 XTX Markets Technologies Limited
+//
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#include "UDPUring.hpp"
+
+#include <cstring>
+#include <liburing.h>
+#include <sys/mman.h>
+
+#include "Assert.hpp"
+#include "Exception.hpp"
+#include "Loop.hpp"
+
+static constexpr uint16_t RECV_BUF_GROUP = 0;
+static constexpr uint32_t MAX_RECV_BUFS = 1 << 15; // kernel limit for provided buffer rings
+static constexpr unsigned SEND_RING_ENTRIES = 256;
+
+static uint32_t nextPowerOfTwo(uint32_t x) {
+    uint32_t p = 1;
+    while (p < x) { p <<= 1; }
+    return p;
+}
+
+UringUDPReceiver::UringUDPReceiver(const std::vector<UringUDPSocket>& socks, size_t maxMsgSize, size_t maxMsgCount, Duration spin, SpinCounters* spinCounters) :
+    _socks(socks),
+    _armed(socks.size(), false),
+    _ring(std::make_unique<io_uring>()),
+    _bufRing(nullptr),
+    // Enough so that the buffers we hand out in one `receive` never starve
+    // the sockets while we're processing them.
+    _numBufs(std::min<uint32_t>(nextPowerOfTwo(std::max<size_t>(2*maxMsgCount, 64)), MAX_RECV_BUFS)),
+    _bufSize(sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_in) + maxMsgSize),
+    _spin(spin),
+    _spinCounters(spinCounters)
+{
+    ALWAYS_ASSERT(!_socks.empty());
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = 2*_numBufs;
+    int ret = io_uring_queue_init_params(nextPowerOfTwo(_socks.size()), _ring.get(), &params);
+    if (ret < 0) {
+        throw EXPLICIT_SYSCALL_EXCEPTION(-ret, "io_uring_queue_init_params");
+    }
+
+    // the buffer ring needs to be page aligned
+    size_t bufRingSize = _numBufs * sizeof(io_uring_buf);
+    void* bufRing = mmap(nullptr, bufRingSize, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+    if (bufRing == MAP_FAILED) {
+        throw SYSCALL_EXCEPTION("mmap");
+    }
+    _bufRing = (io_uring_buf_ring*)bufRing;
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)_bufRing;
+    reg.ring_entries = _numBufs;
+    reg.bgid = RECV_BUF_GROUP;
+    ret = io_uring_register_buf_ring(_ring.get(), &reg, 0);
+    if (ret < 0) {
+        throw EXPLICIT_SYSCALL_EXCEPTION(-ret, "io_uring_register_buf_ring");
+    }
+    io_uring_buf_ring_init(_bufRing);
+    _bufs.resize(_numBufs * _bufSize);
+    for (uint32_t i = 0; i < _numBufs; i++) {
+        _usedBufs.emplace_back(i);
+    }
+    _recycleBuffers();
+
+    memset(&_msgHdr, 0, sizeof(_msgHdr));
+    _msgHdr.msg_namelen = sizeof(sockaddr_in);
+
+    // Arm right away rather than at the first `receive`: when the ring fd is
+    // used with epoll nothing would ever show up otherwise, and we'd never
+    // get to the first `receive`.
+    _arm();
+}
+
+UringUDPReceiver::~UringUDPReceiver() {
+    io_uring_queue_exit(_ring.get());
+    if (_bufRing != nullptr) {
+        munmap(_bufRing, _numBufs * sizeof(io_uring_buf));
+    }
+}
+
+int UringUDPReceiver::fd() const {
+    return _ring->ring_fd;
+}
+
+void UringUDPReceiver::_recycleBuffers() {
+    int mask = io_uring_buf_ring_mask(_numBufs);
+    for (size_t i = 0; i < _usedBufs.size(); i++) {
+        uint16_t bid = _usedBufs[i];
+        io_uring_buf_ring_add(_bufRing, &_bufs[bid*_bufSize], _bufSize, bid, mask, i);
+    }
+    io_uring_buf_ring_advance(_bufRing, _usedBufs.size());
+    _usedBufs.clear();
+}
+
+size_t UringUDPReceiver::_arm() {
+    size_t armed = 0;
+    for (size_t i = 0; i < _socks.size(); i++) {
+        if (_armed[i]) { continue; }
+        io_uring_sqe* sqe = io_uring_get_sqe(_ring.get());
+        ALWAYS_ASSERT(sqe != nullptr); // we have at most one SQE per socket in flight
+        io_uring_prep_recvmsg_multishot(sqe, _socks[i].fd, &_msgHdr, 0);
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = RECV_BUF_GROUP;
+        io_uring_sqe_set_data64(sqe, i);
+        _armed[i] = true;
+        armed++;
+    }
+    if (armed > 0) {
+        int ret = io_uring_submit(_ring.get());
+        if (ret < 0) {
+            throw EXPLICIT_SYSCALL_EXCEPTION(-ret, "io_uring_submit");
+        }
+    }
+    return armed;
+}
+
+bool UringUDPReceiver::receive(Env& env, std::vector<UringUDPMessage>& msgs, size_t maxMsgCount, Duration timeout) {
+    msgs.clear();
+    // the caller is done with the previous messages, give the buffers back
+    // before re-arming, since running out of them stops the multishot recvs.
+    _recycleBuffers();
+    if (size_t armed = _arm(); armed > 0) {
+        LOG_TRACE(env, "re-armed multishot recvmsg on %s sockets", armed);
+    }
+
+    if (io_uring_cq_ready(_ring.get()) == 0 && timeout != 0) {
+        if (_spin > 0) {
+            Duration spin = timeout > 0 ? std::min(timeout, _spin) : _spin;
+            bool spun = spinUntil(spin, [this]() { return io_uring_cq_ready(_ring.get()) > 0; });
+            if (_spinCounters != nullptr) {
+                (spun ? _spinCounters->spun : _spinCounters->slept).fetch_add(1, std::memory_order_relaxed);
+            }
+            if (!spun && timeout > 0) { timeout = timeout - spin; }
+        }
+        if (io_uring_cq_ready(_ring.get()) == 0) {
+            int ret = Loop::uringWait(_ring.get(), timeout);
+            if (ret == -EINTR) { return false; }
+            if (ret < 0 && ret != -ETIME) {
+                throw EXPLICIT_SYSCALL_EXCEPTION(-ret, "io_uring_wait_cqes");
+            }
+        }
+    }
+
+    unsigned head;
+    io_uring_cqe* cqe;
+    unsigned seen = 0;
+    io_uring_for_each_cqe(_ring.get(), head, cqe) {
+        if (msgs.size() >= maxMsgCount) { break; }
+        seen++;
+        uint64_t sockIdx = io_uring_cqe_get_data64(cqe);
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            _armed[sockIdx] = false; // we'll re-arm at the next `receive`
+        }
+        if (cqe->res < 0) {
+            if (cqe->res != -ENOBUFS) {
+                LOG_INFO(env, "multishot recvmsg on fd %s failed: %s", _socks[sockIdx].fd, translateErrno(-cqe->res));
+            }
+            continue;
+        }
+        if (unlikely(!(cqe->flags & IORING_CQE_F_BUFFER))) { continue; }
+        uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        _usedBufs.emplace_back(bid);
+        char* buf = &_bufs[bid*_bufSize];
+        io_uring_recvmsg_out* out = io_uring_recvmsg_validate(buf, cqe->res, &_msgHdr);
+        if (unlikely(out == nullptr || (out->flags & MSG_TRUNC))) {
+            LOG_DEBUG(env, "dropping malformed or truncated message on fd %s", _socks[sockIdx].fd);
+            continue;
+        }
+        auto& msg = msgs.emplace_back();
+        msg.data = (char*)io_uring_recvmsg_payload(out, &_msgHdr);
+        msg.len = io_uring_recvmsg_payload_length(out, cqe->res, &_msgHdr);
+        memcpy(&msg.clientAddr, io_uring_recvmsg_name(out), sizeof(sockaddr_in));
+        msg.sockIx1 = _socks[sockIdx].sockIx1;
+        msg.sockIx2 = _socks[sockIdx].sockIx2;
+    }
+    io_uring_cq_advance(_ring.get(), seen);
+    return true;
+}
+
+UringUDPSender::UringUDPSender() :
+    _ring(std::make_unique<io_uring>()),
+    _inFlight(0),
+    _droppedEperm(0),
+    _droppedEnetunreach(0)
+{
+    int ret = io_uring_queue_init(SEND_RING_ENTRIES, _ring.get(), 0);
+    if (ret < 0) {
+        throw EXPLICIT_SYSCALL_EXCEPTION(-ret, "io_uring_queue_init");
+    }
+}
+
+UringUDPSender::~UringUDPSender() {
+    while (_inFlight > 0) {
+        io_uring_cqe* cqe;
+        if (io_uring_wait_cqe(_ring.get(), &cqe) < 0) { break; }
+        io_uring_cqe_seen(_ring.get(), cqe);
+        _inFlight--;
+    }
+    io_uring_queue_exit(_ring.get());
+}
+
+void UringUDPSender::_submit() {
+    int ret = io_uring_submit(_ring.get());
+    if (ret < 0) {
+        throw EXPLICIT_SYSCALL_EXCEPTION(-ret, "io_uring_submit");
+    }
+}
+
+void UringUDPSender::_queue(int fd, msghdr* hdr) {
+    if (_inFlight == SEND_RING_ENTRIES) {
+        // make room, both in the SQ and in the CQ
+        _submit();
+        _waitOne();
+    }
+    io_uring_sqe* sqe = io_uring_get_sqe(_ring.get());
+    ALWAYS_ASSERT(sqe != nullptr);
+    io_uring_prep_sendmsg(sqe, fd, hdr, 0);
+    io_uring_sqe_set_data64(sqe, _pending.size());
+    _pending.emplace_back(Pending{.fd = fd, .hdr = hdr});
+    _inFlight++;
+}
+
+void UringUDPSender::_waitOne() {
+    io_uring_cqe* cqe;
+    int ret = io_uring_wait_cqe(_ring.get(), &cqe);
+    if (ret < 0) {
+        throw EXPLICIT_SYSCALL_EXCEPTION(-ret, "io_uring_wait_cqe");
+    }
+    int res = cqe->res;
+    Pending pending = _pending[io_uring_cqe_get_data64(cqe)];
+    io_uring_cqe_seen(_ring.get(), cqe);
+    _inFlight--;
+    if (likely(res >= 0)) { return; }
+    switch (-res) {
+    case EPERM: // we get this when nf drops packets
+        _droppedEperm++;
+        break;
+    case ENETUNREACH: // we get this when nic flaps
+        _droppedEnetunreach++;
+        break;
+    case EINVAL:
+        // Like in `UDPSender::sendMessages`, the kernel refused a segmented send,
+        // most likely because the path MTU is smaller than we thought.
+        if (pending.hdr->msg_controllen > 0) {
+            for (size_t i = 0; i < pending.hdr->msg_iovlen; i++) {
+                _resends.emplace_back(pending.fd, msghdr{
+                    .msg_name = pending.hdr->msg_name,
+                    .msg_namelen = pending.hdr->msg_namelen,
+                    .msg_iov = &pending.hdr->msg_iov[i],
+                    .msg_iovlen = 1,
+                });
+            }
+            break;
+        }
+        [[fallthrough]];
+    default:
+        throw EXPLICIT_SYSCALL_EXCEPTION(-res, "sendmsg");
+    }
+}
+
+void UringUDPSender::submit(int fd, std::vector<mmsghdr>& hdrs) {
+    for (auto& hdr : hdrs) {
+        _queue(fd, &hdr.msg_hdr);
+    }
+    _submit();
+}
+
+void UringUDPSender::reap(Env& env) {
+    size_t resent = 0;
+    for (;;) {
+        while (_inFlight > 0) {
+            _waitOne();
+        }
+        if (resent == _resends.size()) { break; }
+        LOG_INFO(env, "segmented send failed with EINVAL, resending %s messages without segmentation", _resends.size() - resent);
+        for (; resent < _resends.size(); resent++) {
+            _queue(_resends[resent].first, &_resends[resent].second);
+        }
+        _submit();
+    }
+    _pending.clear();
+    _resends.clear();
+    if (unlikely(_droppedEperm > 0)) {
+        LOG_INFO(env, "dropping %s messages because of EPERM", _droppedEperm);
+        _droppedEperm = 0;
+    }
+    if (unlikely(_droppedEnetunreach > 0)) {
+        LOG_INFO(env, "dropping %s messages because of ENETUNREACH", _droppedEnetunreach);
+        _droppedEnetunreach = 0;
+    }
+}
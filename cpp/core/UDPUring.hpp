@@ -0,0 +1,103 @@
+// Copyright 2025 XTX Markets Technologies Limited
+//
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <vector>
+
+#include "Env.hpp"
+#include "Spin.hpp"
+#include "Time.hpp"
+
+// io_uring based alternatives to poll+recvmmsg and sendmmsg, used by
+// `UDPReceiver`/`UDPSender` when configured with `ioUring`. Kept separate
+// so that users of UDPSocketPair.hpp don't need liburing.
+
+struct io_uring;
+struct io_uring_buf_ring;
+
+struct UringUDPSocket {
+    int fd;
+    uint8_t sockIx1; // index into the array of UDPSocketPair
+    uint8_t sockIx2; // index into the pair
+};
+
+struct UringUDPMessage {
+    char* data;
+    size_t len;
+    sockaddr_in clientAddr;
+    uint8_t sockIx1;
+    uint8_t sockIx2;
+};
+
+// Keeps a multishot recvmsg armed on every socket, with the packets landing
+// in a ring of provided buffers. Messages returned by `receive` point into
+// those buffers and stay valid until the next call to `receive`.
+struct UringUDPReceiver {
+    UringUDPReceiver(const std::vector<UringUDPSocket>& socks, size_t maxMsgSize, size_t maxMsgCount, Duration spin, SpinCounters* spinCounters);
+    ~UringUDPReceiver();
+    UringUDPReceiver(const UringUDPReceiver&) = delete;
+
+    // Waits up to timeout for messages and returns up to `maxMsgCount` of them.
+    // Returns false on signal interrupt.
+    bool receive(Env& env, std::vector<UringUDPMessage>& msgs, size_t maxMsgCount, Duration timeout);
+
+    // The ring fd is readable whenever there are messages to receive, so it
+    // can be used with epoll in place of the sockets.
+    int fd() const;
+
+private:
+    // Returns how many sockets we had to arm.
+    size_t _arm();
+    void _recycleBuffers();
+
+    std::vector<UringUDPSocket> _socks;
+    std::vector<bool> _armed;
+    std::unique_ptr<io_uring> _ring;
+    io_uring_buf_ring* _bufRing;
+    uint32_t _numBufs;
+    size_t _bufSize;
+    std::vector<char> _bufs;
+    std::vector<uint16_t> _usedBufs; // handed out in the last `receive`
+    msghdr _msgHdr; // template for the multishot recvmsg
+    Duration _spin;
+    SpinCounters* _spinCounters;
+};
+
+// Sends messages by queueing a sendmsg SQE for each of them. `submit` doesn't
+// wait for them to go out: the headers and everything they point to must stay
+// alive until the next `reap`, which waits for whatever is still in flight.
+struct UringUDPSender {
+    UringUDPSender();
+    // Waits for the sends in flight, which might still be reading their buffers.
+    ~UringUDPSender();
+    UringUDPSender(const UringUDPSender&) = delete;
+
+    void submit(int fd, std::vector<mmsghdr>& hdrs);
+    void reap(Env& env);
+
+private:
+    struct Pending {
+        int fd;
+        msghdr* hdr;
+    };
+
+    void _queue(int fd, msghdr* hdr);
+    void _submit();
+    void _waitOne();
+
+    std::unique_ptr<io_uring> _ring;
+    std::vector<Pending> _pending; // queued since the last `reap`, indexed by SQE user data
+    size_t _inFlight; // queued and not completed yet
+    // Segmented sends the kernel refused with EINVAL, cut up into one message
+    // per segment to be sent again by `reap`. A deque since we hand out
+    // pointers to its elements.
+    std::deque<std::pair<int, msghdr>> _resends;
+    size_t _droppedEperm;
+    size_t _droppedEnetunreach;
+};
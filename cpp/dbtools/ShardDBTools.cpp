@@ -155,14 +155,17 @@ void ShardDBTools::outputLogEntries(const std::string& dbPath, LogIdx startIdx,
     size_t entriesAtOnce = std::min<size_t>(count, 1 << 20);
     std::vector<LogsDBLogEntry> logEntries;
     logEntries.reserve(entriesAtOnce);
+    std::vector<ShardLogEntry> shardEntries;
     while (count > 0) {
         entriesAtOnce = std::min(count, entriesAtOnce);
         LogsDBTools::getLogEntries(env, sharedDb, startIdx, entriesAtOnce, logEntries);
         for (const auto& entry : logEntries) {
             BincodeBuf buf((char*)&entry.value.front(), entry.value.size());
-            ShardLogEntry shardEntry;
-            shardEntry.unpack(buf);
-            LOG_INFO(env, "%s", shardEntry);
+            shardEntries.clear();
+            ShardLogEntry::unpackBatch(buf, shardEntries);
+            for (const auto& shardEntry : shardEntries) {
+                LOG_INFO(env, "%s", shardEntry);
+            }
         }
         if (logEntries.size() == entriesAtOnce) {
             startIdx = logEntries.back().idx + 1;
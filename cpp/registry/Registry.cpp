@@ -709,6 +709,8 @@ void Registry::start(const RegistryOptions& options, LoopThreads& threads) {
         LOG_INFO(_env, "  LogsDB options:");
         LOG_INFO(_env, "    noReplication = '%s'", (int)options.logsDBOptions.noReplication);
         LOG_INFO(_env, "    avoidBeingLeader = '%s'", (int)options.logsDBOptions.avoidBeingLeader);
+        LOG_INFO(_env, "    rocksDBMemoryMiB = %s", options.logsDBOptions.rocksDBMemoryMiB);
+        LOG_INFO(_env, "    rocksDBHyperClockCache = %s", (int)options.logsDBOptions.rocksDBHyperClockCache);
         LOG_INFO(_env, "  Registry options:");
         LOG_INFO(_env, "    registryHost = '%s'", options.registryClientOptions.host);
         LOG_INFO(_env, "    registryPort = %s", options.registryClientOptions.port);
@@ -742,7 +744,10 @@ void Registry::start(const RegistryOptions& options, LoopThreads& threads) {
     rocksDBOptions.max_open_files = 1000;
     // We batch writes and flush manually.
     rocksDBOptions.manual_wal_flush = true;
-    _state->sharedDB->open(rocksDBOptions);
+    _state->sharedDB->open(rocksDBOptions, SharedRocksDBMemoryBudget{
+        .bytes = (size_t)options.logsDBOptions.rocksDBMemoryMiB << 20,
+        .hyperClockCache = options.logsDBOptions.rocksDBHyperClockCache,
+    });
     _state->registryDB = std::make_unique<RegistryDB>(logger, xmon, options, *_state->sharedDB);
     _state->logsDB = std::make_unique<LogsDB>(
         logger, xmon, *_state->sharedDB, options.logsDBOptions.replicaId,
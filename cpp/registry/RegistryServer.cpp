@@ -50,7 +50,7 @@ bool RegistryServer::init() {
         }
         _sockFds[i] = fd;
     }
-    if (_socks[0].registerEpoll(_epollFd) == -1) {
+    if (_receiver->registerEpoll(_epollFd, _socks) == -1) {
         LOG_ERROR(_env, "Failed to register udp socks for epoll");
         return false;
     }
@@ -79,7 +79,7 @@ bool RegistryServer::receiveMessages(Duration timeout){
             _acceptConnection(_sockFds[0]); 
         } else if (_events[i].data.fd == _sockFds[1]) {
             _acceptConnection(_sockFds[1]);
-        } else if (_socks[0].containsFd(_events[i].data.fd)) {
+        } else if (_receiver->isEpollFd(_events[i].data.fd, _socks)) {
             haveUdpMessages = true;
         } else if (_events[i].events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR)) {
             _removeClient(_events[i].data.fd);
@@ -37,15 +37,15 @@ public:
         _options(options.serverOptions),
         _maxConnections(options.maxConnections),
         _env(env),
-        _socks({UDPSocketPair(_env, _options.addrs)}),
+        _socks({UDPSocketPair(_env, _options.addrs, {.busyPollUs = _options.busyPollUs, .gro = _options.gro})}),
         _boundAddresses(_socks[0].addr()),
         _lastRequestId(0),
-        _sender(UDPSenderConfig{.maxMsgSize = MAX_UDP_MTU}),        
+        _sender(UDPSenderConfig{.maxMsgSize = MAX_UDP_MTU, .ioUring = _options.ioUring, .gso = _options.gso}),
         _packetDropRand(ternNow().ns),
         _outgoingPacketDropProbability(_options.simulateOutgoingPacketDrop)
     {
         _receiver = std::make_unique<UDPReceiver<1>>(UDPReceiverConfig{
-            .perSockMaxRecvMsg = MAX_RECV_MSGS, .maxMsgSize = MAX_UDP_MTU});
+            .perSockMaxRecvMsg = MAX_RECV_MSGS, .maxMsgSize = MAX_UDP_MTU, .ioUring = _options.ioUring, .gro = _options.gro});
         expandKey(RegistryKey, _expandedRegistryKey);
     }
 
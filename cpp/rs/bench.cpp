@@ -2,40 +2,28 @@
 //
 // SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
 
+#include <algorithm>
 #include <vector>
 #include <string>
 #include <chrono>
 
 #include "rs.h"
 #include "Random.hpp"
+#include "crc32c.h"
 
-int main(int argc, const char** argv) {
-    const auto usageAndDie = [argv]() {
-        fprintf(stderr, "Usage: %s SCALAR|AVX2|GFNI D P block_size\n", argv[0]);
-        exit(2);
-    };
-    if (argc != 5) {
-        usageAndDie();
-    }
-    rs_cpu_level level = RS_CPU_SCALAR;
-    if (argv[1] == std::string("SCALAR")) {
-        level = RS_CPU_SCALAR;
-    } else if (argv[1] == std::string("AVX2")) {
-        level = RS_CPU_AVX2;
-    } else if (argv[1] == std::string("GFNI")) {
-        level = RS_CPU_GFNI;
-    } else {
-        usageAndDie();
-    }
-    rs_set_cpu_level(level);
-    int D = atoi(argv[2]);
-    int P = atoi(argv[3]);
+static const std::vector<std::pair<std::string, rs_cpu_level>> cpuLevels = {
+    {"SCALAR", RS_CPU_SCALAR},
+    {"AVX2", RS_CPU_AVX2},
+    {"GFNI", RS_CPU_GFNI},
+    {"AVX512", RS_CPU_AVX512},
+    {"GFNI512", RS_CPU_GFNI512},
+};
+
+static void bench(const std::string& levelName, int D, int P, uint64_t blockSize, uint64_t iterations, uint32_t threads) {
     struct rs* r = rs_get(rs_mk_parity(D, P));
-    uint64_t blockSize = std::stoull(argv[4]);
-    uint64_t iterations = 100;
-    fprintf(stderr, "Running with RS(%d,%d), block size %ld, %ld iterations.\n", D, P, blockSize, iterations);
     RandomGenerator rand(0);
-    std::vector<uint8_t> buf(blockSize*(D+P+1));
+    int W = std::min(D, P);
+    std::vector<uint8_t> buf(blockSize*(D+P+W));
     rand.generateBytes((char*)buf.data(), blockSize*D);
     std::vector<const uint8_t*> dataBlocks(D);
     for (int i = 0; i < D; i++) {
@@ -53,7 +41,44 @@ int main(int argc, const char** argv) {
     }
     double deltaSeconds = ((double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count())/1e6;
     double gbPerSecond = ((double)((D+P)*blockSize*iterations)/1e9) / deltaSeconds;
-    printf("Compute (total memory touched): %0.2fGB/s\n", gbPerSecond);
+    printf("%s compute (total memory touched): %0.2fGB/s\n", levelName.c_str(), gbPerSecond);
+
+    // parity and page checksums, first separately, as block writers used to
+    // do, then in one go
+    if (blockSize % RS_PAGE_SIZE == 0) {
+        uint64_t pages = blockSize / RS_PAGE_SIZE;
+        std::vector<uint32_t> crcs((D+P)*pages);
+        t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            rs_compute_parity(r, blockSize, &dataBlocks[0], &parityBlocks[0]);
+            for (int j = 0; j < D+P; j++) {
+                const uint8_t* block = j < D ? dataBlocks[j] : parityBlocks[j-D];
+                for (uint64_t k = 0; k < pages; k++) {
+                    crcs[j*pages + k] = crc32c_pclmul(0, (const char*)block + k*RS_PAGE_SIZE, RS_PAGE_SIZE);
+                }
+            }
+        }
+        deltaSeconds = ((double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count())/1e6;
+        gbPerSecond = ((double)((D+P)*blockSize*iterations)/1e9) / deltaSeconds;
+        printf("%s compute + crc32c separately (blocks in and out): %0.2fGB/s\n", levelName.c_str(), gbPerSecond);
+        t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            rs_compute_parity_crc32c(r, blockSize, &dataBlocks[0], &parityBlocks[0], &crcs[0]);
+        }
+        deltaSeconds = ((double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count())/1e6;
+        gbPerSecond = ((double)((D+P)*blockSize*iterations)/1e9) / deltaSeconds;
+        printf("%s compute + crc32c fused (blocks in and out): %0.2fGB/s\n", levelName.c_str(), gbPerSecond);
+    }
+
+    if (threads > 0) {
+        t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i ++) {
+            rs_compute_parity_parallel(r, blockSize, &dataBlocks[0], &parityBlocks[0], nullptr);
+        }
+        deltaSeconds = ((double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count())/1e6;
+        gbPerSecond = ((double)((D+P)*blockSize*iterations)/1e9) / deltaSeconds;
+        printf("%s compute, %u threads (total memory touched): %0.2fGB/s\n", levelName.c_str(), threads, gbPerSecond);
+    }
 
     // just recover the last one
     uint32_t haveBlocks = 1u << D;
@@ -61,14 +86,104 @@ int main(int argc, const char** argv) {
         haveBlocks |= 1u << i;
     }
     dataBlocks[D-1] = &buf[D*blockSize];
-    rs_recover(r, blockSize, haveBlocks, &dataBlocks[0], 1u << (D-1), &buf[(D+1)*blockSize]);
+    // first without the recovery matrix cache, so that we can see how much
+    // it helps
+    for (bool cache : {false, true}) {
+        rs_set_recover_cache(cache);
+        rs_recover(r, blockSize, haveBlocks, &dataBlocks[0], 1u << (D-1), &buf[(D+1)*blockSize]);
+        t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            rs_recover(r, blockSize, haveBlocks, &dataBlocks[0], 1u << (D-1), &buf[(D+1)*blockSize]);
+        }
+        deltaSeconds = ((double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count())/1e6;
+        gbPerSecond = ((double)((D+1)*blockSize*iterations)/1e9) / deltaSeconds;
+        printf("%s recover, %s (total memory touched): %0.2fGB/s\n", levelName.c_str(), cache ? "cached" : "uncached", gbPerSecond);
+    }
+    if (threads > 0) {
+        t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            rs_recover_parallel(r, blockSize, haveBlocks, &dataBlocks[0], 1u << (D-1), &buf[(D+1)*blockSize], nullptr);
+        }
+        deltaSeconds = ((double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count())/1e6;
+        gbPerSecond = ((double)((D+1)*blockSize*iterations)/1e9) / deltaSeconds;
+        printf("%s recover, %u threads (total memory touched): %0.2fGB/s\n", levelName.c_str(), threads, gbPerSecond);
+    }
+
+    // lose the first W data blocks, and recover them from the rest and the
+    // parity blocks, one by one and then all at once
+    haveBlocks = 0;
+    std::vector<const uint8_t*> haveBlocksPtrs;
+    for (int i = W; i < D+W; i++) {
+        haveBlocks |= 1u << i;
+        haveBlocksPtrs.emplace_back(&buf[i*blockSize]);
+    }
+    std::vector<uint8_t*> wantBlocksPtrs;
+    for (int i = 0; i < W; i++) {
+        wantBlocksPtrs.emplace_back(&buf[(D+P+i)*blockSize]);
+    }
+    uint32_t wantBlocks = (1u << W) - 1;
     t0 = std::chrono::steady_clock::now();
     for (int i = 0; i < iterations; i++) {
-        rs_recover(r, blockSize, haveBlocks, &dataBlocks[0], 1u << (D-1), &buf[(D+1)*blockSize]);
+        for (int j = 0; j < W; j++) {
+            rs_recover(r, blockSize, haveBlocks, &haveBlocksPtrs[0], 1u << j, wantBlocksPtrs[j]);
+        }
     }
     deltaSeconds = ((double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count())/1e6;
-    gbPerSecond = ((double)((D+1)*blockSize*iterations)/1e9) / deltaSeconds;
-    printf("Recover (total memory touched): %0.2fGB/s\n", gbPerSecond);
+    gbPerSecond = ((double)((D+W)*blockSize*iterations)/1e9) / deltaSeconds;
+    printf("%s recover %d one by one (blocks in and out): %0.2fGB/s\n", levelName.c_str(), W, gbPerSecond);
+    rs_recover_many(r, blockSize, haveBlocks, &haveBlocksPtrs[0], wantBlocks, &wantBlocksPtrs[0]);
+    t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        rs_recover_many(r, blockSize, haveBlocks, &haveBlocksPtrs[0], wantBlocks, &wantBlocksPtrs[0]);
+    }
+    deltaSeconds = ((double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count())/1e6;
+    gbPerSecond = ((double)((D+W)*blockSize*iterations)/1e9) / deltaSeconds;
+    printf("%s recover %d at once (blocks in and out): %0.2fGB/s\n", levelName.c_str(), W, gbPerSecond);
+}
+
+int main(int argc, const char** argv) {
+    const auto usageAndDie = [argv]() {
+        fprintf(stderr, "Usage: %s [-threads N] SCALAR|AVX2|GFNI|AVX512|GFNI512|ALL D P block_size\n", argv[0]);
+        fprintf(stderr, "ALL runs all the levels this CPU supports, one after the other.\n");
+        fprintf(stderr, "-threads also runs the parallel variants, with N threads.\n");
+        exit(2);
+    };
+    uint32_t threads = 0;
+    if (argc > 1 && argv[1] == std::string("-threads")) {
+        if (argc < 3) {
+            usageAndDie();
+        }
+        threads = std::stoul(argv[2]);
+        if (threads < 1) {
+            usageAndDie();
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc != 5) {
+        usageAndDie();
+    }
+    std::vector<std::pair<std::string, rs_cpu_level>> levels;
+    for (const auto& level : cpuLevels) {
+        if (argv[1] == level.first || (argv[1] == std::string("ALL") && rs_has_cpu_level(level.second))) {
+            levels.emplace_back(level);
+        }
+    }
+    if (levels.empty()) {
+        usageAndDie();
+    }
+    int D = atoi(argv[2]);
+    int P = atoi(argv[3]);
+    uint64_t blockSize = std::stoull(argv[4]);
+    uint64_t iterations = 100;
+    fprintf(stderr, "Running with RS(%d,%d), block size %ld, %ld iterations.\n", D, P, blockSize, iterations);
+    if (threads > 0) {
+        rs_set_threads(threads);
+    }
+    for (const auto& level : levels) {
+        rs_set_cpu_level(level.second);
+        bench(level.first, D, P, blockSize, iterations, threads);
+    }
 
     return 0;
 }
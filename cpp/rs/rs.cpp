@@ -7,6 +7,9 @@
 #include <stdio.h>
 #include <signal.h>
 #include <immintrin.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <algorithm>
 #include <array>
 
 #include "rs.h"
@@ -47,6 +50,68 @@ static inline __m256i broadcast_u8(uint8_t x) {
 
 #include "rs_core.c"
 
+// We include the CRC32C implementation rather than linking against `crc32c`,
+// so that `rs_compute_parity_crc32c` can checksum whole pages with
+// `crc32c_4k_fusion` directly, and so that the `rs` library itself doesn't
+// need `crc32c` to link (the Go bindings only pass `-lrs`). `rs-tests` and
+// `rs-bench` link `crc32c` just to check against it.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+namespace {
+#define CRC32C_USE_PCLMUL 1
+#define CRC32C_NAME(a) rs_##a
+#include "crc32c_body.c"
+}
+#pragma GCC diagnostic pop
+
+// The 512-bit kernels only live here, rather than in `rs_core.c`, since the
+// kernel module doesn't get to use AVX-512. Unlike the 256-bit ones they
+// don't fall back to scalar code for the tail, but use masked loads and stores.
+
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i gf_mul_expanded_avx512(__m512i x, __m512i expanded_y_lo, __m512i expanded_y_hi, __m512i low_nibble_mask) {
+    __m512i x_lo = _mm512_and_si512(x, low_nibble_mask);
+    __m512i x_hi = _mm512_and_si512(_mm512_srli_epi16(x, 4), low_nibble_mask);
+    return _mm512_xor_si512(
+        _mm512_shuffle_epi8(expanded_y_lo, x_lo),
+        _mm512_shuffle_epi8(expanded_y_hi, x_hi)
+    );
+}
+
+// We can't want more blocks than there are parity blocks.
+static constexpr int RS_MAX_WANT_BLOCKS = 15;
+
+__attribute__((target("avx512f,avx512bw")))
+static inline __mmask64 rs_avx512_mask(u64 size, u64 i) {
+    return size - i >= 64 ? ~0ull : (1ull << (size - i)) - 1;
+}
+
+static inline u32 rs_xgetbv(u32 index) {
+    u32 lo, hi;
+    __asm("xgetbv":"=a"(lo),"=d"(hi):"c"(index));
+    return lo;
+}
+
+static bool rs_has_avx512(bool gfni) {
+    u32 _0_0[4];
+    rs_cpuidex(0, 0, _0_0);
+    if (_0_0[0] < 7) {
+        return false;
+    }
+    u32 _1_0[4];
+    rs_cpuidex(1, 0, _1_0);
+    // the OS must save the opmask and the upper halves of the zmm registers (and
+    // the xmm/ymm ones), which we can only ask if it's using xsave at all.
+    if (!(_1_0[2] & (1<<27)) || (rs_xgetbv(0) & 0xE6) != 0xE6) {
+        return false;
+    }
+    u32 _7_0[4];
+    rs_cpuidex(7, 0, _7_0);
+    bool avx512 = (_7_0[1] & (1<<16)) && (_7_0[1] & (1<<30)); // AVX512F, AVX512BW
+    // valgrind doesn't do AVX-512
+    return avx512 && (!gfni || (_7_0[2] & (1<<8))) && !rs_detect_valgrind();
+}
+
 uint8_t rs_parity(struct rs* r) {
     return r->parity;
 }
@@ -71,13 +136,28 @@ static struct rs* rs_cached[256] = {
 };
 
 bool rs_has_cpu_level(rs_cpu_level level) {
-    return rs_has_cpu_level_core(level);
+    switch (level) {
+    case RS_CPU_AVX512:
+        return rs_has_avx512(false);
+    case RS_CPU_GFNI512:
+        return rs_has_avx512(true);
+    default:
+        return rs_has_cpu_level_core(level);
+    }
 }
 
 static uint8_t rs_chosen_cpu_level = RS_CPU_SCALAR;
 
 __attribute__((constructor))
 void rs_detect_cpu_level() {
+    if (rs_has_cpu_level(RS_CPU_GFNI512)) {
+        rs_chosen_cpu_level = RS_CPU_GFNI512;
+        return;
+    }
+    if (rs_has_cpu_level(RS_CPU_AVX512)) {
+        rs_chosen_cpu_level = RS_CPU_AVX512;
+        return;
+    }
     if (rs_has_cpu_level(RS_CPU_GFNI)) {
         rs_chosen_cpu_level = RS_CPU_GFNI;
         return;
@@ -135,6 +215,55 @@ static void rs_compute_parity_gfni_tmpl(struct rs* r, uint64_t size, const uint8
     rs_compute_parity_gfni(D, P, r, size, data, parity);
 }
 
+template<int D, int P> __attribute__((noinline, target("avx512f,avx512bw")))
+static void rs_compute_parity_avx512_tmpl(struct rs* r, uint64_t size, const uint8_t** data, uint8_t** parity) {
+    __m512i low_nibble_mask = _mm512_set1_epi8(0x0f);
+    for (u64 i = 0; i < size; i += 64) {
+        __mmask64 mask = rs_avx512_mask(size, i);
+        {
+            __m512i parity_0 = _mm512_setzero_si512();
+            for (int d = 0; d < D; d++) {
+                parity_0 = _mm512_xor_si512(parity_0, _mm512_maskz_loadu_epi8(mask, data[d] + i));
+            }
+            _mm512_mask_storeu_epi8(parity[0] + i, mask, parity_0);
+        }
+        for (int p = 1; p < P; p++) {
+            __m512i parity_p = _mm512_setzero_si512();
+            for (int d = 0; d < D; d++) {
+                __m512i data_d = _mm512_maskz_loadu_epi8(mask, data[d] + i);
+                const u8* factor = &r->expanded_matrix[D*p*32 + 32*d];
+                __m512i factor_lo = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)factor));
+                __m512i factor_hi = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)(factor + 16)));
+                parity_p = _mm512_xor_si512(parity_p, gf_mul_expanded_avx512(data_d, factor_lo, factor_hi, low_nibble_mask));
+            }
+            _mm512_mask_storeu_epi8(parity[p] + i, mask, parity_p);
+        }
+    }
+}
+
+template<int D, int P> __attribute__((noinline, target("avx512f,avx512bw,gfni")))
+static void rs_compute_parity_gfni512_tmpl(struct rs* r, uint64_t size, const uint8_t** data, uint8_t** parity) {
+    for (u64 i = 0; i < size; i += 64) {
+        __mmask64 mask = rs_avx512_mask(size, i);
+        {
+            __m512i parity_0 = _mm512_setzero_si512();
+            for (int d = 0; d < D; d++) {
+                parity_0 = _mm512_xor_si512(parity_0, _mm512_maskz_loadu_epi8(mask, data[d] + i));
+            }
+            _mm512_mask_storeu_epi8(parity[0] + i, mask, parity_0);
+        }
+        for (int p = 1; p < P; p++) {
+            __m512i parity_p = _mm512_setzero_si512();
+            for (int d = 0; d < D; d++) {
+                __m512i data_d = _mm512_maskz_loadu_epi8(mask, data[d] + i);
+                __m512i factor = _mm512_set1_epi8(r->matrix[D*D + D*p + d]);
+                parity_p = _mm512_xor_si512(parity_p, _mm512_gf2p8mul_epi8(data_d, factor));
+            }
+            _mm512_mask_storeu_epi8(parity[p] + i, mask, parity_p);
+        }
+    }
+}
+
 template<int D, int P>
 static void rs_compute_parity_tmpl(struct rs* r, uint64_t size, const uint8_t** data, uint8_t** parity) {
     switch (rs_cpu_level l = rs_get_cpu_level()) {
@@ -147,6 +276,12 @@ static void rs_compute_parity_tmpl(struct rs* r, uint64_t size, const uint8_t**
     case RS_CPU_GFNI:
         rs_compute_parity_gfni_tmpl<D, P>(r, size, data, parity);
         break;
+    case RS_CPU_AVX512:
+        rs_compute_parity_avx512_tmpl<D, P>(r, size, data, parity);
+        break;
+    case RS_CPU_GFNI512:
+        rs_compute_parity_gfni512_tmpl<D, P>(r, size, data, parity);
+        break;
     default:
         die("bad cpu_level %d\n", l);
     }
@@ -157,6 +292,50 @@ void rs_compute_parity(struct rs* r, uint64_t size, const uint8_t** data, uint8_
     rs_compute_parity_funcs[r->parity](r, size, data, parity);
 }
 
+// How many pages we compute the parity for before checksumming them. We want
+// the data and parity pages to still be in L1/L2 when we get to them, while
+// still giving the parity kernels enough to chew on in one go.
+#define RS_CRC32C_STRIP_PAGES 4
+
+// 4096 = 30*136 + 16, see `crc32c_4k_fusion`
+static_assert(RS_PAGE_SIZE == 30*136 + 16);
+
+static inline u32 rs_page_crc32c(const u8* page) {
+    return ~crc32c_4k_fusion(~(u32)0, (const char*)page, 30);
+}
+
+void rs_compute_parity_crc32c(struct rs* r, uint64_t size, const uint8_t** data, uint8_t** parity, uint32_t* crcs) {
+    if (size % RS_PAGE_SIZE != 0) {
+        die("size %lu is not a multiple of the page size %d", size, RS_PAGE_SIZE);
+    }
+    int D = rs_data_blocks(r->parity);
+    int P = rs_parity_blocks(r->parity);
+    u64 pages = size / RS_PAGE_SIZE;
+    const u8* strip_data[16];
+    u8* strip_parity[16];
+    for (u64 page = 0; page < pages; page += RS_CRC32C_STRIP_PAGES) {
+        u64 strip_pages = std::min<u64>(RS_CRC32C_STRIP_PAGES, pages - page);
+        u64 offset = page * RS_PAGE_SIZE;
+        for (int i = 0; i < D; i++) {
+            strip_data[i] = data[i] + offset;
+        }
+        for (int i = 0; i < P; i++) {
+            strip_parity[i] = parity[i] + offset;
+        }
+        rs_compute_parity_funcs[r->parity](r, strip_pages * RS_PAGE_SIZE, strip_data, strip_parity);
+        for (int i = 0; i < D; i++) {
+            for (u64 j = 0; j < strip_pages; j++) {
+                crcs[i*pages + page + j] = rs_page_crc32c(strip_data[i] + j*RS_PAGE_SIZE);
+            }
+        }
+        for (int i = 0; i < P; i++) {
+            for (u64 j = 0; j < strip_pages; j++) {
+                crcs[(D+i)*pages + page + j] = rs_page_crc32c(strip_parity[i] + j*RS_PAGE_SIZE);
+            }
+        }
+    }
+}
+
 template<int D> __attribute__((noinline))
 static void rs_recover_matmul_scalar_tmpl(uint64_t size, const uint8_t** have, uint8_t* want, const uint8_t* mat) {
     rs_recover_matmul_scalar(D, size, have, want, mat);
@@ -172,6 +351,51 @@ static void rs_recover_matmul_gfni_tmpl(uint64_t size, const uint8_t** have, uin
     rs_recover_matmul_gfni(D, size, have, want, mat);
 }
 
+template<int D> __attribute__((noinline, target("avx512f,avx512bw")))
+static void rs_recover_matmul_avx512_tmpl(uint64_t size, const uint8_t** have, uint8_t* want, const uint8_t* mat) {
+    __m512i have_to_want_lo[D];
+    __m512i have_to_want_hi[D];
+    for (int d = 0; d < D; d++) {
+        u8 expanded[32];
+        gf_mul_expand_factor(mat[d], expanded);
+        have_to_want_lo[d] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)expanded));
+        have_to_want_hi[d] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)(expanded + 16)));
+    }
+    __m512i low_nibble_mask = _mm512_set1_epi8(0x0f);
+    for (u64 i = 0; i < size; i += 64) {
+        __mmask64 mask = rs_avx512_mask(size, i);
+        __m512i want_i = _mm512_setzero_si512();
+        for (int d = 0; d < D; d++) {
+            want_i = _mm512_xor_si512(
+                want_i,
+                gf_mul_expanded_avx512(
+                    _mm512_maskz_loadu_epi8(mask, have[d] + i),
+                    have_to_want_lo[d],
+                    have_to_want_hi[d],
+                    low_nibble_mask
+                )
+            );
+        }
+        _mm512_mask_storeu_epi8(want + i, mask, want_i);
+    }
+}
+
+template<int D> __attribute__((noinline, target("avx512f,avx512bw,gfni")))
+static void rs_recover_matmul_gfni512_tmpl(uint64_t size, const uint8_t** have, uint8_t* want, const uint8_t* mat) {
+    __m512i have_to_want[D];
+    for (int d = 0; d < D; d++) {
+        have_to_want[d] = _mm512_set1_epi8(mat[d]);
+    }
+    for (u64 i = 0; i < size; i += 64) {
+        __mmask64 mask = rs_avx512_mask(size, i);
+        __m512i want_i = _mm512_setzero_si512();
+        for (int d = 0; d < D; d++) {
+            want_i = _mm512_xor_si512(want_i, _mm512_gf2p8mul_epi8(_mm512_maskz_loadu_epi8(mask, have[d] + i), have_to_want[d]));
+        }
+        _mm512_mask_storeu_epi8(want + i, mask, want_i);
+    }
+}
+
 template<int D>
 static void rs_recover_matmul_tmpl(uint64_t size, const uint8_t** have, uint8_t* want, const uint8_t* mat) {
     switch (rs_cpu_level l = rs_get_cpu_level()) {
@@ -184,12 +408,143 @@ static void rs_recover_matmul_tmpl(uint64_t size, const uint8_t** have, uint8_t*
     case RS_CPU_GFNI:
         rs_recover_matmul_gfni_tmpl<D>(size, have, want, mat);
         break;
+    case RS_CPU_AVX512:
+        rs_recover_matmul_avx512_tmpl<D>(size, have, want, mat);
+        break;
+    case RS_CPU_GFNI512:
+        rs_recover_matmul_gfni512_tmpl<D>(size, have, want, mat);
+        break;
     default:
         die("bad cpu_level %d\n", l);
     }
 }
 
 static void (*rs_recover_matmul_funcs[16])(uint64_t size, const uint8_t** have, uint8_t* want, const uint8_t* mat);
+// Recovering needs a Gaussian elimination to get the [Dx1] matrix going from
+// what we have to what we want, which dominates when recovering small blocks.
+// But there are only so many (have_blocks, want_block) pairs for each parity,
+// so we cache them, in a fixed size open addressing table per parity, allocated
+// lazily like `rs_cached`.
+//
+// The table is lock-free: a writer claims an empty slot by setting its key to
+// RS_RECOVER_CACHE_PENDING, then fills in the matrix, and then publishes the
+// key. Readers only look at the matrix if they see the key they want. Once a
+// slot is published it never changes. If we can't find a free slot within a few
+// probes, we just don't cache.
+
+#define RS_RECOVER_CACHE_SLOTS (1<<13)
+#define RS_RECOVER_CACHE_PROBES 16
+#define RS_RECOVER_CACHE_PENDING (~0ull)
+
+struct rs_recover_cache_slot {
+    u64 key; // 0 if empty
+    u8 have_to_want[16];
+};
+
+struct rs_recover_cache {
+    rs_recover_cache_slot slots[RS_RECOVER_CACHE_SLOTS];
+};
+
+static struct rs_recover_cache* rs_recover_caches[256];
+
+static bool rs_recover_cache_enabled = true;
+
+void rs_set_recover_cache(bool enabled) {
+    __atomic_store_n(&rs_recover_cache_enabled, enabled, __ATOMIC_RELAXED);
+}
+
+static inline u64 rs_recover_cache_key(u32 have_blocks, u32 want_block) {
+    // nonzero, since we always have some blocks, and never RS_RECOVER_CACHE_PENDING
+    return ((u64)want_block << 32) | have_blocks;
+}
+
+static inline u32 rs_recover_cache_slot_ix(u64 key) {
+    return (key * 0x9E3779B97F4A7C15ull) >> (64 - 13);
+}
+
+static_assert(RS_RECOVER_CACHE_SLOTS == 1<<13);
+
+// Returns nullptr if caching is disabled, or if we couldn't allocate the cache.
+static struct rs_recover_cache* rs_recover_cache_get(u8 parity) {
+    if (!__atomic_load_n(&rs_recover_cache_enabled, __ATOMIC_RELAXED)) {
+        return nullptr;
+    }
+    struct rs_recover_cache* cache = __atomic_load_n(&rs_recover_caches[parity], __ATOMIC_ACQUIRE);
+    if (__builtin_expect(cache == nullptr, 0)) {
+        cache = (struct rs_recover_cache*)calloc(1, sizeof(struct rs_recover_cache));
+        if (cache == nullptr) {
+            return nullptr;
+        }
+        struct rs_recover_cache* expected = nullptr;
+        if (!__atomic_compare_exchange_n(&rs_recover_caches[parity], &expected, cache, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            // somebody else got to it first
+            free(cache);
+            cache = expected;
+        }
+    }
+    return cache;
+}
+
+// Fills in `have_to_want` ([D]) and returns true if we have it cached.
+static bool rs_recover_cache_lookup(struct rs_recover_cache* cache, int D, u32 have_blocks, u32 want_block, u8* have_to_want) {
+    u64 key = rs_recover_cache_key(have_blocks, want_block);
+    u32 ix = rs_recover_cache_slot_ix(key);
+    for (int i = 0; i < RS_RECOVER_CACHE_PROBES; i++) {
+        rs_recover_cache_slot& slot = cache->slots[(ix + i) % RS_RECOVER_CACHE_SLOTS];
+        u64 slot_key = __atomic_load_n(&slot.key, __ATOMIC_ACQUIRE);
+        if (slot_key == key) {
+            memcpy(have_to_want, slot.have_to_want, D);
+            return true;
+        }
+        if (slot_key == 0) {
+            return false;
+        }
+    }
+    return false;
+}
+
+static void rs_recover_cache_insert(struct rs_recover_cache* cache, int D, u32 have_blocks, u32 want_block, const u8* have_to_want) {
+    u64 key = rs_recover_cache_key(have_blocks, want_block);
+    u32 ix = rs_recover_cache_slot_ix(key);
+    for (int i = 0; i < RS_RECOVER_CACHE_PROBES; i++) {
+        rs_recover_cache_slot& slot = cache->slots[(ix + i) % RS_RECOVER_CACHE_SLOTS];
+        u64 slot_key = 0;
+        if (__atomic_compare_exchange_n(&slot.key, &slot_key, RS_RECOVER_CACHE_PENDING, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+            memcpy(slot.have_to_want, have_to_want, D);
+            __atomic_store_n(&slot.key, key, __ATOMIC_RELEASE);
+            return;
+        }
+        if (slot_key == key) {
+            // somebody else got to it first
+            return;
+        }
+        // note that if it's pending it might turn out to be for our key, in
+        // which case we'll have it twice, which is harmless.
+    }
+}
+
+// Fills in `have_to_want` ([D]), from the cache if possible.
+static void rs_recover_row(struct rs* r, uint32_t have_blocks, uint32_t want_block, u8* have_to_want) {
+    int D = rs_data_blocks(r->parity);
+    struct rs_recover_cache* cache = rs_recover_cache_get(r->parity);
+    if (cache == nullptr || !rs_recover_cache_lookup(cache, D, have_blocks, want_block, have_to_want)) {
+        u8* mat = (u8*)malloc(RS_RECOVER_MAT_SIZE(D));
+        if (mat == NULL) {
+            free(mat);
+            die("could not allocate mat");
+        }
+        if (!rs_recover_mat(r, have_blocks, want_block, mat)) {
+            free(mat);
+            die("could not get recover matrix");
+        }
+        memcpy(have_to_want, mat, D);
+        free(mat);
+        if (cache != nullptr) {
+            rs_recover_cache_insert(cache, D, have_blocks, want_block, have_to_want);
+        }
+    }
+}
+
 void rs_recover(
     struct rs* r,
     uint64_t size,
@@ -197,21 +552,485 @@ void rs_recover(
     const uint8_t** have,
     uint32_t want_block,
     uint8_t* want
+) {
+    u8 have_to_want[16];
+    rs_recover_row(r, have_blocks, want_block, have_to_want);
+    rs_recover_matmul_funcs[rs_data_blocks(r->parity)](size, have, want, have_to_want);
+}
+
+// One row per wanted block, going from the `have` blocks to it.
+static bool rs_recover_many_mat(
+    struct rs* r,
+    u32 have_blocks,
+    u32 want_blocks,
+    u8* scratch, // RS_RECOVER_MAT_SIZE(D)
+    u8* have_to_want // out, [WxD]
+) {
+    int D = rs_data_blocks_core(r->parity);
+    int B = rs_blocks_core(r->parity);
+    if ((have_blocks >> B) || (want_blocks >> B)) {
+        rs_warn("have_blocks=%08x or want_blocks=%08x out of bounds wrt B=%d", have_blocks, want_blocks, B);
+        return false;
+    }
+    if (have_blocks & want_blocks) {
+        rs_warn("have_blocks=%08x overlaps with want_blocks=%08x", have_blocks, want_blocks);
+        return false;
+    }
+    if (__builtin_popcount(have_blocks) != D || want_blocks == 0) {
+        rs_warn("expected %d have_blocks and some want_blocks, got have_blocks=%08x want_blocks=%08x", D, have_blocks, want_blocks);
+        return false;
+    }
+    // [DxD] matrix going from the data blocks to the blocks we currently have
+    u8* data_to_have = scratch;
+    int b, d, w, i, j;
+    for (b = 0, d = 0; b < B; b++) {
+        if (!((have_blocks >> b) & 1u)) { continue; }
+        memcpy(data_to_have + d*D, r->matrix + b*D, D);
+        d++;
+    }
+    // [DxD] matrix going from what we have to the original data blocks
+    u8* have_to_data = scratch + D*D;
+    if (!rs_gf_invert_matrix(data_to_have, have_to_data, D)) {
+        rs_warn("unexpected singular matrix");
+        return false;
+    }
+    // have_to_want = data_to_want * have_to_data, for each wanted block
+    for (b = 0, w = 0; b < B; b++) {
+        if (!((want_blocks >> b) & 1u)) { continue; }
+        const u8* data_to_want = &r->matrix[b*D];
+        for (i = 0; i < D; i++) {
+            u8 x = 0;
+            for (j = 0; j < D; j++) {
+                x ^= gf_mul(data_to_want[j], have_to_data[j*D + i]);
+            }
+            have_to_want[w*D + i] = x;
+        }
+        w++;
+    }
+    return true;
+}
+
+// The kernels below go through the input once, and for each chunk of it
+// update all the wanted blocks, so that we only stream `have` from memory once.
+
+template<int D> __attribute__((noinline))
+static void rs_recover_many_matmul_scalar_tmpl(uint64_t size, const uint8_t** have, int W, uint8_t** want, const uint8_t* mat) {
+    u8 expanded[RS_MAX_WANT_BLOCKS*D*32];
+    for (int k = 0; k < W*D; k++) {
+        gf_mul_expand_factor(mat[k], &expanded[k*32]);
+    }
+    for (u64 i = 0; i < size; i++) {
+        for (int w = 0; w < W; w++) {
+            u8* want_w = want[w];
+            const u8* expanded_w = &expanded[w*D*32];
+            rs_recover_matmul_single_expanded(D, i, have, want_w, expanded_w);
+        }
+    }
+}
+
+template<int D> __attribute__((noinline))
+static void rs_recover_many_matmul_avx2_tmpl(uint64_t size, const uint8_t** have, int W, uint8_t** want, const uint8_t* mat) {
+    __m256i factors_lo[RS_MAX_WANT_BLOCKS*D];
+    __m256i factors_hi[RS_MAX_WANT_BLOCKS*D];
+    u8 expanded[RS_MAX_WANT_BLOCKS*D*32];
+    for (int k = 0; k < W*D; k++) {
+        gf_mul_expand_factor(mat[k], &expanded[k*32]);
+        factors_lo[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)&expanded[k*32]));
+        factors_hi[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)&expanded[k*32 + 16]));
+    }
+    __m256i low_nibble_mask = broadcast_u8(0x0f);
+    u64 avx_size = size - size%32;
+    u64 i;
+    for (i = 0; i < avx_size; i += 32) {
+        __m256i want_i[RS_MAX_WANT_BLOCKS];
+        for (int w = 0; w < W; w++) {
+            want_i[w] = _mm256_setzero_si256();
+        }
+        for (int d = 0; d < D; d++) {
+            __m256i have_d = _mm256_loadu_si256((const __m256i*)(have[d] + i));
+            __m256i have_d_lo = _mm256_and_si256(have_d, low_nibble_mask);
+            __m256i have_d_hi = _mm256_and_si256(_mm256_srli_epi16(have_d, 4), low_nibble_mask);
+            for (int w = 0; w < W; w++) {
+                want_i[w] = _mm256_xor_si256(want_i[w], _mm256_xor_si256(
+                    _mm256_shuffle_epi8(factors_lo[w*D + d], have_d_lo),
+                    _mm256_shuffle_epi8(factors_hi[w*D + d], have_d_hi)
+                ));
+            }
+        }
+        for (int w = 0; w < W; w++) {
+            _mm256_storeu_si256((__m256i*)(want[w] + i), want_i[w]);
+        }
+    }
+    for (; i < size; i++) {
+        for (int w = 0; w < W; w++) {
+            u8* want_w = want[w];
+            const u8* expanded_w = &expanded[w*D*32];
+            rs_recover_matmul_single_expanded(D, i, have, want_w, expanded_w);
+        }
+    }
+}
+
+template<int D> __attribute__((noinline))
+static void rs_recover_many_matmul_gfni_tmpl(uint64_t size, const uint8_t** have, int W, uint8_t** want, const uint8_t* mat) {
+    __m256i factors[RS_MAX_WANT_BLOCKS*D];
+    for (int k = 0; k < W*D; k++) {
+        factors[k] = broadcast_u8(mat[k]);
+    }
+    u64 avx_size = size - size%32;
+    u64 i;
+    for (i = 0; i < avx_size; i += 32) {
+        __m256i want_i[RS_MAX_WANT_BLOCKS];
+        for (int w = 0; w < W; w++) {
+            want_i[w] = _mm256_setzero_si256();
+        }
+        for (int d = 0; d < D; d++) {
+            __m256i have_d = _mm256_loadu_si256((const __m256i*)(have[d] + i));
+            for (int w = 0; w < W; w++) {
+                want_i[w] = _mm256_xor_si256(want_i[w], _mm256_gf2p8mul_epi8(have_d, factors[w*D + d]));
+            }
+        }
+        for (int w = 0; w < W; w++) {
+            _mm256_storeu_si256((__m256i*)(want[w] + i), want_i[w]);
+        }
+    }
+    for (; i < size; i++) {
+        for (int w = 0; w < W; w++) {
+            u8* want_w = want[w];
+            const u8* mat_w = &mat[w*D];
+            rs_recover_matmul_single(D, i, have, want_w, mat_w);
+        }
+    }
+}
+
+template<int D> __attribute__((noinline, target("avx512f,avx512bw")))
+static void rs_recover_many_matmul_avx512_tmpl(uint64_t size, const uint8_t** have, int W, uint8_t** want, const uint8_t* mat) {
+    __m512i factors_lo[RS_MAX_WANT_BLOCKS*D];
+    __m512i factors_hi[RS_MAX_WANT_BLOCKS*D];
+    for (int k = 0; k < W*D; k++) {
+        u8 expanded[32];
+        gf_mul_expand_factor(mat[k], expanded);
+        factors_lo[k] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)expanded));
+        factors_hi[k] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)(expanded + 16)));
+    }
+    __m512i low_nibble_mask = _mm512_set1_epi8(0x0f);
+    for (u64 i = 0; i < size; i += 64) {
+        __mmask64 mask = rs_avx512_mask(size, i);
+        __m512i want_i[RS_MAX_WANT_BLOCKS];
+        for (int w = 0; w < W; w++) {
+            want_i[w] = _mm512_setzero_si512();
+        }
+        for (int d = 0; d < D; d++) {
+            __m512i have_d = _mm512_maskz_loadu_epi8(mask, have[d] + i);
+            __m512i have_d_lo = _mm512_and_si512(have_d, low_nibble_mask);
+            __m512i have_d_hi = _mm512_and_si512(_mm512_srli_epi16(have_d, 4), low_nibble_mask);
+            for (int w = 0; w < W; w++) {
+                want_i[w] = _mm512_xor_si512(want_i[w], _mm512_xor_si512(
+                    _mm512_shuffle_epi8(factors_lo[w*D + d], have_d_lo),
+                    _mm512_shuffle_epi8(factors_hi[w*D + d], have_d_hi)
+                ));
+            }
+        }
+        for (int w = 0; w < W; w++) {
+            _mm512_mask_storeu_epi8(want[w] + i, mask, want_i[w]);
+        }
+    }
+}
+
+template<int D> __attribute__((noinline, target("avx512f,avx512bw,gfni")))
+static void rs_recover_many_matmul_gfni512_tmpl(uint64_t size, const uint8_t** have, int W, uint8_t** want, const uint8_t* mat) {
+    __m512i factors[RS_MAX_WANT_BLOCKS*D];
+    for (int k = 0; k < W*D; k++) {
+        factors[k] = _mm512_set1_epi8(mat[k]);
+    }
+    for (u64 i = 0; i < size; i += 64) {
+        __mmask64 mask = rs_avx512_mask(size, i);
+        __m512i want_i[RS_MAX_WANT_BLOCKS];
+        for (int w = 0; w < W; w++) {
+            want_i[w] = _mm512_setzero_si512();
+        }
+        for (int d = 0; d < D; d++) {
+            __m512i have_d = _mm512_maskz_loadu_epi8(mask, have[d] + i);
+            for (int w = 0; w < W; w++) {
+                want_i[w] = _mm512_xor_si512(want_i[w], _mm512_gf2p8mul_epi8(have_d, factors[w*D + d]));
+            }
+        }
+        for (int w = 0; w < W; w++) {
+            _mm512_mask_storeu_epi8(want[w] + i, mask, want_i[w]);
+        }
+    }
+}
+
+template<int D>
+static void rs_recover_many_matmul_tmpl(uint64_t size, const uint8_t** have, int W, uint8_t** want, const uint8_t* mat) {
+    switch (rs_cpu_level l = rs_get_cpu_level()) {
+    case RS_CPU_SCALAR:
+        rs_recover_many_matmul_scalar_tmpl<D>(size, have, W, want, mat);
+        break;
+    case RS_CPU_AVX2:
+        rs_recover_many_matmul_avx2_tmpl<D>(size, have, W, want, mat);
+        break;
+    case RS_CPU_GFNI:
+        rs_recover_many_matmul_gfni_tmpl<D>(size, have, W, want, mat);
+        break;
+    case RS_CPU_AVX512:
+        rs_recover_many_matmul_avx512_tmpl<D>(size, have, W, want, mat);
+        break;
+    case RS_CPU_GFNI512:
+        rs_recover_many_matmul_gfni512_tmpl<D>(size, have, W, want, mat);
+        break;
+    default:
+        die("bad cpu_level %d\n", l);
+    }
+}
+
+static void (*rs_recover_many_matmul_funcs[16])(uint64_t size, const uint8_t** have, int W, uint8_t** want, const uint8_t* mat);
+void rs_recover_many(
+    struct rs* r,
+    uint64_t size,
+    uint32_t have_blocks,
+    const uint8_t** have,
+    uint32_t want_blocks,
+    uint8_t** want
 ) {
     int D = rs_data_blocks(r->parity);
-    u8* mat = (u8*)malloc(RS_RECOVER_MAT_SIZE(D));
+    int W = __builtin_popcount(want_blocks);
+    u8* mat = (u8*)malloc(RS_RECOVER_MAT_SIZE(D) + W*D);
     if (mat == NULL) {
-        free(mat);
         die("could not allocate mat");
     }
-    if (!rs_recover_mat(r, have_blocks, want_block, mat)) {
-        free(mat);
-        die("could not get recover matrix");
+    u8* have_to_want = mat + RS_RECOVER_MAT_SIZE(D);
+    // the rows are the same we'd get recovering one block at a time, so we
+    // share the cache with `rs_recover`
+    struct rs_recover_cache* cache = rs_recover_cache_get(r->parity);
+    bool cached = cache != nullptr;
+    for (u32 blocks = want_blocks, w = 0; cached && blocks; blocks &= blocks - 1, w++) {
+        cached = rs_recover_cache_lookup(cache, D, have_blocks, blocks & -blocks, &have_to_want[w*D]);
+    }
+    if (!cached) {
+        if (!rs_recover_many_mat(r, have_blocks, want_blocks, mat, have_to_want)) {
+            free(mat);
+            die("could not get recover matrix");
+        }
+        for (u32 blocks = want_blocks, w = 0; cache != nullptr && blocks; blocks &= blocks - 1, w++) {
+            rs_recover_cache_insert(cache, D, have_blocks, blocks & -blocks, &have_to_want[w*D]);
+        }
     }
-    rs_recover_matmul_funcs[D](size, have, want, mat);
+    rs_recover_many_matmul_funcs[D](size, have, W, want, have_to_want);
     free(mat);
 }
 
+// The built-in pool for the parallel variants. One job runs at a time, and the
+// submitting thread works on it too. Tasks are few and large, so we just pick
+// them up under the lock. Plain pthreads rather than `std::thread` and
+// friends, so that `librs` doesn't need the C++ runtime.
+struct rs_pool_state {
+    pthread_mutex_t submit_mu; // held for the whole job
+    pthread_mutex_t mu;        // protects everything below
+    pthread_cond_t work_cv;
+    pthread_cond_t done_cv;
+    uint32_t threads;
+    uint32_t started;
+    void (*fn)(void* arg, uint32_t i);
+    void* arg;
+    uint32_t n;
+    uint32_t next;
+    uint32_t done;
+};
+
+// Statically initialized and never destroyed, since the workers are never
+// joined, and they wait on it.
+static rs_pool_state rs_pool = {
+    .submit_mu = PTHREAD_MUTEX_INITIALIZER,
+    .mu = PTHREAD_MUTEX_INITIALIZER,
+    .work_cv = PTHREAD_COND_INITIALIZER,
+    .done_cv = PTHREAD_COND_INITIALIZER,
+    .threads = 4,
+    .started = 0,
+    .fn = nullptr,
+    .arg = nullptr,
+    .n = 0,
+    .next = 0,
+    .done = 0,
+};
+
+static void* rs_pool_worker(void*) {
+    pthread_mutex_lock(&rs_pool.mu);
+    for (;;) {
+        while (rs_pool.next >= rs_pool.n) {
+            pthread_cond_wait(&rs_pool.work_cv, &rs_pool.mu);
+        }
+        uint32_t i = rs_pool.next++;
+        auto fn = rs_pool.fn;
+        void* arg = rs_pool.arg;
+        pthread_mutex_unlock(&rs_pool.mu);
+        fn(arg, i);
+        pthread_mutex_lock(&rs_pool.mu);
+        if (++rs_pool.done == rs_pool.n) {
+            pthread_cond_broadcast(&rs_pool.done_cv);
+        }
+    }
+    return nullptr;
+}
+
+static void rs_pool_run(void*, uint32_t n, void (*fn)(void* arg, uint32_t i), void* arg) {
+    pthread_mutex_lock(&rs_pool.submit_mu);
+    pthread_mutex_lock(&rs_pool.mu);
+    // the calling thread is one of them
+    for (; rs_pool.started+1 < rs_pool.threads; rs_pool.started++) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        pthread_t thread;
+        int err = pthread_create(&thread, &attr, rs_pool_worker, nullptr);
+        pthread_attr_destroy(&attr);
+        if (err != 0) {
+            die("could not start pool thread: %s", strerror(err));
+        }
+    }
+    rs_pool.fn = fn;
+    rs_pool.arg = arg;
+    rs_pool.n = n;
+    rs_pool.next = 0;
+    rs_pool.done = 0;
+    pthread_cond_broadcast(&rs_pool.work_cv);
+    while (rs_pool.next < rs_pool.n) {
+        uint32_t i = rs_pool.next++;
+        pthread_mutex_unlock(&rs_pool.mu);
+        fn(arg, i);
+        pthread_mutex_lock(&rs_pool.mu);
+        rs_pool.done++;
+    }
+    while (rs_pool.done < rs_pool.n) {
+        pthread_cond_wait(&rs_pool.done_cv, &rs_pool.mu);
+    }
+    rs_pool.n = 0;
+    rs_pool.next = 0;
+    pthread_mutex_unlock(&rs_pool.mu);
+    pthread_mutex_unlock(&rs_pool.submit_mu);
+}
+
+void rs_set_threads(uint32_t threads) {
+    if (threads < 1) {
+        die("need at least one thread");
+    }
+    pthread_mutex_lock(&rs_pool.mu);
+    rs_pool.threads = threads;
+    pthread_mutex_unlock(&rs_pool.mu);
+}
+
+static uint32_t rs_executor_threads(const struct rs_executor* executor) {
+    if (executor != nullptr) {
+        return executor->threads;
+    }
+    pthread_mutex_lock(&rs_pool.mu);
+    uint32_t threads = rs_pool.threads;
+    pthread_mutex_unlock(&rs_pool.mu);
+    return threads;
+}
+
+// Below this much per thread it's not worth waking anybody up.
+#define RS_PARALLEL_MIN_CHUNK (1ull<<20)
+
+// We give each task one contiguous, page aligned chunk, rather than
+// interleaving small stripes across the threads. The kernels stream through
+// memory anyway, and this way each thread always touches the same pages of a
+// given buffer, which is what you want if the caller has first-touched them
+// with the same split, or on NUMA machines generally.
+static uint32_t rs_parallel_chunks(uint64_t size, uint32_t threads, uint64_t* chunk) {
+    uint32_t n = std::min<uint64_t>(threads, size / RS_PARALLEL_MIN_CHUNK);
+    if (n < 2) {
+        *chunk = size;
+        return 1;
+    }
+    *chunk = (size/n + RS_PAGE_SIZE - 1) & ~(uint64_t)(RS_PAGE_SIZE - 1);
+    return (size + *chunk - 1) / *chunk;
+}
+
+static void rs_executor_run(const struct rs_executor* executor, uint32_t n, void (*fn)(void* arg, uint32_t i), void* arg) {
+    if (executor != nullptr) {
+        executor->run(executor->ctx, n, fn, arg);
+    } else {
+        rs_pool_run(nullptr, n, fn, arg);
+    }
+}
+
+namespace {
+struct rs_compute_parity_job {
+    struct rs* r;
+    uint64_t size;
+    uint64_t chunk;
+    const uint8_t** data;
+    uint8_t** parity;
+};
+}
+
+static void rs_compute_parity_task(void* arg, uint32_t i) {
+    const auto& job = *(const rs_compute_parity_job*)arg;
+    int D = rs_data_blocks(job.r->parity);
+    int P = rs_parity_blocks(job.r->parity);
+    uint64_t offset = i*job.chunk;
+    const u8* data[16];
+    u8* parity[16];
+    for (int j = 0; j < D; j++) {
+        data[j] = job.data[j] + offset;
+    }
+    for (int j = 0; j < P; j++) {
+        parity[j] = job.parity[j] + offset;
+    }
+    rs_compute_parity_funcs[job.r->parity](job.r, std::min(job.chunk, job.size - offset), data, parity);
+}
+
+void rs_compute_parity_parallel(struct rs* r, uint64_t size, const uint8_t** data, uint8_t** parity, const struct rs_executor* executor) {
+    rs_compute_parity_job job = {.r = r, .size = size, .chunk = 0, .data = data, .parity = parity};
+    uint32_t n = rs_parallel_chunks(size, rs_executor_threads(executor), &job.chunk);
+    if (n < 2) {
+        rs_compute_parity(r, size, data, parity);
+        return;
+    }
+    rs_executor_run(executor, n, rs_compute_parity_task, &job);
+}
+
+namespace {
+struct rs_recover_job {
+    int D;
+    uint64_t size;
+    uint64_t chunk;
+    const uint8_t** have;
+    uint8_t* want;
+    u8 have_to_want[16];
+};
+}
+
+static void rs_recover_task(void* arg, uint32_t i) {
+    const auto& job = *(const rs_recover_job*)arg;
+    uint64_t offset = i*job.chunk;
+    const u8* have[16];
+    for (int j = 0; j < job.D; j++) {
+        have[j] = job.have[j] + offset;
+    }
+    rs_recover_matmul_funcs[job.D](std::min(job.chunk, job.size - offset), have, job.want + offset, job.have_to_want);
+}
+
+void rs_recover_parallel(
+    struct rs* r,
+    uint64_t size,
+    uint32_t have_blocks,
+    const uint8_t** have,
+    uint32_t want_block,
+    uint8_t* want,
+    const struct rs_executor* executor
+) {
+    rs_recover_job job = {.D = rs_data_blocks(r->parity), .size = size, .chunk = 0, .have = have, .want = want, .have_to_want = {}};
+    uint32_t n = rs_parallel_chunks(size, rs_executor_threads(executor), &job.chunk);
+    if (n < 2) {
+        rs_recover(r, size, have_blocks, have, want_block, want);
+        return;
+    }
+    // invert once, up front
+    rs_recover_row(r, have_blocks, want_block, job.have_to_want);
+    rs_executor_run(executor, n, rs_recover_task, &job);
+}
+
 __attribute__((constructor))
 static void rs_initialize_compute_parity_funcs() {
     rs_compute_parity_funcs[rs_mk_parity(0, 0)] = nullptr;
@@ -491,3 +1310,23 @@ static void rs_initialize_recover_matmul_funcs() {
     rs_recover_matmul_funcs[14] = &rs_recover_matmul_tmpl<14>;
     rs_recover_matmul_funcs[15] = &rs_recover_matmul_tmpl<15>;
 }
+
+__attribute__((constructor))
+static void rs_initialize_recover_many_matmul_funcs() {
+    rs_recover_many_matmul_funcs[0] = nullptr;
+    rs_recover_many_matmul_funcs[1] = nullptr;
+    rs_recover_many_matmul_funcs[2] = &rs_recover_many_matmul_tmpl<2>;
+    rs_recover_many_matmul_funcs[3] = &rs_recover_many_matmul_tmpl<3>;
+    rs_recover_many_matmul_funcs[4] = &rs_recover_many_matmul_tmpl<4>;
+    rs_recover_many_matmul_funcs[5] = &rs_recover_many_matmul_tmpl<5>;
+    rs_recover_many_matmul_funcs[6] = &rs_recover_many_matmul_tmpl<6>;
+    rs_recover_many_matmul_funcs[7] = &rs_recover_many_matmul_tmpl<7>;
+    rs_recover_many_matmul_funcs[8] = &rs_recover_many_matmul_tmpl<8>;
+    rs_recover_many_matmul_funcs[9] = &rs_recover_many_matmul_tmpl<9>;
+    rs_recover_many_matmul_funcs[10] = &rs_recover_many_matmul_tmpl<10>;
+    rs_recover_many_matmul_funcs[11] = &rs_recover_many_matmul_tmpl<11>;
+    rs_recover_many_matmul_funcs[12] = &rs_recover_many_matmul_tmpl<12>;
+    rs_recover_many_matmul_funcs[13] = &rs_recover_many_matmul_tmpl<13>;
+    rs_recover_many_matmul_funcs[14] = &rs_recover_many_matmul_tmpl<14>;
+    rs_recover_many_matmul_funcs[15] = &rs_recover_many_matmul_tmpl<15>;
+}
@@ -55,6 +55,9 @@ enum rs_cpu_level {
     RS_CPU_SCALAR = 1,
     RS_CPU_AVX2 = 2,
     RS_CPU_GFNI = 3,
+    // Like the above, but with 512-bit vectors. Requires AVX512F and AVX512BW.
+    RS_CPU_AVX512 = 4,
+    RS_CPU_GFNI512 = 5,
 };
 
 bool rs_has_cpu_level(enum rs_cpu_level level);
@@ -81,6 +84,19 @@ void rs_compute_parity(
     uint8_t** parity      // output, uint8_t[P][size]
 );
 
+#define RS_PAGE_SIZE 4096
+
+// Like `rs_compute_parity`, but also computes the CRC32C of every page of the
+// data and parity blocks, in the same pass, while they are still in cache.
+// `size` must be a multiple of `RS_PAGE_SIZE`.
+void rs_compute_parity_crc32c(
+    struct rs* rs,
+    uint64_t size,
+    const uint8_t** data, // input, uint8_t[D][size]
+    uint8_t** parity,     // output, uint8_t[P][size]
+    uint32_t* crcs        // output, uint32_t[B][size/RS_PAGE_SIZE], data blocks first
+);
+
 // Computes an arbitrary block given at least `D` other blocks.
 // This is what you use to recover a lost block.
 void rs_recover(
@@ -88,10 +104,64 @@ void rs_recover(
     uint64_t size,
     uint32_t have_blocks,       // [0, B)[D], in bitmask (lowest bit = lowest index)
     const uint8_t** have,       // uint8_t[D][size]
-    uint32_t want_block,        // bit set = block we want (in the future this might also be a mask, if we want to recover multiple at once)
+    uint32_t want_block,        // bit set = block we want (see `rs_recover_many` to recover more than one)
     uint8_t* want               // uint8_t[size]
 );
 
+// Whether to cache the recovery matrices for each set of have/want blocks,
+// which is the default. Only useful to turn off for benchmarks.
+void rs_set_recover_cache(bool enabled);
+
+// Like `rs_recover`, but computes all the blocks in `want_blocks` at once,
+// inverting the matrix once and reading `have` once. Much cheaper than calling
+// `rs_recover` for each block when recovering more than one.
+void rs_recover_many(
+    struct rs* rs,
+    uint64_t size,
+    uint32_t have_blocks,       // [0, B)[D], in bitmask (lowest bit = lowest index)
+    const uint8_t** have,       // uint8_t[D][size]
+    uint32_t want_blocks,       // [0, B)[W], in bitmask, disjoint from `have_blocks`
+    uint8_t** want              // uint8_t[W][size], in the same order as `want_blocks`
+);
+
+// Something to run the parallel variants below on, if you'd rather not use
+// the built-in pool.
+struct rs_executor {
+    // Must call `fn(arg, 0)`, ..., `fn(arg, n-1)`, possibly concurrently,
+    // and return once they have all returned.
+    void (*run)(void* ctx, uint32_t n, void (*fn)(void* arg, uint32_t i), void* arg);
+    void* ctx;
+    // How many threads `run` will use -- we split the work in at most this
+    // many tasks.
+    uint32_t threads;
+};
+
+// How many threads the built-in pool uses, including the calling one, 4 by
+// default. The pool only ever grows, and runs one job at a time.
+void rs_set_threads(uint32_t threads);
+
+// Like `rs_compute_parity` and `rs_recover`, but split `size` into one
+// contiguous chunk per thread, for large buffers (say, a whole span). Buffers
+// smaller than a couple of MiBs are done on the calling thread. Uses the
+// built-in pool if `executor` is NULL.
+void rs_compute_parity_parallel(
+    struct rs* rs,
+    uint64_t size,
+    const uint8_t** data,
+    uint8_t** parity,
+    const struct rs_executor* executor
+);
+
+void rs_recover_parallel(
+    struct rs* rs,
+    uint64_t size,
+    uint32_t have_blocks,
+    const uint8_t** have,
+    uint32_t want_block,
+    uint8_t* want,
+    const struct rs_executor* executor
+);
+
 #ifdef __cplusplus
 }
 #endif
@@ -10,6 +10,7 @@
 
 #include "rs.h"
 #include "Random.hpp"
+#include "crc32c.h"
 
 #define ASSERT(expr) do { \
         if (!(expr)) { \
@@ -18,17 +19,26 @@
         } \
     } while (false)
 
+// Runs the tasks backwards, one after the other.
+static void reverseRun(void*, uint32_t n, void (*fn)(void* arg, uint32_t i), void* arg) {
+    for (uint32_t i = n; i > 0; i--) {
+        fn(arg, i-1);
+    }
+}
+
 int main() {
     RandomGenerator rand(0);
     constexpr int maxBlockSize = 1000;
     std::vector<uint8_t> buf(maxBlockSize*(16+16)); // all blocks
-    std::vector<rs_cpu_level> cpuLevels = {RS_CPU_SCALAR, RS_CPU_AVX2, RS_CPU_GFNI};
+    std::vector<rs_cpu_level> cpuLevels = {RS_CPU_SCALAR, RS_CPU_AVX2, RS_CPU_GFNI, RS_CPU_AVX512, RS_CPU_GFNI512};
     for (const auto level: cpuLevels) {
         if (!rs_has_cpu_level(level)) {
             continue;
         }
         rs_set_cpu_level(level);
         for (int i = 0; i < 16*16*100; i++) {
+            // exercise both fresh and cached recovery matrices
+            rs_set_recover_cache(i%4 != 0);
             int numData = 2 + rand.generate64()%(16-2);
             int numParity = 1 + rand.generate64()%(16-1);
             int blockSize;
@@ -78,7 +88,107 @@ int main() {
                 std::vector<uint8_t> expectedBlock(data.begin() + wantBlock*blockSize, data.begin() + (wantBlock+1)*blockSize);
                 ASSERT(expectedBlock == recoveredBlock);
             }
+            // restore many random blocks at once, using random blocks.
+            {
+                std::vector<uint8_t> allBlocks(numData+numParity);
+                for (int i = 0; i < allBlocks.size(); i++) {
+                    allBlocks[i] = i;
+                }
+                for (int i = 0; i < numData+numParity-1; i++) {
+                    std::swap(allBlocks[i], allBlocks[i + rand.generate64()%(numData+numParity-i)]);
+                }
+                int numWant = 1 + rand.generate64()%numParity;
+                std::sort(allBlocks.begin(), allBlocks.begin()+numData);
+                std::sort(allBlocks.begin()+numData, allBlocks.begin()+numData+numWant);
+                uint32_t haveBlocksBits = 0;
+                std::vector<const uint8_t*> havePtrs(numData);
+                for (int i = 0; i < numData; i++) {
+                    haveBlocksBits |= 1u << allBlocks[i];
+                    havePtrs[i] = &data[allBlocks[i]*blockSize];
+                }
+                uint32_t wantBlocksBits = 0;
+                std::vector<uint8_t> recoveredBlocks(numWant*blockSize);
+                std::vector<uint8_t*> wantPtrs(numWant);
+                for (int i = 0; i < numWant; i++) {
+                    wantBlocksBits |= 1u << allBlocks[numData+i];
+                    wantPtrs[i] = &recoveredBlocks[i*blockSize];
+                }
+                rs_recover_many(rs, blockSize, haveBlocksBits, &havePtrs[0], wantBlocksBits, &wantPtrs[0]);
+                for (int i = 0; i < numWant; i++) {
+                    int wantBlock = allBlocks[numData+i];
+                    ASSERT(memcmp(&data[wantBlock*blockSize], wantPtrs[i], blockSize) == 0);
+                }
+            }
         }        
+        // parity and page checksums in one go, against doing them separately
+        for (int i = 0; i < 16*16; i++) {
+            int numData = 2 + rand.generate64()%(16-2);
+            int numParity = 1 + rand.generate64()%(16-1);
+            int pages = 1 + rand.generate64()%9;
+            uint64_t blockSize = pages*RS_PAGE_SIZE;
+            auto rs = rs_get(rs_mk_parity(numData, numParity));
+            std::vector<uint8_t> blocks((numData + 2*numParity)*blockSize);
+            rand.generateBytes((char*)blocks.data(), numData*blockSize);
+            std::vector<const uint8_t*> dataPtrs(numData);
+            for (int i = 0; i < numData; i++) {
+                dataPtrs[i] = &blocks[i*blockSize];
+            }
+            std::vector<uint8_t*> parityPtrs(numParity);
+            std::vector<uint8_t*> expectedParityPtrs(numParity);
+            for (int i = 0; i < numParity; i++) {
+                parityPtrs[i] = &blocks[(numData+i)*blockSize];
+                expectedParityPtrs[i] = &blocks[(numData+numParity+i)*blockSize];
+            }
+            std::vector<uint32_t> crcs((numData+numParity)*pages);
+            rs_compute_parity_crc32c(rs, blockSize, &dataPtrs[0], &parityPtrs[0], &crcs[0]);
+            rs_compute_parity(rs, blockSize, &dataPtrs[0], &expectedParityPtrs[0]);
+            ASSERT(memcmp(parityPtrs[0], expectedParityPtrs[0], numParity*blockSize) == 0);
+            for (int i = 0; i < numData+numParity; i++) {
+                for (int j = 0; j < pages; j++) {
+                    ASSERT(crcs[i*pages + j] == crc32c(0, (const char*)&blocks[i*blockSize + j*RS_PAGE_SIZE], RS_PAGE_SIZE));
+                }
+            }
+        }
+        // large buffers split across threads, against doing them in one go
+        rs_set_threads(3);
+        rs_executor reverseExecutor = {.run = reverseRun, .ctx = nullptr, .threads = 5};
+        for (int i = 0; i < 4; i++) {
+            int numData = 2 + rand.generate64()%(16-2);
+            int numParity = 1 + rand.generate64()%(16-1);
+            uint64_t blockSize = (2<<20) + rand.generate64()%(4<<20);
+            if (rs_get_cpu_level() == RS_CPU_SCALAR) {
+                numData = std::min(numData, 4);
+                numParity = std::min(numParity, 2);
+            }
+            const rs_executor* executor = i%2 ? &reverseExecutor : nullptr;
+            auto rs = rs_get(rs_mk_parity(numData, numParity));
+            std::vector<uint8_t> blocks((numData + 2*numParity + 1)*blockSize);
+            rand.generateBytes((char*)blocks.data(), numData*blockSize);
+            std::vector<const uint8_t*> dataPtrs(numData);
+            for (int i = 0; i < numData; i++) {
+                dataPtrs[i] = &blocks[i*blockSize];
+            }
+            std::vector<uint8_t*> parityPtrs(numParity);
+            std::vector<uint8_t*> expectedParityPtrs(numParity);
+            for (int i = 0; i < numParity; i++) {
+                parityPtrs[i] = &blocks[(numData+i)*blockSize];
+                expectedParityPtrs[i] = &blocks[(numData+numParity+i)*blockSize];
+            }
+            rs_compute_parity_parallel(rs, blockSize, &dataPtrs[0], &parityPtrs[0], executor);
+            rs_compute_parity(rs, blockSize, &dataPtrs[0], &expectedParityPtrs[0]);
+            ASSERT(memcmp(parityPtrs[0], expectedParityPtrs[0], numParity*blockSize) == 0);
+            // recover the first data block from the others and the last parity block
+            uint32_t haveBlocksBits = 1u << (numData+numParity-1);
+            std::vector<const uint8_t*> havePtrs;
+            for (int i = 1; i < numData; i++) {
+                haveBlocksBits |= 1u << i;
+                havePtrs.emplace_back(dataPtrs[i]);
+            }
+            havePtrs.emplace_back(parityPtrs[numParity-1]);
+            uint8_t* recoveredBlock = &blocks[(numData+2*numParity)*blockSize];
+            rs_recover_parallel(rs, blockSize, haveBlocksBits, &havePtrs[0], 1u, recoveredBlock, executor);
+            ASSERT(memcmp(dataPtrs[0], recoveredBlock, blockSize) == 0);
+        }
     }
     return 0;
 }
@@ -6,8 +6,11 @@
 
 #include <atomic>
 #include <cstdint>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <ostream>
+#include <sstream>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -34,19 +37,81 @@
 #include "ShardDB.hpp"
 #include "ShardKey.hpp"
 #include "SharedRocksDB.hpp"
+#include "SnapshotTransfer.hpp"
 #include "RegistryClient.hpp"
+#include "MPMC.hpp"
 #include "SPSC.hpp"
 #include "Time.hpp"
 #include "Timings.hpp"
 #include "UDPSocketPair.hpp"
 #include "Xmon.hpp"
 
+// The stages a write request goes through after being received, in order.
+// `ShardShared::timings` has the total time per request kind, these tell us
+// where it went.
+enum class ShardReqStage : uint8_t {
+    ENQUEUE = 0, // pushed to the writer queue by the server
+    DEQUEUE = 1, // pulled from the writer queue
+    PREPARE = 2, // log entry prepared (or failed to)
+    APPEND = 3,  // appended to LogsDB
+    RELEASE = 4, // released by LogsDB and read back to be applied
+    APPLY = 5,   // applied, response ready
+    FLUSH = 6,   // durable
+    SEND = 7,    // response sent
+};
+
+constexpr int SHARD_REQ_STAGES = 8;
+
+std::ostream& operator<<(std::ostream& out, ShardReqStage stage) {
+    switch (stage) {
+    case ShardReqStage::ENQUEUE: return out << "enqueue";
+    case ShardReqStage::DEQUEUE: return out << "dequeue";
+    case ShardReqStage::PREPARE: return out << "prepare";
+    case ShardReqStage::APPEND: return out << "append";
+    case ShardReqStage::RELEASE: return out << "release";
+    case ShardReqStage::APPLY: return out << "apply";
+    case ShardReqStage::FLUSH: return out << "flush";
+    case ShardReqStage::SEND: return out << "send";
+    default: return out << "ShardReqStage(" << (int)stage << ")";
+    }
+}
+
 struct ShardReq {
     uint32_t protocol;
-    ShardReqMsg msg;
     TernTime receivedAt;
+    std::array<TernTime, SHARD_REQ_STAGES> stagedAt; // when each stage was done, 0 if we haven't got there (or skipped it)
     IpPort clientAddr;
     int sockIx; // which sock to use to reply
+
+    // The message might have bytes in the server's decode arena, which we keep
+    // alive for as long as the request is around. It's only handed out as const,
+    // so that nothing can be moved out of it and outlive the arena: copies of
+    // `BincodeBytes` always go to the heap.
+    const ShardReqMsg& msg() const {
+        return _msg;
+    }
+
+    void setMsg(ShardReqMsg&& msg, BincodeArena* arena) {
+        _arena = arena == nullptr ? BincodeArenaRef() : BincodeArenaRef(arena);
+        _msg = std::move(msg);
+    }
+
+private:
+    BincodeArenaRef _arena; // declared before `_msg`, so that it's released after it
+    ShardReqMsg _msg;
+};
+
+// What's left of a write request once we've packed its response, while the
+// response waits to be flushed and sent.
+struct ShardReqTrace {
+    ShardMessageKind kind;
+    uint64_t id;
+    TernTime receivedAt;
+    std::array<TernTime, SHARD_REQ_STAGES> stagedAt;
+
+    ShardReqTrace(const ShardReq& req) :
+        kind(req.msg().body.kind()), id(req.msg().id), receivedAt(req.receivedAt), stagedAt(req.stagedAt)
+    {}
 };
 
 struct ProxyLogsDBRequest {
@@ -62,6 +127,7 @@ struct ProxyLogsDBResponse {
 // TODO make options
 const int WRITER_QUEUE_SIZE = 8192;
 const int READER_QUEUE_SIZE = 1024;
+const int SYNC_QUEUE_SIZE = 4; // how many write batches can be waiting for fsync
 const int MAX_RECV_MSGS = 100;
 
 enum class WriterQueueEntryKind :uint8_t {
@@ -173,6 +239,11 @@ public:
         return std::get<2>(_data);
     }
 
+    ShardReq& getShardReq() {
+        ALWAYS_ASSERT(_kind == WriterQueueEntryKind::SHARD_REQUEST, "%s != %s", _kind, WriterQueueEntryKind::SHARD_REQUEST);
+        return std::get<2>(_data);
+    }
+
     ShardReq&& moveShardReq() {
         ALWAYS_ASSERT(_kind == WriterQueueEntryKind::SHARD_REQUEST, "%s != %s", _kind, WriterQueueEntryKind::SHARD_REQUEST);
         clear();
@@ -235,15 +306,31 @@ private:
     std::variant<LogsDBRequest, LogsDBResponse, ShardReq, ProxyShardRespMsg, ProxyLogsDBRequest, ProxyLogsDBResponse> _data;
 };
 
+// What the writer produced in one step when syncing asynchronously: the
+// messages in `sender` (LogsDB acks, client responses) can only go out once
+// everything up to `point` is durable.
+struct ShardSyncBatch {
+    ShardDBSyncPoint point;
+    std::unique_ptr<UDPSender> sender;
+    std::vector<ShardReqTrace> traces; // the requests whose responses are in `sender`
+};
+
 struct ShardShared {
     const ShardOptions& options;
 
     // network
-    std::array<UDPSocketPair, 1> socks; // in an array to play with UDPReceiver<>
+    // One entry per server thread, all bound to the same addresses with SO_REUSEPORT
+    // if there is more than one. Each in an array to play with UDPReceiver<>.
+    std::vector<std::array<UDPSocketPair, 1>> socks;
 
-    // server to -> reader/writer communication
-    SPSC<ShardWriterRequest> writerRequestsQueue;
-    SPSC<ShardReq> readerRequestsQueue;
+    // server to -> reader/writer communication, every server thread pushes to these
+    MPMC<ShardWriterRequest> writerRequestsQueue;
+    std::vector<std::unique_ptr<MPMC<ShardReq>>> readerRequestsQueues; // one per reader
+
+    // writer -> syncer with batches to sync and send, and back with the
+    // emptied senders. Only used with `asyncWalSync`.
+    SPSC<ShardSyncBatch> syncQueue;
+    SPSC<ShardSyncBatch> syncedQueue;
 
     // databases and caches
     SharedRocksDB& sharedDB;
@@ -257,24 +344,59 @@ struct ShardShared {
 
     // statistics
     std::array<Timings, maxShardMessageKind+1> timings;
+    // How long write requests took in each stage, from the previous one they went through
+    std::array<std::array<Timings, SHARD_REQ_STAGES>, maxShardMessageKind+1> stageTimings;
     std::array<ErrorCount, maxShardMessageKind+1> errors;
     std::atomic<double> logEntriesQueueSize;
     std::atomic<double> readerRequestQueueSize;
-    std::array<std::atomic<double>, 2> receivedRequests; // how many requests we got at once from each socket
+    std::vector<std::array<std::atomic<double>, 2>> receivedRequests; // how many requests we got at once from each socket, per server
     std::atomic<double> pulledWriteRequests; // how many requests we got from write queue
     std::atomic<double> pulledReadRequests; // how many requests we got from read queue
+    SpinCounters receiverSpinCounters; // shared by all servers
 
     // we should get up to date information from registry before we start serving any requests
     // this is populated by ShardRegisterer
     std::atomic<bool> isInitiated;
     std::atomic<bool> isBlockServiceCacheInitiated;
 
+    // writer -> readers, the read lease we hold, see `LogsDB::readLease()`. The index and the
+    // expiry are only meaningful together, so they're published under a seqlock: readers retry
+    // while `readLeaseSeq` is odd or changed under them.
+    std::atomic<uint64_t> readLeaseSeq;
+    std::atomic<uint64_t> readLeaseIdx;
+    std::atomic<TernTime> readLeaseExpiry;
+
+    // only called by the writer
+    void publishReadLease(const LogsDBReadLease& lease) {
+        uint64_t seq = readLeaseSeq.load(std::memory_order_relaxed);
+        readLeaseSeq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        readLeaseIdx.store(lease.idx.u64, std::memory_order_relaxed);
+        readLeaseExpiry.store(lease.expiry, std::memory_order_relaxed);
+        readLeaseSeq.store(seq + 2, std::memory_order_release);
+    }
+
+    LogsDBReadLease readLease() const {
+        for (;;) {
+            uint64_t seq = readLeaseSeq.load(std::memory_order_acquire);
+            if (unlikely(seq & 1)) { continue; }
+            LogsDBReadLease lease;
+            lease.idx = readLeaseIdx.load(std::memory_order_relaxed);
+            lease.expiry = readLeaseExpiry.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (likely(readLeaseSeq.load(std::memory_order_relaxed) == seq)) {
+                return lease;
+            }
+        }
+    }
+
     ShardShared() = delete;
-    ShardShared(const ShardOptions& options_, SharedRocksDB& sharedDB_, BlockServicesCacheDB& blockServicesCache_, ShardDB& shardDB_, LogsDB& logsDB_, UDPSocketPair&& sock) :
+    ShardShared(const ShardOptions& options_, SharedRocksDB& sharedDB_, BlockServicesCacheDB& blockServicesCache_, ShardDB& shardDB_, LogsDB& logsDB_, std::vector<std::array<UDPSocketPair, 1>>&& socks_) :
         options(options_),
-        socks({std::move(sock)}),
-        writerRequestsQueue(WRITER_QUEUE_SIZE),
-        readerRequestsQueue(READER_QUEUE_SIZE),
+        socks(std::move(socks_)),
+        writerRequestsQueue(WRITER_QUEUE_SIZE, options.serverOptions.spin),
+        syncQueue(SYNC_QUEUE_SIZE),
+        syncedQueue(SYNC_QUEUE_SIZE),
         sharedDB(sharedDB_),
         logsDB(logsDB_),
         shardDB(shardDB_),
@@ -283,21 +405,70 @@ struct ShardShared {
         leadersAtOtherLocations(std::make_shared<std::vector<FullShardInfo>>()),
         logEntriesQueueSize(0),
         readerRequestQueueSize(0),
+        receivedRequests(socks.size()),
         pulledWriteRequests(0),
         pulledReadRequests(0),
         isInitiated(false),
-        isBlockServiceCacheInitiated(false)
+        isBlockServiceCacheInitiated(false),
+        readLeaseSeq(0),
+        readLeaseIdx(0),
+        readLeaseExpiry(0)
     {
         for (ShardMessageKind kind : allShardMessageKind) {
             timings[(int)kind] = Timings::Standard();
+            for (auto& stageTiming : stageTimings[(int)kind]) {
+                stageTiming = Timings::Standard();
+            }
         }
-        for (auto& x: receivedRequests) {
-            x = 0;
+        for (auto& xs: receivedRequests) {
+            for (auto& x: xs) {
+                x = 0;
+            }
+        }
+        for (int i = 0; i < options.numReaders; i++) {
+            readerRequestsQueues.emplace_back(std::make_unique<MPMC<ShardReq>>(READER_QUEUE_SIZE, options.serverOptions.spin));
         }
     }
 
-    const UDPSocketPair& sock() const {
-        return socks[0];
+    // All server sockets share the same addresses, so replies can go out of any of them.
+    // Each sending thread picks its own with `sendIx`, so that they don't all contend on
+    // the same socket.
+    const UDPSocketPair& sock(size_t sendIx = 0) const {
+        return socks[sendIx % socks.size()][0];
+    }
+};
+
+// Records the time traced write requests spent in each stage once they're
+// sent, and logs the breakdown for some of the slow ones.
+struct ShardReqTracer {
+private:
+    static constexpr Duration SLOW_REQUEST = 1_sec;
+    static constexpr Duration SLOW_REQUEST_LOG_INTERVAL = 1_sec; // at most one slow request logged per interval
+
+    TernTime _lastSlowLogged;
+
+public:
+    void record(Env& env, ShardShared& shared, const std::vector<ShardReqTrace>& traces) {
+        for (const auto& trace : traces) {
+            auto& timings = shared.stageTimings[(int)trace.kind];
+            TernTime prev = trace.receivedAt;
+            for (int stage = 0; stage < SHARD_REQ_STAGES; stage++) {
+                if (trace.stagedAt[stage] == 0) { continue; }
+                timings[stage].add(trace.stagedAt[stage] - prev);
+                prev = trace.stagedAt[stage];
+            }
+            auto elapsed = prev - trace.receivedAt;
+            if (likely(elapsed < SLOW_REQUEST) || prev - _lastSlowLogged < SLOW_REQUEST_LOG_INTERVAL) { continue; }
+            _lastSlowLogged = prev;
+            std::ostringstream ss;
+            prev = trace.receivedAt;
+            for (int stage = 0; stage < SHARD_REQ_STAGES; stage++) {
+                if (trace.stagedAt[stage] == 0) { continue; }
+                ss << " " << (ShardReqStage)stage << "=" << (trace.stagedAt[stage] - prev);
+                prev = trace.stagedAt[stage];
+            }
+            LOG_INFO(env, "slow request %s kind %s took %s:%s", trace.id, trace.kind, elapsed, ss.str());
+        }
     }
 };
 
@@ -332,7 +503,7 @@ static void packShardResponse(
     const ShardRespMsg& msg
 ) {
     auto respKind = msg.body.kind();
-    auto reqKind = req.msg.body.kind();
+    auto reqKind = req.msg().body.kind();
     auto elapsed = ternNow() - req.receivedAt;
     shared.timings[(int)reqKind].add(elapsed);
     shared.errors[(int)reqKind].add( respKind != ShardMessageKind::ERROR ? TernError::NO_ERROR : msg.body.getError());
@@ -375,7 +546,7 @@ static void packCheckPointedShardResponse(
     const AES128Key& key
 ) {
     auto respKind = msg.body.resp.kind();
-    auto reqKind = req.msg.body.kind();
+    auto reqKind = req.msg().body.kind();
     auto elapsed = ternNow() - req.receivedAt;
     shared.timings[(int)reqKind].add(elapsed);
     shared.errors[(int)reqKind].add( respKind != ShardMessageKind::ERROR ? TernError::NO_ERROR : msg.body.resp.getError());
@@ -420,6 +591,7 @@ struct ShardServer : Loop {
 private:
     // init data
     ShardShared& _shared;
+    const size_t _serverIx; // which of _shared.socks we receive from
 
     // run data
     AES128Key _expandedCDCKey;
@@ -428,15 +600,27 @@ private:
     // log entries buffers
     std::vector<ShardWriterRequest> _writeEntries;
 
-    // read requests buffer
-    std::vector<ShardReq> _readRequests;
+    // read requests buffers, one per reader
+    std::vector<std::vector<ShardReq>> _readRequests;
+    size_t _nextReader; // round robin across readers
+
+    // requests are decoded in a fresh arena every step, which goes back to
+    // the pool once the readers/writer are done with the requests.
+    static constexpr size_t DECODE_ARENA_SIZE = 64 << 10;
+    BincodeArenaPool _decodeArenas;
+    BincodeArena* _decodeArena;
 
     std::unique_ptr<UDPReceiver<1>> _receiver;
     std::unique_ptr<ShardChannel> _channel;
 public:
-    ShardServer(Logger& logger, std::shared_ptr<XmonAgent>& xmon, ShardShared& shared) :
-        Loop(logger, xmon, "server"),
-        _shared(shared)
+    ShardServer(Logger& logger, std::shared_ptr<XmonAgent>& xmon, ShardShared& shared, size_t serverIx) :
+        Loop(logger, xmon, "server_" + std::to_string(serverIx)),
+        _shared(shared),
+        _serverIx(serverIx),
+        _readRequests(shared.readerRequestsQueues.size()),
+        _nextReader(0),
+        _decodeArenas(DECODE_ARENA_SIZE),
+        _decodeArena(nullptr)
     {
         auto convertProb = [this](const std::string& what, double prob, uint64_t& iprob) {
             if (prob != 0.0) {
@@ -447,7 +631,14 @@ public:
         };
         expandKey(ShardKey, _expandedShardKey);
         expandKey(CDCKey, _expandedCDCKey);
-        _receiver = std::make_unique<UDPReceiver<1>>(UDPReceiverConfig{.perSockMaxRecvMsg = MAX_RECV_MSGS, .maxMsgSize = MAX_UDP_MTU});
+        _receiver = std::make_unique<UDPReceiver<1>>(UDPReceiverConfig{
+            .perSockMaxRecvMsg = MAX_RECV_MSGS,
+            .maxMsgSize = MAX_UDP_MTU,
+            .spin = _shared.options.serverOptions.spin,
+            .spinCounters = &_shared.receiverSpinCounters,
+            .ioUring = _shared.options.serverOptions.ioUring,
+            .gro = _shared.options.serverOptions.gro,
+        });
         _channel = std::make_unique<ShardChannel>();
     }
 
@@ -548,12 +739,16 @@ private:
 
     void _handleShardRequest(UDPMessage& msg, uint32_t protocol) {
         LOG_DEBUG(_env, "received message from %s", msg.clientAddr);
-        if (unlikely(!_shared.options.isLeader())) {
+        // with read leases followers serve reads from clients, everything else goes to the leader
+        bool followerReads = _shared.options.logsDBOptions.readLeases && protocol == SHARD_REQ_PROTOCOL_VERSION;
+        if (unlikely(!_shared.options.isLeader() && !followerReads)) {
             LOG_DEBUG(_env, "not leader, dropping request %s", msg.clientAddr);
             return;
         }
 
         ShardReqMsg req;
+        size_t arenaUsed = _decodeArena->used();
+        msg.buf.arena = _decodeArena;
         try {
             switch (protocol) {
             case CDC_TO_SHARD_REQ_PROTOCOL_VERSION:
@@ -592,6 +787,11 @@ private:
 
         LOG_DEBUG(_env, "received request id %s, kind %s, from %s", req.id, req.body.kind(), msg.clientAddr);
 
+        if (unlikely(!_shared.options.isLeader() && !readOnlyShardReq(req.body.kind()))) {
+            LOG_DEBUG(_env, "not leader, dropping write request %s", msg.clientAddr);
+            return;
+        }
+
         if (bigRequest(req.body.kind())) {
                 if (unlikely(_env._shouldLog(LogLevel::LOG_TRACE))) {
                     LOG_TRACE(_env, "parsed request: %s", req);
@@ -602,12 +802,18 @@ private:
             LOG_DEBUG(_env, "parsed request: %s", req);
         }
 
-        auto& entry = readOnlyShardReq(req.body.kind()) ? _readRequests.emplace_back() : _writeEntries.emplace_back().setShardReq();
+        auto& entry = readOnlyShardReq(req.body.kind()) ? _nextReadRequests().emplace_back() : _writeEntries.emplace_back().setShardReq();
         entry.sockIx = msg.socketIx;
         entry.clientAddr = msg.clientAddr;
         entry.receivedAt = t0;
         entry.protocol = protocol;
-        entry.msg = std::move(req);
+        entry.setMsg(std::move(req), _decodeArena->used() != arenaUsed ? _decodeArena : nullptr);
+    }
+
+    std::vector<ShardReq>& _nextReadRequests() {
+        auto& requests = _readRequests[_nextReader];
+        _nextReader = (_nextReader + 1) % _readRequests.size();
+        return requests;
     }
 
     void _handleShardResponse(UDPMessage& msg, uint32_t protocol) {
@@ -640,9 +846,14 @@ public:
         }
 
         _writeEntries.clear();
-        _readRequests.clear();
+        for (auto& requests : _readRequests) {
+            requests.clear();
+        }
+        // after the clears above, since requests we failed to push might still
+        // be referring to the previous arena.
+        _decodeArena = &_decodeArenas.acquire();
 
-        if (unlikely(!_channel->receiveMessages(_env, _shared.socks, *_receiver))) {
+        if (unlikely(!_channel->receiveMessages(_env, _shared.socks[_serverIx], *_receiver))) {
             return;
         }
 
@@ -673,8 +884,9 @@ public:
             ++shardMsgCount[msg.socketIx];
         }
 
-        for (size_t i = 0; i < _shared.receivedRequests.size(); ++i) {
-            _shared.receivedRequests[i] = _shared.receivedRequests[i]*0.95 + ((double)shardMsgCount[i])*0.05;
+        auto& receivedRequests = _shared.receivedRequests[_serverIx];
+        for (size_t i = 0; i < receivedRequests.size(); ++i) {
+            receivedRequests[i] = receivedRequests[i]*0.95 + ((double)shardMsgCount[i])*0.05;
         }
 
         // write out write requests to queue
@@ -682,6 +894,12 @@ public:
             size_t numRequests = _writeEntries.size();
             if (numRequests > 0) {
                 LOG_DEBUG(_env, "pushing %s requests to writer", numRequests);
+                auto enqueuedAt = ternNow();
+                for (auto& entry : _writeEntries) {
+                    if (entry.kind() == WriterQueueEntryKind::SHARD_REQUEST) {
+                        entry.getShardReq().stagedAt[(int)ShardReqStage::ENQUEUE] = enqueuedAt;
+                    }
+                }
                 uint32_t pushed = _shared.writerRequestsQueue.push(_writeEntries);
                 _shared.logEntriesQueueSize = _shared.logEntriesQueueSize*0.95 + _shared.writerRequestsQueue.size()*0.05;
                 if (pushed < numRequests) {
@@ -689,17 +907,22 @@ public:
                 }
             }
         }
-        // write out read requests to queue
+        // write out read requests to queues
         {
-            size_t numReadRequests = _readRequests.size();
-            if (numReadRequests > 0) {
-                LOG_DEBUG(_env, "pushing %s read requests to reader", numReadRequests);
-                uint32_t pushed = _shared.readerRequestsQueue.push(_readRequests);
-                _shared.readerRequestQueueSize = _shared.readerRequestQueueSize*0.95 + _shared.readerRequestsQueue.size()*0.05;
-                if (pushed < numReadRequests) {
-                    LOG_INFO(_env, "tried to push %s elements to reader queue, but pushed %s instead", numReadRequests, pushed);
+            size_t queuedReadRequests = 0;
+            for (size_t i = 0; i < _readRequests.size(); ++i) {
+                auto& queue = *_shared.readerRequestsQueues[i];
+                size_t numReadRequests = _readRequests[i].size();
+                if (numReadRequests > 0) {
+                    LOG_DEBUG(_env, "pushing %s read requests to reader %s", numReadRequests, i);
+                    uint32_t pushed = queue.push(_readRequests[i]);
+                    if (pushed < numReadRequests) {
+                        LOG_INFO(_env, "tried to push %s elements to reader queue %s, but pushed %s instead", numReadRequests, i, pushed);
+                    }
                 }
+                queuedReadRequests += queue.size();
             }
+            _shared.readerRequestQueueSize = _shared.readerRequestQueueSize*0.95 + queuedReadRequests*0.05;
         }
     }
 };
@@ -743,12 +966,12 @@ private:
     AES128Key _expandedShardKey;
     AES128Key _expandedCDCKey;
 
-    // outgoing network
-    UDPSender _sender;
+    // outgoing network. With `asyncWalSync` this gets swapped with an empty
+    // one every time we hand a batch over to the syncer.
+    std::unique_ptr<UDPSender> _sender;
     RandomGenerator _packetDropRand;
     uint64_t _outgoingPacketDropProbability; // probability * 10,000
-
-
+    std::vector<ShardSyncBatch> _syncBatches; // buffer to push/pull to/from the syncer
 
     // work queue
     const size_t _maxWorkItemsAtOnce;
@@ -757,7 +980,9 @@ private:
     LogsDB& _logsDB;
     bool _isLogsDBLeader;
     uint64_t _currentLogIndex;
-    LogIdx _knownLastReleased; // used by leaders in proxy location to determine if they need to catch up
+    // Released in the primary location, used by leaders in proxy location to determine if they need to
+    // catch up. Can be ahead of what we apply, which stops at `LogsDB::getLastContinuous`.
+    LogIdx _knownLastReleased;
 
     Duration _nextTimeout;
     // buffers for separated items from work queue
@@ -774,14 +999,18 @@ private:
     std::vector<LogsDBResponse> _logsDBOutResponses;
 
     std::vector<LogsDBLogEntry> _logsDBEntries; // used for batching writes/reads to logsdb
-    std::vector<ShardLogEntry> _shardEntries; // used for batching logEntries
+    std::vector<ShardLogEntry> _shardEntries; // used for batching logEntries, consecutive entries with the same idx go in the same LogsDB entry
+    std::vector<ShardLogEntry> _appliedEntries; // entries in the LogsDB entry we're applying
+    // all the entries we read from LogsDB in one go, when applying them in parallel
+    std::vector<ShardLogEntry> _parallelEntries;
+    std::vector<ShardLogEntryToApply> _parallelEntriesToApply;
 
-    std::unordered_map<uint64_t, ShardLogEntry> _inFlightEntries; // used while primary leader to track in flight entries we produced
+    std::unordered_map<uint64_t, std::vector<ShardLogEntry>> _inFlightEntries; // used while primary leader to track in flight entries we produced, by LogsDB entry
 
     static constexpr Duration PROXIED_REUQEST_TIMEOUT = 100_ms;
     std::unordered_map<uint64_t, ProxyShardReq> _proxyShardRequests; // outstanding proxied shard requests
     std::unordered_map<uint64_t, std::pair<LogIdx, TernTime>> _proxyCatchupRequests; // outstanding logsdb catchup requests to primary leader
-    std::unordered_map<uint64_t, std::pair<ShardRespContainer, ProxyShardReq>> _proxiedResponses; // responses from primary location that we need to send back to client
+    std::unordered_multimap<uint64_t, std::pair<ShardRespContainer, ProxyShardReq>> _proxiedResponses; // responses from primary location that we need to send back to client, by the log entry they wait for
 
     std::vector<ProxyLogsDBRequest> _proxyReadRequests; // currently processing proxied read requests
     std::vector<LogIdx>  _proxyReadRequestsIndices;  // indices from above reuqests as LogsDB api needs them
@@ -800,7 +1029,9 @@ private:
 
     uint64_t _requestIdCounter;
 
-    std::unordered_map<uint64_t, ShardReq> _logIdToShardRequest; // used to track which log entry was generated by which request
+    std::unordered_map<uint64_t, std::vector<ShardReq>> _logIdToShardRequests; // used to track which log entries were generated by which requests, in the order they appear in the LogsDB entry
+    std::vector<ShardReqTrace> _traces; // requests we've packed responses for in this step
+    ShardReqTracer _tracer;
     std::shared_ptr<std::array<AddrsInfo, LogsDB::REPLICA_COUNT>> _replicaInfo;
 
     virtual void sendStop() override {
@@ -812,7 +1043,7 @@ public:
         Loop(logger, xmon, "writer"),
         _basePath(shared.options.logsDBOptions.dbDir),
         _shared(shared),
-        _sender(UDPSenderConfig{.maxMsgSize = MAX_UDP_MTU}),
+        _sender(std::make_unique<UDPSender>(writerSenderConfig(shared.options))),
         _packetDropRand(ternNow().ns),
         _outgoingPacketDropProbability(0),
         _maxWorkItemsAtOnce(LogsDB::IN_FLIGHT_APPEND_WINDOW * 10),
@@ -837,10 +1068,48 @@ public:
         convertProb("outgoing", _shared.options.serverOptions.simulateOutgoingPacketDrop, _outgoingPacketDropProbability);
         _workItems.reserve(_maxWorkItemsAtOnce);
         _shardEntries.reserve(LogsDB::IN_FLIGHT_APPEND_WINDOW);
+        if (_shared.options.asyncWalSync) {
+            // the senders we can fill in while the syncer works, other than the current one
+            for (int i = 0; i < SYNC_QUEUE_SIZE-1; i++) {
+                _syncBatches.emplace_back().sender = std::make_unique<UDPSender>(writerSenderConfig(_shared.options));
+            }
+            ALWAYS_ASSERT(_shared.syncedQueue.push(_syncBatches) == _syncBatches.size());
+            _syncBatches.clear();
+        }
     }
 
     virtual ~ShardWriter() = default;
 
+    static UDPSenderConfig writerSenderConfig(const ShardOptions& options) {
+        return UDPSenderConfig{.maxMsgSize = MAX_UDP_MTU, .ioUring = options.serverOptions.ioUring, .gso = options.serverOptions.gso};
+    }
+
+    // Hands what we've written and the messages which depend on it being
+    // durable to the syncer, and takes back an empty sender. Waits if the
+    // syncer is too far behind.
+    void _handOffToSyncer(ShardDBSyncPoint&& point) {
+        _syncBatches.clear();
+        auto& batch = _syncBatches.emplace_back();
+        batch.point = std::move(point);
+        batch.sender = std::move(_sender);
+        batch.traces = std::move(_traces);
+        // there are only as many batches as fit in the queue, so this only
+        // fails if it's closed
+        if (unlikely(_shared.syncQueue.push(_syncBatches) == 0)) {
+            stop();
+            return;
+        }
+        _syncBatches.clear();
+        if (unlikely(_shared.syncedQueue.pull(_syncBatches, 1) == 0)) {
+            stop();
+            return;
+        }
+        _sender = std::move(_syncBatches[0].sender);
+        _traces = std::move(_syncBatches[0].traces);
+        _traces.clear();
+        _syncBatches.clear();
+    }
+
     void _sendProxyAndCatchupRequests() {
         if (!_shared.options.isProxyLocation()) {
             return;
@@ -867,7 +1136,7 @@ public:
             LogReqMsg reqMsg;
             reqMsg.id = req.first;
             reqMsg.body.setLogRead().idx = req.second.first;
-            _sender.prepareOutgoingMessage(
+            _sender->prepareOutgoingMessage(
                 _env,
                 _shared.sock().addr(),
                 *primaryLeaderAddress,
@@ -882,27 +1151,27 @@ public:
             req.second.lastSent = now;
             ProxyShardReqMsg reqMsg;
             reqMsg.id = req.first;
-            switch (req.second.req.msg.body.kind()) {
+            switch (req.second.req.msg().body.kind()) {
                 case ShardMessageKind::ADD_SPAN_INITIATE:
                 {
                     auto& addSpanReq = reqMsg.body.setAddSpanAtLocationInitiate();
                     addSpanReq.locationId = _shared.options.logsDBOptions.location;
                     addSpanReq.req.reference = NULL_INODE_ID;
-                    addSpanReq.req.req = req.second.req.msg.body.getAddSpanInitiate();
+                    addSpanReq.req.req = req.second.req.msg().body.getAddSpanInitiate();
                     break;
                 }
                 case ShardMessageKind::ADD_SPAN_INITIATE_WITH_REFERENCE:
                 {
                     auto& addSpanReq = reqMsg.body.setAddSpanAtLocationInitiate();
                     addSpanReq.locationId = _shared.options.logsDBOptions.location;
-                    addSpanReq.req = req.second.req.msg.body.getAddSpanInitiateWithReference();
+                    addSpanReq.req = req.second.req.msg().body.getAddSpanInitiateWithReference();
                     break;
                 }
                 default:
-                    reqMsg.body = req.second.req.msg.body;
+                    reqMsg.body = req.second.req.msg().body;
             }
 
-            _sender.prepareOutgoingMessage(
+            _sender->prepareOutgoingMessage(
                 _env,
                 _shared.sock().addr(),
                 *primaryLeaderAddress,
@@ -938,7 +1207,7 @@ public:
                     LOG_DEBUG(_env, "artificially dropping replication write %s to shard %s at location %s", write.idx, receiver.id, receiver.locationId);
                     return;
                 }
-                _sender.prepareOutgoingMessage(
+                _sender->prepareOutgoingMessage(
                     _env,
                     _shared.sock().addr(),
                     receiver.addrs,
@@ -950,56 +1219,141 @@ public:
         }
     }
 
+    // Requests for ADD_SPAN_INITIATE(_WITH_REFERENCE) are logged as ADD_SPAN_AT_LOCATION_INITIATE,
+    // turn the response back into what the client asked for.
+    static void _fixupAddSpanAtLocationResponse(const ShardReq& request, ShardRespContainer& resp) {
+        if (resp.kind() != ShardMessageKind::ADD_SPAN_AT_LOCATION_INITIATE) {
+            return;
+        }
+        ShardRespContainer tmpResp;
+        switch (request.msg().body.kind()) {
+            case ShardMessageKind::ADD_SPAN_INITIATE:
+            {
+                auto& addResp = tmpResp.setAddSpanInitiate();
+                addResp.blocks = std::move(resp.getAddSpanAtLocationInitiate().resp.blocks);
+                resp.setAddSpanInitiate().blocks = std::move(addResp.blocks);
+                break;
+            }
+            case ShardMessageKind::ADD_SPAN_INITIATE_WITH_REFERENCE:
+            {
+                auto& addResp = tmpResp.setAddSpanInitiateWithReference();
+                addResp.resp.blocks = std::move(resp.getAddSpanAtLocationInitiate().resp.blocks);
+                resp.setAddSpanInitiateWithReference().resp.blocks = std::move(addResp.resp.blocks);
+                break;
+            }
+            case ShardMessageKind::ADD_SPAN_AT_LOCATION_INITIATE:
+            {
+                break;
+            }
+            default:
+                ALWAYS_ASSERT(false, "Unexpected reponse kind %s for requests kind %s", resp.kind(), request.msg().body.kind() );
+        }
+    }
+
+    // Forwards to the client the response we got from the primary location for a request we proxied.
+    void _sendProxiedResponse(ProxyShardReq& proxyReq, ShardRespContainer& body) {
+        auto& req = proxyReq.req;
+        if (unlikely(req.msg().id == 0)) {
+            LOG_DEBUG(_env, "applying request-less log entry");
+            // client does not care about response
+            return;
+        }
+        LOG_DEBUG(_env, "applying log entry for request %s kind %s from %s", req.msg().id, req.msg().body.kind(), req.clientAddr);
+        proxyReq.finished = ternNow();
+        logSlowProxyReq(proxyReq);
+
+        // depending on protocol we need different kind of responses
+        bool dropArtificially = _packetDropRand.generate64() % 10'000 < _outgoingPacketDropProbability;
+        ALWAYS_ASSERT(req.protocol == SHARD_REQ_PROTOCOL_VERSION);
+        ShardRespMsg resp;
+        resp.id = req.msg().id;
+        resp.body = std::move(body);
+        _fixupAddSpanAtLocationResponse(req, resp.body);
+        packShardResponse(_env, _shared, _shared.sock().addr(), *_sender, dropArtificially, req, resp);
+        ALWAYS_ASSERT(_inFlightRequestKeys.erase(InFlightRequestKey{req.msg().id, req.clientAddr}) == 1);
+    }
+
     void _applyLogEntries() {
         ALWAYS_ASSERT(_logsDBEntries.empty());
         auto lastContinuousIdx = _logsDB.getLastContinuous();
         while (_currentLogIndex < lastContinuousIdx.u64) {
             _logsDB.readEntries(_logsDBEntries);
             ALWAYS_ASSERT(!_logsDBEntries.empty());
+            auto releasedAt = ternNow();
+            if (!_isLogsDBLeader && _shared.options.applyThreads > 1) {
+                _applyLogEntriesParallel();
+                _tryReplicateToOtherLocations();
+                _logsDBEntries.clear();
+                continue;
+            }
+            if (_shared.options.groupCommit) {
+                _shared.shardDB.startApplyGroup();
+            }
             for (auto& logsDBEntry : _logsDBEntries) {
                 ++_currentLogIndex;
                 ALWAYS_ASSERT(_currentLogIndex == logsDBEntry.idx);
                 ALWAYS_ASSERT(logsDBEntry.value.size() > 0);
                 BincodeBuf buf((char*)&logsDBEntry.value.front(), logsDBEntry.value.size());
-                ShardLogEntry shardEntry;
-                shardEntry.unpack(buf);
-                ALWAYS_ASSERT(_currentLogIndex == shardEntry.idx);
+                _appliedEntries.clear();
+                ShardLogEntry::unpackBatch(buf, _appliedEntries);
+                for (const auto& shardEntry : _appliedEntries) {
+                    ALWAYS_ASSERT(_currentLogIndex == shardEntry.idx);
+                }
+                size_t batchSize = _appliedEntries.size();
 
-                if (_isLogsDBLeader) {
-                    {
-                        //this is sanity check confirming what we got through the log and deserialized
-                        //exactly matches what we serialized and pushed to log
-                        //this is only ever true in primary location
-                        auto it = _inFlightEntries.find(shardEntry.idx.u64);
-                        ALWAYS_ASSERT(it != _inFlightEntries.end());
-                        ALWAYS_ASSERT(shardEntry == it->second);
-                        ALWAYS_ASSERT(shardEntry.idx == it->second.idx);
-                        _inFlightEntries.erase(it);
+                if (!_isLogsDBLeader) {
+                    // we are not leader, we can not do any checks and there is no response to send
+                    for (size_t i = 0; i < batchSize; ++i) {
+                        ShardRespContainer _;
+                        _shared.shardDB.applyLogEntry(logsDBEntry.idx.u64, i, batchSize, _appliedEntries[i], _);
                     }
-                    auto it = _logIdToShardRequest.find(shardEntry.idx.u64);
-                    if (it == _logIdToShardRequest.end()) {
-                        // if we are primary location, all writes should be triggered by requests
-                        ALWAYS_ASSERT(_shared.options.isProxyLocation());
-                        // we are proxy location there are writes not initiated by us and we behave like follower
-                        // we are not leader, we can not do any checks and there is no response to send
+                    continue;
+                }
+
+                {
+                    //this is sanity check confirming what we got through the log and deserialized
+                    //exactly matches what we serialized and pushed to log
+                    auto it = _inFlightEntries.find(logsDBEntry.idx.u64);
+                    ALWAYS_ASSERT(it != _inFlightEntries.end());
+                    ALWAYS_ASSERT(_appliedEntries == it->second);
+                    _inFlightEntries.erase(it);
+                }
+
+                if (_shared.options.isProxyLocation()) {
+                    // we are proxy location, writes are not initiated by us and we apply them like a follower,
+                    // then answer the requests we proxied to the primary location which were waiting for them
+                    for (size_t i = 0; i < batchSize; ++i) {
                         ShardRespContainer _;
-                        _shared.shardDB.applyLogEntry(logsDBEntry.idx.u64, shardEntry,  _);
-                        continue;
+                        _shared.shardDB.applyLogEntry(logsDBEntry.idx.u64, i, batchSize, _appliedEntries[i], _);
                     }
-                    auto& request = it->second;
-                    if (likely(request.msg.id)) {
-                        LOG_DEBUG(_env, "applying log entry for request %s kind %s from %s", request.msg.id, request.msg.body.kind(), request.clientAddr);
+                    auto proxied = _proxiedResponses.equal_range(logsDBEntry.idx.u64);
+                    for (auto it = proxied.first; it != proxied.second; ++it) {
+                        _sendProxiedResponse(it->second.second, it->second.first);
+                    }
+                    _proxiedResponses.erase(proxied.first, proxied.second);
+                    continue;
+                }
+
+                // if we are primary location, all writes should be triggered by requests
+                auto it = _logIdToShardRequests.find(logsDBEntry.idx.u64);
+                ALWAYS_ASSERT(it != _logIdToShardRequests.end());
+                ALWAYS_ASSERT(it->second.size() == batchSize);
+                for (size_t i = 0; i < batchSize; ++i) {
+                    const auto& shardEntry = _appliedEntries[i];
+                    auto& request = it->second[i];
+                    request.stagedAt[(int)ShardReqStage::RELEASE] = releasedAt;
+                    if (likely(request.msg().id)) {
+                        LOG_DEBUG(_env, "applying log entry for request %s kind %s from %s", request.msg().id, request.msg().body.kind(), request.clientAddr);
                     } else {
                         LOG_DEBUG(_env, "applying request-less log entry");
                     }
                     // first handle case where client does not care about response
-                    if (request.msg.id == 0) {
+                    if (request.msg().id == 0) {
                         ShardRespContainer resp;
-                        _shared.shardDB.applyLogEntry(logsDBEntry.idx.u64, shardEntry,  resp);
+                        _shared.shardDB.applyLogEntry(logsDBEntry.idx.u64, i, batchSize, shardEntry, resp);
                         if (unlikely(resp.kind() == ShardMessageKind::ERROR)) {
                             RAISE_ALERT(_env, "could not apply request-less log entry: %s", resp.getError());
                         }
-                        _logIdToShardRequest.erase(it);
                         continue;
                     }
 
@@ -1009,70 +1363,39 @@ public:
                         case SHARD_REQ_PROTOCOL_VERSION:
                             {
                                 ShardRespMsg resp;
-                                _shared.shardDB.applyLogEntry(logsDBEntry.idx.u64, shardEntry,  resp.body);
-                                resp.id = request.msg.id;
-                                auto it = _proxiedResponses.find(logsDBEntry.idx.u64);
-                                if (it != _proxiedResponses.end()) {
-                                    ALWAYS_ASSERT(_shared.options.isProxyLocation());
-                                    it->second.second.finished = ternNow();
-                                    logSlowProxyReq(it->second.second);
-                                    resp.body = std::move(it->second.first);
-                                    _proxiedResponses.erase(it);
-                                }
-                                if (resp.body.kind() == ShardMessageKind::ADD_SPAN_AT_LOCATION_INITIATE) {
-                                    ShardRespContainer tmpResp;
-                                    switch (request.msg.body.kind()) {
-                                        case ShardMessageKind::ADD_SPAN_INITIATE:
-                                        {
-                                            auto& addResp = tmpResp.setAddSpanInitiate();
-                                            addResp.blocks = std::move(resp.body.getAddSpanAtLocationInitiate().resp.blocks);
-                                            resp.body.setAddSpanInitiate().blocks = std::move(addResp.blocks);
-                                            break;
-                                        }
-                                        case ShardMessageKind::ADD_SPAN_INITIATE_WITH_REFERENCE:
-                                        {
-                                            auto& addResp = tmpResp.setAddSpanInitiateWithReference();
-                                            addResp.resp.blocks = std::move(resp.body.getAddSpanAtLocationInitiate().resp.blocks);
-                                            resp.body.setAddSpanInitiateWithReference().resp.blocks = std::move(addResp.resp.blocks);
-                                            break;
-                                        }
-                                        case ShardMessageKind::ADD_SPAN_AT_LOCATION_INITIATE:
-                                        {
-                                            break;
-                                        }
-                                        default:
-                                            ALWAYS_ASSERT(false, "Unexpected reponse kind %s for requests kind %s", resp.body.kind(), request.msg.body.kind() );
-                                    }
-                                }
-                                packShardResponse(_env, _shared, _shared.sock().addr(), _sender, dropArtificially, request, resp);
+                                _shared.shardDB.applyLogEntry(logsDBEntry.idx.u64, i, batchSize, shardEntry, resp.body);
+                                resp.id = request.msg().id;
+                                _fixupAddSpanAtLocationResponse(request, resp.body);
+                                packShardResponse(_env, _shared, _shared.sock().addr(), *_sender, dropArtificially, request, resp);
                             }
                             break;
                         case CDC_TO_SHARD_REQ_PROTOCOL_VERSION:
                             {
                                 CdcToShardRespMsg resp;
                                 resp.body.checkPointIdx = shardEntry.idx;
-                                resp.id = request.msg.id;
-                                _shared.shardDB.applyLogEntry(logsDBEntry.idx.u64, shardEntry,  resp.body.resp);
-                                packCheckPointedShardResponse(_env, _shared, _shared.sock().addr(), _sender, dropArtificially, request, resp, _expandedCDCKey);
+                                resp.id = request.msg().id;
+                                _shared.shardDB.applyLogEntry(logsDBEntry.idx.u64, i, batchSize, shardEntry, resp.body.resp);
+                                packCheckPointedShardResponse(_env, _shared, _shared.sock().addr(), *_sender, dropArtificially, request, resp, _expandedCDCKey);
                             }
                             break;
                         case PROXY_SHARD_REQ_PROTOCOL_VERSION:
                             {
                                 ProxyShardRespMsg resp;
                                 resp.body.checkPointIdx = shardEntry.idx;
-                                resp.id = request.msg.id;
-                                _shared.shardDB.applyLogEntry(logsDBEntry.idx.u64, shardEntry,  resp.body.resp);
-                                packCheckPointedShardResponse(_env, _shared, _shared.sock().addr(), _sender, dropArtificially, request, resp, _expandedShardKey);
+                                resp.id = request.msg().id;
+                                _shared.shardDB.applyLogEntry(logsDBEntry.idx.u64, i, batchSize, shardEntry, resp.body.resp);
+                                packCheckPointedShardResponse(_env, _shared, _shared.sock().addr(), *_sender, dropArtificially, request, resp, _expandedShardKey);
                             }
                             break;
                     }
-                    ALWAYS_ASSERT(_inFlightRequestKeys.erase(InFlightRequestKey{request.msg.id, request.clientAddr}) == 1);
-                    _logIdToShardRequest.erase(it);
-                } else {
-                    // we are not leader, we can not do any checks and there is no response to send
-                    ShardRespContainer _;
-                    _shared.shardDB.applyLogEntry(logsDBEntry.idx.u64, shardEntry,  _);
+                    request.stagedAt[(int)ShardReqStage::APPLY] = ternNow();
+                    _traces.emplace_back(request);
+                    ALWAYS_ASSERT(_inFlightRequestKeys.erase(InFlightRequestKey{request.msg().id, request.clientAddr}) == 1);
                 }
+                _logIdToShardRequests.erase(it);
+            }
+            if (_shared.options.groupCommit) {
+                _shared.shardDB.commitApplyGroup();
             }
             // we send new LogsDB entry to leaders in other locations
             _tryReplicateToOtherLocations();
@@ -1080,6 +1403,33 @@ public:
         }
     }
 
+    // Like the follower path in `_applyLogEntries`, but applying all of what we
+    // read at once, concurrently where entries don't touch the same inodes.
+    void _applyLogEntriesParallel() {
+        _parallelEntries.clear();
+        _parallelEntriesToApply.clear();
+        for (auto& logsDBEntry : _logsDBEntries) {
+            ++_currentLogIndex;
+            ALWAYS_ASSERT(_currentLogIndex == logsDBEntry.idx);
+            ALWAYS_ASSERT(logsDBEntry.value.size() > 0);
+            BincodeBuf buf((char*)&logsDBEntry.value.front(), logsDBEntry.value.size());
+            size_t first = _parallelEntries.size();
+            ShardLogEntry::unpackBatch(buf, _parallelEntries);
+            size_t batchSize = _parallelEntries.size() - first;
+            for (size_t i = 0; i < batchSize; ++i) {
+                ALWAYS_ASSERT(_currentLogIndex == _parallelEntries[first+i].idx);
+                _parallelEntriesToApply.emplace_back(ShardLogEntryToApply{
+                    .logEntryIx = logsDBEntry.idx.u64, .batchPos = i, .batchSize = batchSize, .logEntry = nullptr,
+                });
+            }
+        }
+        // only now that `_parallelEntries` won't move anymore
+        for (size_t i = 0; i < _parallelEntries.size(); ++i) {
+            _parallelEntriesToApply[i].logEntry = &_parallelEntries[i];
+        }
+        _shared.shardDB.applyLogEntriesParallel(_parallelEntriesToApply, _shared.options.applyThreads);
+    }
+
     void _processCathupReads() {
         if (_proxyReadRequests.empty()) {
             return;
@@ -1111,7 +1461,7 @@ public:
             auto& readResp = resp.body.setLogRead();
             readResp.result = TernError::NO_ERROR;
             readResp.value.els = _logsDBEntries[i].value;
-            _sender.prepareOutgoingMessage(
+            _sender->prepareOutgoingMessage(
                 _env,
                 _shared.sock().addr(),
                 request.sockIx,
@@ -1133,7 +1483,8 @@ public:
         ALWAYS_ASSERT(_shardEntries.empty());
         ALWAYS_ASSERT(_knownLastReleased.u64 >= _currentLogIndex + _inFlightEntries.size());
         // first we move any continuous entries from cathup window and schedule them for replication
-        auto maxToWrite = LogsDB::IN_FLIGHT_APPEND_WINDOW - _inFlightEntries.size();
+        auto appendWindow = _logsDB.appendWindow();
+        auto maxToWrite = appendWindow > _inFlightEntries.size() ? appendWindow - _inFlightEntries.size() : 0;
         auto expectedLogIdx = _currentLogIndex + _inFlightEntries.size() + 1;
         while(maxToWrite > 0) {
             --maxToWrite;
@@ -1147,16 +1498,18 @@ public:
             // there should be no request in flight for it
             ALWAYS_ASSERT(_catchupWindow[_catchupWindowIndex%_catchupWindow.size()].first == 0);
             BincodeBuf buf((char*)&logsDBEntry.value.front(), logsDBEntry.value.size());
-            auto& shardEntry = _shardEntries.emplace_back();
-            shardEntry.unpack(buf);
-            shardEntry.idx = expectedLogIdx;
+            size_t firstEntry = _shardEntries.size();
+            ShardLogEntry::unpackBatch(buf, _shardEntries);
+            for (size_t i = firstEntry; i < _shardEntries.size(); ++i) {
+                _shardEntries[i].idx = expectedLogIdx;
+            }
             expectedLogIdx++;
             _catchupWindowIndex++;
             //clear catchup window element
             logsDBEntry.idx = 0;
             logsDBEntry.value.clear();
         }
-        auto maxCatchupElements = std::min(_knownLastReleased.u64 - (_currentLogIndex + _inFlightEntries.size() + _shardEntries.size()), _catchupWindow.size());
+        auto maxCatchupElements = std::min(_knownLastReleased.u64 - (expectedLogIdx - 1), _catchupWindow.size());
 
         // schedule any catchup requests for missing entries
         for (uint64_t i = 0 ; i < maxCatchupElements; ++i) {
@@ -1182,6 +1535,15 @@ public:
 
     void logsDBStep() {
         _logsDB.processIncomingMessages(_logsDBRequests,_logsDBResponses);
+        if (_shared.options.logsDBOptions.readLeases) {
+            // before we answer the grants. As leader every acknowledged write is visible, so
+            // reads are fine as long as they reflect what's visible.
+            if (_logsDB.isLeader()) {
+                _shared.publishReadLease(LogsDBReadLease{_logsDB.getLastContinuous(), std::numeric_limits<uint64_t>::max()});
+            } else {
+                _shared.publishReadLease(_logsDB.readLease());
+            }
+        }
         _knownLastReleased = std::max(_knownLastReleased,_logsDB.getLastReleased());
         _nextTimeout = _logsDB.getNextTimeout();
         auto now = ternNow();
@@ -1206,6 +1568,7 @@ public:
                 _inFlightRequestKeys.clear();
                 _proxyShardRequests.clear();
                 _proxiedResponses.clear();
+                _logIdToShardRequests.clear();
                 for(auto& entry : _catchupWindow) {
                     entry.first = 0;
                     entry.second.idx = 0;
@@ -1231,79 +1594,107 @@ public:
         // there could be log entries just released which we should apply
         _applyLogEntries();
 
-        // if we are leader we should alyways have latest state applied
-        ALWAYS_ASSERT(!_isLogsDBLeader || _currentLogIndex == _logsDB.getLastReleased());
+        // if we are leader we should alyways have latest state applied. With read leases, released entries
+        // only become visible once no lease holder is behind them, but those are all our own entries in flight.
+        ALWAYS_ASSERT(!_isLogsDBLeader || _currentLogIndex == _logsDB.getLastContinuous());
+        ALWAYS_ASSERT(!_isLogsDBLeader || _currentLogIndex + _inFlightEntries.size() >= _logsDB.getLastReleased().u64);
 
         ShardReq snapshotReq;
         // prepare log entries for requests or proxy them to primary leader
         ALWAYS_ASSERT(_shardEntries.empty());
+        // the LogsDB entry we're filling in, and how many entries and bytes we've put in it
+        uint64_t batchLogIdx = _currentLogIndex + _inFlightEntries.size();
+        size_t batchEntries = 0;
+        size_t batchSize = 0;
+        const auto windowFull = [&]() {
+            return batchLogIdx - _currentLogIndex >= _logsDB.appendWindow();
+        };
         for (auto& req : _shardRequests) {
-            if (req.msg.id != 0 && _inFlightRequestKeys.contains(InFlightRequestKey{req.msg.id, req.clientAddr})) {
+            if (req.msg().id != 0 && _inFlightRequestKeys.contains(InFlightRequestKey{req.msg().id, req.clientAddr})) {
                 // we already have a request in flight with this id from this client
                 continue;
             }
-            if (req.msg.body.kind() == ShardMessageKind::SHARD_SNAPSHOT) {
+            if (req.msg().body.kind() == ShardMessageKind::SHARD_SNAPSHOT) {
                 snapshotReq = std::move(req);
                 continue;
             }
 
             if (_shared.options.isProxyLocation()) {
-                if (req.msg.id != 0) {
-                    _inFlightRequestKeys.insert(InFlightRequestKey{req.msg.id, req.clientAddr});
+                if (req.msg().id != 0) {
+                    _inFlightRequestKeys.insert(InFlightRequestKey{req.msg().id, req.clientAddr});
                 }
                 // we send them out later along with timed out ones
                 _proxyShardRequests.insert({++_requestIdCounter, ProxyShardReq{std::move(req), 0, now, 0, 0}});
                 continue;
             }
 
-            if (_inFlightEntries.size() + _shardEntries.size() == LogsDB::IN_FLIGHT_APPEND_WINDOW) {
+            if ((batchEntries == 0 || batchEntries == _shared.options.logBatchEntries) && windowFull()) {
                 // we have reached the limit of in flight entries anything else will be dropped anyway
                 // clients will retry
                 continue;
             }
             auto& entry = _shardEntries.emplace_back();
 
-            auto err = _shared.shardDB.prepareLogEntry(req.msg.body, entry);
+            auto err = _shared.shardDB.prepareLogEntry(req.msg().body, entry);
+            req.stagedAt[(int)ShardReqStage::PREPARE] = ternNow();
             if (unlikely(err != TernError::NO_ERROR)) {
                 _shardEntries.pop_back(); // back out the log entry
-                LOG_ERROR(_env, "error preparing log entry for request: %s from: %s err: %s", req.msg, req.clientAddr, err);
+                LOG_ERROR(_env, "error preparing log entry for request: %s from: %s err: %s", req.msg(), req.clientAddr, err);
                 // depending on protocol we need different kind of responses
                 bool dropArtificially = _packetDropRand.generate64() % 10'000 < _outgoingPacketDropProbability;
                 switch(req.protocol){
                     case SHARD_REQ_PROTOCOL_VERSION:
                         {
                             ShardRespMsg resp;
-                            resp.id = req.msg.id;
+                            resp.id = req.msg().id;
                             resp.body.setError() = err;
-                            packShardResponse(_env, _shared, _shared.sock().addr(), _sender, dropArtificially, req, resp);
+                            packShardResponse(_env, _shared, _shared.sock().addr(), *_sender, dropArtificially, req, resp);
                         }
                         break;
                     case CDC_TO_SHARD_REQ_PROTOCOL_VERSION:
                         {
                             CdcToShardRespMsg resp;
-                            resp.body.checkPointIdx = _logsDB.getLastReleased();
-                            resp.id = req.msg.id;
+                            resp.body.checkPointIdx = _currentLogIndex;
+                            resp.id = req.msg().id;
                             resp.body.resp.setError() = err;
-                            packCheckPointedShardResponse(_env, _shared, _shared.sock().addr(), _sender, dropArtificially, req, resp, _expandedCDCKey);
+                            packCheckPointedShardResponse(_env, _shared, _shared.sock().addr(), *_sender, dropArtificially, req, resp, _expandedCDCKey);
                         }
                         break;
                     case PROXY_SHARD_REQ_PROTOCOL_VERSION:
                         {
                             ProxyShardRespMsg resp;
-                            resp.body.checkPointIdx = _logsDB.getLastReleased();
-                            resp.id = req.msg.id;
+                            resp.body.checkPointIdx = _currentLogIndex;
+                            resp.id = req.msg().id;
                             resp.body.resp.setError() = err;
-                            packCheckPointedShardResponse(_env, _shared, _shared.sock().addr(), _sender, dropArtificially, req, resp, _expandedShardKey);
+                            packCheckPointedShardResponse(_env, _shared, _shared.sock().addr(), *_sender, dropArtificially, req, resp, _expandedShardKey);
                         }
                         break;
                 }
+                _traces.emplace_back(req);
+                continue;
+            }
+            // batch with the previous entries if it fits, otherwise start a new LogsDB entry
+            size_t entrySize = entry.batchedSize();
+            if (
+                batchEntries == 0 || batchEntries == _shared.options.logBatchEntries ||
+                ShardLogEntry::BATCH_HEADER_SIZE + batchSize + entrySize > LogsDB::DEFAULT_UDP_ENTRY_SIZE
+            ) {
+                if (windowFull()) {
+                    _shardEntries.pop_back();
+                    continue;
+                }
+                batchLogIdx++;
+                batchEntries = 0;
+                batchSize = 0;
             }
-            entry.idx = _currentLogIndex + _inFlightEntries.size() + _shardEntries.size();
+            batchEntries++;
+            batchSize += entrySize;
+            entry.idx = batchLogIdx;
             // requests with id 0 are "one off, don't want response, will not retry" so we assume that if we receive it twice we need to execute it twice
-            if (req.msg.id != 0) {
-                _inFlightRequestKeys.insert(InFlightRequestKey{req.msg.id, req.clientAddr});
+            if (req.msg().id != 0) {
+                _inFlightRequestKeys.insert(InFlightRequestKey{req.msg().id, req.clientAddr});
             }
-            _logIdToShardRequest.insert({entry.idx.u64, std::move(req)});
+            _logIdToShardRequests[entry.idx.u64].emplace_back(std::move(req));
         }
 
 
@@ -1313,58 +1704,11 @@ public:
                 // it is possible we already replied to this request and removed it from the map
                 continue;
             }
-            auto& req = it->second.req;
             it->second.gotLogIdx = now;
 
             // it is possible we already applied the log entry, forward the response
             if (resp.body.checkPointIdx <= _logsDB.getLastContinuous()) {
-                if (likely(req.msg.id)) {
-                    LOG_DEBUG(_env, "applying log entry for request %s kind %s from %s", req.msg.id, req.msg.body.kind(), req.clientAddr);
-                } else {
-                    LOG_DEBUG(_env, "applying request-less log entry");
-                    // client does not care about response
-                    _proxyShardRequests.erase(it);
-                    continue;
-                }
-                it->second.finished = now;
-
-                logSlowProxyReq(it->second);
-
-                // depending on protocol we need different kind of responses
-                bool dropArtificially = _packetDropRand.generate64() % 10'000 < _outgoingPacketDropProbability;
-                ALWAYS_ASSERT(req.protocol == SHARD_REQ_PROTOCOL_VERSION);
-                {
-                    ShardRespMsg forwarded_resp;
-                    forwarded_resp.id = req.msg.id;
-                    forwarded_resp.body = std::move(resp.body.resp);
-                    if (forwarded_resp.body.kind() == ShardMessageKind::ADD_SPAN_AT_LOCATION_INITIATE) {
-                        ShardRespContainer tmpResp;
-                        switch (req.msg.body.kind()) {
-                            case ShardMessageKind::ADD_SPAN_INITIATE:
-                            {
-                                auto& addResp = tmpResp.setAddSpanInitiate();
-                                addResp.blocks = std::move(forwarded_resp.body.getAddSpanAtLocationInitiate().resp.blocks);
-                                forwarded_resp.body.setAddSpanInitiate().blocks = std::move(addResp.blocks);
-                                break;
-                            }
-                            case ShardMessageKind::ADD_SPAN_INITIATE_WITH_REFERENCE:
-                            {
-                                auto& addResp = tmpResp.setAddSpanInitiateWithReference();
-                                addResp.resp.blocks = std::move(forwarded_resp.body.getAddSpanAtLocationInitiate().resp.blocks);
-                                forwarded_resp.body.setAddSpanInitiateWithReference().resp.blocks = std::move(addResp.resp.blocks);
-                                break;
-                            }
-                            case ShardMessageKind::ADD_SPAN_AT_LOCATION_INITIATE:
-                            {
-                                break;
-                            }
-                            default:
-                                ALWAYS_ASSERT(false, "Unexpected reponse kind %s for requests kind %s", forwarded_resp.body.kind(), req.msg.body.kind() );
-                        }
-                    }
-                    packShardResponse(_env, _shared, _shared.sock().addr(), _sender, dropArtificially, req, forwarded_resp);
-                }
-                ALWAYS_ASSERT(_inFlightRequestKeys.erase(InFlightRequestKey{req.msg.id, req.clientAddr}) == 1);
+                _sendProxiedResponse(it->second, resp.body.resp);
                 _proxyShardRequests.erase(it);
                 continue;
             }
@@ -1379,8 +1723,7 @@ public:
 
             // we have the response but we will not reply immediately as we need to wait for logsDB to apply the log entry to guarantee
             // read your own writes
-            _logIdToShardRequest.insert({resp.body.checkPointIdx.u64, std::move(req)});
-            _proxiedResponses.insert({resp.body.checkPointIdx.u64, std::pair<ShardRespContainer, ProxyShardReq>({std::move(resp.body.resp), std::move(it->second)})});
+            _proxiedResponses.emplace(resp.body.checkPointIdx.u64, std::pair<ShardRespContainer, ProxyShardReq>(std::move(resp.body.resp), std::move(it->second)));
             _proxyShardRequests.erase(it);
         }
 
@@ -1458,21 +1801,41 @@ public:
         if (!_shardEntries.empty()) {
             ALWAYS_ASSERT(_isLogsDBLeader);
             ALWAYS_ASSERT(_logsDBEntries.empty());
-            _logsDBEntries.reserve(_shardEntries.size());
             std::array<uint8_t, MAX_UDP_MTU> data;
 
-            for(auto& entry : _shardEntries) {
-                auto& logsDBEntry = _logsDBEntries.emplace_back();;
+            // consecutive entries with the same index go in the same LogsDB entry
+            for (size_t i = 0; i < _shardEntries.size();) {
+                size_t j = i + 1;
+                while (j < _shardEntries.size() && _shardEntries[j].idx == _shardEntries[i].idx) { j++; }
+                auto& logsDBEntry = _logsDBEntries.emplace_back();
                 BincodeBuf buf((char*)&data[0], MAX_UDP_MTU);
-                entry.pack(buf);
+                if (_shared.options.compressLogEntries) {
+                    ShardLogEntry::packBatchCompressed(buf, &_shardEntries[i], j - i);
+                } else {
+                    ShardLogEntry::packBatch(buf, &_shardEntries[i], j - i);
+                }
                 logsDBEntry.value.assign(buf.data, buf.cursor);
+                i = j;
             }
             auto err = _logsDB.appendEntries(_logsDBEntries);
             ALWAYS_ASSERT(err == TernError::NO_ERROR);
+            auto appendedAt = ternNow();
+            for (const auto& logsDBEntry : _logsDBEntries) {
+                auto it = _logIdToShardRequests.find(logsDBEntry.idx.u64);
+                if (it == _logIdToShardRequests.end()) { continue; }
+                for (auto& req : it->second) {
+                    req.stagedAt[(int)ShardReqStage::APPEND] = appendedAt;
+                }
+            }
+            size_t logsDBEntryIx = 0;
             for (size_t i = 0; i < _shardEntries.size(); ++i) {
-                ALWAYS_ASSERT(_logsDBEntries[i].idx == _shardEntries[i].idx);
-                _inFlightEntries.emplace(_shardEntries[i].idx.u64, std::move(_shardEntries[i]));
+                if (i > 0 && _shardEntries[i].idx != _shardEntries[i-1].idx) {
+                    logsDBEntryIx++;
+                }
+                ALWAYS_ASSERT(_logsDBEntries[logsDBEntryIx].idx == _shardEntries[i].idx);
+                _inFlightEntries[_shardEntries[i].idx.u64].emplace_back(std::move(_shardEntries[i]));
             }
+            ALWAYS_ASSERT(logsDBEntryIx + 1 == _logsDBEntries.size());
             _logsDBEntries.clear();
         }
 
@@ -1490,25 +1853,48 @@ public:
 
         _sendProxyAndCatchupRequests();
 
-        _shared.shardDB.flush(true);
+        // Everything we're about to send (LogsDB acks, client responses) relies
+        // on what we've written being durable. With `asyncWalSync` the fsync
+        // happens in the syncer, which then sends the messages, while we move
+        // on to the next step.
+        ShardDBSyncPoint syncPoint;
+        if (_shared.options.asyncWalSync) {
+            syncPoint = _shared.shardDB.prepareSync();
+        } else {
+            _shared.shardDB.flush(true);
+            auto flushedAt = ternNow();
+            for (auto& trace : _traces) {
+                trace.stagedAt[(int)ShardReqStage::FLUSH] = flushedAt;
+            }
+        }
         // not needed as we just flushed and apparently it does actually flush again
         // _logsDB.flush(true);
 
         // snapshot is processed once and last as it will initiate a flush
-        if (unlikely(snapshotReq.msg.body.kind() == ShardMessageKind::SHARD_SNAPSHOT)) {
+        if (unlikely(snapshotReq.msg().body.kind() == ShardMessageKind::SHARD_SNAPSHOT)) {
             ShardRespMsg resp;
-            resp.id = snapshotReq.msg.id;
-            auto err = _shared.sharedDB.snapshot(_basePath +"/snapshot-" + std::to_string(snapshotReq.msg.body.getShardSnapshot().snapshotId));
+            resp.id = snapshotReq.msg().id;
+            auto err = _shared.sharedDB.snapshot(_basePath +"/snapshot-" + std::to_string(snapshotReq.msg().body.getShardSnapshot().snapshotId));
 
             if (err == TernError::NO_ERROR) {
                 resp.body.setShardSnapshot();
             } else {
                 resp.body.setError() = err;
             }
-            packShardResponse(_env, _shared, _shared.sock().addr(), _sender, false, snapshotReq, resp);
+            packShardResponse(_env, _shared, _shared.sock().addr(), *_sender, false, snapshotReq, resp);
         }
 
-        _sender.sendMessages(_env, _shared.sock());
+        if (_shared.options.asyncWalSync) {
+            _handOffToSyncer(std::move(syncPoint));
+        } else {
+            _sender->sendMessages(_env, _shared.sock());
+            auto sentAt = ternNow();
+            for (auto& trace : _traces) {
+                trace.stagedAt[(int)ShardReqStage::SEND] = sentAt;
+            }
+            _tracer.record(_env, _shared, _traces);
+            _traces.clear();
+        }
     }
 
     AddrsInfo* addressFromReplicaId(ReplicaId id) {
@@ -1537,7 +1923,7 @@ public:
             return;
         }
 
-        _sender.prepareOutgoingMessage(
+        _sender->prepareOutgoingMessage(
             _env,
             _shared.sock().addr(),
             addrInfo,
@@ -1562,7 +1948,7 @@ public:
             return;
         }
 
-        _sender.prepareOutgoingMessage(
+        _sender->prepareOutgoingMessage(
             _env,
             _shared.sock().addr(),
             addrInfo,
@@ -1609,7 +1995,7 @@ public:
                 _logsDBResponses.emplace_back(item.moveLogsDBResponse());
                 break;
             case WriterQueueEntryKind::SHARD_REQUEST:
-                _shardRequests.emplace_back(item.moveShardReq());
+                _shardRequests.emplace_back(item.moveShardReq()).stagedAt[(int)ShardReqStage::DEQUEUE] = start;
                 break;
             case WriterQueueEntryKind::SHARD_RESPONSE:
                 _shardResponses.emplace_back(item.moveShardResp());
@@ -1627,10 +2013,64 @@ public:
     }
 };
 
+// Takes the fsync out of the writer loop (see `asyncWalSync`): syncs the
+// batches the writer hands over, and then sends out the messages which were
+// waiting on them.
+struct ShardSyncer : Loop {
+private:
+    ShardShared& _shared;
+    std::vector<ShardSyncBatch> _batches;
+    ShardReqTracer _tracer;
+
+    virtual void sendStop() override {
+        _shared.syncQueue.close();
+        _shared.syncedQueue.close();
+    }
+
+public:
+    ShardSyncer(Logger& logger, std::shared_ptr<XmonAgent>& xmon, ShardShared& shared) :
+        Loop(logger, xmon, "syncer"),
+        _shared(shared)
+    {
+        _batches.reserve(SYNC_QUEUE_SIZE);
+    }
+
+    virtual ~ShardSyncer() = default;
+
+    virtual void step() override {
+        _batches.clear();
+        uint32_t pulled = _shared.syncQueue.pull(_batches, SYNC_QUEUE_SIZE);
+        if (unlikely(pulled == 0)) {
+            // queue is closed, stop
+            stop();
+            return;
+        }
+        LOG_DEBUG(_env, "syncing %s write batches", pulled);
+        // batches come in order, so syncing the last one covers them all
+        _shared.shardDB.sync(std::move(_batches.back().point));
+        auto flushedAt = ternNow();
+        for (auto& batch : _batches) {
+            batch.point = {};
+            batch.sender->sendMessages(_env, _shared.sock());
+            auto sentAt = ternNow();
+            for (auto& trace : batch.traces) {
+                trace.stagedAt[(int)ShardReqStage::FLUSH] = flushedAt;
+                trace.stagedAt[(int)ShardReqStage::SEND] = sentAt;
+            }
+            _tracer.record(_env, _shared, batch.traces);
+            batch.traces.clear();
+        }
+        _shared.syncedQueue.push(_batches);
+    }
+};
+
 struct ShardReader : Loop {
 private:
 
     ShardShared& _shared;
+    size_t _readerIx;
+    MPMC<ShardReq>& _queue;
+    ShardDBReadView _readView;
     AES128Key _expandedShardKey;
     AES128Key _expandedCDCKey;
     ShardRespMsg _respContainer;
@@ -1642,14 +2082,16 @@ private:
     uint64_t _outgoingPacketDropProbability; // probability * 10,000
 
     virtual void sendStop() override {
-        _shared.readerRequestsQueue.close();
+        _queue.close();
     }
 
 public:
-    ShardReader(Logger& logger, std::shared_ptr<XmonAgent>& xmon, ShardShared& shared) :
-        Loop(logger, xmon, "reader"),
+    ShardReader(Logger& logger, std::shared_ptr<XmonAgent>& xmon, ShardShared& shared, size_t readerIx) :
+        Loop(logger, xmon, "reader_" + std::to_string(readerIx)),
         _shared(shared),
-        _sender(UDPSenderConfig{.maxMsgSize = MAX_UDP_MTU}),
+        _readerIx(readerIx),
+        _queue(*shared.readerRequestsQueues.at(readerIx)),
+        _sender(UDPSenderConfig{.maxMsgSize = MAX_UDP_MTU, .ioUring = shared.options.serverOptions.ioUring, .gso = shared.options.serverOptions.gso}),
         _packetDropRand(ternNow().ns),
         _outgoingPacketDropProbability(0)
     {
@@ -1668,37 +2110,48 @@ public:
 
     virtual ~ShardReader() = default;
 
+    // Whether a read done from state up to `readIdx` reflects every write acknowledged so far
+    bool _coveredByReadLease(uint64_t readIdx) {
+        auto lease = _shared.readLease();
+        return ternNow() < lease.expiry && readIdx >= lease.idx.u64;
+    }
+
     virtual void step() override {
         _requests.clear();
-        uint32_t pulled = _shared.readerRequestsQueue.pull(_requests, MAX_RECV_MSGS * 2);
+        uint32_t pulled = _queue.pull(_requests, MAX_RECV_MSGS * 2);
         auto start = ternNow();
         if (likely(pulled > 0)) {
             LOG_DEBUG(_env, "pulled %s requests from read queue", pulled);
             _shared.pulledReadRequests = _shared.pulledReadRequests*0.95 + ((double)pulled)*0.05;
         }
-        if (unlikely(_shared.readerRequestsQueue.isClosed())) {
+        if (unlikely(_queue.isClosed())) {
             // queue is closed, stop
             stop();
             return;
         }
 
         for(auto& req : _requests) {
-            ALWAYS_ASSERT(readOnlyShardReq(req.msg.body.kind()));
+            ALWAYS_ASSERT(readOnlyShardReq(req.msg().body.kind()));
             bool dropArtificially = _packetDropRand.generate64() % 10'000 < _outgoingPacketDropProbability;
             switch(req.protocol){
                 case SHARD_REQ_PROTOCOL_VERSION:
                 {
                     ShardRespMsg resp;
-                    resp.id = req.msg.id;
-                    _shared.shardDB.read(req.msg.body, resp.body);
+                    resp.id = req.msg().id;
+                    uint64_t readIdx = _shared.shardDB.read(req.msg().body, resp.body, _readView);
+                    if (unlikely(_shared.options.logsDBOptions.readLeases && !_coveredByReadLease(readIdx))) {
+                        // the client will retry, possibly somewhere else
+                        LOG_DEBUG(_env, "read of request %s at %s not covered by read lease, dropping it", req.msg().id, readIdx);
+                        break;
+                    }
                     packShardResponse(_env, _shared, _shared.sock().addr(), _sender, dropArtificially, req, resp);
                     break;
                 }
                 case CDC_TO_SHARD_REQ_PROTOCOL_VERSION:
                 {
                     CdcToShardRespMsg resp;
-                    resp.id = req.msg.id;
-                    resp.body.checkPointIdx = _shared.shardDB.read(req.msg.body, resp.body.resp);
+                    resp.id = req.msg().id;
+                    resp.body.checkPointIdx = _shared.shardDB.read(req.msg().body, resp.body.resp, _readView);
                     packCheckPointedShardResponse(_env, _shared, _shared.sock().addr(), _sender, dropArtificially, req, resp, _expandedCDCKey);
                     break;
                 }
@@ -1707,7 +2160,8 @@ public:
             }
         }
 
-        _sender.sendMessages(_env, _shared.sock());
+        // the writer sends from the first socket, spread the readers over the others
+        _sender.sendMessages(_env, _shared.sock(1 + _readerIx));
     }
 };
 
@@ -1904,6 +2358,31 @@ static void logsDBstatsToMetrics(struct MetricsBuilder& metricsBuilder, const Lo
         metricsBuilder.fieldFloat( "append_window", stats.appendWindow.load(std::memory_order_relaxed));
         metricsBuilder.timestamp(now);
     }
+    {
+        metricsBuilder.measurement("eggsfs_shard_logsdb");
+        metricsBuilder.tag("shard", shrid);
+        metricsBuilder.tag("location", int(location));
+        metricsBuilder.tag("leader", stats.isLeader.load(std::memory_order_relaxed));
+        metricsBuilder.fieldU64( "append_window_limit", stats.appendWindowLimit.load(std::memory_order_relaxed));
+        metricsBuilder.timestamp(now);
+    }
+    {
+        metricsBuilder.measurement("eggsfs_shard_logsdb");
+        metricsBuilder.tag("shard", shrid);
+        metricsBuilder.tag("location", int(location));
+        metricsBuilder.tag("leader", stats.isLeader.load(std::memory_order_relaxed));
+        metricsBuilder.fieldU64( "append_window_full", stats.appendWindowFull.load(std::memory_order_relaxed));
+        metricsBuilder.timestamp(now);
+    }
+    {
+        metricsBuilder.measurement("eggsfs_shard_logsdb");
+        metricsBuilder.tag("shard", shrid);
+        metricsBuilder.tag("location", int(location));
+        metricsBuilder.tag("leader", stats.isLeader.load(std::memory_order_relaxed));
+        metricsBuilder.fieldU64( "commit_latency", stats.commitLatency.load(std::memory_order_relaxed).ns);
+        metricsBuilder.fieldU64( "read_lease_holders", stats.readLeaseHolders.load(std::memory_order_relaxed));
+        metricsBuilder.timestamp(now);
+    }
     {
         metricsBuilder.measurement("eggsfs_shard_logsdb");
         metricsBuilder.tag("shard", shrid);
@@ -2022,8 +2501,12 @@ public:
     virtual bool periodicStep() {
         _shared.sharedDB.dumpRocksDBStatistics();
         for (int i = 0; i < 2; i++) {
-            if (std::ceil(_shared.receivedRequests[i]) >= MAX_RECV_MSGS) {
-                _env.updateAlert(_sockQueueAlerts[i], "recv queue for sock %s is full (%s)", i, _shared.receivedRequests[i]);
+            double receivedRequests = 0;
+            for (const auto& serverReceivedRequests : _shared.receivedRequests) {
+                receivedRequests = std::max<double>(receivedRequests, serverReceivedRequests[i]);
+            }
+            if (std::ceil(receivedRequests) >= MAX_RECV_MSGS) {
+                _env.updateAlert(_sockQueueAlerts[i], "recv queue for sock %s is full (%s)", i, receivedRequests);
             } else {
                 _env.clearAlert(_sockQueueAlerts[i]);
             }
@@ -2053,6 +2536,26 @@ public:
                 _metricsBuilder.timestamp(now);
             }
         }
+        for (ShardMessageKind kind : allShardMessageKind) {
+            if (readOnlyShardReq(kind)) { continue; }
+            for (int stage = 0; stage < SHARD_REQ_STAGES; stage++) {
+                auto& timings = _shared.stageTimings[(int)kind][stage];
+                uint64_t count = timings.count();
+                if (count == 0) { continue; }
+                _metricsBuilder.measurement("eggsfs_shard_request_stages");
+                _metricsBuilder.tag("shard", _shrid);
+                _metricsBuilder.tag("location", int(_location));
+                _metricsBuilder.tag("kind", kind);
+                _metricsBuilder.tag("stage", (ShardReqStage)stage);
+                _metricsBuilder.fieldU64("count", count);
+                _metricsBuilder.fieldU64("mean", timings.mean().ns);
+                _metricsBuilder.fieldU64("p50", timings.percentile(0.5).ns);
+                _metricsBuilder.fieldU64("p99", timings.percentile(0.99).ns);
+                _metricsBuilder.timestamp(now);
+                // each sample covers what happened since the previous one
+                timings.reset();
+            }
+        }
         {
             _metricsBuilder.measurement("eggsfs_shard_write_queue");
             _metricsBuilder.tag("shard", _shrid);
@@ -2067,13 +2570,16 @@ public:
             _metricsBuilder.fieldFloat("size", _shared.readerRequestQueueSize);
             _metricsBuilder.timestamp(now);
         }
-        for (int i = 0; i < _shared.receivedRequests.size(); i++) {
-            _metricsBuilder.measurement("eggsfs_shard_received_requests");
-            _metricsBuilder.tag("shard", _shrid);
-            _metricsBuilder.tag("location", int(_location));
-            _metricsBuilder.tag("socket", i);
-            _metricsBuilder.fieldFloat("count", _shared.receivedRequests[i]);
-            _metricsBuilder.timestamp(now);
+        for (int j = 0; j < _shared.receivedRequests.size(); j++) {
+            for (int i = 0; i < _shared.receivedRequests[j].size(); i++) {
+                _metricsBuilder.measurement("eggsfs_shard_received_requests");
+                _metricsBuilder.tag("shard", _shrid);
+                _metricsBuilder.tag("location", int(_location));
+                _metricsBuilder.tag("server", j);
+                _metricsBuilder.tag("socket", i);
+                _metricsBuilder.fieldFloat("count", _shared.receivedRequests[j][i]);
+                _metricsBuilder.timestamp(now);
+            }
         }
         {
             _metricsBuilder.measurement("eggsfs_shard_pulled_write_requests");
@@ -2089,6 +2595,33 @@ public:
             _metricsBuilder.fieldFloat("count", _shared.pulledReadRequests);
             _metricsBuilder.timestamp(now);
         }
+        if (_shared.options.serverOptions.spin > 0) {
+            const auto spinMetrics = [this, now](const std::string& what, const SpinCounters& counters) {
+                _metricsBuilder.measurement("eggsfs_shard_spin");
+                _metricsBuilder.tag("shard", _shrid);
+                _metricsBuilder.tag("location", int(_location));
+                _metricsBuilder.tag("what", what);
+                _metricsBuilder.fieldU64("spun", counters.spun.load(std::memory_order_relaxed));
+                _metricsBuilder.fieldU64("slept", counters.slept.load(std::memory_order_relaxed));
+                _metricsBuilder.timestamp(now);
+            };
+            spinMetrics("receiver", _shared.receiverSpinCounters);
+            spinMetrics("writer", _shared.writerRequestsQueue.spinCounters());
+            for (size_t i = 0; i < _shared.readerRequestsQueues.size(); i++) {
+                spinMetrics("reader_" + std::to_string(i), _shared.readerRequestsQueues[i]->spinCounters());
+            }
+        }
+        {
+            auto stats = _shared.shardDB.metadataCacheStats();
+            _metricsBuilder.measurement("eggsfs_shard_metadata_cache");
+            _metricsBuilder.tag("shard", _shrid);
+            _metricsBuilder.tag("location", int(_location));
+            _metricsBuilder.fieldU64("hits", stats.hits);
+            _metricsBuilder.fieldU64("misses", stats.misses);
+            _metricsBuilder.fieldU64("evictions", stats.evictions);
+            _metricsBuilder.fieldU64("invalidations", stats.invalidations);
+            _metricsBuilder.timestamp(now);
+        }
         {
             _rocksDBStats.clear();
             _shared.sharedDB.rocksDBMetrics(_rocksDBStats);
@@ -2139,10 +2672,29 @@ void runShard(ShardOptions& options) {
         LOG_INFO(env, "  registryPort = %s", options.registryClientOptions.port);
         LOG_INFO(env, "  ownAddres = %s", options.serverOptions.addrs);
         LOG_INFO(env, "  simulateOutgoingPacketDrop = %s", options.serverOptions.simulateOutgoingPacketDrop);
+        LOG_INFO(env, "  spin = %s", options.serverOptions.spin);
+        LOG_INFO(env, "  busyPollUs = %s", options.serverOptions.busyPollUs);
+        LOG_INFO(env, "  ioUring = %s", (int)options.serverOptions.ioUring);
+        LOG_INFO(env, "  gso = %s", (int)options.serverOptions.gso);
+        LOG_INFO(env, "  gro = %s", (int)options.serverOptions.gro);
+        LOG_INFO(env, "  numReaders = %s", (int)options.numReaders);
+        LOG_INFO(env, "  numServers = %s", (int)options.numServers);
+        LOG_INFO(env, "  metadataCacheEntries = %s", options.metadataCacheEntries);
+        LOG_INFO(env, "  dbProfile = %s", options.dbProfile);
+        LOG_INFO(env, "  asyncWalSync = %s", (int)options.asyncWalSync);
+        LOG_INFO(env, "  logBatchEntries = %s", options.logBatchEntries);
+        LOG_INFO(env, "  compressLogEntries = %s", (int)options.compressLogEntries);
+        LOG_INFO(env, "  applyThreads = %s", (int)options.applyThreads);
+        LOG_INFO(env, "  groupCommit = %s", (int)options.groupCommit);
         LOG_INFO(env, "  syslog = %s", (int)options.logOptions.syslog);
         LOG_INFO(env, "Using LogsDB with options:");
         LOG_INFO(env, "    noReplication = '%s'", (int)options.logsDBOptions.noReplication);
         LOG_INFO(env, "    avoidBeingLeader = '%s'", (int)options.logsDBOptions.avoidBeingLeader);
+        LOG_INFO(env, "    readLeases = '%s'", (int)options.logsDBOptions.readLeases);
+        LOG_INFO(env, "    snapshotPort = %s", options.logsDBOptions.snapshotPort);
+        LOG_INFO(env, "    catchupFrom = '%s:%s'", options.logsDBOptions.catchupFromHost, options.logsDBOptions.catchupFromPort);
+        LOG_INFO(env, "    rocksDBMemoryMiB = %s", options.logsDBOptions.rocksDBMemoryMiB);
+        LOG_INFO(env, "    rocksDBHyperClockCache = %s", (int)options.logsDBOptions.rocksDBHyperClockCache);
     }
 
     // Immediately start xmon: we want the database initializing update to
@@ -2164,8 +2716,12 @@ void runShard(ShardOptions& options) {
     XmonNCAlert dbInitAlert;
     env.updateAlert(dbInitAlert, "initializing database");
 
+    if (!options.logsDBOptions.catchupFromHost.empty() && needsBulkCatchup(env, options.logsDBOptions.dbDir + "/db")) {
+        fetchSnapshot(env, options.logsDBOptions.catchupFromHost, options.logsDBOptions.catchupFromPort, options.logsDBOptions.dbDir + "/db");
+    }
+
     SharedRocksDB sharedDB(logger, xmon, options.logsDBOptions.dbDir + "/db", options.logsDBOptions.dbDir  + "/db-statistics.txt");
-    sharedDB.registerCFDescriptors(ShardDB::getColumnFamilyDescriptors());
+    sharedDB.registerCFDescriptors(ShardDB::getColumnFamilyDescriptors(options.dbProfile));
     sharedDB.registerCFDescriptors(LogsDB::getColumnFamilyDescriptors());
     sharedDB.registerCFDescriptors(BlockServicesCacheDB::getColumnFamilyDescriptors());
     rocksdb::Options rocksDBOptions;
@@ -2178,21 +2734,46 @@ void runShard(ShardOptions& options) {
     rocksDBOptions.max_open_files = 1000;
     // We batch writes and flush manually.
     rocksDBOptions.manual_wal_flush = true;
-    sharedDB.open(rocksDBOptions);
+    sharedDB.open(rocksDBOptions, SharedRocksDBMemoryBudget{
+        .bytes = (size_t)options.logsDBOptions.rocksDBMemoryMiB << 20,
+        .hyperClockCache = options.logsDBOptions.rocksDBHyperClockCache,
+    });
 
     BlockServicesCacheDB blockServicesCache(logger, xmon, sharedDB);
 
-    ShardDB shardDB(logger, xmon, options.shardId, options.logsDBOptions.location, options.transientDeadlineInterval, sharedDB, blockServicesCache);
-    LogsDB logsDB(logger, xmon, sharedDB, options.logsDBOptions.replicaId, shardDB.lastAppliedLogEntry(), options.logsDBOptions.noReplication, options.logsDBOptions.avoidBeingLeader);
+    ShardDB shardDB(logger, xmon, options.shardId, options.logsDBOptions.location, options.transientDeadlineInterval, sharedDB, blockServicesCache, options.metadataCacheEntries);
+    LogsDB logsDB(logger, xmon, sharedDB, options.logsDBOptions.replicaId, shardDB.lastAppliedLogEntry(), options.logsDBOptions.noReplication, options.logsDBOptions.avoidBeingLeader, options.logsDBOptions.readLeases);
     env.clearAlert(dbInitAlert);
 
-    ShardShared shared(options, sharedDB, blockServicesCache, shardDB, logsDB, UDPSocketPair(env, options.serverOptions.addrs));
+    std::vector<std::array<UDPSocketPair, 1>> socks;
+    socks.reserve(options.numServers);
+    UDPSocketConfig sockConfig{
+        .reusePort = options.numServers > 1,
+        .busyPollUs = options.serverOptions.busyPollUs,
+        .gro = options.serverOptions.gro,
+    };
+    socks.emplace_back(std::array<UDPSocketPair, 1>{UDPSocketPair(env, options.serverOptions.addrs, sockConfig)});
+    for (int i = 1; i < options.numServers; i++) {
+        // bind to what the first pair got, in case the ports were picked by the kernel
+        socks.emplace_back(std::array<UDPSocketPair, 1>{UDPSocketPair(env, socks[0][0].addr(), sockConfig)});
+    }
+    ShardShared shared(options, sharedDB, blockServicesCache, shardDB, logsDB, std::move(socks));
 
-    threads.emplace_back(LoopThread::Spawn(std::make_unique<ShardServer>(logger, xmon, shared)));
-    threads.emplace_back(LoopThread::Spawn(std::make_unique<ShardReader>(logger, xmon, shared)));
+    for (size_t i = 0; i < shared.socks.size(); i++) {
+        threads.emplace_back(LoopThread::Spawn(std::make_unique<ShardServer>(logger, xmon, shared, i)));
+    }
+    for (size_t i = 0; i < shared.readerRequestsQueues.size(); i++) {
+        threads.emplace_back(LoopThread::Spawn(std::make_unique<ShardReader>(logger, xmon, shared, i)));
+    }
     threads.emplace_back(LoopThread::Spawn(std::make_unique<ShardWriter>(logger, xmon, shared)));
+    if (options.asyncWalSync) {
+        threads.emplace_back(LoopThread::Spawn(std::make_unique<ShardSyncer>(logger, xmon, shared)));
+    }
     threads.emplace_back(LoopThread::Spawn(std::make_unique<ShardRegisterer>(logger, xmon, shared)));
     threads.emplace_back(LoopThread::Spawn(std::make_unique<ShardBlockServiceUpdater>(logger, xmon, shared)));
+    if (options.logsDBOptions.snapshotPort != 0) {
+        threads.emplace_back(LoopThread::Spawn(std::make_unique<SnapshotServer>(logger, xmon, sharedDB, options.logsDBOptions.dbDir, options.serverOptions.addrs, options.logsDBOptions.snapshotPort, shared.replicas)));
+    }
     if (!options.metricsOptions.origin.empty()) {
         threads.emplace_back(LoopThread::Spawn(std::make_unique<ShardMetricsInserter>(logger, xmon, options.metricsOptions, shared)));
     }
@@ -16,6 +16,34 @@ struct ShardOptions {
     ServerOptions serverOptions;
     
     Duration transientDeadlineInterval = DEFAULT_DEADLINE_INTERVAL;
+    // How many threads serve read-only requests. Each gets its own queue and
+    // socket sender, and the server spreads read requests across them.
+    uint8_t numReaders = 1;
+    // How many sockets we open per address (with SO_REUSEPORT if more than one),
+    // each with its own server thread parsing and queueing requests.
+    uint8_t numServers = 1;
+    // Bound on the directories and current edges kept in memory for reads, 0 disables it.
+    size_t metadataCacheEntries = DEFAULT_METADATA_CACHE_ENTRIES;
+    // How the ShardDB column families are tuned.
+    ShardDBProfile dbProfile = ShardDBProfile::DEFAULT;
+    // Whether to fsync the WAL on a separate thread, with the writer moving on
+    // to the next batch meanwhile. Responses are still only sent once synced.
+    bool asyncWalSync = false;
+    // How many shard log entries we put at most in a single LogsDB entry. Anything
+    // above 1 writes the batched format, which all replicas and locations need
+    // to understand before it's turned on.
+    uint32_t logBatchEntries = 1;
+    // Whether to LZ4 compress (and checksum) what we put in LogsDB entries. Like
+    // batching, all replicas and locations need to understand the compressed
+    // format before it's turned on.
+    bool compressLogEntries = false;
+    // How many threads apply log entries when we're not the LogsDB leader. Entries
+    // which touch different inodes get applied concurrently, the result is the
+    // same as applying them one by one.
+    uint8_t applyThreads = 1;
+    // Whether to write all the log entries we apply in one go as a single RocksDB
+    // write batch, rather than one per entry.
+    bool groupCommit = false;
     ShardId shardId;
     bool shardIdSet = false;
 
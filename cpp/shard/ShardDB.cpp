@@ -7,18 +7,28 @@
 #include <atomic>
 #include <bit>
 #include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <exception>
 #include <fstream>
+#include <functional>
 #include <limits>
+#include <lz4.h>
 #include <memory>
+#include <mutex>
 #include <rocksdb/db.h>
+#include <rocksdb/filter_policy.h>
 #include <rocksdb/options.h>
+#include <rocksdb/slice_transform.h>
 #include <rocksdb/snapshot.h>
 #include <rocksdb/statistics.h>
 #include <rocksdb/table.h>
+#include <rocksdb/utilities/write_batch_with_index.h>
 #include <rocksdb/write_batch.h>
 #include <system_error>
+#include <thread>
 #include <type_traits>
+#include <unordered_set>
 
 #include "Assert.hpp"
 #include "AssertiveLock.hpp"
@@ -34,6 +44,7 @@
 #include "Protocol.hpp"
 #include "Random.hpp"
 #include "RocksDBUtils.hpp"
+#include "ShardDBCache.hpp"
 #include "ShardDBData.hpp"
 #include "SharedRocksDB.hpp"
 #include "Time.hpp"
@@ -110,6 +121,16 @@ static bool validName(const BincodeBytesRef& name) {
     return true;
 }
 
+// With the tuned profile `edges` and `spans` have a prefix extractor (dir id +
+// current, file id). Iterators are then only guaranteed to be correct within
+// the prefix they start in, which is fine if we stop at the first key outside
+// it, but not if we need to go from snapshot to current edges, or viceversa:
+// those need to opt out of prefix seeks.
+static rocksdb::ReadOptions totalOrder(rocksdb::ReadOptions options) {
+    options.total_order_seek = true;
+    return options;
+}
+
 static int pickMtu(uint16_t mtu) {
     if (mtu == 0) { mtu = DEFAULT_UDP_MTU; }
     mtu = std::min<uint16_t>(MAX_UDP_MTU, mtu);
@@ -131,10 +152,104 @@ void ShardLogEntry::unpack(BincodeBuf& buf) {
     body.unpack(buf);
 }
 
+void ShardLogEntry::packBatch(BincodeBuf& buf, const ShardLogEntry* entries, size_t count) {
+    ALWAYS_ASSERT(count > 0 && count <= MAX_SHARD_LOG_BATCH_ENTRIES);
+    if (count == 1) {
+        entries[0].pack(buf);
+        return;
+    }
+    buf.packScalar<uint32_t>(SHARD_LOG_BATCH_PROTOCOL_VERSION);
+    entries[0].idx.pack(buf);
+    buf.packScalar<uint16_t>(count);
+    for (size_t i = 0; i < count; i++) {
+        ALWAYS_ASSERT(entries[i].idx == entries[0].idx);
+        entries[i].time.pack(buf);
+        entries[i].body.pack(buf);
+    }
+}
+
+void ShardLogEntry::packBatchCompressed(BincodeBuf& buf, const ShardLogEntry* entries, size_t count) {
+    std::array<char, MAX_UDP_MTU> data;
+    BincodeBuf uncompressedBuf(&data[0], data.size());
+    packBatch(uncompressedBuf, entries, count);
+    size_t uncompressedSize = uncompressedBuf.len();
+    int compressedSize = 0;
+    if (buf.remaining() > COMPRESSED_HEADER_SIZE) {
+        int capacity = std::min(buf.remaining() - COMPRESSED_HEADER_SIZE, uncompressedSize - 1);
+        compressedSize = LZ4_compress_default(&data[0], (char*)buf.cursor + COMPRESSED_HEADER_SIZE, uncompressedSize, capacity);
+    }
+    // 0 means it didn't fit in the capacity, in which case we're better off not compressing
+    if (compressedSize == 0 || COMPRESSED_HEADER_SIZE + compressedSize >= uncompressedSize) {
+        buf.ensureSizeOrPanic(uncompressedSize);
+        memcpy(buf.cursor, &data[0], uncompressedSize);
+        buf.cursor += uncompressedSize;
+        return;
+    }
+    buf.packScalar<uint32_t>(SHARD_LOG_COMPRESSED_PROTOCOL_VERSION);
+    buf.packScalar<uint32_t>(uncompressedSize);
+    buf.packScalar<uint32_t>(crc32c(0, &data[0], uncompressedSize));
+    buf.cursor += compressedSize;
+}
+
+void ShardLogEntry::unpackBatch(BincodeBuf& buf, std::vector<ShardLogEntry>& entries) {
+    uint32_t protocol = buf.unpackScalar<uint32_t>();
+    if (protocol == SHARD_LOG_COMPRESSED_PROTOCOL_VERSION) {
+        size_t uncompressedSize = buf.unpackScalar<uint32_t>();
+        uint32_t expectedCrc = buf.unpackScalar<uint32_t>();
+        if (uncompressedSize > MAX_UDP_MTU) {
+            throw TERN_EXCEPTION("bad uncompressed log entry size %s", uncompressedSize);
+        }
+        std::array<char, MAX_UDP_MTU> data;
+        int decompressedSize = LZ4_decompress_safe((const char*)buf.cursor, &data[0], buf.remaining(), uncompressedSize);
+        if (decompressedSize < 0 || (size_t)decompressedSize != uncompressedSize) {
+            throw TERN_EXCEPTION("could not decompress log entry of %s bytes, expected %s, got %s", buf.remaining(), uncompressedSize, decompressedSize);
+        }
+        uint32_t crc = crc32c(0, &data[0], uncompressedSize);
+        if (crc != expectedCrc) {
+            throw TERN_EXCEPTION("bad crc for compressed log entry, expected %s, got %s", expectedCrc, crc);
+        }
+        buf.cursor = buf.end;
+        BincodeBuf uncompressedBuf(&data[0], uncompressedSize);
+        uncompressedBuf.arena = buf.arena;
+        // we never compress twice
+        ALWAYS_ASSERT(uncompressedBuf.unpackScalar<uint32_t>() != SHARD_LOG_COMPRESSED_PROTOCOL_VERSION);
+        uncompressedBuf.cursor = uncompressedBuf.data;
+        unpackBatch(uncompressedBuf, entries);
+        uncompressedBuf.ensureFinished();
+        return;
+    }
+    if (protocol == SHARD_LOG_PROTOCOL_VERSION) {
+        auto& entry = entries.emplace_back();
+        entry.idx.unpack(buf);
+        entry.time.unpack(buf);
+        entry.body.unpack(buf);
+        return;
+    }
+    ALWAYS_ASSERT(protocol == SHARD_LOG_BATCH_PROTOCOL_VERSION);
+    LogIdx idx;
+    idx.unpack(buf);
+    size_t count = buf.unpackScalar<uint16_t>();
+    ALWAYS_ASSERT(count > 1 && count <= MAX_SHARD_LOG_BATCH_ENTRIES);
+    for (size_t i = 0; i < count; i++) {
+        auto& entry = entries.emplace_back();
+        entry.idx = idx;
+        entry.time.unpack(buf);
+        entry.body.unpack(buf);
+    }
+}
+
 std::ostream& operator<<(std::ostream& out, const ShardLogEntry& entry) {
     return out << "ShardLogEntry(idx=" << entry.idx << ",time=" << entry.time << ",body=" << entry.body << ")";
 }
 
+std::ostream& operator<<(std::ostream& out, ShardDBProfile profile) {
+    switch (profile) {
+    case ShardDBProfile::DEFAULT: return out << "default";
+    case ShardDBProfile::TUNED: return out << "tuned";
+    default: return out << "ShardDBProfile(" << (int)profile << ")";
+    }
+}
+
 static char maxNameChars[255];
 __attribute__((constructor))
 static void fillMaxNameChars() {
@@ -142,22 +257,195 @@ static void fillMaxNameChars() {
 }
 static BincodeBytes maxName(maxNameChars, 255);
 
-std::vector<rocksdb::ColumnFamilyDescriptor> ShardDB::getColumnFamilyDescriptors() {
-    // TODO actually figure out the best strategy for each family, including the default
-    // one.
+std::vector<rocksdb::ColumnFamilyDescriptor> ShardDB::getColumnFamilyDescriptors(ShardDBProfile profile) {
     rocksdb::ColumnFamilyOptions blockServicesToFilesOptions;
     blockServicesToFilesOptions.merge_operator = CreateInt64AddOperator();
+    rocksdb::ColumnFamilyOptions filesOptions;
+    rocksdb::ColumnFamilyOptions spansOptions;
+    rocksdb::ColumnFamilyOptions directoriesOptions;
+    rocksdb::ColumnFamilyOptions edgesOptions;
+    if (profile == ShardDBProfile::TUNED) {
+        // files and directories are almost only accessed by id: bloom filters
+        // and hash indices within data blocks. This is `OptimizeForPointLookup`
+        // minus its dedicated block cache: with `-rocksdb-memory-mb`,
+        // `SharedRocksDB` gives every CF the same one, otherwise each CF gets
+        // the RocksDB default.
+        const auto pointLookup = [](rocksdb::ColumnFamilyOptions& options) {
+            rocksdb::BlockBasedTableOptions tableOptions;
+            tableOptions.data_block_index_type = rocksdb::BlockBasedTableOptions::kDataBlockBinaryAndHash;
+            tableOptions.data_block_hash_table_util_ratio = 0.75;
+            tableOptions.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10));
+            options.table_factory.reset(rocksdb::NewBlockBasedTableFactory(tableOptions));
+            options.memtable_prefix_bloom_size_ratio = 0.02;
+            options.memtable_whole_key_filtering = true;
+        };
+        pointLookup(filesOptions);
+        pointLookup(directoriesOptions);
+        // Edges are looked up by name and iterated within a directory (and
+        // current/snapshot), which is the first 8 bytes of `EdgeKey`.
+        {
+            rocksdb::BlockBasedTableOptions tableOptions;
+            tableOptions.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10));
+            tableOptions.whole_key_filtering = true;
+            edgesOptions.table_factory.reset(rocksdb::NewBlockBasedTableFactory(tableOptions));
+            edgesOptions.prefix_extractor.reset(rocksdb::NewFixedPrefixTransform(sizeof(uint64_t)));
+            edgesOptions.memtable_prefix_bloom_size_ratio = 0.05;
+        }
+        // Spans are big and only ever iterated within a file (the first 8
+        // bytes of `SpanKey`): large blocks, and partitioned indices/filters so
+        // that we don't need to hold the whole index in memory.
+        {
+            rocksdb::BlockBasedTableOptions tableOptions;
+            tableOptions.block_size = 64 << 10;
+            tableOptions.index_type = rocksdb::BlockBasedTableOptions::kTwoLevelIndexSearch;
+            tableOptions.partition_filters = true;
+            tableOptions.metadata_block_size = 4 << 10;
+            tableOptions.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10));
+            tableOptions.whole_key_filtering = false;
+            tableOptions.cache_index_and_filter_blocks = true;
+            tableOptions.pin_top_level_index_and_filter = true;
+            spansOptions.table_factory.reset(rocksdb::NewBlockBasedTableFactory(tableOptions));
+            spansOptions.prefix_extractor.reset(rocksdb::NewFixedPrefixTransform(sizeof(uint64_t)));
+        }
+    }
     return std::vector<rocksdb::ColumnFamilyDescriptor> {
             {rocksdb::kDefaultColumnFamilyName, {}},
-            {"files", {}},
-            {"spans", {}},
+            {"files", filesOptions},
+            {"spans", spansOptions},
             {"transientFiles", {}},
-            {"directories", {}},
-            {"edges", {}},
+            {"directories", directoriesOptions},
+            {"edges", edgesOptions},
             {"blockServicesToFiles", blockServicesToFilesOptions},
     };
 }
 
+// The threads `applyLogEntriesParallel` spreads entries over. The calling thread
+// takes part too, so we only spawn `threads-1` of them.
+struct ShardDBApplyPool {
+    ShardDBApplyPool(size_t threads) : _fn(nullptr), _n(0), _next(0), _done(0), _generation(0), _active(0), _stopping(false) {
+        for (size_t i = 1; i < threads; i++) {
+            _workers.emplace_back([this]() { _work(); });
+        }
+    }
+
+    ~ShardDBApplyPool() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _cv.notify_all();
+        for (auto& worker : _workers) {
+            worker.join();
+        }
+    }
+
+    size_t threads() const {
+        return _workers.size() + 1;
+    }
+
+    // Runs `fn(i)` for all i < n, and returns once they're all done, rethrowing
+    // the first exception any of them threw.
+    void run(size_t n, const std::function<void(size_t)>& fn) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _fn = &fn;
+            _n = n;
+            _next.store(0);
+            _done.store(0);
+            _error = nullptr;
+            _generation++;
+        }
+        _cv.notify_all();
+        _drain();
+        std::unique_lock<std::mutex> lock(_mutex);
+        // wait for the workers to be out of `_drain` too, so that none of them
+        // picks up work from the next run thinking it's from this one
+        _doneCv.wait(lock, [this]() { return _done.load() == _n && _active == 0; });
+        _fn = nullptr;
+        if (_error) {
+            std::rethrow_exception(_error);
+        }
+    }
+
+private:
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::condition_variable _doneCv;
+    const std::function<void(size_t)>* _fn;
+    size_t _n;
+    std::atomic<size_t> _next;
+    std::atomic<size_t> _done;
+    std::exception_ptr _error;
+    uint64_t _generation;
+    size_t _active;
+    bool _stopping;
+
+    void _drain() {
+        for (;;) {
+            size_t i = _next.fetch_add(1);
+            if (i >= _n) { return; }
+            try {
+                (*_fn)(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (!_error) { _error = std::current_exception(); }
+            }
+            if (_done.fetch_add(1) + 1 == _n) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _doneCv.notify_all();
+            }
+        }
+    }
+
+    void _work() {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (;;) {
+            _cv.wait(lock, [&]() { return _stopping || _generation != seen; });
+            if (_stopping) { return; }
+            seen = _generation;
+            _active++;
+            lock.unlock();
+            _drain();
+            lock.lock();
+            if (--_active == 0) {
+                _doneCv.notify_all();
+            }
+        }
+    }
+};
+
+// Iterators over the apply group (see `ShardDBImpl::_newIterator`) have their
+// key and value invalidated when the group is written to, which the apply
+// functions do while still holding on to what they found. So we keep copies.
+struct ShardDBApplyGroupIterator : rocksdb::Iterator {
+    ShardDBApplyGroupIterator(rocksdb::Iterator* it) : _it(it) {}
+
+    virtual bool Valid() const override { return _it->Valid(); }
+    virtual void SeekToFirst() override { _it->SeekToFirst(); _copy(); }
+    virtual void SeekToLast() override { _it->SeekToLast(); _copy(); }
+    virtual void Seek(const rocksdb::Slice& target) override { _it->Seek(target); _copy(); }
+    virtual void SeekForPrev(const rocksdb::Slice& target) override { _it->SeekForPrev(target); _copy(); }
+    virtual void Next() override { _it->Next(); _copy(); }
+    virtual void Prev() override { _it->Prev(); _copy(); }
+    virtual rocksdb::Slice key() const override { return _key; }
+    virtual rocksdb::Slice value() const override { return _value; }
+    virtual rocksdb::Status status() const override { return _it->status(); }
+
+private:
+    std::unique_ptr<rocksdb::Iterator> _it;
+    std::string _key;
+    std::string _value;
+
+    void _copy() {
+        if (_it->Valid()) {
+            _key.assign(_it->key().data(), _it->key().size());
+            _value.assign(_it->value().data(), _it->value().size());
+        }
+    }
+};
+
 struct ShardDBImpl {
     Env _env;
 
@@ -169,7 +457,8 @@ struct ShardDBImpl {
 
     // TODO it would be good to store basically all of the metadata in memory,
     // so that we'd just read from it, but this requires a bit of care when writing
-    // since we rollback on error.
+    // since we rollback on error. For now we cache the hottest bits (directories
+    // and current edges, which every lookup goes through), see `_cachedGet`.
 
     rocksdb::DB* _db;
     rocksdb::ColumnFamilyHandle* _defaultCf;
@@ -181,11 +470,22 @@ struct ShardDBImpl {
     rocksdb::ColumnFamilyHandle* _blockServicesToFilesCf;
 
     AssertiveLock _applyLogEntryLock;
+    // created on the first `applyLogEntriesParallel`
+    std::unique_ptr<ShardDBApplyPool> _applyPool;
+    // Where `applyLogEntry` writes between `startApplyGroup` and `commitApplyGroup`.
+    // Only the writer touches it, and it only reads through it without a snapshot.
+    rocksdb::WriteBatchWithIndex _applyGroup;
+    bool _applyGroupOpen;
 
     std::shared_ptr<const rocksdb::Snapshot> _currentReadSnapshot;
+    // bumped every time _currentReadSnapshot is replaced, so that readers
+    // can cheaply tell whether their ShardDBReadView is stale
+    std::atomic<uint64_t> _readSnapshotGeneration;
 
     const BlockServicesCacheDB& _blockServicesCache;
 
+    ShardDBCache _metadataCache;
+
     // ----------------------------------------------------------------
     // initialization
 
@@ -198,7 +498,8 @@ struct ShardDBImpl {
         uint8_t locationId,
         Duration deadlineInterval,
         const SharedRocksDB& sharedDB,
-        const BlockServicesCacheDB& blockServicesCache
+        const BlockServicesCacheDB& blockServicesCache,
+        size_t metadataCacheEntries
     ) :
         _env(logger, xmon, "shard_db"),
         _shid(shid),
@@ -212,11 +513,16 @@ struct ShardDBImpl {
         _directoriesCf(sharedDB.getCF("directories")),
         _edgesCf(sharedDB.getCF("edges")),
         _blockServicesToFilesCf(sharedDB.getCF("blockServicesToFiles")),
-        _blockServicesCache(blockServicesCache)
+        // overwriting keys is needed to iterate over it
+        _applyGroup(rocksdb::BytewiseComparator(), 0, true),
+        _applyGroupOpen(false),
+        _readSnapshotGeneration(0),
+        _blockServicesCache(blockServicesCache),
+        _metadataCache(metadataCacheEntries)
     {
         LOG_INFO(_env, "initializing shard %s RocksDB", _shid);
         _initDb();
-        _updateCurrentReadSnapshot();
+        _publishReadSnapshot(_takeSnapshot());
     }
 
     void close() {
@@ -229,7 +535,7 @@ struct ShardDBImpl {
             bool shardInfoExists;
             {
                 std::string value;
-                auto status = _db->Get({}, shardMetadataKey(&SHARD_INFO_KEY), &value);
+                auto status = _get({}, shardMetadataKey(&SHARD_INFO_KEY), &value);
                 if (status.IsNotFound()) {
                     shardInfoExists = false;
                 } else {
@@ -255,7 +561,7 @@ struct ShardDBImpl {
 
         const auto keyExists = [this](rocksdb::ColumnFamilyHandle* cf, const rocksdb::Slice& key) -> bool {
             std::string value;
-            auto status = _db->Get({}, cf, key, &value);
+            auto status = _get({}, cf, key, &value);
             if (status.IsNotFound()) {
                 return false;
             } else {
@@ -325,7 +631,7 @@ struct ShardDBImpl {
         std::string fileValue;
         {
             auto k = InodeIdKey::Static(req.id);
-            auto status = _db->Get(options, _transientCf, k.toSlice(), &fileValue);
+            auto status = _get(options, _transientCf, k.toSlice(), &fileValue);
             if (status.IsNotFound()) {
                 return TernError::FILE_NOT_FOUND;
             }
@@ -373,7 +679,7 @@ struct ShardDBImpl {
         options.iterate_upper_bound = &upperBoundSlice;
 
         {
-            auto it = std::unique_ptr<rocksdb::Iterator>(_db->NewIterator(options, _edgesCf));
+            auto it = std::unique_ptr<rocksdb::Iterator>(_newIterator(options, _edgesCf));
             StaticValue<EdgeKey> beginKey;
             beginKey().setDirIdWithCurrent(req.dirId, true); // current = true
             beginKey().setNameHash(req.startHash);
@@ -472,7 +778,7 @@ struct ShardDBImpl {
             key().setNameHash(nameHash);
             key().setName(req.startName.ref());
             std::string value;
-            auto status = _db->Get(options, _edgesCf, key.toSlice(), &value);
+            auto status = _get(options, _edgesCf, key.toSlice(), &value);
             if (status.IsNotFound()) { return false; }
             ROCKS_DB_CHECKED(status);
             ExternalValue<CurrentEdgeBody> edge(value);
@@ -503,7 +809,7 @@ struct ShardDBImpl {
         (forwards ? options.iterate_upper_bound : options.iterate_lower_bound) = &snapshotEndSlice;
 
         // then start iterating
-        auto it = std::unique_ptr<rocksdb::Iterator>(_db->NewIterator(options, _edgesCf));
+        auto it = std::unique_ptr<rocksdb::Iterator>(_newIterator(options, _edgesCf));
         for (
             forwards ? it->Seek(snapshotStart.toSlice()) : it->SeekForPrev(snapshotStart.toSlice());
             it->Valid();
@@ -564,7 +870,8 @@ struct ShardDBImpl {
         if (!current) {
             startKey().setCreationTime(req.startTime);
         }
-        auto it = std::unique_ptr<rocksdb::Iterator>(_db->NewIterator(options, _edgesCf));
+        // this goes across current and snapshot edges
+        auto it = std::unique_ptr<rocksdb::Iterator>(_newIterator(totalOrder(options), _edgesCf));
         int budget = pickMtu(req.mtu) - ShardRespMsg::STATIC_SIZE - FullReadDirResp::STATIC_SIZE;
         for (
             forwards ? it->Seek(startKey.toSlice()) : it->SeekForPrev(startKey.toSlice());
@@ -633,7 +940,7 @@ struct ShardDBImpl {
             reqKey().setNameHash(nameHash);
             reqKey().setName(req.name.ref());
             std::string edgeValue;
-            auto status = _db->Get(options, _edgesCf, reqKey.toSlice(), &edgeValue);
+            auto status = _cachedGet(options, _edgesCf, reqKey.toSlice(), edgeValue);
             if (status.IsNotFound()) {
                 return TernError::NAME_NOT_FOUND;
             }
@@ -650,7 +957,7 @@ struct ShardDBImpl {
         resp.nextId = NULL_INODE_ID;
 
         {
-            std::unique_ptr<rocksdb::Iterator> it(_db->NewIterator(options, _transientCf));
+            std::unique_ptr<rocksdb::Iterator> it(_newIterator(options, _transientCf));
             auto beginKey = InodeIdKey::Static(req.beginId);
             int budget = pickMtu(req.mtu) - ShardRespMsg::STATIC_SIZE - VisitTransientFilesResp::STATIC_SIZE;
             for (it->Seek(beginKey.toSlice()); it->Valid(); it->Next()) {
@@ -682,7 +989,7 @@ struct ShardDBImpl {
         int budget = pickMtu(req.mtu) - ShardRespMsg::STATIC_SIZE - Resp::STATIC_SIZE;
         int maxIds = (budget/8) + 1; // include next inode
         {
-            std::unique_ptr<rocksdb::Iterator> it(_db->NewIterator(options, cf));
+            std::unique_ptr<rocksdb::Iterator> it(_newIterator(options, cf));
             auto beginKey = InodeIdKey::Static(req.beginId);
             for (
                 it->Seek(beginKey.toSlice());
@@ -751,7 +1058,7 @@ struct ShardDBImpl {
         beginKey().setFileId(req.fileId);
         beginKey().setOffset(req.byteOffset);
         {
-            std::unique_ptr<rocksdb::Iterator> it(_db->NewIterator(options, _spansCf));
+            std::unique_ptr<rocksdb::Iterator> it(_newIterator(options, _spansCf));
             for (
                 it->SeekForPrev(beginKey.toSlice());
                 it->Valid() && (req.limit == 0 || resp.spans.els.size() < req.limit);
@@ -886,7 +1193,7 @@ struct ShardDBImpl {
         beginKey().setFileId(req.fileId);
         beginKey().setOffset(req.byteOffset);
         {
-            std::unique_ptr<rocksdb::Iterator> it(_db->NewIterator(options, _spansCf));
+            std::unique_ptr<rocksdb::Iterator> it(_newIterator(options, _spansCf));
             for (
                 it->SeekForPrev(beginKey.toSlice());
                 it->Valid() && (req.limit == 0 || resp.spans.els.size() < req.limit);
@@ -986,7 +1293,7 @@ struct ShardDBImpl {
         auto endKeySlice = endKey.toSlice();
 
         options.iterate_upper_bound = &endKeySlice;
-        std::unique_ptr<rocksdb::Iterator> it(_db->NewIterator(options, _blockServicesToFilesCf));
+        std::unique_ptr<rocksdb::Iterator> it(_newIterator(options, _blockServicesToFilesCf));
         for (
             it->Seek(beginKey.toSlice());
             it->Valid() && resp.fileIds.els.size() < maxFiles;
@@ -1009,15 +1316,32 @@ struct ShardDBImpl {
     }
 
     uint64_t read(const ShardReqContainer& req, ShardRespContainer& resp) {
+        auto snapshot = _getCurrentReadSnapshot();
+        rocksdb::ReadOptions options;
+        options.snapshot = snapshot.get();
+        return _read(options, req, resp);
+    }
+
+    uint64_t read(const ShardReqContainer& req, ShardRespContainer& resp, ShardDBReadView& view) {
+        // Load the generation before the pointer: we might end up with a
+        // snapshot newer than the generation we record, which just means
+        // we'll refresh once more than strictly needed.
+        uint64_t generation = _readSnapshotGeneration.load(std::memory_order_acquire);
+        if (unlikely(view.generation != generation)) {
+            view.snapshot = _getCurrentReadSnapshot();
+            view.generation = generation;
+        }
+        rocksdb::ReadOptions options;
+        options.snapshot = view.snapshot.get();
+        return _read(options, req, resp);
+    }
+
+    uint64_t _read(rocksdb::ReadOptions& options, const ShardReqContainer& req, ShardRespContainer& resp) {
         LOG_DEBUG(_env, "processing read-only request of kind %s", req.kind());
 
         auto err = TernError::NO_ERROR;
         resp.clear();
 
-        auto snapshot = _getCurrentReadSnapshot();
-        rocksdb::ReadOptions options;
-        options.snapshot = snapshot.get();
-
         switch (req.kind()) {
         case ShardMessageKind::STAT_FILE:
             err = _statFile(options, req.getStatFile(), resp.setStatFile());
@@ -1541,7 +1865,7 @@ struct ShardDBImpl {
                 // We should never have many tombstones here (spans aren't really deleted and
                 // re-added apart from rare cases), so the offset upper bound is fine.
                 startK().setOffset(first ? 0 : ~(uint64_t)0);
-                std::unique_ptr<rocksdb::Iterator> it(_db->NewIterator(options, _spansCf));
+                std::unique_ptr<rocksdb::Iterator> it(_newIterator(options, _spansCf));
                 it->SeekForPrev(startK.toSlice());
                 if (!it->Valid()) { // nothing to do if we can't find a span
                     if (!it->status().IsNotFound()) {
@@ -1930,19 +2254,53 @@ struct ShardDBImpl {
     // ----------------------------------------------------------------
     // log application
 
-    void _advanceLastAppliedLogEntry(rocksdb::WriteBatch& batch, uint64_t index) {
+    // Returns false if the entry has already been applied, which only happens
+    // if we're applying again a batch we stopped halfway through.
+    bool _advanceLastAppliedLogEntry(rocksdb::WriteBatchBase& batch, uint64_t index, size_t batchPos, size_t batchSize) {
         uint64_t oldIndex = _lastAppliedLogEntry({});
         ALWAYS_ASSERT(oldIndex+1 == index, "old index is %s, expected %s, got %s", oldIndex, oldIndex+1, index);
+        ALWAYS_ASSERT(batchPos < batchSize);
+        if (batchSize > 1) {
+            uint64_t applied = _appliedInLogBatch(index);
+            if (batchPos < applied) {
+                return false;
+            }
+            ALWAYS_ASSERT(batchPos == applied, "expected entry %s in batch at index %s, got %s", applied, index, batchPos);
+            if (batchPos+1 < batchSize) {
+                LOG_DEBUG(_env, "applied %s/%s entries in batch at log index %s", batchPos+1, batchSize, index);
+                StaticValue<LogBatchProgressBody> v;
+                v().setLogIndex(index);
+                v().setApplied(batchPos+1);
+                ROCKS_DB_CHECKED(batch.Put({}, shardMetadataKey(&LOG_BATCH_PROGRESS_KEY), v.toSlice()));
+                return true;
+            }
+            ROCKS_DB_CHECKED(batch.Delete({}, shardMetadataKey(&LOG_BATCH_PROGRESS_KEY)));
+        }
         LOG_DEBUG(_env, "bumping log index from %s to %s", oldIndex, index);
         StaticValue<U64Value> v;
         v().setU64(index);
         ROCKS_DB_CHECKED(batch.Put({}, shardMetadataKey(&LAST_APPLIED_LOG_ENTRY_KEY), v.toSlice()));
+        return true;
+    }
+
+    // How many entries of the batch at `index` we've already applied.
+    uint64_t _appliedInLogBatch(uint64_t index) {
+        std::string value;
+        auto status = _get({}, shardMetadataKey(&LOG_BATCH_PROGRESS_KEY), &value);
+        if (status.IsNotFound()) {
+            return 0;
+        }
+        ROCKS_DB_CHECKED(status);
+        ExternalValue<LogBatchProgressBody> progress(value);
+        // we only ever leave progress for the batch right after the last applied index
+        ALWAYS_ASSERT(progress().logIndex() == index, "found progress for batch at log index %s, expected %s", progress().logIndex(), index);
+        return progress().applied();
     }
 
-    TernError _applyConstructFile(rocksdb::WriteBatch& batch, TernTime time, const ConstructFileEntry& entry, ConstructFileResp& resp) {
+    TernError _applyConstructFile(rocksdb::WriteBatchBase& batch, TernTime time, const ConstructFileEntry& entry, ConstructFileResp& resp) {
         const auto nextFileId = [this, &batch](const ShardMetadataKey* key) -> InodeId {
             std::string value;
-            ROCKS_DB_CHECKED(_db->Get({}, shardMetadataKey(key), &value));
+            ROCKS_DB_CHECKED(_get({}, shardMetadataKey(key), &value));
             ExternalValue<InodeIdValue> inodeId(value);
             inodeId().setId(InodeId::FromU64(inodeId().id().u64 + 0x100));
             ROCKS_DB_CHECKED(batch.Put(shardMetadataKey(key), inodeId.toSlice()));
@@ -1975,7 +2333,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applyLinkFile(rocksdb::WriteBatch& batch, TernTime time, const LinkFileEntry& entry, LinkFileResp& resp) {
+    TernError _applyLinkFile(rocksdb::WriteBatchBase& batch, TernTime time, const LinkFileEntry& entry, LinkFileResp& resp) {
         std::string fileValue;
         ExternalValue<TransientFileBody> transientFile;
         {
@@ -1995,7 +2353,7 @@ struct ShardDBImpl {
                 edgeKey().setName(entry.name.ref());
                 std::string edgeValue;
                 {
-                    auto status = _db->Get({}, _edgesCf, edgeKey.toSlice(), &edgeValue);
+                    auto status = _get({}, _edgesCf, edgeKey.toSlice(), &edgeValue);
                     if (status.IsNotFound()) {
                         LOG_DEBUG(_env, "could not find edge after FILE_NOT_FOUND for link file");
                         return err;
@@ -2038,7 +2396,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _initiateDirectoryModification(TernTime time, bool allowSnapshot, rocksdb::WriteBatch& batch, InodeId dirId, std::string& dirValue, ExternalValue<DirectoryBody>& dir) {
+    TernError _initiateDirectoryModification(TernTime time, bool allowSnapshot, rocksdb::WriteBatchBase& batch, InodeId dirId, std::string& dirValue, ExternalValue<DirectoryBody>& dir) {
         ExternalValue<DirectoryBody> tmpDir;
         TernError err = _getDirectory({}, dirId, allowSnapshot, dirValue, tmpDir);
         if (err != TernError::NO_ERROR) {
@@ -2065,7 +2423,7 @@ struct ShardDBImpl {
     }
 
     // When we just want to compute the hash of something when modifying the dir
-    TernError _initiateDirectoryModificationAndHash(TernTime time, bool allowSnapshot, rocksdb::WriteBatch& batch, InodeId dirId, const BincodeBytesRef& name, uint64_t& nameHash) {
+    TernError _initiateDirectoryModificationAndHash(TernTime time, bool allowSnapshot, rocksdb::WriteBatchBase& batch, InodeId dirId, const BincodeBytesRef& name, uint64_t& nameHash) {
         ExternalValue<DirectoryBody> dir;
         std::string dirValue;
         TernError err = _initiateDirectoryModification(time, allowSnapshot, batch, dirId, dirValue, dir);
@@ -2082,7 +2440,7 @@ struct ShardDBImpl {
     // The creation time might be different than the current time because we might find it
     // in an existing edge.
     TernError _createCurrentEdge(
-        TernTime logEntryTime, rocksdb::WriteBatch& batch, InodeId dirId, const BincodeBytes& name, InodeId targetId,
+        TernTime logEntryTime, rocksdb::WriteBatchBase& batch, InodeId dirId, const BincodeBytes& name, InodeId targetId,
         // if locked=true, oldCreationTime will be used to check that we're locking the right edge.
         bool locked, TernTime oldCreationTime,
         TernTime& creationTime
@@ -2106,7 +2464,7 @@ struct ShardDBImpl {
         edgeKey().setNameHash(nameHash);
         edgeKey().setName(name.ref());
         std::string edgeValue;
-        auto status = _db->Get({}, _edgesCf, edgeKey.toSlice(), &edgeValue);
+        auto status = _get({}, _edgesCf, edgeKey.toSlice(), &edgeValue);
 
         // in the block below, we exit the function early if something is off.
         if (status.IsNotFound()) {
@@ -2119,7 +2477,7 @@ struct ShardDBImpl {
             snapshotEdgeKey().setNameHash(nameHash);
             snapshotEdgeKey().setName(name.ref());
             snapshotEdgeKey().setCreationTime({std::numeric_limits<uint64_t>::max()});
-            std::unique_ptr<rocksdb::Iterator> it(_db->NewIterator({}, _edgesCf));
+            std::unique_ptr<rocksdb::Iterator> it(_newIterator({}, _edgesCf));
             // TODO add iteration bounds
             it->SeekForPrev(snapshotEdgeKey.toSlice());
             if (it->Valid() && !it->status().IsNotFound()) {
@@ -2191,7 +2549,7 @@ struct ShardDBImpl {
 
     }
 
-    TernError _applySameDirectoryRename(TernTime time, rocksdb::WriteBatch& batch, const SameDirectoryRenameEntry& entry, SameDirectoryRenameResp& resp) {
+    TernError _applySameDirectoryRename(TernTime time, rocksdb::WriteBatchBase& batch, const SameDirectoryRenameEntry& entry, SameDirectoryRenameResp& resp) {
         // First, remove the old edge -- which won't be owned anymore, since we're renaming it.
         {
             TernError err = _softUnlinkCurrentEdge(time, batch, entry.dirId, entry.oldName, entry.oldCreationTime, entry.targetId, false);
@@ -2209,7 +2567,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applySameDirectoryRenameSnapshot(TernTime time, rocksdb::WriteBatch& batch, const SameDirectoryRenameSnapshotEntry& entry, SameDirectoryRenameSnapshotResp& resp) {
+    TernError _applySameDirectoryRenameSnapshot(TernTime time, rocksdb::WriteBatchBase& batch, const SameDirectoryRenameSnapshotEntry& entry, SameDirectoryRenameSnapshotResp& resp) {
         // First, disown the snapshot edge.
         {
             // compute hash
@@ -2229,7 +2587,7 @@ struct ShardDBImpl {
             edgeKey().setName(entry.oldName.ref());
             edgeKey().setCreationTime(entry.oldCreationTime);
             std::string edgeValue;
-            auto status = _db->Get({}, _edgesCf, edgeKey.toSlice(), &edgeValue);
+            auto status = _get({}, _edgesCf, edgeKey.toSlice(), &edgeValue);
             if (status.IsNotFound()) {
                 return TernError::EDGE_NOT_FOUND;
             }
@@ -2268,7 +2626,7 @@ struct ShardDBImpl {
     }
 
     // the creation time of the delete edge is always `time`.
-    TernError _softUnlinkCurrentEdge(TernTime time, rocksdb::WriteBatch& batch, InodeId dirId, const BincodeBytes& name, TernTime creationTime, InodeId targetId, bool owned) {
+    TernError _softUnlinkCurrentEdge(TernTime time, rocksdb::WriteBatchBase& batch, InodeId dirId, const BincodeBytes& name, TernTime creationTime, InodeId targetId, bool owned) {
         // compute hash
         uint64_t nameHash;
         {
@@ -2285,7 +2643,7 @@ struct ShardDBImpl {
         edgeKey().setNameHash(nameHash);
         edgeKey().setName(name.ref());
         std::string edgeValue;
-        auto status = _db->Get({}, _edgesCf, edgeKey.toSlice(), &edgeValue);
+        auto status = _get({}, _edgesCf, edgeKey.toSlice(), &edgeValue);
         if (status.IsNotFound()) {
             return TernError::EDGE_NOT_FOUND;
         }
@@ -2326,14 +2684,14 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applySoftUnlinkFile(TernTime time, rocksdb::WriteBatch& batch, const SoftUnlinkFileEntry& entry, SoftUnlinkFileResp& resp) {
+    TernError _applySoftUnlinkFile(TernTime time, rocksdb::WriteBatchBase& batch, const SoftUnlinkFileEntry& entry, SoftUnlinkFileResp& resp) {
         TernError err = _softUnlinkCurrentEdge(time, batch, entry.ownerId, entry.name, entry.creationTime, entry.fileId, true);
         if (err != TernError::NO_ERROR) { return err; }
         resp.deleteCreationTime = time;
         return TernError::NO_ERROR;
     }
 
-    TernError _applyCreateDirectoryInode(TernTime time, rocksdb::WriteBatch& batch, const CreateDirectoryInodeEntry& entry, CreateDirectoryInodeResp& resp) {
+    TernError _applyCreateDirectoryInode(TernTime time, rocksdb::WriteBatchBase& batch, const CreateDirectoryInodeEntry& entry, CreateDirectoryInodeResp& resp) {
         // The assumption here is that only the CDC creates directories, and it doles out
         // inode ids per transaction, so that you'll never get competing creates here, but
         // we still check that the parent makes sense.
@@ -2370,7 +2728,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applyCreateLockedCurrentEdge(TernTime time, rocksdb::WriteBatch& batch, const CreateLockedCurrentEdgeEntry& entry, CreateLockedCurrentEdgeResp& resp) {
+    TernError _applyCreateLockedCurrentEdge(TernTime time, rocksdb::WriteBatchBase& batch, const CreateLockedCurrentEdgeEntry& entry, CreateLockedCurrentEdgeResp& resp) {
         auto err = _createCurrentEdge(time, batch, entry.dirId, entry.name, entry.targetId, true, entry.oldCreationTime, resp.creationTime); // locked=true
         if (err != TernError::NO_ERROR) {
             return err;
@@ -2378,7 +2736,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applyUnlockCurrentEdge(TernTime time, rocksdb::WriteBatch& batch, const UnlockCurrentEdgeEntry& entry, UnlockCurrentEdgeResp& resp) {
+    TernError _applyUnlockCurrentEdge(TernTime time, rocksdb::WriteBatchBase& batch, const UnlockCurrentEdgeEntry& entry, UnlockCurrentEdgeResp& resp) {
         uint64_t nameHash;
         {
             std::string dirValue;
@@ -2397,7 +2755,7 @@ struct ShardDBImpl {
         currentKey().setName(entry.name.ref());
         std::string edgeValue;
         {
-            auto status = _db->Get({}, _edgesCf, currentKey.toSlice(), &edgeValue);
+            auto status = _get({}, _edgesCf, currentKey.toSlice(), &edgeValue);
             if (status.IsNotFound()) {
                 return TernError::EDGE_NOT_FOUND;
             }
@@ -2433,7 +2791,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applyLockCurrentEdge(TernTime time, rocksdb::WriteBatch& batch, const LockCurrentEdgeEntry& entry, LockCurrentEdgeResp& resp) {
+    TernError _applyLockCurrentEdge(TernTime time, rocksdb::WriteBatchBase& batch, const LockCurrentEdgeEntry& entry, LockCurrentEdgeResp& resp) {
         // TODO lots of duplication with _applyUnlockCurrentEdge
         uint64_t nameHash;
         {
@@ -2453,7 +2811,7 @@ struct ShardDBImpl {
         currentKey().setName(entry.name.ref());
         std::string edgeValue;
         {
-            auto status = _db->Get({}, _edgesCf, currentKey.toSlice(), &edgeValue);
+            auto status = _get({}, _edgesCf, currentKey.toSlice(), &edgeValue);
             if (status.IsNotFound()) {
                 return TernError::EDGE_NOT_FOUND;
             }
@@ -2472,7 +2830,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applyRemoveDirectoryOwner(TernTime time, rocksdb::WriteBatch& batch, const RemoveDirectoryOwnerEntry& entry, RemoveDirectoryOwnerResp& resp) {
+    TernError _applyRemoveDirectoryOwner(TernTime time, rocksdb::WriteBatchBase& batch, const RemoveDirectoryOwnerEntry& entry, RemoveDirectoryOwnerResp& resp) {
         std::string dirValue;
         ExternalValue<DirectoryBody> dir;
         {
@@ -2492,7 +2850,7 @@ struct ShardDBImpl {
             edgeKey().setDirIdWithCurrent(entry.dirId, true); // current=true
             edgeKey().setNameHash(0);
             edgeKey().setName({});
-            std::unique_ptr<rocksdb::Iterator> it(_db->NewIterator({}, _edgesCf));
+            std::unique_ptr<rocksdb::Iterator> it(_newIterator({}, _edgesCf));
             // TODO apply iteration bound
             it->Seek(edgeKey.toSlice());
             if (it->Valid()) {
@@ -2521,7 +2879,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applyRemoveDirectoryInode(TernTime time, rocksdb::WriteBatch& batch, const RemoveInodeEntry& entry, RemoveInodeResp& resp) {
+    TernError _applyRemoveDirectoryInode(TernTime time, rocksdb::WriteBatchBase& batch, const RemoveInodeEntry& entry, RemoveInodeResp& resp) {
         ALWAYS_ASSERT(entry.id.type() == InodeType::DIRECTORY);
 
         std::string dirValue;
@@ -2545,7 +2903,7 @@ struct ShardDBImpl {
             edgeKey().setNameHash(0);
             edgeKey().setName({});
             edgeKey().setCreationTime(0);
-            std::unique_ptr<rocksdb::Iterator> it(_db->NewIterator({}, _edgesCf));
+            std::unique_ptr<rocksdb::Iterator> it(_newIterator(totalOrder({}), _edgesCf)); // we might need to go from snapshot to current edges
             // TODO apply iteration bound
             it->Seek(edgeKey.toSlice());
             if (it->Valid()) {
@@ -2569,7 +2927,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applyRemoveFileInode(TernTime time, rocksdb::WriteBatch& batch, const RemoveInodeEntry& entry, RemoveInodeResp& resp) {
+    TernError _applyRemoveFileInode(TernTime time, rocksdb::WriteBatchBase& batch, const RemoveInodeEntry& entry, RemoveInodeResp& resp) {
         ALWAYS_ASSERT(entry.id.type() == InodeType::FILE || entry.id.type() == InodeType::SYMLINK);
 
         // we demand for the file to be transient, for the deadline to have passed, and for it to have
@@ -2606,7 +2964,7 @@ struct ShardDBImpl {
                 StaticValue<SpanKey> spanKey;
                 spanKey().setFileId(entry.id);
                 spanKey().setOffset(0);
-                std::unique_ptr<rocksdb::Iterator> it(_db->NewIterator({}, _spansCf));
+                std::unique_ptr<rocksdb::Iterator> it(_newIterator({}, _spansCf));
                 // TODO apply iteration bound
                 it->Seek(spanKey.toSlice());
                 if (it->Valid()) {
@@ -2627,7 +2985,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applyRemoveInode(TernTime time, rocksdb::WriteBatch& batch, const RemoveInodeEntry& entry, RemoveInodeResp& resp) {
+    TernError _applyRemoveInode(TernTime time, rocksdb::WriteBatchBase& batch, const RemoveInodeEntry& entry, RemoveInodeResp& resp) {
         if (entry.id.type() == InodeType::DIRECTORY) {
             return _applyRemoveDirectoryInode(time, batch, entry, resp);
         } else {
@@ -2635,7 +2993,7 @@ struct ShardDBImpl {
         }
     }
 
-    TernError _applySetDirectoryOwner(TernTime time, rocksdb::WriteBatch& batch, const SetDirectoryOwnerEntry& entry, SetDirectoryOwnerResp& resp) {
+    TernError _applySetDirectoryOwner(TernTime time, rocksdb::WriteBatchBase& batch, const SetDirectoryOwnerEntry& entry, SetDirectoryOwnerResp& resp) {
         std::string dirValue;
         ExternalValue<DirectoryBody> dir;
         {
@@ -2655,7 +3013,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applySetDirectoryInfo(TernTime time, rocksdb::WriteBatch& batch, const SetDirectoryInfoEntry& entry, SetDirectoryInfoResp& resp) {
+    TernError _applySetDirectoryInfo(TernTime time, rocksdb::WriteBatchBase& batch, const SetDirectoryInfoEntry& entry, SetDirectoryInfoResp& resp) {
         std::string dirValue;
         ExternalValue<DirectoryBody> dir;
         {
@@ -2680,7 +3038,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applyRemoveNonOwnedEdge(TernTime time, rocksdb::WriteBatch& batch, const RemoveNonOwnedEdgeEntry& entry, RemoveNonOwnedEdgeResp& resp) {
+    TernError _applyRemoveNonOwnedEdge(TernTime time, rocksdb::WriteBatchBase& batch, const RemoveNonOwnedEdgeEntry& entry, RemoveNonOwnedEdgeResp& resp) {
         uint64_t nameHash;
         {
             // allowSnapshot=true since GC needs to be able to remove non-owned edges from snapshot dir
@@ -2698,7 +3056,7 @@ struct ShardDBImpl {
             k().setName(entry.name.ref());
             k().setCreationTime(entry.creationTime);
             std::string edgeValue;
-            auto status = _db->Get({}, _edgesCf, k.toSlice(), &edgeValue);
+            auto status = _get({}, _edgesCf, k.toSlice(), &edgeValue);
             if (status.IsNotFound()) {
                 return TernError::NO_ERROR; // make the client's life easier
             }
@@ -2715,7 +3073,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applySameShardHardFileUnlink(TernTime time, rocksdb::WriteBatch& batch, const SameShardHardFileUnlinkEntry& entry, SameShardHardFileUnlinkResp& resp) {
+    TernError _applySameShardHardFileUnlink(TernTime time, rocksdb::WriteBatchBase& batch, const SameShardHardFileUnlinkEntry& entry, SameShardHardFileUnlinkResp& resp) {
         // fetch the file
         std::string fileValue;
         ExternalValue<FileBody> file;
@@ -2759,7 +3117,7 @@ struct ShardDBImpl {
             k().setName(entry.name.ref());
             k().setCreationTime(entry.creationTime);
             std::string edgeValue;
-            auto status = _db->Get({}, _edgesCf, k.toSlice(), &edgeValue);
+            auto status = _get({}, _edgesCf, k.toSlice(), &edgeValue);
             if (status.IsNotFound()) {
                 return TernError::EDGE_NOT_FOUND; // can't return TernError::NO_ERROR, since the transient file still exists
             }
@@ -2789,7 +3147,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applyRemoveSpanInitiate(TernTime time, rocksdb::WriteBatch& batch, const RemoveSpanInitiateEntry& entry, RemoveSpanInitiateResp& resp) {
+    TernError _applyRemoveSpanInitiate(TernTime time, rocksdb::WriteBatchBase& batch, const RemoveSpanInitiateEntry& entry, RemoveSpanInitiateResp& resp) {
         std::string fileValue;
         ExternalValue<TransientFileBody> file;
         {
@@ -2810,7 +3168,7 @@ struct ShardDBImpl {
         LOG_DEBUG(_env, "deleting span from file %s of size %s", entry.fileId, file().fileSize());
 
         // Fetch the last span
-        std::unique_ptr<rocksdb::Iterator> spanIt(_db->NewIterator({}, _spansCf));
+        std::unique_ptr<rocksdb::Iterator> spanIt(_newIterator({}, _spansCf));
         ExternalValue<SpanKey> spanKey;
         ExternalValue<SpanBody> span;
         {
@@ -2872,7 +3230,7 @@ struct ShardDBImpl {
 
     uint64_t _getNextBlockId() {
         std::string v;
-        ROCKS_DB_CHECKED(_db->Get({}, _defaultCf, shardMetadataKey(&NEXT_BLOCK_ID_KEY), &v));
+        ROCKS_DB_CHECKED(_get({}, _defaultCf, shardMetadataKey(&NEXT_BLOCK_ID_KEY), &v));
         return ExternalValue<U64Value>(v)().u64();
     }
 
@@ -2882,7 +3240,7 @@ struct ShardDBImpl {
         return nextBlockId;
     }
 
-    void _writeNextBlockId(rocksdb::WriteBatch& batch, uint64_t nextBlockId) {
+    void _writeNextBlockId(rocksdb::WriteBatchBase& batch, uint64_t nextBlockId) {
         StaticValue<U64Value> v;
         v().setU64(nextBlockId);
         ROCKS_DB_CHECKED(batch.Put(_defaultCf, shardMetadataKey(&NEXT_BLOCK_ID_KEY), v.toSlice()));
@@ -2903,7 +3261,7 @@ struct ShardDBImpl {
         }
     }
 
-    void _addBlockServicesToFiles(rocksdb::WriteBatch& batch, BlockServiceId blockServiceId, InodeId fileId, int64_t delta) {
+    void _addBlockServicesToFiles(rocksdb::WriteBatchBase& batch, BlockServiceId blockServiceId, InodeId fileId, int64_t delta) {
         StaticValue<BlockServiceToFileKey> k;
         k().setBlockServiceId(blockServiceId);
         k().setFileId(fileId);
@@ -2913,7 +3271,7 @@ struct ShardDBImpl {
         ROCKS_DB_CHECKED(batch.Merge(_blockServicesToFilesCf, k.toSlice(), v.toSlice()));
     }
 
-    TernError _applyAddInlineSpan(TernTime time, rocksdb::WriteBatch& batch, const AddInlineSpanEntry& entry, AddInlineSpanResp& resp) {
+    TernError _applyAddInlineSpan(TernTime time, rocksdb::WriteBatchBase& batch, const AddInlineSpanEntry& entry, AddInlineSpanResp& resp) {
         std::string fileValue;
         ExternalValue<TransientFileBody> file;
         {
@@ -2945,7 +3303,7 @@ struct ShardDBImpl {
             // the client needs to migrate the blocks, or just throw away the file.
             if (file().fileSize() == entry.byteOffset+entry.size) {
                 std::string spanValue;
-                auto status = _db->Get({}, _spansCf, spanKey.toSlice(), &spanValue);
+                auto status = _get({}, _spansCf, spanKey.toSlice(), &spanValue);
                 if (status.IsNotFound()) {
                     LOG_DEBUG(_env, "file size does not match, but could not find existing span");
                     return TernError::SPAN_NOT_FOUND;
@@ -2991,7 +3349,7 @@ struct ShardDBImpl {
 
     }
 
-    TernError _applyAddSpanInitiate(TernTime time, rocksdb::WriteBatch& batch, const AddSpanAtLocationInitiateEntry& entry, AddSpanAtLocationInitiateResp& resp) {
+    TernError _applyAddSpanInitiate(TernTime time, rocksdb::WriteBatchBase& batch, const AddSpanAtLocationInitiateEntry& entry, AddSpanAtLocationInitiateResp& resp) {
         std::string fileValue;
         ExternalValue<TransientFileBody> file;
         {
@@ -3018,7 +3376,7 @@ struct ShardDBImpl {
             // the client needs to migrate the blocks, or just throw away the file.
             if (file().fileSize() == entry.byteOffset+entry.size) {
                 std::string spanValue;
-                auto status = _db->Get({}, _spansCf, spanKey.toSlice(), &spanValue);
+                auto status = _get({}, _spansCf, spanKey.toSlice(), &spanValue);
                 if (status.IsNotFound()) {
                     LOG_DEBUG(_env, "file size does not match, but could not find existing span");
                     return TernError::SPAN_NOT_FOUND;
@@ -3149,7 +3507,7 @@ struct ShardDBImpl {
         return good;
     }
 
-    TernError _applyAddSpanCertify(TernTime time, rocksdb::WriteBatch& batch, const AddSpanCertifyEntry& entry, AddSpanCertifyResp& resp) {
+    TernError _applyAddSpanCertify(TernTime time, rocksdb::WriteBatchBase& batch, const AddSpanCertifyEntry& entry, AddSpanCertifyResp& resp) {
         std::string fileValue;
         ExternalValue<TransientFileBody> file;
         {
@@ -3167,7 +3525,7 @@ struct ShardDBImpl {
         // it, verify the proofs.
         {
             std::string spanValue;
-            auto status = _db->Get({}, _spansCf, spanKey.toSlice(), &spanValue);
+            auto status = _get({}, _spansCf, spanKey.toSlice(), &spanValue);
             if (status.IsNotFound()) {
                 return TernError::SPAN_NOT_FOUND;
             }
@@ -3214,7 +3572,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applyAddSpanLocation(TernTime time, rocksdb::WriteBatch& batch, const AddSpanLocationEntry& entry, AddSpanLocationResp& resp) {
+    TernError _applyAddSpanLocation(TernTime time, rocksdb::WriteBatchBase& batch, const AddSpanLocationEntry& entry, AddSpanLocationResp& resp) {
         std::string destinationFileValue;
         ExternalValue<FileBody> destinationFile;
         {
@@ -3320,7 +3678,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applyMakeFileTransient(TernTime time, rocksdb::WriteBatch& batch, const MakeFileTransientEntry& entry, MakeFileTransientResp& resp) {
+    TernError _applyMakeFileTransient(TernTime time, rocksdb::WriteBatchBase& batch, const MakeFileTransientEntry& entry, MakeFileTransientResp& resp) {
         std::string fileValue;
         ExternalValue<FileBody> file;
         {
@@ -3356,7 +3714,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applyScrapTransientFile(TernTime time, rocksdb::WriteBatch& batch, const ScrapTransientFileEntry& entry, ScrapTransientFileResp& resp) {
+    TernError _applyScrapTransientFile(TernTime time, rocksdb::WriteBatchBase& batch, const ScrapTransientFileEntry& entry, ScrapTransientFileResp& resp) {
         std::string transientValue;
         ExternalValue<TransientFileBody> transientBody;
         TernError err = _getTransientFile({}, time, true, entry.id, transientValue, transientBody);
@@ -3372,7 +3730,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applyRemoveSpanCertify(TernTime time, rocksdb::WriteBatch& batch, const RemoveSpanCertifyEntry& entry, RemoveSpanCertifyResp& resp) {
+    TernError _applyRemoveSpanCertify(TernTime time, rocksdb::WriteBatchBase& batch, const RemoveSpanCertifyEntry& entry, RemoveSpanCertifyResp& resp) {
         std::string fileValue;
         ExternalValue<TransientFileBody> file;
         {
@@ -3389,7 +3747,7 @@ struct ShardDBImpl {
         std::string spanValue;
         ExternalValue<SpanBody> span;
         {
-            auto status = _db->Get({}, _spansCf, spanKey.toSlice(), &spanValue);
+            auto status = _get({}, _spansCf, spanKey.toSlice(), &spanValue);
             if (status.IsNotFound()) {
                 LOG_DEBUG(_env, "skipping removal of span for file %s, offset %s, since we're already done", entry.fileId, entry.byteOffset);
                 return TernError::NO_ERROR; // already done
@@ -3448,7 +3806,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applyRemoveOwnedSnapshotFileEdge(TernTime time, rocksdb::WriteBatch& batch, const RemoveOwnedSnapshotFileEdgeEntry& entry, RemoveOwnedSnapshotFileEdgeResp& resp) {
+    TernError _applyRemoveOwnedSnapshotFileEdge(TernTime time, rocksdb::WriteBatchBase& batch, const RemoveOwnedSnapshotFileEdgeEntry& entry, RemoveOwnedSnapshotFileEdgeResp& resp) {
         uint64_t nameHash;
         {
             // the GC needs to work on deleted dirs who might still have owned files, so allowSnapshot=true
@@ -3473,7 +3831,7 @@ struct ShardDBImpl {
     bool _fetchSpan(InodeId fileId, uint64_t byteOffset, StaticValue<SpanKey>& spanKey, std::string& spanValue, ExternalValue<SpanBody>& span) {
         spanKey().setFileId(fileId);
         spanKey().setOffset(byteOffset);
-        auto status = _db->Get({}, _spansCf, spanKey.toSlice(), &spanValue);
+        auto status = _get({}, _spansCf, spanKey.toSlice(), &spanValue);
         if (status.IsNotFound()) {
             LOG_DEBUG(_env, "could not find span at offset %s in file %s", byteOffset, fileId);
             return false;
@@ -3503,7 +3861,7 @@ struct ShardDBImpl {
         }
     }
 
-    TernError _applySwapBlocks(TernTime time, rocksdb::WriteBatch& batch, const SwapBlocksEntry& entry, SwapBlocksResp& resp) {
+    TernError _applySwapBlocks(TernTime time, rocksdb::WriteBatchBase& batch, const SwapBlocksEntry& entry, SwapBlocksResp& resp) {
         // Fetch spans
         StaticValue<SpanKey> span1Key;
         std::string span1Value;
@@ -3611,7 +3969,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applyMoveSpan(TernTime time, rocksdb::WriteBatch& batch, const MoveSpanEntry& entry, MoveSpanResp& resp) {
+    TernError _applyMoveSpan(TernTime time, rocksdb::WriteBatchBase& batch, const MoveSpanEntry& entry, MoveSpanResp& resp) {
         // fetch files
         std::string transientValue1;
         ExternalValue<TransientFileBody> transientFile1;
@@ -3652,7 +4010,7 @@ struct ShardDBImpl {
         std::string spanValue;
         spanKey().setFileId(entry.fileId1);
         spanKey().setOffset(entry.byteOffset1);
-        auto status = _db->Get({}, _spansCf, spanKey.toSlice(), &spanValue);
+        auto status = _get({}, _spansCf, spanKey.toSlice(), &spanValue);
         if (status.IsNotFound()) {
             LOG_DEBUG(_env, "span not found in db (this should probably never happen)");
             return TernError::SPAN_NOT_FOUND;
@@ -3694,7 +4052,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applySwapSpans(TernTime time, rocksdb::WriteBatch& batch, const SwapSpansEntry& entry, SwapSpansResp& resp) {
+    TernError _applySwapSpans(TernTime time, rocksdb::WriteBatchBase& batch, const SwapSpansEntry& entry, SwapSpansResp& resp) {
         StaticValue<SpanKey> span1Key;
         std::string span1Value;
         ExternalValue<SpanBody> span1;
@@ -3761,7 +4119,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applySetTime(TernTime time, rocksdb::WriteBatch& batch, const SetTimeEntry& entry, SetTimeResp& resp) {
+    TernError _applySetTime(TernTime time, rocksdb::WriteBatchBase& batch, const SetTimeEntry& entry, SetTimeResp& resp) {
         std::string fileValue;
         ExternalValue<FileBody> file;
         TernError err = _getFile({}, entry.id, fileValue, file);
@@ -3783,7 +4141,7 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    TernError _applyRemoveZeroBlockServiceFiles(TernTime time, rocksdb::WriteBatch& batch, const RemoveZeroBlockServiceFilesEntry& entry, RemoveZeroBlockServiceFilesResp& resp) {
+    TernError _applyRemoveZeroBlockServiceFiles(TernTime time, rocksdb::WriteBatchBase& batch, const RemoveZeroBlockServiceFilesEntry& entry, RemoveZeroBlockServiceFilesResp& resp) {
         // Max number of entries we'll look at, otherwise each req will spend tons of time
         // iterating.
         int maxEntries = 1'000;
@@ -3792,6 +4150,8 @@ struct ShardDBImpl {
         beginKey().setBlockServiceId(entry.startBlockService.u64);
         beginKey().setFileId(entry.startFile);
 
+        // Straight from the DB, this entry is never applied in an apply group since
+        // iterators over it don't resolve merges.
         rocksdb::ReadOptions options;
         std::unique_ptr<rocksdb::Iterator> it(_db->NewIterator(options, _blockServicesToFilesCf));
         int i;
@@ -3823,17 +4183,69 @@ struct ShardDBImpl {
         return TernError::NO_ERROR;
     }
 
-    void applyLogEntry(uint64_t logIndex, const ShardLogEntry& logEntry, ShardRespContainer& resp) {
+    void applyLogEntry(uint64_t logIndex, size_t batchPos, size_t batchSize, const ShardLogEntry& logEntry, ShardRespContainer& resp) {
+        auto locked = _applyLogEntryLock.lock();
+        _applyLogEntry(logIndex, batchPos, batchSize, logEntry, resp);
+    }
+
+    void _applyLogEntry(uint64_t logIndex, size_t batchPos, size_t batchSize, const ShardLogEntry& logEntry, ShardRespContainer& resp) {
         // TODO figure out the story with what regards time monotonicity (possibly drop non-monotonic log
         // updates?)
 
         LOG_DEBUG(_env, "applying log at index %s", logIndex);
-        auto locked = _applyLogEntryLock.lock();
         resp.clear();
-        auto err = TernError::NO_ERROR;
+
+        if (_applyGroupOpen) {
+            if (logEntry.body.kind() == ShardLogEntryKind::REMOVE_ZERO_BLOCK_SERVICE_FILES) {
+                // it needs to see everything before it in the DB, see `_applyRemoveZeroBlockServiceFiles`
+                _commitApplyGroup();
+            }
+            if (!_advanceLastAppliedLogEntry(_applyGroup, logIndex, batchPos, batchSize)) {
+                LOG_DEBUG(_env, "skipping entry %s in batch at log index %s, already applied", batchPos, logIndex);
+                return;
+            }
+            _applyLogEntryBody(_applyGroup, logIndex, logEntry, resp);
+            return;
+        }
 
         rocksdb::WriteBatch batch;
-        _advanceLastAppliedLogEntry(batch, logIndex);
+        if (!_advanceLastAppliedLogEntry(batch, logIndex, batchPos, batchSize)) {
+            LOG_DEBUG(_env, "skipping entry %s in batch at log index %s, already applied", batchPos, logIndex);
+            return;
+        }
+        _applyLogEntryBody(batch, logIndex, logEntry, resp);
+
+        ROCKS_DB_CHECKED(_db->Write({}, &batch));
+        _invalidateMetadataCache(batch);
+    }
+
+    void startApplyGroup() {
+        auto locked = _applyLogEntryLock.lock();
+        ALWAYS_ASSERT(!_applyGroupOpen);
+        _applyGroupOpen = true;
+    }
+
+    void commitApplyGroup() {
+        auto locked = _applyLogEntryLock.lock();
+        ALWAYS_ASSERT(_applyGroupOpen);
+        _commitApplyGroup();
+        _applyGroupOpen = false;
+    }
+
+    void _commitApplyGroup() {
+        auto& batch = *_applyGroup.GetWriteBatch();
+        if (batch.Count() > 0) {
+            LOG_DEBUG(_env, "writing apply group with %s updates", batch.Count());
+            ROCKS_DB_CHECKED(_db->Write({}, &batch));
+            _invalidateMetadataCache(batch);
+        }
+        _applyGroup.Clear();
+    }
+
+    // Writes the changes of the entry to `batch`, or nothing if it fails. It only reads
+    // from the database, so it can run concurrently for entries which don't touch the
+    // same state, see `applyLogEntriesParallel`.
+    void _applyLogEntryBody(rocksdb::WriteBatchBase& batch, uint64_t logIndex, const ShardLogEntry& logEntry, ShardRespContainer& resp) {
         // We set this savepoint since we still want to record the log index advancement
         // even if the application does _not_ go through.
         //
@@ -3842,7 +4254,7 @@ struct ShardDBImpl {
         // it's all rolled back.
         batch.SetSavePoint();
 
-        std::string entryScratch;
+        auto err = TernError::NO_ERROR;
         TernTime time = logEntry.time;
         const auto& logEntryBody = logEntry.body;
 
@@ -3982,8 +4394,224 @@ struct ShardDBImpl {
         } else {
             LOG_DEBUG(_env, "applied log entry of kind %s, index %s, writing changes", logEntryBody.kind(), logIndex);
         }
+    }
 
-        ROCKS_DB_CHECKED(_db->Write({}, &batch));
+    // What `_applyLogEntryBody` might touch for an entry, to tell which entries can be
+    // applied concurrently. Everything an entry reads or writes is keyed by the inodes
+    // it names, other than the id counters and the block services to files merges, which
+    // add up the same way in any order.
+    struct LogEntryFootprint {
+        std::array<InodeId, 2> inodes = {NULL_INODE_ID, NULL_INODE_ID};
+        uint8_t counters = 0;
+        // Creates an inode which we can't know in advance, and which later entries might use.
+        bool newInode = false;
+        // Needs to be applied on its own.
+        bool barrier = false;
+    };
+    static constexpr uint8_t INODE_ID_COUNTER = 1 << 0;
+    static constexpr uint8_t BLOCK_ID_COUNTER = 1 << 1;
+
+    static LogEntryFootprint _logEntryFootprint(const ShardLogEntryContainer& body) {
+        LogEntryFootprint fp;
+        const auto touches = [&fp](InodeId a, InodeId b = NULL_INODE_ID) {
+            fp.inodes = {a, b};
+        };
+        switch (body.kind()) {
+        case ShardLogEntryKind::CONSTRUCT_FILE:
+            fp.counters = INODE_ID_COUNTER;
+            fp.newInode = true;
+            break;
+        case ShardLogEntryKind::LINK_FILE:
+            touches(body.getLinkFile().fileId, body.getLinkFile().ownerId); break;
+        case ShardLogEntryKind::SAME_DIRECTORY_RENAME:
+            touches(body.getSameDirectoryRename().dirId, body.getSameDirectoryRename().targetId); break;
+        case ShardLogEntryKind::SAME_DIRECTORY_RENAME_SNAPSHOT:
+            touches(body.getSameDirectoryRenameSnapshot().dirId, body.getSameDirectoryRenameSnapshot().targetId); break;
+        case ShardLogEntryKind::SOFT_UNLINK_FILE:
+            touches(body.getSoftUnlinkFile().ownerId, body.getSoftUnlinkFile().fileId); break;
+        case ShardLogEntryKind::CREATE_DIRECTORY_INODE:
+            touches(body.getCreateDirectoryInode().id, body.getCreateDirectoryInode().ownerId); break;
+        case ShardLogEntryKind::CREATE_LOCKED_CURRENT_EDGE:
+            touches(body.getCreateLockedCurrentEdge().dirId, body.getCreateLockedCurrentEdge().targetId); break;
+        case ShardLogEntryKind::UNLOCK_CURRENT_EDGE:
+            touches(body.getUnlockCurrentEdge().dirId, body.getUnlockCurrentEdge().targetId); break;
+        case ShardLogEntryKind::LOCK_CURRENT_EDGE:
+            touches(body.getLockCurrentEdge().dirId, body.getLockCurrentEdge().targetId); break;
+        case ShardLogEntryKind::REMOVE_DIRECTORY_OWNER:
+            touches(body.getRemoveDirectoryOwner().dirId); break;
+        case ShardLogEntryKind::REMOVE_INODE:
+            touches(body.getRemoveInode().id); break;
+        case ShardLogEntryKind::SET_DIRECTORY_OWNER:
+            touches(body.getSetDirectoryOwner().dirId, body.getSetDirectoryOwner().ownerId); break;
+        case ShardLogEntryKind::SET_DIRECTORY_INFO:
+            touches(body.getSetDirectoryInfo().dirId); break;
+        case ShardLogEntryKind::REMOVE_NON_OWNED_EDGE:
+            touches(body.getRemoveNonOwnedEdge().dirId, body.getRemoveNonOwnedEdge().targetId); break;
+        case ShardLogEntryKind::SAME_SHARD_HARD_FILE_UNLINK:
+            touches(body.getSameShardHardFileUnlink().ownerId, body.getSameShardHardFileUnlink().targetId); break;
+        case ShardLogEntryKind::REMOVE_SPAN_INITIATE:
+            touches(body.getRemoveSpanInitiate().fileId); break;
+        case ShardLogEntryKind::ADD_INLINE_SPAN:
+            touches(body.getAddInlineSpan().fileId); break;
+        case ShardLogEntryKind::ADD_SPAN_INITIATE:
+            touches(body.getAddSpanInitiate().fileId);
+            fp.counters = BLOCK_ID_COUNTER;
+            break;
+        case ShardLogEntryKind::ADD_SPAN_AT_LOCATION_INITIATE:
+            touches(body.getAddSpanAtLocationInitiate().fileId);
+            fp.counters = BLOCK_ID_COUNTER;
+            break;
+        case ShardLogEntryKind::ADD_SPAN_CERTIFY:
+            touches(body.getAddSpanCertify().fileId); break;
+        case ShardLogEntryKind::ADD_SPAN_LOCATION:
+            touches(body.getAddSpanLocation().fileId1, body.getAddSpanLocation().fileId2); break;
+        case ShardLogEntryKind::MAKE_FILE_TRANSIENT_DE_PR_EC_AT_ED:
+            touches(body.getMakeFileTransientDEPRECATED().id); break;
+        case ShardLogEntryKind::MAKE_FILE_TRANSIENT:
+            touches(body.getMakeFileTransient().id); break;
+        case ShardLogEntryKind::SCRAP_TRANSIENT_FILE:
+            touches(body.getScrapTransientFile().id); break;
+        case ShardLogEntryKind::REMOVE_SPAN_CERTIFY:
+            touches(body.getRemoveSpanCertify().fileId); break;
+        case ShardLogEntryKind::REMOVE_OWNED_SNAPSHOT_FILE_EDGE:
+            touches(body.getRemoveOwnedSnapshotFileEdge().ownerId, body.getRemoveOwnedSnapshotFileEdge().targetId); break;
+        case ShardLogEntryKind::SWAP_BLOCKS:
+            touches(body.getSwapBlocks().fileId1, body.getSwapBlocks().fileId2); break;
+        case ShardLogEntryKind::SWAP_SPANS:
+            touches(body.getSwapSpans().fileId1, body.getSwapSpans().fileId2); break;
+        case ShardLogEntryKind::MOVE_SPAN:
+            touches(body.getMoveSpan().fileId1, body.getMoveSpan().fileId2); break;
+        case ShardLogEntryKind::SET_TIME:
+            touches(body.getSetTime().id); break;
+        default:
+            // REMOVE_ZERO_BLOCK_SERVICE_FILES reads the block services to files merges
+            fp.barrier = true;
+            break;
+        }
+        return fp;
+    }
+
+    void applyLogEntriesParallel(const std::vector<ShardLogEntryToApply>& entries, size_t threads) {
+        auto locked = _applyLogEntryLock.lock();
+        ALWAYS_ASSERT(!_applyGroupOpen);
+        if (_applyPool == nullptr || _applyPool->threads() != threads) {
+            _applyPool = std::make_unique<ShardDBApplyPool>(threads);
+        }
+
+        size_t i = 0;
+        // If we stopped halfway through a batch the entries already applied need
+        // skipping, leave that to `_applyLogEntry`.
+        if (!entries.empty() && entries[0].batchSize > 1 && _appliedInLogBatch(entries[0].logEntryIx) > 0) {
+            for (; i < entries.size() && entries[i].logEntryIx == entries[0].logEntryIx; i++) {
+                ShardRespContainer resp;
+                _applyLogEntry(entries[i].logEntryIx, entries[i].batchPos, entries[i].batchSize, *entries[i].logEntry, resp);
+            }
+        }
+
+        std::vector<rocksdb::WriteBatch> batches;
+        std::vector<ShardRespContainer> resps;
+        std::unordered_set<uint64_t> waveInodes;
+        const std::function<void(size_t)> applyOne = [&](size_t j) {
+            const auto& entry = entries[i+j];
+            _applyLogEntryBody(batches[j], entry.logEntryIx, *entry.logEntry, resps[j]);
+        };
+        while (i < entries.size()) {
+            // Pick the longest run of entries which don't touch each other's state: they all
+            // read what was there before the run, so it doesn't matter in which order they go.
+            size_t waveSize = 0;
+            uint8_t waveCounters = 0;
+            waveInodes.clear();
+            for (; i + waveSize < entries.size(); waveSize++) {
+                auto fp = _logEntryFootprint(entries[i+waveSize].logEntry->body);
+                if (fp.barrier) {
+                    waveSize += waveSize == 0;
+                    break;
+                }
+                bool conflicts = (fp.counters & waveCounters) != 0;
+                for (InodeId id : fp.inodes) {
+                    conflicts = conflicts || (id != NULL_INODE_ID && waveInodes.contains(id.u64));
+                }
+                if (conflicts) { break; }
+                waveCounters |= fp.counters;
+                for (InodeId id : fp.inodes) {
+                    if (id != NULL_INODE_ID) { waveInodes.insert(id.u64); }
+                }
+                if (fp.newInode) {
+                    waveSize++;
+                    break;
+                }
+            }
+            LOG_DEBUG(_env, "applying %s log entries concurrently, from index %s", waveSize, entries[i].logEntryIx);
+
+            batches.clear();
+            batches.resize(waveSize);
+            resps.clear();
+            resps.resize(waveSize);
+            _applyPool->run(waveSize, applyOne);
+
+            // and write them out in order
+            for (size_t j = 0; j < waveSize; j++) {
+                const auto& entry = entries[i+j];
+                ALWAYS_ASSERT(_advanceLastAppliedLogEntry(batches[j], entry.logEntryIx, entry.batchPos, entry.batchSize));
+                ROCKS_DB_CHECKED(_db->Write({}, &batches[j]));
+                _invalidateMetadataCache(batches[j]);
+            }
+            i += waveSize;
+        }
+    }
+
+    // Collects the cached keys touched by a write batch.
+    struct CachedKeysCollector : rocksdb::WriteBatch::Handler {
+        uint32_t directoriesCfId;
+        uint32_t edgesCfId;
+        std::vector<std::string> keys;
+
+        void _touch(uint32_t cfId, const rocksdb::Slice& key) {
+            if (cfId == directoriesCfId) {
+                keys.emplace_back(_metadataCacheKey(cfId, key));
+            } else if (cfId == edgesCfId) {
+                auto edgeKey = ExternalValue<EdgeKey>::FromSlice(key);
+                if (edgeKey().current()) { // we only cache current edges
+                    keys.emplace_back(_metadataCacheKey(cfId, key));
+                }
+            }
+        }
+
+        rocksdb::Status PutCF(uint32_t cfId, const rocksdb::Slice& key, const rocksdb::Slice& value) override {
+            _touch(cfId, key);
+            return rocksdb::Status::OK();
+        }
+        rocksdb::Status DeleteCF(uint32_t cfId, const rocksdb::Slice& key) override {
+            _touch(cfId, key);
+            return rocksdb::Status::OK();
+        }
+        rocksdb::Status SingleDeleteCF(uint32_t cfId, const rocksdb::Slice& key) override {
+            _touch(cfId, key);
+            return rocksdb::Status::OK();
+        }
+        rocksdb::Status MergeCF(uint32_t cfId, const rocksdb::Slice& key, const rocksdb::Slice& value) override {
+            _touch(cfId, key);
+            return rocksdb::Status::OK();
+        }
+        rocksdb::Status DeleteRangeCF(uint32_t cfId, const rocksdb::Slice& begin, const rocksdb::Slice& end) override {
+            // we never range delete metadata, and we wouldn't know what to invalidate
+            ALWAYS_ASSERT(cfId != directoriesCfId && cfId != edgesCfId);
+            return rocksdb::Status::OK();
+        }
+    };
+
+    void _invalidateMetadataCache(const rocksdb::WriteBatch& batch) {
+        if (!_metadataCache.enabled()) { return; }
+        CachedKeysCollector collector;
+        collector.directoriesCfId = _directoriesCf->GetID();
+        collector.edgesCfId = _edgesCf->GetID();
+        ROCKS_DB_CHECKED(batch.Iterate(&collector));
+        if (collector.keys.empty()) { return; }
+        // Snapshots taken from now on include the batch, older ones do not.
+        uint64_t seq = _db->GetLatestSequenceNumber();
+        for (const auto& key : collector.keys) {
+            _metadataCache.invalidate(key, seq);
+        }
     }
 
     // ----------------------------------------------------------------
@@ -3993,9 +4621,63 @@ struct ShardDBImpl {
         return cbcmac(_expandedSecretKey, (const uint8_t*)&id, sizeof(id));
     }
 
+    // cached keys are prefixed with the column family, since keys are not unique across them
+    static std::string _metadataCacheKey(uint32_t cfId, const rocksdb::Slice& key) {
+        std::string cacheKey;
+        cacheKey.reserve(1 + key.size());
+        cacheKey.push_back((char)cfId);
+        cacheKey.append(key.data(), key.size());
+        return cacheKey;
+    }
+
+    // Reads without a snapshot are the write path, which needs to see what's been
+    // applied in the current apply group, if any. Readers always have a snapshot,
+    // and must not look at `_applyGroupOpen`, which the writer flips: check the
+    // snapshot first.
+    rocksdb::Status _get(const rocksdb::ReadOptions& options, rocksdb::ColumnFamilyHandle* cf, const rocksdb::Slice& key, std::string* value) {
+        if (options.snapshot == nullptr && _applyGroupOpen) {
+            return _applyGroup.GetFromBatchAndDB(_db, options, cf, key, value);
+        }
+        return _db->Get(options, cf, key, value);
+    }
+
+    rocksdb::Status _get(const rocksdb::ReadOptions& options, const rocksdb::Slice& key, std::string* value) {
+        return _get(options, _defaultCf, key, value);
+    }
+
+    rocksdb::Iterator* _newIterator(const rocksdb::ReadOptions& options, rocksdb::ColumnFamilyHandle* cf) {
+        if (options.snapshot == nullptr && _applyGroupOpen) {
+            return new ShardDBApplyGroupIterator(_applyGroup.NewIteratorWithBase(cf, _db->NewIterator(options, cf), &options));
+        }
+        return _db->NewIterator(options, cf);
+    }
+
+    // Like `_db->Get`, but going through `_metadataCache` for snapshot reads.
+    // Only use this for the column families which `_invalidateMetadataCache`
+    // tracks. Reads without a snapshot (i.e. the write path) bypass the cache,
+    // since they need to see writes which are not flushed yet.
+    rocksdb::Status _cachedGet(const rocksdb::ReadOptions& options, rocksdb::ColumnFamilyHandle* cf, const rocksdb::Slice& key, std::string& value) {
+        if (options.snapshot == nullptr || !_metadataCache.enabled()) {
+            return _get(options, cf, key, &value);
+        }
+        uint64_t seq = options.snapshot->GetSequenceNumber();
+        std::string cacheKey = _metadataCacheKey(cf->GetID(), key);
+        bool found;
+        if (_metadataCache.get(cacheKey, seq, value, found)) {
+            return found ? rocksdb::Status::OK() : rocksdb::Status::NotFound();
+        }
+        auto status = _get(options, cf, key, &value);
+        if (status.ok()) {
+            _metadataCache.put(cacheKey, seq, true, value);
+        } else if (status.IsNotFound()) {
+            _metadataCache.put(cacheKey, seq, false, {});
+        }
+        return status;
+    }
+
     uint64_t _lastAppliedLogEntry(const rocksdb::ReadOptions& options) {
         std::string value;
-        ROCKS_DB_CHECKED(_db->Get(options, shardMetadataKey(&LAST_APPLIED_LOG_ENTRY_KEY), &value));
+        ROCKS_DB_CHECKED(_get(options, shardMetadataKey(&LAST_APPLIED_LOG_ENTRY_KEY), &value));
         ExternalValue<U64Value> v(value);
         return v().u64();
     }
@@ -4005,7 +4687,7 @@ struct ShardDBImpl {
             return TernError::TYPE_IS_NOT_DIRECTORY;
         }
         auto k = InodeIdKey::Static(id);
-        auto status = _db->Get(options, _directoriesCf, k.toSlice(), &dirValue);
+        auto status = _cachedGet(options, _directoriesCf, k.toSlice(), dirValue);
         if (status.IsNotFound()) {
             return TernError::DIRECTORY_NOT_FOUND;
         }
@@ -4034,7 +4716,7 @@ struct ShardDBImpl {
             return TernError::TYPE_IS_DIRECTORY;
         }
         auto k = InodeIdKey::Static(id);
-        auto status = _db->Get(options, _filesCf, k.toSlice(), &fileValue);
+        auto status = _get(options, _filesCf, k.toSlice(), &fileValue);
         if (status.IsNotFound()) {
             return TernError::FILE_NOT_FOUND;
         }
@@ -4048,7 +4730,7 @@ struct ShardDBImpl {
             return TernError::TYPE_IS_DIRECTORY;
         }
         auto k = InodeIdKey::Static(id);
-        auto status = _db->Get(options, _transientCf, k.toSlice(), &value);
+        auto status = _get(options, _transientCf, k.toSlice(), &value);
         if (status.IsNotFound()) {
             return TernError::FILE_NOT_FOUND;
         }
@@ -4064,7 +4746,7 @@ struct ShardDBImpl {
     }
 
     TernError _initiateTransientFileModification(
-        TernTime time, bool allowPastDeadline, rocksdb::WriteBatch& batch, InodeId id, std::string& tfValue, ExternalValue<TransientFileBody>& tf
+        TernTime time, bool allowPastDeadline, rocksdb::WriteBatchBase& batch, InodeId id, std::string& tfValue, ExternalValue<TransientFileBody>& tf
     ) {
         ExternalValue<TransientFileBody> tmpTf;
         TernError err = _getTransientFile({}, time, allowPastDeadline, id, tfValue, tmpTf);
@@ -4098,16 +4780,34 @@ struct ShardDBImpl {
         return std::atomic_load(&_currentReadSnapshot);
     }
 
-    void _updateCurrentReadSnapshot() {
+    std::shared_ptr<const rocksdb::Snapshot> _takeSnapshot() {
         const rocksdb::Snapshot* snapshotPtr = _db->GetSnapshot();
         ALWAYS_ASSERT(snapshotPtr != nullptr);
-        std::shared_ptr<const rocksdb::Snapshot> snapshot(snapshotPtr, [this](const rocksdb::Snapshot* ptr) { _db->ReleaseSnapshot(ptr); });
-        std::atomic_exchange(&_currentReadSnapshot, snapshot);
+        return std::shared_ptr<const rocksdb::Snapshot>(snapshotPtr, [this](const rocksdb::Snapshot* ptr) { _db->ReleaseSnapshot(ptr); });
+    }
+
+    void _publishReadSnapshot(std::shared_ptr<const rocksdb::Snapshot>&& snapshot) {
+        std::atomic_exchange(&_currentReadSnapshot, std::move(snapshot));
+        _readSnapshotGeneration.fetch_add(1, std::memory_order_release);
     }
 
     void flush(bool sync) {
+        ALWAYS_ASSERT(!_applyGroupOpen);
         ROCKS_DB_CHECKED(_db->FlushWAL(sync));
-        _updateCurrentReadSnapshot();
+        _publishReadSnapshot(_takeSnapshot());
+    }
+
+    ShardDBSyncPoint prepareSync() {
+        ALWAYS_ASSERT(!_applyGroupOpen);
+        return ShardDBSyncPoint{.snapshot = _takeSnapshot()};
+    }
+
+    void sync(ShardDBSyncPoint&& point) {
+        // This might also sync writes which came after the sync point, which
+        // is fine, but we must only expose what we know is synced to readers,
+        // hence the snapshot taken at `prepareSync()`.
+        ROCKS_DB_CHECKED(_db->FlushWAL(true));
+        _publishReadSnapshot(std::move(point.snapshot));
     }
 };
 
@@ -4223,8 +4923,8 @@ bool readOnlyShardReq(const ShardMessageKind kind) {
     throw TERN_EXCEPTION("bad message kind %s", kind);
 }
 
-ShardDB::ShardDB(Logger& logger, std::shared_ptr<XmonAgent>& agent, ShardId shid, uint8_t location, Duration deadlineInterval, const SharedRocksDB& sharedDB, const BlockServicesCacheDB& blockServicesCache) {
-    _impl = new ShardDBImpl(logger, agent, shid, location, deadlineInterval, sharedDB, blockServicesCache);
+ShardDB::ShardDB(Logger& logger, std::shared_ptr<XmonAgent>& agent, ShardId shid, uint8_t location, Duration deadlineInterval, const SharedRocksDB& sharedDB, const BlockServicesCacheDB& blockServicesCache, size_t metadataCacheEntries) {
+    _impl = new ShardDBImpl(logger, agent, shid, location, deadlineInterval, sharedDB, blockServicesCache, metadataCacheEntries);
 }
 
 void ShardDB::close() {
@@ -4240,18 +4940,42 @@ uint64_t ShardDB::read(const ShardReqContainer& req, ShardRespContainer& resp) {
     return ((ShardDBImpl*)_impl)->read(req, resp);
 }
 
+uint64_t ShardDB::read(const ShardReqContainer& req, ShardRespContainer& resp, ShardDBReadView& view) {
+    return ((ShardDBImpl*)_impl)->read(req, resp, view);
+}
+
 TernError ShardDB::prepareLogEntry(const ShardReqContainer& req, ShardLogEntry& logEntry) {
     return ((ShardDBImpl*)_impl)->prepareLogEntry(req, logEntry);
 }
 
 void ShardDB::applyLogEntry(uint64_t logEntryIx, const ShardLogEntry& logEntry, ShardRespContainer& resp) {
-    ((ShardDBImpl*)_impl)->applyLogEntry(logEntryIx, logEntry, resp);
+    ((ShardDBImpl*)_impl)->applyLogEntry(logEntryIx, 0, 1, logEntry, resp);
+}
+
+void ShardDB::applyLogEntry(uint64_t logEntryIx, size_t batchPos, size_t batchSize, const ShardLogEntry& logEntry, ShardRespContainer& resp) {
+    ((ShardDBImpl*)_impl)->applyLogEntry(logEntryIx, batchPos, batchSize, logEntry, resp);
+}
+
+void ShardDB::applyLogEntriesParallel(const std::vector<ShardLogEntryToApply>& entries, size_t threads) {
+    ((ShardDBImpl*)_impl)->applyLogEntriesParallel(entries, threads);
+}
+
+void ShardDB::startApplyGroup() {
+    ((ShardDBImpl*)_impl)->startApplyGroup();
+}
+
+void ShardDB::commitApplyGroup() {
+    ((ShardDBImpl*)_impl)->commitApplyGroup();
 }
 
 uint64_t ShardDB::lastAppliedLogEntry() {
     return ((ShardDBImpl*)_impl)->_lastAppliedLogEntry({});
 }
 
+ShardDBCache::Stats ShardDB::metadataCacheStats() const {
+    return ((ShardDBImpl*)_impl)->_metadataCache.stats();
+}
+
 const std::array<uint8_t, 16>& ShardDB::secretKey() const {
     return ((ShardDBImpl*)_impl)->_secretKey;
 }
@@ -4259,3 +4983,11 @@ const std::array<uint8_t, 16>& ShardDB::secretKey() const {
 void ShardDB::flush(bool sync) {
     return ((ShardDBImpl*)_impl)->flush(sync);
 }
+
+ShardDBSyncPoint ShardDB::prepareSync() {
+    return ((ShardDBImpl*)_impl)->prepareSync();
+}
+
+void ShardDB::sync(ShardDBSyncPoint&& point) {
+    return ((ShardDBImpl*)_impl)->sync(std::move(point));
+}
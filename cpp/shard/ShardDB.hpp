@@ -6,6 +6,7 @@
 
 #include <array>
 #include <cstdint>
+#include <memory>
 #include <vector>
 #include <rocksdb/db.h>
 
@@ -13,6 +14,7 @@
 #include "Msgs.hpp"
 #include "Env.hpp"
 #include "SharedRocksDB.hpp"
+#include "ShardDBCache.hpp"
 
 
 struct ShardLogEntry {
@@ -31,10 +33,37 @@ struct ShardLogEntry {
 
     void pack(BincodeBuf& buf) const;
     void unpack(BincodeBuf& buf);
+
+    // Several entries can be replicated in a single LogsDB entry, all sharing
+    // its index. A single entry is packed as above (SHARD_LOG_PROTOCOL_VERSION),
+    // more than one in the batched format (SHARD_LOG_BATCH_PROTOCOL_VERSION), so
+    // nothing changes on the wire or on disk unless we actually batch.
+    static constexpr size_t BATCH_HEADER_SIZE = 4 + 8 + 2; // version, idx, count
+    size_t batchedSize() const { return 8 + body.packedSize(); } // time, body
+    static void packBatch(BincodeBuf& buf, const ShardLogEntry* entries, size_t count);
+    // Like `packBatch`, but LZ4 compresses the result, with the crc32c of the
+    // uncompressed bytes (SHARD_LOG_COMPRESSED_PROTOCOL_VERSION). Falls back to
+    // `packBatch` if compressing doesn't make it any smaller.
+    static constexpr size_t COMPRESSED_HEADER_SIZE = 4 + 4 + 4; // version, size, crc
+    static void packBatchCompressed(BincodeBuf& buf, const ShardLogEntry* entries, size_t count);
+    // Appends the entries packed by `packBatch`, `packBatchCompressed` or `pack`
+    // to `entries`. Throws if a compressed batch is corrupted.
+    static void unpackBatch(BincodeBuf& buf, std::vector<ShardLogEntry>& entries);
 };
 
 std::ostream& operator<<(std::ostream& out, const ShardLogEntry& entry);
 
+constexpr size_t MAX_SHARD_LOG_BATCH_ENTRIES = 1 << 10;
+
+// An entry to apply with `ShardDB::applyLogEntriesParallel`, with the same
+// arguments `ShardDB::applyLogEntry` takes.
+struct ShardLogEntryToApply {
+    uint64_t logEntryIx;
+    size_t batchPos;
+    size_t batchSize;
+    const ShardLogEntry* logEntry;
+};
+
 bool readOnlyShardReq(const ShardMessageKind kind);
 
 DirectoryInfo defaultDirectoryInfo();
@@ -44,6 +73,30 @@ constexpr uint32_t MAXIMUM_SPAN_SIZE = 100 << 20;
 
 constexpr Duration DEFAULT_DEADLINE_INTERVAL = 2_hours;
 
+// Directories and current edges, see `ShardDBCache`.
+constexpr size_t DEFAULT_METADATA_CACHE_ENTRIES = 100'000;
+
+// How the column families are tuned, see `ShardDB::getColumnFamilyDescriptors`.
+enum class ShardDBProfile : uint8_t {
+    DEFAULT, // RocksDB defaults everywhere
+    TUNED,   // bloom filters everywhere, prefix seeks on edges/spans, bigger blocks for spans
+};
+
+std::ostream& operator<<(std::ostream& out, ShardDBProfile profile);
+
+// A reader's private copy of the read snapshot. Each reader thread owns one
+// and only goes to the shared snapshot pointer when `flush()` has published
+// a new one, so that many readers don't contend on it for every request.
+struct ShardDBReadView {
+    uint64_t generation = 0;
+    std::shared_ptr<const rocksdb::Snapshot> snapshot;
+};
+
+// What has been written to a ShardDB up to some point, see `ShardDB::prepareSync`.
+struct ShardDBSyncPoint {
+    std::shared_ptr<const rocksdb::Snapshot> snapshot;
+};
+
 struct ShardDB {
 private:
     void* _impl;
@@ -52,7 +105,8 @@ public:
     ShardDB() = delete;
 
     // init/teardown
-    ShardDB(Logger& logger, std::shared_ptr<XmonAgent>& xmon, ShardId shid, uint8_t location, Duration deadlineInterval, const SharedRocksDB& sharedDB, const BlockServicesCacheDB& blockServicesCache);
+    // `metadataCacheEntries` bounds the in-memory cache used by reads, 0 disables it.
+    ShardDB(Logger& logger, std::shared_ptr<XmonAgent>& xmon, ShardId shid, uint8_t location, Duration deadlineInterval, const SharedRocksDB& sharedDB, const BlockServicesCacheDB& blockServicesCache, size_t metadataCacheEntries);
     ~ShardDB();
     void close();
 
@@ -60,6 +114,10 @@ public:
     // Returns last applied log entry at the point of reading
     uint64_t read(const ShardReqContainer& req, ShardRespContainer& resp);
 
+    // Same as above, but reads through `view`, refreshing it first if a newer
+    // snapshot is available. Each concurrent reader should have its own view.
+    uint64_t read(const ShardReqContainer& req, ShardRespContainer& resp, ShardDBReadView& view);
+
     // Prepares and persists a log entry to be applied.
     //
     // This function can be called concurrently. We only read from the database to
@@ -111,6 +169,31 @@ public:
     // log entries without any write/fsync.
     void applyLogEntry(uint64_t logEntryIx, const ShardLogEntry& logEntry, ShardRespContainer& resp);
 
+    // Same as above, for the entry at `batchPos` in a batch of `batchSize` entries sharing
+    // the index `logEntryIx` (see `ShardLogEntry::packBatch`), which must be applied in order.
+    // Each entry is applied on its own and gets its own response, as if it was alone at that
+    // index, but `lastAppliedLogEntry()` only moves to `logEntryIx` with the last one. If we
+    // stopped halfway through a batch, the entries already applied are skipped (leaving the
+    // response empty) when the batch is applied again.
+    void applyLogEntry(uint64_t logEntryIx, size_t batchPos, size_t batchSize, const ShardLogEntry& logEntry, ShardRespContainer& resp);
+
+    // Same as calling `applyLogEntry` on each of `entries` in order, and the state we end
+    // up with is exactly the same, but without responses. Consecutive entries touching
+    // different inodes (and not competing for the same id counter) are applied concurrently
+    // on up to `threads` threads, each into its own write batch, and the batches are then
+    // written in log order. Only useful when nobody waits for the responses: followers,
+    // and catching up.
+    void applyLogEntriesParallel(const std::vector<ShardLogEntryToApply>& entries, size_t threads);
+
+    // Between these two, `applyLogEntry` doesn't write each entry on its own, but puts
+    // all of them in a single write batch which `commitApplyGroup()` writes at once,
+    // saving on memtable inserts and WAL records when applying bursts of small entries.
+    // Entries applied or prepared in the meantime see the ones before them, but reads
+    // don't until the group is committed, which must happen before `flush()` or
+    // `prepareSync()`.
+    void startApplyGroup();
+    void commitApplyGroup();
+
     // Flushes the changes to the WAL, and persists it if sync=true (won't be
     // required when we have a distributed log).
     //
@@ -118,8 +201,21 @@ public:
     // not be visible to reads (but they will be visible to writes).
     void flush(bool sync);
 
+    // `flush(true)` split in two, so that the fsync can happen on another thread
+    // while the writer moves on. `prepareSync()` must be called by the writer and
+    // captures what has been written so far. `sync()` can be called from another
+    // thread: it makes everything up to the sync point durable and then makes it
+    // visible to reads. Sync points must be synced in the order they were prepared.
+    ShardDBSyncPoint prepareSync();
+    void sync(ShardDBSyncPoint&& point);
+
+    // Hits/misses of the directory/edge cache in front of reads.
+    ShardDBCache::Stats metadataCacheStats() const;
+
     // For internal testing
     const std::array<uint8_t, 16>& secretKey() const;
 
-    static std::vector<rocksdb::ColumnFamilyDescriptor> getColumnFamilyDescriptors();
+    // The profile can be changed across restarts, it only affects newly written
+    // SST files (and filters written with a different prefix extractor are ignored).
+    static std::vector<rocksdb::ColumnFamilyDescriptor> getColumnFamilyDescriptors(ShardDBProfile profile = ShardDBProfile::DEFAULT);
 };
@@ -0,0 +1,199 @@
+// Copyright 2025 XTX Markets Technologies Limited
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <rocksdb/slice.h>
+
+// A bounded cache of RocksDB values (directory bodies and current edges),
+// sitting in front of snapshot reads.
+//
+// Reads in ShardDB go through a snapshot which lags behind the writes, so
+// we can't just drop keys when we write them: a reader on an older snapshot
+// might put the old value back right after. Instead every entry remembers the
+// sequence number it is valid from:
+//
+// * Values are tagged with the sequence number of the snapshot they were read
+//   from, and are only returned to readers whose snapshot is at least as new.
+// * Writes replace the entry with a tombstone tagged with the sequence number
+//   of the write, and readers can only fill it back in if their snapshot
+//   includes the write.
+// * When a tombstone gets evicted we forget which key it was for, so we stop
+//   accepting values from snapshots older than it altogether.
+//
+// Eviction is CLOCK, the cache is split in independently locked shards to
+// keep the readers from contending.
+struct ShardDBCache {
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t invalidations = 0;
+    };
+
+    // `capacity` is in number of entries, 0 disables the cache.
+    ShardDBCache(size_t capacity) {
+        if (capacity == 0) { return; }
+        size_t perShard = (capacity + NUM_SHARDS - 1) / NUM_SHARDS;
+        _shards.reserve(NUM_SHARDS);
+        for (size_t i = 0; i < NUM_SHARDS; i++) {
+            _shards.emplace_back(std::make_unique<Shard>(perShard));
+        }
+    }
+
+    ShardDBCache(const ShardDBCache&) = delete;
+
+    bool enabled() const {
+        return !_shards.empty();
+    }
+
+    // Returns true if we have a value for `key` which is valid at snapshot `seq`.
+    // `found` is false if the key is known not to exist.
+    bool get(const rocksdb::Slice& key, uint64_t seq, std::string& value, bool& found) {
+        Shard& shard = _shard(key);
+        {
+            std::lock_guard<std::mutex> lock(shard.mu);
+            auto it = shard.index.find(std::string_view(key.data(), key.size()));
+            if (it != shard.index.end()) {
+                Slot& slot = shard.slots[it->second];
+                if (!slot.tombstone && slot.seq <= seq) {
+                    slot.referenced = true;
+                    found = slot.found;
+                    if (found) { value = slot.value; }
+                    _hits.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+        }
+        _misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Records what we read for `key` at snapshot `seq`. Ignored if we know of
+    // a write which is not visible at `seq`.
+    void put(const rocksdb::Slice& key, uint64_t seq, bool found, const rocksdb::Slice& value) {
+        Shard& shard = _shard(key);
+        std::lock_guard<std::mutex> lock(shard.mu);
+        if (seq < shard.minSeq) { return; }
+        auto it = shard.index.find(std::string_view(key.data(), key.size()));
+        if (it != shard.index.end()) {
+            Slot& slot = shard.slots[it->second];
+            // tombstones hold the seq of the write, values the seq they've been read at,
+            // either way anything older than that is not useful.
+            if (seq < slot.seq) { return; }
+            slot.tombstone = false;
+            slot.found = found;
+            slot.seq = seq;
+            slot.value.assign(value.data(), value.size());
+            slot.referenced = true;
+            return;
+        }
+        Slot& slot = _evict(shard);
+        slot.used = true;
+        slot.tombstone = false;
+        slot.found = found;
+        slot.seq = seq;
+        slot.referenced = true;
+        slot.key.assign(key.data(), key.size());
+        slot.value.assign(value.data(), value.size());
+        shard.index.emplace(std::string_view(slot.key), &slot - shard.slots.data());
+    }
+
+    // `key` has been written at sequence number `seq`.
+    void invalidate(const rocksdb::Slice& key, uint64_t seq) {
+        Shard& shard = _shard(key);
+        std::lock_guard<std::mutex> lock(shard.mu);
+        _invalidations.fetch_add(1, std::memory_order_relaxed);
+        auto it = shard.index.find(std::string_view(key.data(), key.size()));
+        Slot* slot;
+        if (it != shard.index.end()) {
+            slot = &shard.slots[it->second];
+        } else {
+            slot = &_evict(shard);
+            slot->used = true;
+            slot->key.assign(key.data(), key.size());
+            shard.index.emplace(std::string_view(slot->key), slot - shard.slots.data());
+        }
+        slot->tombstone = true;
+        slot->seq = seq;
+        slot->referenced = false; // tombstones go first
+        slot->value.clear();
+    }
+
+    Stats stats() const {
+        Stats stats;
+        stats.hits = _hits.load(std::memory_order_relaxed);
+        stats.misses = _misses.load(std::memory_order_relaxed);
+        stats.evictions = _evictions.load(std::memory_order_relaxed);
+        stats.invalidations = _invalidations.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    static constexpr size_t NUM_SHARDS = 16;
+
+    struct Slot {
+        std::string key;
+        std::string value;
+        uint64_t seq = 0;
+        bool used = false;
+        bool tombstone = false;
+        bool found = false;
+        bool referenced = false;
+    };
+
+    struct Shard {
+        std::mutex mu;
+        std::vector<Slot> slots;
+        // keys point into `slots`, which never reallocates
+        std::unordered_map<std::string_view, size_t> index;
+        size_t hand = 0;
+        // we don't accept values read at snapshots older than this
+        uint64_t minSeq = 0;
+
+        Shard(size_t capacity) : slots(capacity) {
+            index.reserve(capacity);
+        }
+    };
+
+    std::vector<std::unique_ptr<Shard>> _shards;
+    std::atomic<uint64_t> _hits{0};
+    std::atomic<uint64_t> _misses{0};
+    std::atomic<uint64_t> _evictions{0};
+    std::atomic<uint64_t> _invalidations{0};
+
+    Shard& _shard(const rocksdb::Slice& key) {
+        size_t h = std::hash<std::string_view>{}(std::string_view(key.data(), key.size()));
+        return *_shards[h % NUM_SHARDS];
+    }
+
+    // Returns a free slot, evicting something if needed. Must hold the shard lock.
+    Slot& _evict(Shard& shard) {
+        for (;;) {
+            Slot& slot = shard.slots[shard.hand];
+            shard.hand = (shard.hand + 1) % shard.slots.size();
+            if (!slot.used) { return slot; }
+            if (slot.referenced) {
+                slot.referenced = false;
+                continue;
+            }
+            if (slot.tombstone) {
+                shard.minSeq = std::max(shard.minSeq, slot.seq);
+            }
+            shard.index.erase(std::string_view(slot.key));
+            slot.used = false;
+            _evictions.fetch_add(1, std::memory_order_relaxed);
+            return slot;
+        }
+    }
+};
@@ -24,12 +24,14 @@ enum class ShardMetadataKey : uint8_t {
     NEXT_FILE_ID = 2,
     NEXT_SYMLINK_ID = 3,
     NEXT_BLOCK_ID = 4,
+    LOG_BATCH_PROGRESS = 5,
 };
 constexpr ShardMetadataKey SHARD_INFO_KEY = ShardMetadataKey::INFO;
 constexpr ShardMetadataKey LAST_APPLIED_LOG_ENTRY_KEY = ShardMetadataKey::LAST_APPLIED_LOG_ENTRY;
 constexpr ShardMetadataKey NEXT_FILE_ID_KEY = ShardMetadataKey::NEXT_FILE_ID;
 constexpr ShardMetadataKey NEXT_SYMLINK_ID_KEY = ShardMetadataKey::NEXT_SYMLINK_ID;
 constexpr ShardMetadataKey NEXT_BLOCK_ID_KEY = ShardMetadataKey::NEXT_BLOCK_ID;
+constexpr ShardMetadataKey LOG_BATCH_PROGRESS_KEY = ShardMetadataKey::LOG_BATCH_PROGRESS;
 
 inline rocksdb::Slice shardMetadataKey(const ShardMetadataKey* k) {
     return rocksdb::Slice((const char*)k, sizeof(*k));
@@ -43,6 +45,16 @@ struct ShardInfoBody {
     )
 };
 
+// How many entries of the batch at `logIndex` have been applied, while we're
+// halfway through it. See `ShardDB::applyLogEntry`.
+struct LogBatchProgressBody {
+    FIELDS(
+        LE, uint64_t, logIndex, setLogIndex,
+        LE, uint64_t, applied,  setApplied,
+        END_STATIC
+    )
+};
+
 enum class SpanState : uint8_t {
     CLEAN = 0,
     DIRTY = 1,
@@ -27,6 +27,53 @@ static bool parseShardOptions(CommandLineArgs& args, ShardOptions& options) {
             options.transientDeadlineInterval = parseDuration(args.next());
             continue;
         }
+        if (arg == "-num-readers") {
+            options.numReaders = parseUint8(args.next());
+            continue;
+        }
+        if (arg == "-num-servers") {
+            options.numServers = parseUint8(args.next());
+            continue;
+        }
+        if (arg == "-metadata-cache-entries") {
+            options.metadataCacheEntries = parseUint32(args.next());
+            continue;
+        }
+        if (arg == "-db-profile") {
+            std::string profile = args.next().getArg();
+            if (profile == "default") {
+                options.dbProfile = ShardDBProfile::DEFAULT;
+            } else if (profile == "tuned") {
+                options.dbProfile = ShardDBProfile::TUNED;
+            } else {
+                fprintf(stderr, "Bad db profile `%s'\n", profile.c_str());
+                args.dieWithUsage();
+            }
+            continue;
+        }
+        if (arg == "-async-wal-sync") {
+            args.next();
+            options.asyncWalSync = true;
+            continue;
+        }
+        if (arg == "-log-batch-entries") {
+            options.logBatchEntries = parseUint32(args.next());
+            continue;
+        }
+        if (arg == "-compress-log-entries") {
+            args.next();
+            options.compressLogEntries = true;
+            continue;
+        }
+        if (arg == "-group-commit") {
+            args.next();
+            options.groupCommit = true;
+            continue;
+        }
+        if (arg == "-apply-threads") {
+            options.applyThreads = parseUint8(args.next());
+            continue;
+        }
         if (arg == "-shard") {
             options.shardId = parseUint8(args.next());
             options.shardIdSet = true;
@@ -48,6 +95,24 @@ static void printShardOptionsUsage() {
     fprintf(stderr, "ShardOptions:\n");
     fprintf(stderr, " -shard\n");
     fprintf(stderr, "    	Which shard we are running as [0-255]\n");
+    fprintf(stderr, " -num-readers\n");
+    fprintf(stderr, "    	How many threads serve read-only requests [1-255]. Default is 1\n");
+    fprintf(stderr, " -num-servers\n");
+    fprintf(stderr, "    	How many SO_REUSEPORT sockets, each with its own receiving thread, to open per address [1-255]. Default is 1\n");
+    fprintf(stderr, " -metadata-cache-entries\n");
+    fprintf(stderr, "    	How many directories and edges to keep cached in memory for reads, 0 to disable. Default is %zu\n", DEFAULT_METADATA_CACHE_ENTRIES);
+    fprintf(stderr, " -db-profile default|tuned\n");
+    fprintf(stderr, "    	How to tune the RocksDB column families: 'tuned' adds bloom filters, prefix seeks on edges and spans, and larger blocks with partitioned indices for spans. Default is 'default'\n");
+    fprintf(stderr, " -async-wal-sync\n");
+    fprintf(stderr, "    	Fsync the WAL on a separate thread while the writer processes the next batch. Responses are still only sent once durable\n");
+    fprintf(stderr, " -log-batch-entries\n");
+    fprintf(stderr, "    	Maximum number of log entries packed in a single LogsDB entry (default 1). All replicas and locations must be able to read batched entries before going above 1\n");
+    fprintf(stderr, " -compress-log-entries\n");
+    fprintf(stderr, "    	LZ4 compress and checksum LogsDB entries, when it makes them smaller. All replicas and locations must be able to read compressed entries before turning this on\n");
+    fprintf(stderr, " -group-commit\n");
+    fprintf(stderr, "    	Write the log entries applied in each step as a single RocksDB write batch, rather than one per entry\n");
+    fprintf(stderr, " -apply-threads\n");
+    fprintf(stderr, "    	How many threads apply log entries when following, for entries touching different inodes [1-255]. Default is 1\n");
     fprintf(stderr, " -transient-deadline-interval\n");
     fprintf(stderr, "    	Tweaks the interval with which the deadline for transient file gets bumped.\n");
 }
@@ -57,6 +122,22 @@ static bool validateShardOptions(const ShardOptions& options) {
         fprintf(stderr, "-shard needs to be set\n");
         return false;
     }
+    if (options.numReaders == 0) {
+        fprintf(stderr, "-num-readers needs to be at least 1\n");
+        return false;
+    }
+    if (options.numServers == 0) {
+        fprintf(stderr, "-num-servers needs to be at least 1\n");
+        return false;
+    }
+    if (options.applyThreads == 0) {
+        fprintf(stderr, "-apply-threads needs to be at least 1\n");
+        return false;
+    }
+    if (options.logBatchEntries == 0 || options.logBatchEntries > MAX_SHARD_LOG_BATCH_ENTRIES) {
+        fprintf(stderr, "-log-batch-entries needs to be between 1 and %zu\n", MAX_SHARD_LOG_BATCH_ENTRIES);
+        return false;
+    }
     return (validateLogOptions(options.logOptions) && 
             validateXmonOptions(options.xmonOptions) &&
             validateMetricsOptions(options.metricsOptions) &&
@@ -2,15 +2,21 @@
 //
 // SPDX-License-Identifier: GPL-2.0-or-later
 
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <limits>
 #include <ostream>
 #include <resolv.h>
+#include <thread>
 #include <unordered_set>
 #include <vector>
 
 #include "LogsDB.hpp"
 #include "MsgsGen.hpp"
+#include "SnapshotTransfer.hpp"
 #include "Time.hpp"
+#include "crc32c.h"
 #include "utils/TempLogsDB.hpp"
 
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
@@ -151,6 +157,285 @@ TEST_CASE("LogsDBStandAloneLeader") {
 
 }
 
+TEST_CASE("LogsDBAppendWindow") {
+    _setCurrentTime(ternNow());
+    TempLogsDB db(LogLevel::LOG_ERROR, 0, 0, true, false);
+
+    std::vector<LogsDBRequest> inReq;
+    std::vector<LogsDBResponse> inResp;
+    db->processIncomingMessages(inReq, inResp);
+    _setCurrentTime(ternNow() + LogsDB::LEADER_INACTIVE_TIMEOUT + 1_ms);
+    db->processIncomingMessages(inReq, inResp);
+    REQUIRE(db->isLeader());
+    REQUIRE(db->appendWindow() == LogsDB::INITIAL_APPEND_WINDOW);
+    REQUIRE(db->getStats().appendWindowLimit.load() == LogsDB::INITIAL_APPEND_WINDOW);
+
+    std::string bigValue(LogsDB::DEFAULT_UDP_ENTRY_SIZE, 'x');
+    // fills the window, returns how many entries got in
+    auto fill = [&](size_t count) {
+        std::vector<LogsDBLogEntry> entries;
+        for (size_t i = 0; i < count; ++i) {
+            entries.emplace_back(initEntry(0, bigValue));
+        }
+        REQUIRE(db->appendEntries(entries) == TernError::NO_ERROR);
+        size_t appended = 0;
+        for (; appended < entries.size() && entries[appended].idx != 0; ++appended) {}
+        for (size_t i = appended; i < entries.size(); ++i) {
+            REQUIRE(entries[i].idx == 0);
+        }
+        return appended;
+    };
+    auto adjust = [&]() {
+        _setCurrentTime(ternNow() + LogsDB::APPEND_WINDOW_ADJUST_INTERVAL);
+        db->processIncomingMessages(inReq, inResp);
+    };
+
+    // anything past the window gets rejected, and we record that we've hit it
+    REQUIRE(fill(LogsDB::INITIAL_APPEND_WINDOW + 10) == LogsDB::INITIAL_APPEND_WINDOW);
+    REQUIRE(db->getStats().appendWindowFull.load() == 1);
+
+    // without replication commits are instant, so a full window doubles
+    adjust();
+    REQUIRE(db->appendWindow() == 2 * LogsDB::INITIAL_APPEND_WINDOW);
+    REQUIRE(fill(2 * LogsDB::INITIAL_APPEND_WINDOW + 10) == 2 * LogsDB::INITIAL_APPEND_WINDOW);
+    REQUIRE(db->getStats().appendWindowFull.load() == 2);
+
+    // with entries this big the memory budget stops it before the hard cap
+    size_t budgetWindow = LogsDB::APPEND_WINDOW_MEMORY_BUDGET / (LogsDB::DEFAULT_UDP_ENTRY_SIZE * LogsDB::REPLICA_COUNT);
+    REQUIRE(budgetWindow > 2 * LogsDB::INITIAL_APPEND_WINDOW);
+    REQUIRE(budgetWindow < LogsDB::IN_FLIGHT_APPEND_WINDOW);
+    adjust();
+    REQUIRE(db->appendWindow() == budgetWindow);
+    REQUIRE(db->getStats().appendWindowLimit.load() == budgetWindow);
+    REQUIRE(fill(budgetWindow + 1) == budgetWindow);
+
+    // still full, but the budget holds
+    adjust();
+    REQUIRE(db->appendWindow() == budgetWindow);
+
+    // if we don't fill the window it stays where it is
+    REQUIRE(fill(1) == 1);
+    adjust();
+    REQUIRE(db->appendWindow() == budgetWindow);
+}
+
+TEST_CASE("LogsDBReadLeases") {
+    _setCurrentTime(ternNow());
+    // replicas 3 and 4 are down, which still leaves us a quorum
+    std::array<std::unique_ptr<TempLogsDB>, 3> dbs;
+    for (uint8_t i = 0; i < dbs.size(); i++) {
+        dbs[i] = std::make_unique<TempLogsDB>(LogLevel::LOG_ERROR, i, 0, false, i != 0, true);
+    }
+    std::array<std::vector<LogsDBRequest>, 3> inReqs;
+    std::array<std::vector<LogsDBResponse>, 3> inResps;
+    // delivers everything in flight, apart from read lease grants to `partitioned`
+    const auto step = [&](uint8_t partitioned = 0) {
+        for (uint8_t i = 0; i < dbs.size(); i++) {
+            (*dbs[i])->processIncomingMessages(inReqs[i], inResps[i]);
+        }
+        for (uint8_t i = 0; i < dbs.size(); i++) {
+            std::vector<LogsDBRequest*> outReq;
+            std::vector<LogsDBResponse> outResp;
+            (*dbs[i])->getOutgoingMessages(outReq, outResp);
+            for (auto req : outReq) {
+                auto to = req->replicaId.u8;
+                if (
+                    to >= dbs.size() ||
+                    // keepalives carry no release point
+                    (to == partitioned && req->msg.body.kind() == LogMessageKind::RELEASE && req->msg.body.getRelease().lastReleased != 0)
+                ) {
+                    continue;
+                }
+                auto& delivered = inReqs[to].emplace_back();
+                delivered.replicaId = i;
+                delivered.msg.id = req->msg.id;
+                delivered.msg.body = req->msg.body;
+            }
+            for (auto& resp : outResp) {
+                auto to = resp.replicaId.u8;
+                resp.replicaId = i;
+                inResps[to].emplace_back(std::move(resp));
+            }
+        }
+    };
+    const auto pump = [&](uint8_t partitioned = 0) {
+        for (int i = 0; i < 5; i++) { step(partitioned); }
+    };
+
+    step();
+    _setCurrentTime(ternNow() + LogsDB::LEADER_INACTIVE_TIMEOUT + 1_ms);
+    pump();
+    auto& leader = *dbs[0];
+    REQUIRE(leader->isLeader());
+
+    std::vector<LogsDBLogEntry> entries{initEntry(0, "entry1")};
+    REQUIRE(leader->appendEntries(entries) == TernError::NO_ERROR);
+    pump();
+    REQUIRE(leader->getLastReleased() == 1);
+    // a new leader waits for leases granted by a previous one to run out
+    REQUIRE(leader->getLastContinuous() == 0);
+    for (uint8_t i = 1; i < dbs.size(); i++) {
+        auto lease = (*dbs[i])->readLease();
+        REQUIRE(lease.idx == 1);
+        REQUIRE(ternNow() < lease.expiry);
+    }
+    _setCurrentTime(ternNow() + LogsDB::READ_LEASE_DURATION*2);
+    pump();
+    REQUIRE(leader->getLastContinuous() == 1);
+
+    // grants don't get to replica 2 anymore: we can't make anything visible until its lease runs out
+    entries = {initEntry(0, "entry2")};
+    REQUIRE(leader->appendEntries(entries) == TernError::NO_ERROR);
+    pump(2);
+    REQUIRE(leader->getLastReleased() == 2);
+    REQUIRE(leader->getLastContinuous() == 1);
+    REQUIRE((*dbs[1])->readLease().idx == 2);
+    REQUIRE((*dbs[2])->readLease().idx == 1);
+    _setCurrentTime(ternNow() + LogsDB::READ_LEASE_DURATION);
+    REQUIRE_FALSE(ternNow() < (*dbs[2])->readLease().expiry);
+    pump(2);
+    REQUIRE(leader->getLastContinuous() == 2);
+    std::vector<LogsDBLogEntry> readEntries;
+    leader->readEntries(readEntries);
+    REQUIRE(readEntries.size() == 2);
+
+    // replica 2 still hears from the leader while it gets no grants, and doesn't try to replace it
+    for (int i = 0; i < 5; i++) {
+        _setCurrentTime(ternNow() + LogsDB::SEND_RELEASE_INTERVAL);
+        pump(2);
+    }
+    REQUIRE(leader->isLeader());
+    REQUIRE_FALSE((*dbs[2])->isLeader());
+    REQUIRE(leader->getLastContinuous() == 2);
+}
+
+// Applies entries like the shard writer does, checking that as leader everything released is either
+// applied or something it appended itself which is waiting for leases.
+struct LeaseWriter {
+    LogIdx applied;
+    std::unordered_set<uint64_t> inFlight;
+
+    void append(LogsDB& db, const std::string& data) {
+        std::vector<LogsDBLogEntry> entries{initEntry(0, data)};
+        REQUIRE(db.appendEntries(entries) == TernError::NO_ERROR);
+        REQUIRE(entries[0].idx != 0);
+        inFlight.insert(entries[0].idx.u64);
+    }
+
+    void apply(LogsDB& db) {
+        std::vector<LogsDBLogEntry> entries;
+        while (applied < db.getLastContinuous()) {
+            entries.clear();
+            db.readEntries(entries);
+            REQUIRE(!entries.empty());
+            for (const auto& entry : entries) {
+                applied = applied + 1;
+                REQUIRE(entry.idx == applied);
+                inFlight.erase(entry.idx.u64);
+            }
+        }
+        if (db.isLeader()) {
+            REQUIRE(applied == db.getLastContinuous());
+            REQUIRE(applied.u64 + inFlight.size() >= db.getLastReleased().u64);
+        }
+    }
+};
+
+TEST_CASE("LogsDBReadLeasesElection") {
+    _setCurrentTime(ternNow());
+    // replica 4 is down, which still leaves us a quorum when replica 0 goes down too
+    std::array<std::unique_ptr<TempLogsDB>, 4> dbs;
+    for (uint8_t i = 0; i < dbs.size(); i++) {
+        dbs[i] = std::make_unique<TempLogsDB>(LogLevel::LOG_ERROR, i, 0, false, i != 0, true);
+    }
+    std::array<LeaseWriter, 4> writers;
+    std::array<std::vector<LogsDBRequest>, 4> inReqs;
+    std::array<std::vector<LogsDBResponse>, 4> inResps;
+    uint8_t down = LogsDB::REPLICA_COUNT;
+    const auto step = [&]() {
+        for (uint8_t i = 0; i < dbs.size(); i++) {
+            if (i == down) { continue; }
+            (*dbs[i])->processIncomingMessages(inReqs[i], inResps[i]);
+            writers[i].apply(*dbs[i]->db);
+        }
+        for (uint8_t i = 0; i < dbs.size(); i++) {
+            if (i == down) { continue; }
+            std::vector<LogsDBRequest*> outReq;
+            std::vector<LogsDBResponse> outResp;
+            (*dbs[i])->getOutgoingMessages(outReq, outResp);
+            for (auto req : outReq) {
+                auto to = req->replicaId.u8;
+                if (to >= dbs.size() || to == down) {
+                    continue;
+                }
+                auto& delivered = inReqs[to].emplace_back();
+                delivered.replicaId = i;
+                delivered.msg.id = req->msg.id;
+                delivered.msg.body = req->msg.body;
+            }
+            for (auto& resp : outResp) {
+                auto to = resp.replicaId.u8;
+                if (to == down) {
+                    continue;
+                }
+                resp.replicaId = i;
+                inResps[to].emplace_back(std::move(resp));
+            }
+        }
+    };
+    const auto pump = [&]() {
+        for (int i = 0; i < 5; i++) { step(); }
+    };
+    // moves time in small steps, so that leases keep getting renewed
+    const auto advance = [&](Duration d) {
+        for (auto end = ternNow() + d; ternNow() < end;) {
+            _setCurrentTime(ternNow() + LogsDB::READ_LEASE_RENEW_INTERVAL);
+            pump();
+        }
+    };
+
+    step();
+    advance(LogsDB::LEADER_INACTIVE_TIMEOUT + 1_ms);
+    REQUIRE((*dbs[0])->isLeader());
+    writers[0].append(*dbs[0]->db, "entry1");
+    pump();
+    advance(LogsDB::READ_LEASE_DURATION*2 + 1_ms);
+    REQUIRE((*dbs[0])->getLastContinuous() == 1);
+    REQUIRE(writers[1].applied == 1);
+
+    // replica 0 goes away, and replica 1 takes over
+    down = 0;
+    dbs[1]->restart(1, writers[1].applied, false, false, true);
+    inReqs[1].clear();
+    inResps[1].clear();
+    advance(LogsDB::LEADER_INACTIVE_TIMEOUT + 1_ms);
+    auto& leader = *dbs[1];
+    REQUIRE(leader->isLeader());
+
+    // what we write now gets released, but is only made visible once the leases replica 0
+    // might have granted have run out
+    writers[1].append(*leader.db, "entry2");
+    pump();
+    REQUIRE(leader->getLastReleased() == 2);
+    REQUIRE(leader->getLastContinuous() == 1);
+    REQUIRE(writers[1].applied == 1);
+    advance(LogsDB::READ_LEASE_DURATION*2 + 1_ms);
+    REQUIRE(leader->getLastContinuous() == 2);
+    REQUIRE(writers[1].applied == 2);
+    REQUIRE(writers[1].inFlight.empty());
+
+    // and from there on, as soon as every lease holder has confirmed
+    writers[1].append(*leader.db, "entry3");
+    pump();
+    pump();
+    REQUIRE(leader->getLastContinuous() == 3);
+    REQUIRE(writers[1].applied == 3);
+    for (uint8_t i = 2; i < dbs.size(); i++) {
+        REQUIRE(writers[i].applied == 3);
+        REQUIRE((*dbs[i])->readLease().idx == 3);
+    }
+}
+
 TEST_CASE("LogsDBAvoidBeingLeader") {
     _setCurrentTime(ternNow());
     TempLogsDB db(LogLevel::LOG_ERROR, 0, 0, true, true);
@@ -174,6 +459,282 @@ TEST_CASE("LogsDBAvoidBeingLeader") {
     REQUIRE(db->getNextTimeout() == LogsDB::LEADER_INACTIVE_TIMEOUT);
 }
 
+struct LogsDBTestAccess {
+    static void getLogEntries(Env& env, SharedRocksDB& sharedDB, LogIdx start, size_t count, std::vector<LogsDBLogEntry>& entries) {
+        LogsDB::_getLogEntries(env, sharedDB, start, count, entries);
+    }
+};
+
+// Appends `count` entries as a standalone leader, in as many goes as the window needs,
+// and reads them back.
+static void appendAndRead(TempLogsDB& db, size_t count) {
+    std::vector<LogsDBRequest> inReq;
+    std::vector<LogsDBResponse> inResp;
+    std::vector<LogsDBLogEntry> entries;
+    while (count > 0) {
+        entries.clear();
+        for (size_t i = 0; i < std::min(count, db->appendWindow()); ++i) {
+            entries.emplace_back(initEntry(0, "entry"));
+        }
+        REQUIRE(db->appendEntries(entries) == TernError::NO_ERROR);
+        db->processIncomingMessages(inReq, inResp);
+        size_t appended = entries.size();
+        count -= appended;
+        entries.clear();
+        db->readEntries(entries);
+        REQUIRE(entries.size() == appended);
+    }
+}
+
+static std::vector<LogIdx> readIndices(TempLogsDB& db, LogIdx start) {
+    Env env(db.logger, db.xmon, "test");
+    std::vector<LogsDBLogEntry> entries;
+    LogsDBTestAccess::getLogEntries(env, *db.sharedDB, start, std::numeric_limits<size_t>::max(), entries);
+    std::vector<LogIdx> indices;
+    for (const auto& entry : entries) {
+        indices.emplace_back(entry.idx);
+    }
+    return indices;
+}
+
+static std::vector<LogIdx> indexRange(uint64_t first, uint64_t last) {
+    std::vector<LogIdx> indices;
+    for (uint64_t idx = first; idx <= last; ++idx) {
+        indices.emplace_back(idx);
+    }
+    return indices;
+}
+
+TEST_CASE("LogsDBPartitions") {
+    _setCurrentTime(ternNow());
+    TempLogsDB db(LogLevel::LOG_ERROR, 0, 0, true, false);
+    std::vector<LogsDBRequest> inReq;
+    std::vector<LogsDBResponse> inResp;
+    db->processIncomingMessages(inReq, inResp);
+    _setCurrentTime(ternNow() + LogsDB::LEADER_INACTIVE_TIMEOUT + 1_ms);
+    db->processIncomingMessages(inReq, inResp);
+    REQUIRE(db->isLeader());
+
+    // On an empty DB the first entry goes to one partition and the rest to the other.
+    // When we rotate the first one gets dropped and reused for the entries after.
+    appendAndRead(db, 100);
+    _setCurrentTime(ternNow() + LogsDB::PARTITION_TIME_SPAN + 1_sec);
+    appendAndRead(db, 100);
+
+    // reads go through the partitions in index order, from wherever they start
+    REQUIRE(readIndices(db, 1) == indexRange(2, 200));
+    REQUIRE(readIndices(db, 50) == indexRange(50, 200));
+    REQUIRE(readIndices(db, 100) == indexRange(100, 200));
+    REQUIRE(readIndices(db, 101) == indexRange(101, 200));
+    REQUIRE(readIndices(db, 150) == indexRange(150, 200));
+    REQUIRE(readIndices(db, 201).empty());
+
+    // without any writes, the older partition goes once everything in it is old enough
+    _setCurrentTime(ternNow() + Duration(LogsDB::PARTITION_TIME_SPAN.ns / 2));
+    db->processIncomingMessages(inReq, inResp);
+    REQUIRE(readIndices(db, 1) == indexRange(2, 200));
+    _setCurrentTime(ternNow() + Duration(LogsDB::PARTITION_TIME_SPAN.ns / 2) + 1_sec);
+    db->processIncomingMessages(inReq, inResp);
+    REQUIRE(readIndices(db, 1) == indexRange(101, 200));
+    std::vector<LogsDBLogEntry> entries;
+    db->readIndexedEntries({50, 150}, entries);
+    REQUIRE(entries.size() == 2);
+    REQUIRE(entries[0].idx == 0);
+    REQUIRE(entries[1].idx == 150);
+
+    // and the next writes start over in the dropped one
+    appendAndRead(db, 10);
+    REQUIRE(readIndices(db, 1) == indexRange(101, 210));
+}
+
+static AddrsInfo localhostAddrs() {
+    AddrsInfo addrs;
+    addrs[0].ip = Ip({127,0,0,1});
+    addrs[0].port = 1;
+    return addrs;
+}
+
+// Serves one connection with whatever `stream` has, for the broken streams.
+struct FakeSnapshotServer {
+    Sock listenSock;
+    uint16_t port;
+    std::thread thread;
+
+    // Keeps the connection open for `stall` after sending `stream`.
+    FakeSnapshotServer(std::string stream, Duration stall = 0) : listenSock(Sock::TCPSock()) {
+        REQUIRE_FALSE(listenSock.error());
+        sockaddr_in addr{};
+        IpPort ipPort;
+        ipPort.ip = Ip({127,0,0,1});
+        ipPort.toSockAddrIn(addr);
+        REQUIRE(bind(listenSock.get(), (sockaddr*)&addr, sizeof(addr)) == 0);
+        socklen_t addrLen = sizeof(addr);
+        REQUIRE(getsockname(listenSock.get(), (sockaddr*)&addr, &addrLen) == 0);
+        port = ntohs(addr.sin_port);
+        REQUIRE(listen(listenSock.get(), 1) == 0);
+        thread = std::thread([this, stall, stream = std::move(stream)]() {
+            int fd = accept(listenSock.get(), nullptr, nullptr);
+            if (fd < 0) { return; }
+            for (size_t written = 0; written < stream.size();) {
+                ssize_t r = write(fd, stream.data() + written, stream.size() - written);
+                if (r <= 0) { break; }
+                written += r;
+            }
+            if (stall > 0) { stall.sleepRetry(); }
+            close(fd);
+        });
+    }
+
+    ~FakeSnapshotServer() {
+        thread.join();
+    }
+};
+
+template<typename T>
+static void appendScalar(std::string& stream, T x) {
+    stream.append((const char*)&x, sizeof(x));
+}
+
+TEST_CASE("SnapshotTransfer") {
+    _setCurrentTime(ternNow());
+    TempLogsDB db(LogLevel::LOG_ERROR, 0, 0, true, false);
+    std::vector<LogsDBRequest> inReq;
+    std::vector<LogsDBResponse> inResp;
+    db->processIncomingMessages(inReq, inResp);
+    _setCurrentTime(ternNow() + LogsDB::LEADER_INACTIVE_TIMEOUT + 1_ms);
+    db->processIncomingMessages(inReq, inResp);
+    REQUIRE(db->isLeader());
+    appendAndRead(db, 100);
+
+    Env env(db.logger, db.xmon, "test");
+    std::string dbPath = db.dbDir + "/copy";
+    auto replicas = std::make_shared<std::array<AddrsInfo, LogsDB::REPLICA_COUNT>>();
+
+    SUBCASE("Loopback") {
+        REQUIRE(needsBulkCatchup(env, dbPath));
+        (*replicas)[1] = localhostAddrs();
+        SnapshotServer server(db.logger, db.xmon, *db.sharedDB, db.dbDir, localhostAddrs(), 0, replicas);
+        std::thread serverThread([&server]() { server.step(); });
+        fetchSnapshot(env, "127.0.0.1", server.port(), dbPath);
+        serverThread.join();
+        REQUIRE_FALSE(needsBulkCatchup(env, dbPath));
+
+        SharedRocksDB copyDB(db.logger, db.xmon, dbPath, "");
+        copyDB.registerCFDescriptors({{rocksdb::kDefaultColumnFamilyName, {}}});
+        copyDB.registerCFDescriptors(LogsDB::getColumnFamilyDescriptors());
+        copyDB.open({});
+        std::vector<LogsDBLogEntry> entries;
+        std::vector<LogsDBLogEntry> copiedEntries;
+        LogsDBTestAccess::getLogEntries(env, *db.sharedDB, 1, std::numeric_limits<size_t>::max(), entries);
+        LogsDBTestAccess::getLogEntries(env, copyDB, 1, std::numeric_limits<size_t>::max(), copiedEntries);
+        REQUIRE(entries.size() == 100);
+        REQUIRE(entries == copiedEntries);
+        REQUIRE(LogsDB::lastReleasedTime(copyDB) == LogsDB::lastReleasedTime(*db.sharedDB));
+        LogsDB copyLogsDB(db.logger, db.xmon, copyDB, 1, db->getLastReleased(), false, false, false);
+        REQUIRE(copyLogsDB.getLastReleased() == db->getLastReleased());
+        copyLogsDB.close();
+    }
+
+    SUBCASE("UnknownPeer") {
+        SnapshotServer server(db.logger, db.xmon, *db.sharedDB, db.dbDir, localhostAddrs(), 0, replicas);
+        std::thread serverThread([&server]() { server.step(); });
+        REQUIRE_THROWS(fetchSnapshot(env, "127.0.0.1", server.port(), dbPath));
+        serverThread.join();
+        REQUIRE(needsBulkCatchup(env, dbPath));
+    }
+
+    SUBCASE("NoLogsDB") {
+        SharedRocksDB otherDB(db.logger, db.xmon, dbPath, "");
+        otherDB.registerCFDescriptors({{rocksdb::kDefaultColumnFamilyName, {}}});
+        rocksdb::Options options;
+        options.create_if_missing = true;
+        otherDB.open(options);
+        otherDB.close();
+        REQUIRE(needsBulkCatchup(env, dbPath));
+    }
+
+    SUBCASE("BrokenStream") {
+        // what's there already must survive a failed fetch
+        std::filesystem::create_directory(dbPath);
+        {
+            std::ofstream marker(dbPath + "/marker");
+            marker << "previous";
+        }
+        std::string contents(1000, 'x');
+        std::string stream;
+        appendScalar(stream, SNAPSHOT_TRANSFER_MAGIC);
+        appendScalar<uint16_t>(stream, 3);
+        stream += "SST";
+        appendScalar<uint64_t>(stream, contents.size());
+        SUBCASE("BadCrc") {
+            stream += contents;
+            appendScalar<uint32_t>(stream, crc32c(0, contents.data(), contents.size()) ^ 1);
+            appendScalar<uint16_t>(stream, 0);
+        }
+        Duration stall = 0;
+        SUBCASE("Truncated") {
+            stream += contents.substr(0, contents.size()/2);
+        }
+        SUBCASE("Stalled") {
+            // the server is still there, but sends nothing else
+            stream += contents.substr(0, contents.size()/2);
+            stall = 1_sec;
+        }
+        {
+            FakeSnapshotServer server(stream, stall);
+            // time is frozen in this test
+            auto t0 = std::chrono::steady_clock::now();
+            REQUIRE_THROWS(fetchSnapshot(env, "127.0.0.1", server.port, dbPath, 100_ms));
+            REQUIRE(std::chrono::steady_clock::now() - t0 < std::chrono::seconds(1));
+        }
+        std::vector<std::string> files;
+        for (const auto& file : std::filesystem::directory_iterator(dbPath)) {
+            files.emplace_back(file.path().filename().generic_string());
+        }
+        REQUIRE(files == std::vector<std::string>{"marker"});
+        std::ifstream marker(dbPath + "/marker");
+        std::string markerContents;
+        marker >> markerContents;
+        REQUIRE(markerContents == "previous");
+    }
+}
+
+TEST_CASE("LogsDBPartitionReadBenchmark" * doctest::skip(true)) {
+    _setCurrentTime(ternNow());
+    TempLogsDB db(LogLevel::LOG_ERROR, 0, 0, true, false);
+    std::vector<LogsDBRequest> inReq;
+    std::vector<LogsDBResponse> inResp;
+    db->processIncomingMessages(inReq, inResp);
+    _setCurrentTime(ternNow() + LogsDB::LEADER_INACTIVE_TIMEOUT + 1_ms);
+    db->processIncomingMessages(inReq, inResp);
+    REQUIRE(db->isLeader());
+
+    // half of the entries in each partition
+    const size_t numEntries = 1'000'000;
+    appendAndRead(db, numEntries / 2);
+    _setCurrentTime(ternNow() + LogsDB::PARTITION_TIME_SPAN + 1_sec);
+    appendAndRead(db, numEntries / 2);
+
+    Env env(db.logger, db.xmon, "test");
+    std::vector<LogsDBLogEntry> entries;
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        LogsDBTestAccess::getLogEntries(env, *db.sharedDB, 1, numEntries, entries);
+        Duration elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+        MESSAGE("read all " << entries.size() << " entries in " << elapsed);
+    }
+    {
+        // reads of a window's worth, as catchup does
+        const size_t numReads = 10'000;
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < numReads; ++i) {
+            LogsDBTestAccess::getLogEntries(env, *db.sharedDB, 1 + (i * 7919) % numEntries, LogsDB::IN_FLIGHT_APPEND_WINDOW, entries);
+        }
+        Duration elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+        MESSAGE(numReads << " reads of " << LogsDB::IN_FLIGHT_APPEND_WINDOW << " entries in " << elapsed << ", " << (elapsed.ns / numReads) << "ns each");
+    }
+}
+
 TEST_CASE("EmptyLogsDBLeaderElection" * doctest::skip(true)) { // leader election temporarily disabled in code
     _setCurrentTime(ternNow());
     TempLogsDB db(LogLevel::LOG_ERROR);
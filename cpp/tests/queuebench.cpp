@@ -0,0 +1,81 @@
+// Copyright 2025 XTX Markets Technologies Limited
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Compares `SPSC` (with producers serialized by a mutex, which is what you
+// have to do to feed it from several threads) against `MPMC`, with one
+// puller and 1/2/4/8 pushers.
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MPMC.hpp"
+#include "SPSC.hpp"
+
+static constexpr uint32_t QUEUE_SIZE = 1 << 12;
+static constexpr uint32_t BATCH_SIZE = 32;
+
+template<typename Queue, typename Push>
+static double run(Queue& queue, Push push, int producers, uint64_t elementsPerProducer) {
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&queue, &push, elementsPerProducer]() {
+            std::vector<uint64_t> batch;
+            uint64_t sent = 0;
+            while (sent < elementsPerProducer) {
+                batch.clear();
+                for (uint64_t i = sent; i < std::min<uint64_t>(sent + BATCH_SIZE, elementsPerProducer); i++) {
+                    batch.emplace_back(i);
+                }
+                uint32_t pushed = push(queue, batch);
+                if (pushed == 0) {
+                    sched_yield();
+                }
+                sent += pushed;
+            }
+        });
+    }
+    uint64_t total = producers*elementsPerProducer;
+    uint64_t received = 0;
+    std::vector<uint64_t> els;
+    while (received < total) {
+        els.clear();
+        received += queue.pull(els, BATCH_SIZE*4);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    double deltaSeconds = ((double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count())/1e6;
+    return ((double)total/1e6) / deltaSeconds;
+}
+
+int main(int argc, const char** argv) {
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [elements_per_producer]\n", argv[0]);
+        exit(2);
+    }
+    uint64_t elementsPerProducer = argc == 2 ? std::stoull(argv[1]) : 10'000'000;
+    for (int producers : {1, 2, 4, 8}) {
+        {
+            SPSC<uint64_t> queue(QUEUE_SIZE);
+            std::mutex lock;
+            double mps = run(queue, [&lock](SPSC<uint64_t>& q, std::vector<uint64_t>& els) {
+                std::lock_guard<std::mutex> guard(lock);
+                return q.push(els);
+            }, producers, elementsPerProducer);
+            printf("SPSC+mutex, %d producers: %0.2fM elements/s\n", producers, mps);
+        }
+        {
+            MPMC<uint64_t> queue(QUEUE_SIZE);
+            double mps = run(queue, [](MPMC<uint64_t>& q, std::vector<uint64_t>& els) {
+                return q.push(els);
+            }, producers, elementsPerProducer);
+            printf("MPMC,       %d producers: %0.2fM elements/s\n", producers, mps);
+        }
+    }
+    return 0;
+}
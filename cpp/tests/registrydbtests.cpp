@@ -10,6 +10,7 @@
 #include "Bincode.hpp"
 #include "Msgs.hpp"
 #include "MsgsGen.hpp"
+#include "RegistryServer.hpp"
 #include "Time.hpp"
 #include "utils/TempRegistryDB.hpp"
 
@@ -793,4 +794,54 @@ TEST_CASE("DecommissionBlockService") {
     CHECK(found);
 }
 
+// With io_uring the receiving server only learns about UDP packets through
+// epoll on the ring, which needs to be armed before anything is received.
+static void checkServerReceivesLogsDBMessages(bool ioUring) {
+    Logger logger(LogLevel::LOG_ERROR, STDERR_FILENO, false, false);
+    std::shared_ptr<XmonAgent> xmon;
+    Env env(logger, xmon, "test");
+    const auto makeServer = [&](bool ioUring) {
+        RegistryOptions options;
+        REQUIRE(parseIpv4Addr("127.0.0.1:0", options.serverOptions.addrs[0]));
+        options.serverOptions.ioUring = ioUring;
+        auto server = std::make_unique<RegistryServer>(options, env);
+        REQUIRE(server->init());
+        return server;
+    };
+    auto receiver = makeServer(ioUring);
+    auto sender = makeServer(false);
+    auto replicas = std::make_shared<std::array<AddrsInfo, LogsDB::REPLICA_COUNT>>();
+    (*replicas)[0] = receiver->boundAddresses();
+    (*replicas)[1] = sender->boundAddresses();
+    receiver->setReplicas(replicas);
+    sender->setReplicas(replicas);
+
+    LogsDBRequest request;
+    request.replicaId = 0;
+    request.msg.id = 42;
+    auto& release = request.msg.body.setRelease();
+    release.token = LeaderToken(1, 1);
+    release.lastReleased = 10;
+    std::vector<LogsDBRequest*> requests{&request};
+    std::vector<LogsDBResponse> responses;
+    sender->sendLogsDBMessages(requests, responses);
+
+    auto deadline = ternNow() + 5_sec;
+    while (receiver->receivedLogsDBRequests().empty() && ternNow() < deadline) {
+        REQUIRE(receiver->receiveMessages(100_ms));
+    }
+    auto& received = receiver->receivedLogsDBRequests();
+    REQUIRE(received.size() == 1);
+    CHECK(received[0].replicaId == 1);
+    CHECK(received[0].msg.id == 42);
+    CHECK(received[0].msg.body.getRelease().lastReleased == 10);
+}
 
+TEST_CASE("ServerReceivesLogsDBMessages") {
+    SUBCASE("poll") {
+        checkServerReceivesLogsDBMessages(false);
+    }
+    SUBCASE("ioUring") {
+        checkServerReceivesLogsDBMessages(true);
+    }
+}
@@ -0,0 +1,156 @@
+// Copyright 2025 XTX Markets Technologies Limited
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Measures lookup and readdir latency against a ShardDB populated with
+// many directories, once for each `ShardDBProfile`. Everything is flushed
+// and compacted to SST files before measuring, and the metadata cache is
+// disabled, so that we're looking at RocksDB.
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <rocksdb/db.h>
+
+#include "BlockServicesCacheDB.hpp"
+#include "Random.hpp"
+#include "RocksDBUtils.hpp"
+#include "ShardDB.hpp"
+#include "SharedRocksDB.hpp"
+
+struct Latencies {
+    std::vector<uint64_t> ns;
+
+    void print(const char* what) {
+        std::sort(ns.begin(), ns.end());
+        uint64_t total = 0;
+        for (uint64_t x : ns) { total += x; }
+        printf(
+            "  %-16s n=%-8zu mean=%7.2fus p50=%7.2fus p99=%7.2fus\n",
+            what, ns.size(), (double)total/ns.size()/1e3, ns[ns.size()/2]/1e3, ns[(ns.size()*99)/100]/1e3
+        );
+    }
+};
+
+static void bench(ShardDBProfile profile, int numDirs, int filesPerDir, int numReads) {
+    Logger logger(LogLevel::LOG_ERROR, STDERR_FILENO, false, false);
+    std::shared_ptr<XmonAgent> xmon;
+    std::string dbDir("shardbench-db.XXXXXX");
+    if (mkdtemp(dbDir.data()) == nullptr) {
+        throw SYSCALL_EXCEPTION("mkdtemp");
+    }
+
+    {
+        SharedRocksDB sharedDB(logger, xmon, dbDir + "/db", dbDir + "/db-statistics.txt");
+        sharedDB.registerCFDescriptors(BlockServicesCacheDB::getColumnFamilyDescriptors());
+        sharedDB.registerCFDescriptors(ShardDB::getColumnFamilyDescriptors(profile));
+        rocksdb::Options rocksDBOptions;
+        rocksDBOptions.create_if_missing = true;
+        rocksDBOptions.create_missing_column_families = true;
+        rocksDBOptions.compression = rocksdb::kLZ4Compression;
+        rocksDBOptions.bottommost_compression = rocksdb::kZSTD;
+        rocksDBOptions.manual_wal_flush = true;
+        sharedDB.open(rocksDBOptions);
+        BlockServicesCacheDB blockServicesCache(logger, xmon, sharedDB);
+        ShardDB db(logger, xmon, ShardId(0), 0, DEFAULT_DEADLINE_INTERVAL, sharedDB, blockServicesCache, 0);
+
+        auto req = std::make_unique<ShardReqContainer>();
+        auto resp = std::make_unique<ShardRespContainer>();
+        auto logEntry = std::make_unique<ShardLogEntry>();
+        uint64_t logEntryIndex = 0;
+        const auto apply = [&]() {
+            ALWAYS_ASSERT(db.prepareLogEntry(*req, *logEntry) == TernError::NO_ERROR);
+            db.applyLogEntry(++logEntryIndex, *logEntry, *resp);
+            ALWAYS_ASSERT(resp->kind() != ShardMessageKind::ERROR, "%s", resp->getError());
+        };
+
+        auto t0 = std::chrono::steady_clock::now();
+        std::vector<InodeId> dirs;
+        for (int i = 1; i <= numDirs; i++) {
+            InodeId dirId(InodeType::DIRECTORY, ShardId(0), i);
+            auto& createReq = req->setCreateDirectoryInode();
+            createReq.id = dirId;
+            createReq.ownerId = ROOT_DIR_INODE_ID;
+            apply();
+            dirs.emplace_back(dirId);
+            for (int j = 0; j < filesPerDir; j++) {
+                auto& constructReq = req->setConstructFile();
+                constructReq.type = (uint8_t)InodeType::FILE;
+                constructReq.note = "bench";
+                apply();
+                InodeId fileId = resp->getConstructFile().id;
+                auto cookie = resp->getConstructFile().cookie;
+                auto& linkReq = req->setLinkFile();
+                linkReq.fileId = fileId;
+                linkReq.cookie = cookie;
+                linkReq.ownerId = dirId;
+                linkReq.name = "file-" + std::to_string(j);
+                apply();
+            }
+            if (i % 100 == 0) { db.flush(false); }
+        }
+        db.flush(false);
+        ROCKS_DB_CHECKED(sharedDB.db()->Flush({}, {sharedDB.getCF("files"), sharedDB.getCF("directories"), sharedDB.getCF("edges")}));
+        ROCKS_DB_CHECKED(sharedDB.db()->CompactRange({}, sharedDB.getCF("edges"), nullptr, nullptr));
+        double setupSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+        printf("profile %s (%d dirs, %d files per dir, setup took %.1fs)\n", profile == ShardDBProfile::TUNED ? "tuned" : "default", numDirs, filesPerDir, setupSecs);
+
+        RandomGenerator rand(42);
+        ShardDBReadView view;
+        const auto timeRead = [&](Latencies& latencies) {
+            auto t = std::chrono::steady_clock::now();
+            db.read(*req, *resp, view);
+            latencies.ns.emplace_back(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t).count());
+        };
+        Latencies lookups, missingLookups, readDirs;
+        for (int i = 0; i < numReads; i++) {
+            InodeId dirId = dirs[rand.generate64() % dirs.size()];
+            {
+                auto& lookupReq = req->setLookup();
+                lookupReq.dirId = dirId;
+                lookupReq.name = "file-" + std::to_string(rand.generate64() % filesPerDir);
+                timeRead(lookups);
+                ALWAYS_ASSERT(resp->kind() == ShardMessageKind::LOOKUP);
+            }
+            {
+                auto& lookupReq = req->setLookup();
+                lookupReq.dirId = dirId;
+                lookupReq.name = "missing-" + std::to_string(i);
+                timeRead(missingLookups);
+            }
+            {
+                auto& readDirReq = req->setReadDir();
+                readDirReq.dirId = dirId;
+                timeRead(readDirs);
+                ALWAYS_ASSERT(resp->kind() == ShardMessageKind::READ_DIR);
+            }
+        }
+        lookups.print("lookup");
+        missingLookups.print("lookup (missing)");
+        readDirs.print("readdir");
+
+        db.close();
+    }
+
+    std::error_code err;
+    std::filesystem::remove_all(std::filesystem::path(dbDir), err);
+}
+
+int main(int argc, const char** argv) {
+    if (argc > 4) {
+        fprintf(stderr, "Usage: %s [num_dirs] [files_per_dir] [num_reads]\n", argv[0]);
+        exit(2);
+    }
+    int numDirs = argc > 1 ? std::stoi(argv[1]) : 2'000;
+    int filesPerDir = argc > 2 ? std::stoi(argv[2]) : 20;
+    int numReads = argc > 3 ? std::stoi(argv[3]) : 100'000;
+    for (ShardDBProfile profile : {ShardDBProfile::DEFAULT, ShardDBProfile::TUNED}) {
+        bench(profile, numDirs, filesPerDir, numReads);
+    }
+    return 0;
+}
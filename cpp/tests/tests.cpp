@@ -8,6 +8,8 @@
 #include <filesystem>
 #include <rocksdb/db.h>
 #include <sstream>
+#include <atomic>
+#include <thread>
 #include <unistd.h>
 
 
@@ -21,6 +23,7 @@
 #include "Time.hpp"
 #include "CDCKey.hpp"
 #include "Random.hpp"
+#include "MPMC.hpp"
 
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
@@ -65,6 +68,69 @@ TEST_CASE("BincodeBytes") {
     }
 }
 
+TEST_CASE("BincodeArena") {
+    ShardReqMsg req;
+    req.id = 42;
+    req.body.setLookup().name = "a-fairly-long-name";
+    char buf[DEFAULT_UDP_MTU];
+    BincodeBuf packBuf(buf, sizeof(buf));
+    req.pack(packBuf);
+
+    BincodeArenaPool pool(64);
+    BincodeArena* arena = &pool.acquire();
+    BincodeArenaRef ref;
+    {
+        ShardReqMsg unpacked;
+        BincodeBuf unpackBuf(buf, packBuf.len());
+        unpackBuf.arena = arena;
+        unpacked.unpack(unpackBuf);
+        CHECK(unpacked.body.getLookup().name == req.body.getLookup().name);
+        CHECK(unpacked.body.getLookup().name.inArena());
+        CHECK(arena->used() == req.body.getLookup().name.size());
+        ref = BincodeArenaRef(arena);
+
+        // moves keep pointing into the arena, copies go to the heap
+        ShardReqMsg moved = std::move(unpacked);
+        CHECK(moved.body.getLookup().name.inArena());
+        BincodeBytes copied = moved.body.getLookup().name;
+        CHECK(!copied.inArena());
+        CHECK(copied == req.body.getLookup().name);
+    }
+
+    // the arena is still referenced, so we get a fresh one
+    CHECK(arena->inUse());
+    BincodeArena* other = &pool.acquire();
+    CHECK(other != arena);
+    CHECK(pool.size() == 2);
+
+    // small strings are inline, and we fall back to the heap when full
+    BincodeBytes small;
+    small.copy("short", 5, other);
+    CHECK(!small.inArena());
+    BincodeBytes big;
+    big.copy(buf, 100, other);
+    CHECK(!big.inArena());
+    CHECK(other->used() == 0);
+
+    // once the ref is gone, arenas get reused
+    ref = BincodeArenaRef();
+    CHECK(!arena->inUse());
+    pool.acquire();
+    pool.acquire();
+    CHECK(pool.size() == 2);
+
+    // idle arenas past the limit get freed
+    BincodeArenaPool smallPool(64, 1);
+    std::vector<BincodeArenaRef> refs;
+    for (int i = 0; i < 4; i++) {
+        refs.emplace_back(&smallPool.acquire());
+    }
+    CHECK(smallPool.size() == 4);
+    refs.clear();
+    smallPool.acquire();
+    CHECK(smallPool.size() == 2);
+}
+
 struct TempRocksDB {
     rocksdb::DB* db;
     std::string dbDir;
@@ -390,7 +456,9 @@ struct TempShardDB {
     std::unique_ptr<BlockServicesCacheDB> blockServicesCacheDB;
     std::unique_ptr<ShardDB> db;
 
-    TempShardDB(LogLevel level, ShardId shid_): logger(level, STDERR_FILENO, false, false), shid(shid_) {
+    ShardDBProfile profile;
+
+    TempShardDB(LogLevel level, ShardId shid_, ShardDBProfile profile_ = ShardDBProfile::DEFAULT): logger(level, STDERR_FILENO, false, false), shid(shid_), profile(profile_) {
         dbDir = std::string("temp-shard-db.XXXXXX");
         if (mkdtemp(dbDir.data()) == nullptr) {
             throw SYSCALL_EXCEPTION("mkdtemp");
@@ -399,7 +467,7 @@ struct TempShardDB {
         sharedDB = std::make_unique<SharedRocksDB>(logger, xmon, dbDir + "/db", dbDir + "/db-statistics.txt");
         initSharedDB();
         blockServicesCacheDB = std::make_unique<BlockServicesCacheDB>(logger, xmon, *sharedDB);
-        db = std::make_unique<ShardDB>(logger, xmon, shid, 0, DEFAULT_DEADLINE_INTERVAL, *sharedDB, *blockServicesCacheDB);
+        db = std::make_unique<ShardDB>(logger, xmon, shid, 0, DEFAULT_DEADLINE_INTERVAL, *sharedDB, *blockServicesCacheDB, DEFAULT_METADATA_CACHE_ENTRIES);
     }
 
     // useful to test recovery
@@ -409,7 +477,7 @@ struct TempShardDB {
         sharedDB = std::make_unique<SharedRocksDB>(logger, xmon, dbDir + "/db", dbDir + "/db-statistics.txt");
         initSharedDB();
         blockServicesCacheDB = std::make_unique<BlockServicesCacheDB>(logger, xmon, *sharedDB);
-        db = std::make_unique<ShardDB>(logger, xmon, shid, 0, DEFAULT_DEADLINE_INTERVAL, *sharedDB, *blockServicesCacheDB);
+        db = std::make_unique<ShardDB>(logger, xmon, shid, 0, DEFAULT_DEADLINE_INTERVAL, *sharedDB, *blockServicesCacheDB, DEFAULT_METADATA_CACHE_ENTRIES);
     }
 
     ~TempShardDB() {
@@ -425,7 +493,7 @@ struct TempShardDB {
 
     void initSharedDB() {
         sharedDB->registerCFDescriptors(BlockServicesCacheDB::getColumnFamilyDescriptors());
-        sharedDB->registerCFDescriptors(ShardDB::getColumnFamilyDescriptors());
+        sharedDB->registerCFDescriptors(ShardDB::getColumnFamilyDescriptors(profile));
         rocksdb::Options rocksDBOptions;
         rocksDBOptions.create_if_missing = true;
         rocksDBOptions.create_missing_column_families = true;
@@ -596,6 +664,567 @@ TEST_CASE("override") {
     }
 }
 
+TEST_CASE("tuned profile") {
+    // with prefix seeks we need to be careful when iterating across prefixes,
+    // so exercise the reads which do that with everything in SST files.
+    TempShardDB db(LogLevel::LOG_ERROR, ShardId(0), ShardDBProfile::TUNED);
+
+    auto reqContainer = std::make_unique<ShardReqContainer>();
+    auto respContainer = std::make_unique<ShardRespContainer>();
+    auto logEntry = std::make_unique<ShardLogEntry>();
+    uint64_t logEntryIndex = 0;
+
+    const auto apply = [&]() {
+        NO_TERN_ERROR(db->prepareLogEntry(*reqContainer, *logEntry));
+        NO_TERN_ERROR_IN_RESPONSE(*respContainer, db->applyLogEntry(++logEntryIndex, *logEntry, *respContainer));
+        db->flush(false);
+    };
+
+    // a few directories around the one we look at, so that there's
+    // something in the neighbouring prefixes
+    std::vector<InodeId> dirs;
+    for (int i = 1; i <= 3; i++) {
+        InodeId dirId(InodeType::DIRECTORY, ShardId(0), i);
+        auto& req = reqContainer->setCreateDirectoryInode();
+        req.id = dirId;
+        req.ownerId = ROOT_DIR_INODE_ID;
+        apply();
+        dirs.emplace_back(dirId);
+    }
+    const auto createFile = [&](InodeId dirId, const char* name) -> TernTime {
+        auto& req = reqContainer->setConstructFile();
+        req.type = (uint8_t)InodeType::FILE;
+        req.note = "test note";
+        apply();
+        InodeId id = respContainer->getConstructFile().id;
+        BincodeFixedBytes<8> cookie = respContainer->getConstructFile().cookie;
+        auto& linkReq = reqContainer->setLinkFile();
+        linkReq.fileId = id;
+        linkReq.cookie = cookie;
+        linkReq.ownerId = dirId;
+        linkReq.name = name;
+        apply();
+        return respContainer->getLinkFile().creationTime;
+    };
+    for (InodeId dirId : dirs) {
+        createFile(dirId, "bar");
+    }
+    InodeId dirId = dirs[1];
+    TernTime fooCreationTime = createFile(dirId, "foo");
+    {
+        auto& req = reqContainer->setLookup();
+        req.dirId = dirId;
+        req.name = "foo";
+        NO_TERN_ERROR_IN_RESPONSE(*respContainer, db->read(*reqContainer, *respContainer));
+        InodeId targetId = respContainer->getLookup().targetId;
+        auto& renameReq = reqContainer->setSameDirectoryRename();
+        renameReq.dirId = dirId;
+        renameReq.targetId = targetId;
+        renameReq.oldName = "foo";
+        renameReq.oldCreationTime = fooCreationTime;
+        renameReq.newName = "baz";
+        apply();
+    }
+
+    rocksdb::FlushOptions flushOptions;
+    ROCKS_DB_CHECKED(db.sharedDB->db()->Flush(flushOptions, {db.sharedDB->getCF("edges"), db.sharedDB->getCF("directories")}));
+
+    {
+        auto& req = reqContainer->setReadDir();
+        req.dirId = dirId;
+        NO_TERN_ERROR_IN_RESPONSE(*respContainer, db->read(*reqContainer, *respContainer));
+        REQUIRE(respContainer->getReadDir().results.els.size() == 2); // bar, baz
+    }
+    for (bool backwards : {false, true}) {
+        auto& req = reqContainer->setFullReadDir();
+        req.dirId = dirId;
+        // forwards from the snapshot edges, or backwards from the current ones
+        req.flags = backwards ? (FULL_READ_DIR_BACKWARDS|FULL_READ_DIR_CURRENT) : 0;
+        NO_TERN_ERROR_IN_RESPONSE(*respContainer, db->read(*reqContainer, *respContainer));
+        // bar, baz, and the snapshot foo
+        REQUIRE(respContainer->getFullReadDir().results.els.size() == 3);
+    }
+    {
+        auto& req = reqContainer->setLookup();
+        req.dirId = dirId;
+        req.name = "baz";
+        NO_TERN_ERROR_IN_RESPONSE(*respContainer, db->read(*reqContainer, *respContainer));
+    }
+}
+
+TEST_CASE("metadata cache") {
+    TempShardDB db(LogLevel::LOG_ERROR, ShardId(0));
+
+    auto reqContainer = std::make_unique<ShardReqContainer>();
+    auto respContainer = std::make_unique<ShardRespContainer>();
+    auto logEntry = std::make_unique<ShardLogEntry>();
+    uint64_t logEntryIndex = 0;
+
+    InodeId id;
+    TernTime creationTime;
+    {
+        BincodeFixedBytes<8> cookie;
+        {
+            auto& req = reqContainer->setConstructFile();
+            req.type = (uint8_t)InodeType::FILE;
+            req.note = "test note";
+            NO_TERN_ERROR(db->prepareLogEntry(*reqContainer, *logEntry));
+            NO_TERN_ERROR_IN_RESPONSE(*respContainer, db->applyLogEntry(++logEntryIndex, *logEntry, *respContainer));
+            db->flush(false);
+            id = respContainer->getConstructFile().id;
+            cookie = respContainer->getConstructFile().cookie;
+        }
+        {
+            auto& req = reqContainer->setLinkFile();
+            req.fileId = id;
+            req.cookie = cookie;
+            req.ownerId = ROOT_DIR_INODE_ID;
+            req.name = "foo";
+            NO_TERN_ERROR(db->prepareLogEntry(*reqContainer, *logEntry));
+            NO_TERN_ERROR_IN_RESPONSE(*respContainer, db->applyLogEntry(++logEntryIndex, *logEntry, *respContainer));
+            db->flush(false);
+            creationTime = respContainer->getLinkFile().creationTime;
+        }
+    }
+
+    const auto lookup = [&](const char* name) -> TernError {
+        auto& req = reqContainer->setLookup();
+        req.dirId = ROOT_DIR_INODE_ID;
+        req.name = name;
+        db->read(*reqContainer, *respContainer);
+        if (respContainer->kind() == ShardMessageKind::ERROR) {
+            return respContainer->getError();
+        }
+        REQUIRE(respContainer->getLookup().targetId == id);
+        return TernError::NO_ERROR;
+    };
+
+    // the second time around both the directory and the edges come from the cache
+    for (int i = 0; i < 2; i++) {
+        REQUIRE(lookup("foo") == TernError::NO_ERROR);
+        REQUIRE(lookup("bar") == TernError::NAME_NOT_FOUND);
+    }
+    auto stats = db->metadataCacheStats();
+    CHECK(stats.hits >= 4);
+
+    {
+        auto& req = reqContainer->setSameDirectoryRename();
+        req.dirId = ROOT_DIR_INODE_ID;
+        req.targetId = id;
+        req.oldName = "foo";
+        req.oldCreationTime = creationTime;
+        req.newName = "bar";
+        NO_TERN_ERROR(db->prepareLogEntry(*reqContainer, *logEntry));
+        NO_TERN_ERROR_IN_RESPONSE(*respContainer, db->applyLogEntry(++logEntryIndex, *logEntry, *respContainer));
+    }
+    // not flushed yet, so the reads (and whatever they put in the cache) must
+    // still be at the old state
+    REQUIRE(lookup("foo") == TernError::NO_ERROR);
+    REQUIRE(lookup("bar") == TernError::NAME_NOT_FOUND);
+    db->flush(false);
+    for (int i = 0; i < 2; i++) {
+        REQUIRE(lookup("foo") == TernError::NAME_NOT_FOUND);
+        REQUIRE(lookup("bar") == TernError::NO_ERROR);
+    }
+}
+
+TEST_CASE("async sync") {
+    TempShardDB db(LogLevel::LOG_ERROR, ShardId(0));
+
+    auto reqContainer = std::make_unique<ShardReqContainer>();
+    auto respContainer = std::make_unique<ShardRespContainer>();
+    auto logEntry = std::make_unique<ShardLogEntry>();
+    uint64_t logEntryIndex = 0;
+
+    const auto createFile = [&](const char* name) {
+        InodeId id;
+        BincodeFixedBytes<8> cookie;
+        {
+            auto& req = reqContainer->setConstructFile();
+            req.type = (uint8_t)InodeType::FILE;
+            req.note = "test note";
+            NO_TERN_ERROR(db->prepareLogEntry(*reqContainer, *logEntry));
+            NO_TERN_ERROR_IN_RESPONSE(*respContainer, db->applyLogEntry(++logEntryIndex, *logEntry, *respContainer));
+            id = respContainer->getConstructFile().id;
+            cookie = respContainer->getConstructFile().cookie;
+        }
+        {
+            auto& req = reqContainer->setLinkFile();
+            req.fileId = id;
+            req.cookie = cookie;
+            req.ownerId = ROOT_DIR_INODE_ID;
+            req.name = name;
+            NO_TERN_ERROR(db->prepareLogEntry(*reqContainer, *logEntry));
+            NO_TERN_ERROR_IN_RESPONSE(*respContainer, db->applyLogEntry(++logEntryIndex, *logEntry, *respContainer));
+        }
+    };
+    const auto lookup = [&](const char* name) -> TernError {
+        auto& req = reqContainer->setLookup();
+        req.dirId = ROOT_DIR_INODE_ID;
+        req.name = name;
+        db->read(*reqContainer, *respContainer);
+        return respContainer->kind() == ShardMessageKind::ERROR ? respContainer->getError() : TernError::NO_ERROR;
+    };
+
+    createFile("first");
+    ShardDBSyncPoint point = db->prepareSync();
+    // written after the sync point, so it must not show up when syncing it
+    createFile("second");
+    REQUIRE(lookup("first") == TernError::NAME_NOT_FOUND);
+    std::thread syncer([&db, &point]() { db->sync(std::move(point)); });
+    syncer.join();
+    REQUIRE(lookup("first") == TernError::NO_ERROR);
+    REQUIRE(lookup("second") == TernError::NAME_NOT_FOUND);
+    db->sync(db->prepareSync());
+    REQUIRE(lookup("second") == TernError::NO_ERROR);
+}
+
+TEST_CASE("log entry batches") {
+    TempShardDB db(LogLevel::LOG_ERROR, ShardId(0));
+
+    auto reqContainer = std::make_unique<ShardReqContainer>();
+    auto respContainer = std::make_unique<ShardRespContainer>();
+    std::vector<ShardLogEntry> entries(3);
+    for (auto& entry : entries) {
+        auto& req = reqContainer->setConstructFile();
+        req.type = (uint8_t)InodeType::FILE;
+        req.note = "test note";
+        NO_TERN_ERROR(db->prepareLogEntry(*reqContainer, entry));
+        entry.idx = 1;
+    }
+
+    // single entries stay in the old format, more get batched
+    std::array<uint8_t, MAX_UDP_MTU> data;
+    for (size_t count : {1, 3}) {
+        BincodeBuf buf((char*)&data[0], MAX_UDP_MTU);
+        ShardLogEntry::packBatch(buf, &entries[0], count);
+        uint32_t protocol;
+        memcpy(&protocol, &data[0], sizeof(protocol));
+        REQUIRE(protocol == (count == 1 ? SHARD_LOG_PROTOCOL_VERSION : SHARD_LOG_BATCH_PROTOCOL_VERSION));
+        BincodeBuf readBuf((char*)&data[0], buf.len());
+        std::vector<ShardLogEntry> unpacked;
+        ShardLogEntry::unpackBatch(readBuf, unpacked);
+        REQUIRE(readBuf.remaining() == 0);
+        REQUIRE(unpacked.size() == count);
+        for (size_t i = 0; i < count; i++) {
+            REQUIRE(unpacked[i].idx == entries[i].idx);
+            REQUIRE(unpacked[i] == entries[i]);
+        }
+    }
+
+    // the log index only moves with the last entry of the batch
+    NO_TERN_ERROR_IN_RESPONSE(*respContainer, db->applyLogEntry(1, 0, entries.size(), entries[0], *respContainer));
+    NO_TERN_ERROR_IN_RESPONSE(*respContainer, db->applyLogEntry(1, 1, entries.size(), entries[1], *respContainer));
+    REQUIRE(db->lastAppliedLogEntry() == 0);
+
+    // after a restart we apply the whole batch again, skipping what we've already applied
+    db->flush(true);
+    db.restart();
+    REQUIRE(db->lastAppliedLogEntry() == 0);
+    for (size_t i = 0; i < entries.size(); i++) {
+        respContainer->clear();
+        db->applyLogEntry(1, i, entries.size(), entries[i], *respContainer);
+        REQUIRE(respContainer->kind() == (i < 2 ? ShardMessageKind::EMPTY : ShardMessageKind::CONSTRUCT_FILE));
+    }
+    REQUIRE(db->lastAppliedLogEntry() == 1);
+    {
+        reqContainer->setVisitTransientFiles();
+        NO_TERN_ERROR_IN_RESPONSE(*respContainer, db->read(*reqContainer, *respContainer));
+        REQUIRE(respContainer->getVisitTransientFiles().files.els.size() == entries.size());
+    }
+}
+
+TEST_CASE("compressed log entries") {
+    TempShardDB db(LogLevel::LOG_ERROR, ShardId(0));
+
+    auto reqContainer = std::make_unique<ShardReqContainer>();
+    std::vector<ShardLogEntry> entries(10);
+    for (auto& entry : entries) {
+        auto& req = reqContainer->setConstructFile();
+        req.type = (uint8_t)InodeType::FILE;
+        req.note = "a rather repetitive test note";
+        NO_TERN_ERROR(db->prepareLogEntry(*reqContainer, entry));
+        entry.idx = 1;
+    }
+
+    std::array<uint8_t, MAX_UDP_MTU> data;
+    std::array<uint8_t, MAX_UDP_MTU> uncompressedData;
+    BincodeBuf uncompressedBuf((char*)&uncompressedData[0], MAX_UDP_MTU);
+    ShardLogEntry::packBatch(uncompressedBuf, &entries[0], entries.size());
+    BincodeBuf buf((char*)&data[0], MAX_UDP_MTU);
+    ShardLogEntry::packBatchCompressed(buf, &entries[0], entries.size());
+    uint32_t protocol;
+    memcpy(&protocol, &data[0], sizeof(protocol));
+    REQUIRE(protocol == SHARD_LOG_COMPRESSED_PROTOCOL_VERSION);
+    REQUIRE(buf.len() < uncompressedBuf.len());
+    {
+        BincodeBuf readBuf((char*)&data[0], buf.len());
+        std::vector<ShardLogEntry> unpacked;
+        ShardLogEntry::unpackBatch(readBuf, unpacked);
+        REQUIRE(readBuf.remaining() == 0);
+        REQUIRE(unpacked.size() == entries.size());
+        for (size_t i = 0; i < entries.size(); i++) {
+            REQUIRE(unpacked[i].idx == entries[i].idx);
+            REQUIRE(unpacked[i] == entries[i]);
+        }
+    }
+
+    // corruption gets noticed
+    data[8] ^= 1; // the crc
+    {
+        BincodeBuf readBuf((char*)&data[0], buf.len());
+        std::vector<ShardLogEntry> unpacked;
+        REQUIRE_THROWS(ShardLogEntry::unpackBatch(readBuf, unpacked));
+    }
+
+    // if it doesn't get smaller we don't bother
+    auto& req = reqContainer->setConstructFile();
+    req.type = (uint8_t)InodeType::FILE;
+    req.note = "";
+    ShardLogEntry entry;
+    NO_TERN_ERROR(db->prepareLogEntry(*reqContainer, entry));
+    entry.idx = 2;
+    BincodeBuf singleBuf((char*)&data[0], MAX_UDP_MTU);
+    ShardLogEntry::packBatchCompressed(singleBuf, &entry, 1);
+    memcpy(&protocol, &data[0], sizeof(protocol));
+    REQUIRE(protocol == SHARD_LOG_PROTOCOL_VERSION);
+}
+
+TEST_CASE("parallel apply") {
+    TempShardDB db(LogLevel::LOG_ERROR, ShardId(0));
+
+    auto reqContainer = std::make_unique<ShardReqContainer>();
+    auto respContainer = std::make_unique<ShardRespContainer>();
+    std::vector<ShardLogEntry> entries;
+    entries.reserve(1000);
+
+    const auto apply = [&]() {
+        auto& entry = entries.emplace_back();
+        NO_TERN_ERROR(db->prepareLogEntry(*reqContainer, entry));
+        entry.idx = entries.size();
+        NO_TERN_ERROR_IN_RESPONSE(*respContainer, db->applyLogEntry(entries.size(), entry, *respContainer));
+    };
+
+    std::vector<InodeId> dirs;
+    for (int i = 1; i <= 4; i++) {
+        InodeId dirId(InodeType::DIRECTORY, ShardId(0), i);
+        auto& req = reqContainer->setCreateDirectoryInode();
+        req.id = dirId;
+        req.ownerId = ROOT_DIR_INODE_ID;
+        apply();
+        dirs.emplace_back(dirId);
+    }
+    // files all over, constructed first so that the links can go together
+    std::vector<std::pair<InodeId, BincodeFixedBytes<8>>> files;
+    for (int i = 0; i < 20; i++) {
+        auto& req = reqContainer->setConstructFile();
+        req.type = (uint8_t)InodeType::FILE;
+        req.note = "test note";
+        apply();
+        files.emplace_back(respContainer->getConstructFile().id, respContainer->getConstructFile().cookie);
+    }
+    std::vector<TernTime> creationTimes;
+    for (size_t i = 0; i < files.size(); i++) {
+        auto& req = reqContainer->setLinkFile();
+        req.fileId = files[i].first;
+        req.cookie = files[i].second;
+        req.ownerId = dirs[i % dirs.size()];
+        req.name = "file-" + std::to_string(i);
+        apply();
+        creationTimes.emplace_back(respContainer->getLinkFile().creationTime);
+    }
+    // renames in the same directory depend on each other, in different ones they don't
+    for (size_t i = 0; i < files.size(); i++) {
+        auto& req = reqContainer->setSameDirectoryRename();
+        req.dirId = dirs[i % dirs.size()];
+        req.targetId = files[i].first;
+        req.oldName = "file-" + std::to_string(i);
+        req.oldCreationTime = creationTimes[i];
+        req.newName = "renamed-" + std::to_string(i);
+        apply();
+        creationTimes[i] = respContainer->getSameDirectoryRename().newCreationTime;
+    }
+    for (size_t i = 0; i < files.size(); i += 2) {
+        auto& req = reqContainer->setSoftUnlinkFile();
+        req.ownerId = dirs[i % dirs.size()];
+        req.fileId = files[i].first;
+        req.name = "renamed-" + std::to_string(i);
+        req.creationTime = creationTimes[i];
+        apply();
+    }
+
+    // a follower applying the same entries in parallel ends up with exactly the same state
+    TempShardDB follower(LogLevel::LOG_ERROR, ShardId(0));
+    std::vector<ShardLogEntryToApply> toApply;
+    for (const auto& entry : entries) {
+        toApply.emplace_back(ShardLogEntryToApply{.logEntryIx = entry.idx.u64, .batchPos = 0, .batchSize = 1, .logEntry = &entry});
+    }
+    follower->applyLogEntriesParallel(toApply, 4);
+    REQUIRE(follower->lastAppliedLogEntry() == db->lastAppliedLogEntry());
+    for (const auto& cf : ShardDB::getColumnFamilyDescriptors(ShardDBProfile::DEFAULT)) {
+        std::unique_ptr<rocksdb::Iterator> it1(db.sharedDB->db()->NewIterator({}, db.sharedDB->getCF(cf.name)));
+        std::unique_ptr<rocksdb::Iterator> it2(follower.sharedDB->db()->NewIterator({}, follower.sharedDB->getCF(cf.name)));
+        const auto skip = [&cf](rocksdb::Iterator* it) {
+            // the secret key is random
+            if (it->Valid() && cf.name == rocksdb::kDefaultColumnFamilyName && it->key() == shardMetadataKey(&SHARD_INFO_KEY)) {
+                it->Next();
+            }
+        };
+        it1->SeekToFirst();
+        it2->SeekToFirst();
+        for (;;) {
+            skip(it1.get());
+            skip(it2.get());
+            REQUIRE(it1->Valid() == it2->Valid());
+            if (!it1->Valid()) { break; }
+            REQUIRE(it1->key() == it2->key());
+            REQUIRE(it1->value() == it2->value());
+            it1->Next();
+            it2->Next();
+        }
+        ROCKS_DB_CHECKED(it1->status());
+        ROCKS_DB_CHECKED(it2->status());
+    }
+}
+
+TEST_CASE("apply groups") {
+    TempShardDB db(LogLevel::LOG_ERROR, ShardId(0));
+
+    auto reqContainer = std::make_unique<ShardReqContainer>();
+    auto respContainer = std::make_unique<ShardRespContainer>();
+    auto logEntry = std::make_unique<ShardLogEntry>();
+    uint64_t logEntryIndex = 0;
+
+    const auto apply = [&]() {
+        NO_TERN_ERROR(db->prepareLogEntry(*reqContainer, *logEntry));
+        NO_TERN_ERROR_IN_RESPONSE(*respContainer, db->applyLogEntry(++logEntryIndex, *logEntry, *respContainer));
+    };
+    const auto lookup = [&](const char* name) -> TernError {
+        auto& req = reqContainer->setLookup();
+        req.dirId = ROOT_DIR_INODE_ID;
+        req.name = name;
+        db->read(*reqContainer, *respContainer);
+        if (respContainer->kind() == ShardMessageKind::ERROR) {
+            return respContainer->getError();
+        }
+        return TernError::NO_ERROR;
+    };
+
+    // each entry needs to see what the ones before it in the group did
+    db->startApplyGroup();
+    InodeId id;
+    {
+        auto& req = reqContainer->setConstructFile();
+        req.type = (uint8_t)InodeType::FILE;
+        req.note = "test note";
+        apply();
+        id = respContainer->getConstructFile().id;
+        BincodeFixedBytes<8> cookie = respContainer->getConstructFile().cookie;
+        auto& linkReq = reqContainer->setLinkFile();
+        linkReq.fileId = id;
+        linkReq.cookie = cookie;
+        linkReq.ownerId = ROOT_DIR_INODE_ID;
+        linkReq.name = "foo";
+        apply();
+        TernTime creationTime = respContainer->getLinkFile().creationTime;
+        auto& renameReq = reqContainer->setSameDirectoryRename();
+        renameReq.dirId = ROOT_DIR_INODE_ID;
+        renameReq.targetId = id;
+        renameReq.oldName = "foo";
+        renameReq.oldCreationTime = creationTime;
+        renameReq.newName = "bar";
+        apply();
+    }
+    // a failing entry only rolls back itself
+    {
+        auto& req = reqContainer->setSoftUnlinkFile();
+        req.ownerId = ROOT_DIR_INODE_ID;
+        req.fileId = id;
+        req.name = "foo";
+        req.creationTime = 0;
+        NO_TERN_ERROR(db->prepareLogEntry(*reqContainer, *logEntry));
+        db->applyLogEntry(++logEntryIndex, *logEntry, *respContainer);
+        REQUIRE(respContainer->kind() == ShardMessageKind::ERROR);
+    }
+    REQUIRE(lookup("bar") == TernError::NAME_NOT_FOUND);
+    db->commitApplyGroup();
+    db->flush(false);
+    REQUIRE(lookup("bar") == TernError::NO_ERROR);
+    REQUIRE(lookup("foo") == TernError::NAME_NOT_FOUND);
+    REQUIRE(db->lastAppliedLogEntry() == logEntryIndex);
+
+    // and it all survives a restart
+    db->flush(true);
+    db.restart();
+    REQUIRE(db->lastAppliedLogEntry() == logEntryIndex);
+    REQUIRE(lookup("bar") == TernError::NO_ERROR);
+}
+
+TEST_CASE("ShardDBCache") {
+    // two entries per shard
+    ShardDBCache cache(32);
+    std::string value;
+    bool found;
+
+    cache.put("a", 10, true, "old");
+    REQUIRE(cache.get("a", 10, value, found));
+    REQUIRE(found);
+    REQUIRE(value == "old");
+    // snapshots older than what we've read at can't see it
+    REQUIRE(!cache.get("a", 9, value, found));
+
+    // readers at snapshots before the write can't put the old value back
+    cache.invalidate("a", 20);
+    REQUIRE(!cache.get("a", 30, value, found));
+    cache.put("a", 15, true, "old");
+    REQUIRE(!cache.get("a", 30, value, found));
+    cache.put("a", 20, true, "new");
+    REQUIRE(cache.get("a", 30, value, found));
+    REQUIRE(value == "new");
+
+    cache.put("b", 20, false, {});
+    REQUIRE(cache.get("b", 20, value, found));
+    REQUIRE(!found);
+
+    // fill it up, everything still needs to be consistent once the tombstones go
+    for (int i = 0; i < 1000; i++) {
+        cache.invalidate(std::to_string(i), 100 + i);
+        cache.put(std::to_string(i), 50, true, "stale");
+        REQUIRE(!cache.get(std::to_string(i), 2000, value, found));
+    }
+    for (int i = 0; i < 1000; i++) {
+        cache.put(std::to_string(i), 50, true, "stale");
+        REQUIRE(!cache.get(std::to_string(i), 2000, value, found));
+    }
+    CHECK(cache.stats().evictions > 0);
+}
+
+TEST_CASE("SharedRocksDB memory budget") {
+    Logger logger(LogLevel::LOG_ERROR, STDERR_FILENO, false, false);
+    std::shared_ptr<XmonAgent> xmon;
+    std::string dbDir("temp-shared-db.XXXXXX");
+    if (mkdtemp(dbDir.data()) == nullptr) {
+        throw SYSCALL_EXCEPTION("mkdtemp");
+    }
+    for (bool hyperClock : {false, true}) {
+        SharedRocksDB sharedDB(logger, xmon, dbDir + "/db", dbDir + "/db-statistics.txt");
+        sharedDB.registerCFDescriptors(ShardDB::getColumnFamilyDescriptors(ShardDBProfile::TUNED));
+        rocksdb::Options rocksDBOptions;
+        rocksDBOptions.create_if_missing = true;
+        rocksDBOptions.create_missing_column_families = true;
+        sharedDB.open(rocksDBOptions, SharedRocksDBMemoryBudget{.bytes = 64 << 20, .hyperClockCache = hyperClock});
+        ROCKS_DB_CHECKED(sharedDB.db()->Put({}, sharedDB.getCF("files"), "foo", "bar"));
+        std::unordered_map<std::string, uint64_t> stats;
+        sharedDB.rocksDBMetrics(stats);
+        CHECK(stats.at("block_cache_capacity") == 64 << 20);
+        CHECK(stats.at("write_buffer_manager_buffer_size") == 16 << 20);
+        // the memtable reserves its memory in the block cache
+        CHECK(stats.at("block_cache_usage") > 0);
+    }
+    std::error_code err;
+    std::filesystem::remove_all(std::filesystem::path(dbDir), err);
+}
+
 TEST_CASE("test fmt") {
     {
         std::stringstream ss;
@@ -609,6 +1238,82 @@ TEST_CASE("test fmt") {
     }
 }
 
+TEST_CASE("MPMC") {
+    static constexpr int producers = 4;
+    static constexpr int consumers = 3;
+    static constexpr uint64_t perProducer = 10'000;
+    MPMC<uint64_t> queue(64);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&queue, p]() {
+            std::vector<uint64_t> batch;
+            for (uint64_t i = 0; i < perProducer;) {
+                batch.clear();
+                for (uint64_t j = i; j < std::min<uint64_t>(i+7, perProducer); j++) {
+                    batch.emplace_back((uint64_t)p*perProducer + j);
+                }
+                i += queue.push(batch);
+            }
+        });
+    }
+    // The consumer which gets the last element closes the queue, which is the only
+    // way for a blocking pull to return nothing.
+    std::atomic<uint64_t> received = 0;
+    std::atomic<bool> spuriousZero = false;
+    std::atomic<bool> outOfOrder = false;
+    std::vector<std::atomic<uint8_t>> seen(producers*perProducer);
+    for (int c = 0; c < consumers; c++) {
+        threads.emplace_back([&]() {
+            std::vector<uint64_t> next(producers, 0);
+            std::vector<uint64_t> els;
+            for (;;) {
+                els.clear();
+                uint32_t pulled = queue.pull(els, 16);
+                if (pulled == 0) {
+                    spuriousZero = spuriousZero || !queue.isClosed();
+                    return;
+                }
+                for (uint64_t x : els) {
+                    // elements from each producer come out in order, for each consumer
+                    outOfOrder = outOfOrder || x%perProducer < next[x/perProducer];
+                    next[x/perProducer] = x%perProducer + 1;
+                    seen[x].fetch_add(1);
+                }
+                if (received.fetch_add(pulled) + pulled == producers*perProducer) {
+                    queue.close();
+                }
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    REQUIRE(!spuriousZero);
+    REQUIRE(!outOfOrder);
+    REQUIRE(received == producers*perProducer);
+    for (const auto& x : seen) {
+        REQUIRE(x == 1);
+    }
+    REQUIRE(queue.size() == 0);
+    std::vector<uint64_t> els;
+    std::vector<uint64_t> more{1};
+    CHECK(queue.push(more) == 0);
+    CHECK(queue.pull(els, 16) == 0);
+}
+
+TEST_CASE("MPMCTimeout") {
+    MPMC<uint64_t> queue(64);
+    std::vector<uint64_t> els;
+    CHECK(queue.pull(els, 16, 1_ms) == 0);
+    CHECK(!queue.isClosed());
+    std::vector<uint64_t> batch{1, 2, 3};
+    REQUIRE(queue.push(batch) == 3);
+    REQUIRE(queue.pull(els, 2) == 2);
+    REQUIRE(queue.size() == 1);
+    REQUIRE(queue.pull(els, 16, 1_ms) == 1);
+    REQUIRE(els == std::vector<uint64_t>{1, 2, 3});
+}
+
 /*
 TEST_CASE("make/rm directory") {
     // not actually the full lifecycle, just some ad hoc tests